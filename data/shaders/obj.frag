@@ -10,6 +10,19 @@ layout(location = 2) in vec3 fragNormal;
 layout(location = 3) in vec3 fragPos;
 layout(location = 4) in vec2 fragTexCoord;
 
+// Material feature bits, see core::model::shaderfeature. Without SPECIALIZED
+// every feature is read from the material.
+layout(constant_id = 0) const uint features = 0;
+const uint SPECIALIZED   = 1u << 0;
+const uint TEXTURED      = 1u << 1;
+const uint NORMAL_MAPPED = 1u << 2;
+const uint ALPHA_TESTED  = 1u << 3;
+const uint UNLIT         = 1u << 4;
+
+layout(constant_id = 1) const float lightPosX = 0.0;
+layout(constant_id = 2) const float lightPosY = 10.0;
+layout(constant_id = 3) const float lightPosZ = 0.0;
+
 layout(binding = 0) uniform UniformBufferObject
 {
     mat4 model;
@@ -35,7 +48,8 @@ struct Material
     int   diffuseTextureId;
     int   specularTextureId;
     int   normalTextureId;
-    float pad;
+    // ALPHA_TESTED and UNLIT when the material opts in
+    uint  flags;
 };
 
 const int sizeofMat = 6;
@@ -70,30 +84,78 @@ Material unpackMaterial()
     m.diffuseTextureId  = floatBitsToInt(d5.x);
     m.specularTextureId = floatBitsToInt(d5.y);
     m.normalTextureId   = floatBitsToInt(d5.z);
+    m.flags             = floatBitsToUint(d5.w);
 
     return m;
 }
 
+// Constant once specialized, so the compiler drops the untaken side
+bool hasFeature(uint feature, bool perMaterial)
+{
+    return (features & SPECIALIZED) != 0 ? (features & feature) != 0
+                                         : perMaterial;
+}
+
+// Tangent frame from screen space derivatives, the vertices carry no
+// tangents
+vec3 perturbNormal(vec3 normal, vec3 mapNormal)
+{
+    vec3 dp1  = dFdx(fragPos);
+    vec3 dp2  = dFdy(fragPos);
+    vec2 duv1 = dFdx(fragTexCoord);
+    vec2 duv2 = dFdy(fragTexCoord);
+
+    vec3  dp2perp = cross(dp2, normal);
+    vec3  dp1perp = cross(normal, dp1);
+    vec3  t       = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3  b       = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invMax  = inversesqrt(max(max(dot(t, t), dot(b, b)), 1e-12));
+    return normalize(mat3(t * invMax, b * invMax, normal) * mapNormal);
+}
+
 void main()
 {
     Material mat = unpackMaterial();
 
-    const vec3 lightPos   = vec3(0.0, 10.0, 0.0);
+    vec3  color = mat.diffuse;
+    float alpha = mat.dissolve;
+    if(hasFeature(TEXTURED, mat.diffuseTextureId >= 0))
+    {
+        vec4 texel = texture(
+                textureSamplers[nonuniformEXT(mat.diffuseTextureId)],
+                fragTexCoord);
+        color *= texel.xyz;
+        alpha *= texel.w;
+    }
+    if(hasFeature(ALPHA_TESTED, (mat.flags & ALPHA_TESTED) != 0)
+       && alpha < 0.5)
+    {
+        discard;
+    }
+    if(hasFeature(UNLIT, (mat.flags & UNLIT) != 0))
+    {
+        outColor = vec4(color, 1.0);
+        return;
+    }
+
+    vec3 normal = normalize(fragNormal);
+    if(hasFeature(NORMAL_MAPPED, mat.normalTextureId >= 0))
+    {
+        vec3 mapNormal = texture(
+                textureSamplers[nonuniformEXT(mat.normalTextureId)],
+                fragTexCoord).xyz;
+        normal = perturbNormal(normal, mapNormal * 2.0 - 1.0);
+    }
+
+    const vec3 lightPos = vec3(lightPosX, lightPosY, lightPosZ);
     float r = (cos(3*ubo.time) + 2) * 0.5;
     float g = (sin(1*ubo.time) + 2) * 0.5;
     float b = (sin(2*ubo.time) + 2) * 0.5;
     const vec3 lightColor = vec3(r, g, b);
     //
     vec3  lightDir = normalize(lightPos - fragPos);
-    float cosTheta = max(dot(fragNormal, lightDir), 0.1);
+    float cosTheta = max(dot(normal, lightDir), 0.1);
 
-    vec3 color = mat.diffuse;
-    if(mat.diffuseTextureId >= 0)
-    {
-        // color = texture(textureSamplers, fragTexCoord).xyz;
-        color *= texture(textureSamplers[mat.diffuseTextureId], fragTexCoord).xyz;
-    }
     vec3 result = lightColor * color * cosTheta;// * fragColor;
     outColor    = vec4(result, 1.0);
-    // outColor = vec4(fragTexCoord, 1.0, 1.0);
 }
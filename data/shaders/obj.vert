@@ -24,11 +24,21 @@ layout(binding = 0) uniform UniformBufferObject
 }
 ubo;
 
-layout(push_constant) uniform PushConstants
+struct InstanceData
 {
-    vec4 position;
+    mat4 transform;
+    vec4 boundingSphere;
+    int  materialOverride;
+    uint entityId;
+    uint batchIndex;
+    uint visibilityIndex;
+};
+
+layout(std430, binding = 3) readonly buffer InstanceBufferObject
+{
+    InstanceData data[];
 }
-pushConsts;
+instances;
 
 mat4 rotationMatrix(vec3 axis, float angle)
 {
@@ -63,17 +73,18 @@ mat4 rotationMatrix(vec3 axis, float angle)
 
 void main()
 {
-    fragColor = inColor;
+    InstanceData instance = instances.data[gl_InstanceIndex];
+    mat4 model = ubo.model * instance.transform;
 
-    fragPos = vec3(ubo.model * vec4(inPosition, 1.0)).xyz;
-
-    vec4 posOffset = pushConsts.position;
+    fragColor = inColor;
 
+    fragPos = vec3(model * vec4(inPosition, 1.0)).xyz;
 
-    matIndex = inMaterialIdx;
-    fragNormal = normalize(vec3(ubo.modelIT * vec4(inNormal, 0.0)));
+    matIndex = instance.materialOverride >= 0 ? instance.materialOverride : inMaterialIdx;
+    // Inverse transpose, instance transforms may scale non-uniformly
+    fragNormal = normalize(transpose(inverse(mat3(model))) * inNormal);
     fragTexcoord = inTexCoord;
-    /* gl_Position = ubo.proj * ubo.view * ubo.model * rotationMatrix(vec3(0,0,1), 3 * ubo.time) */
-    /*               * vec4(inPosition + posOffset.xyz, 1.0); */
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition + posOffset.xyz, 1.0);
+    /* gl_Position = ubo.proj * ubo.view * model * rotationMatrix(vec3(0,0,1), 3 * ubo.time) */
+    /*               * vec4(inPosition, 1.0); */
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition, 1.0);
 }
@@ -15,6 +15,22 @@ struct BaseConfig
     // Display resolution
     int width = 800;
     int height = 800;
+    // Render offscreen without a window and exit after a benchmark run of
+    // benchmarkFrames frames, also enabled with --headless
+    int headless = false;
+    int benchmarkFrames = 1000;
+    // File the benchmark JSON is also written to, empty for stdout only
+    std::string benchmarkOutput;
+    // Chrome trace of the CPU profiler zones, written with F9 and at exit
+    // when traceOnExit is set. Needs a build with the profiler option.
+    std::string traceOutput = "trace.json";
+    int traceOnExit = false;
+    // CSV of the frame time window of the metrics window, written with its
+    // dump button and at exit when frameStatsOnExit is set
+    std::string frameStatsOutput = "framestats.csv";
+    int frameStatsOnExit = false;
+    // Cars the scene is made of, all instances of one model
+    int sceneCars = 12;
 };
 
 struct VulkanConfig
@@ -22,6 +38,32 @@ struct VulkanConfig
     int enableValidationLayers = false;
     int enableDebugUtils = false;
     int vsync = false;
+    // Frames the CPU may record ahead of the GPU, 1 to 3. Fewer is lower
+    // latency, more keeps the GPU busier.
+    int framesInFlight = 2;
+    // Submit the scene with vkCmdDrawIndexedIndirect when supported
+    int indirectDraw = true;
+    // Draw the instances of a mesh and material set with one instanced
+    // draw, off gives every entity a batch of its own
+    int instancing = true;
+    // Frustum cull on the compute queue, needs drawIndirectCount
+    int gpuCulling = true;
+    // Software occlusion culling on the CPU, the scene is also frustum culled
+    // on the CPU when this is on
+    int occlusionCulling = true;
+    // Two pass occlusion culling against a depth pyramid on the GPU, replaces
+    // the compute queue frustum culling when supported
+    int hizCulling = true;
+    // Record the draws of entities that haven't changed once and reuse them,
+    // only on the per batch submission paths. Static entities skip CPU
+    // culling.
+    int staticDrawCache = true;
+    // Pipeline cache kept between runs, empty to build every pipeline from
+    // scratch
+    std::string pipelineCache = "data/pipelinecache.bin";
+    // Map the .spv files from disk instead of using the shaders embedded at
+    // build time, for iterating on shaders without relinking
+    int shadersFromDisk = false;
 };
 
 class Config final
@@ -32,6 +74,12 @@ public:
     [[nodiscard]] static auto getVulkanConfig() { return m_VulkanConfig; }
     [[nodiscard]] static auto getBaseConfig() { return m_BaseConfig; }
 
+    // Command line options override the file
+    static void setBaseConfig(const BaseConfig& config)
+    {
+        m_BaseConfig = config;
+    }
+
 private:
     inline static logs::Logger m_Log;
     inline static std::string m_ConfigFilePath = "data/config.ini";
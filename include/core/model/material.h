@@ -0,0 +1,58 @@
+#pragma once
+
+#include "glm/vec3.hpp"
+
+#include <cstdint>
+#include <span>
+
+namespace core::model
+{
+
+struct MaterialUbo
+{
+    glm::vec3 ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+    glm::vec3 diffuse = glm::vec3(0.0f, 1.0f, 1.0f);
+    glm::vec3 specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    glm::vec3 transmittance = glm::vec3(0.0f, 0.0f, 0.0f);
+    glm::vec3 emission = glm::vec3(0.0f, 0.0f, 0.0f);
+    float shininess = 0.0f;
+    float metallic = 0.0f;
+    float ior = 1.0f;
+    float dissolve = 1.0f;
+    // MTL illumination model, tinyobj reports 0 when the MTL has none so it
+    // doesn't decide anything
+    int illum = 0;
+    int diffuseTextureID = -1;
+    int specularTextureID = -1;
+    int normalTextureID = -1;
+    // Opt-in shaderfeature::ALPHA_TESTED and UNLIT, nothing else in the
+    // material implies them
+    uint32_t flags = 0;
+};
+
+// Feature bits obj.frag is specialized on, specialization constant 0. Without
+// SPECIALIZED the shader reads every feature from the material at runtime,
+// which works for any mix of materials. Alpha testing and unlit shading are
+// only used by materials that set them in MaterialUbo::flags.
+namespace shaderfeature
+{
+
+constexpr uint32_t SPECIALIZED = 1u << 0;
+constexpr uint32_t TEXTURED = 1u << 1;
+constexpr uint32_t NORMAL_MAPPED = 1u << 2;
+constexpr uint32_t ALPHA_TESTED = 1u << 3;
+constexpr uint32_t UNLIT = 1u << 4;
+
+constexpr uint32_t GENERIC = 0;
+// Every combination, fits the pipeline field of the draw sort key
+constexpr uint32_t VARIANT_COUNT = 1u << 5;
+
+} // namespace shaderfeature
+
+[[nodiscard]] uint32_t getShaderFeatures(const MaterialUbo& material);
+
+// Features shared by every material, GENERIC when they differ in any
+[[nodiscard]] uint32_t getShaderFeatures(
+        std::span<const MaterialUbo> materials);
+
+} // namespace core::model
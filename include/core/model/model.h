@@ -2,9 +2,11 @@
 
 #include "core/vulkan/device.h"
 #include "core/texture/texture.h"
+#include "core/model/material.h"
 #include "core/model/vertex.h"
+#include "core/scene/components.h"
 #include "logs/log.h"
-#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
 #include "entt/entity/registry.hpp"
 
 #include <memory>
@@ -14,24 +16,6 @@
 namespace core::model
 {
 
-struct MaterialUbo
-{
-    glm::vec3 ambient = glm::vec3(0.1f, 0.1f, 0.1f);
-    glm::vec3 diffuse = glm::vec3(0.0f, 1.0f, 1.0f);
-    glm::vec3 specular = glm::vec3(1.0f, 1.0f, 1.0f);
-    glm::vec3 transmittance = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 emission = glm::vec3(0.0f, 0.0f, 0.0f);
-    float shininess = 0.0f;
-    float metallic = 0.0f;
-    float ior = 1.0f;
-    float dissolve = 1.0f;
-    int illum = 0;
-    int diffuseTextureID = -1;
-    int specularTextureID = -1;
-    int normalTextureID = -1;
-    float pad = 0.0f;
-};
-
 enum struct TextureType
 {
     Diffuse,
@@ -58,11 +42,19 @@ public:
 
     void load(const std::string& path);
 
+    // Spawn an entity drawing this model, all instances share the geometry
+    // and materials
+    entt::entity createInstance(const glm::vec3& position);
+
+    // Let the instance hide other entities in the software occlusion culler
+    void addOccluder(entt::entity entity);
+
     auto getMaterialBuffer() const { return m_MaterialBuffer; }
     const auto& getVertices() const { return m_Vertices; }
     const auto& getIndices() const { return m_Indices; }
-    const auto* VertexBuffer() const { return &m_VertexBuffer; }
-    const auto& IndexBuffer() const { return m_IndexBuffer; }
+    const auto& getGeometry() const { return m_Geometry; }
+    // Bounding sphere in model space, xyz center and w radius
+    const auto& getBounds() const { return m_Bounds; }
 
     auto getImageInfos() const { return m_Infos; }
     auto getBufferInfo() const
@@ -76,11 +68,6 @@ public:
     }
 
 private:
-    struct PushConstantBlock
-    {
-        glm::vec4 position = glm::vec4(0.0f);
-    } m_PushConstants;
-
     inline static logs::Logger m_Log;
     vk::Device* m_Device;
     entt::registry& m_Registry;
@@ -88,14 +75,15 @@ private:
     std::vector<VertexPNTC> m_Vertices;
     std::vector<uint32_t> m_Indices;
     std::vector<MaterialUbo> m_Materials;
+    // Shared by every instance, see getShaderFeatures
+    uint32_t m_ShaderFeatures = shaderfeature::GENERIC;
     std::vector<std::string> m_TexturePaths;
     std::vector<texture::Texture2d> m_Textures;
     std::vector<VkDescriptorImageInfo> m_Infos;
 
-    VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
-    VmaAllocation m_VertexMemory = VK_NULL_HANDLE;
-    VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
-    VmaAllocation m_IndexMemory = VK_NULL_HANDLE;
+    vk::GeometryAllocation m_Geometry;
+    glm::vec4 m_Bounds = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+    std::shared_ptr<const scene::component::OccluderMesh> m_OccluderMesh;
     VkBuffer m_MaterialBuffer = VK_NULL_HANDLE;
     VmaAllocation m_MaterialMemory = VK_NULL_HANDLE;
 
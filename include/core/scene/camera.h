@@ -32,6 +32,8 @@ public:
     void update(float dt);
 
     void updateRotation(float dtheta, float dphi);
+    // Around the target by an angle in radians, for scripted cameras
+    void orbit(float radians);
     void updateZoom(float delta);
     void pan(float dx, float dy);
 
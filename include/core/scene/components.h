@@ -4,6 +4,7 @@
 #include "glm/mat4x4.hpp"
 #include "vulkan/vulkan.h"
 
+#include <memory>
 #include <vector>
 
 namespace core::scene::component
@@ -33,17 +34,60 @@ struct BufferInfo
     // constexpr operator VkDescriptorBufferInfo() const { return info; }
 };
 
+// Range of the mesh inside the device geometry arena
 struct VertexInfo
 {
-    size_t numIndices = 0;
-    VkBuffer vertexBuffer = VK_NULL_HANDLE;
-    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    uint32_t indexCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+};
+
+// Bounding sphere in mesh space, xyz center and w radius
+struct Bounds
+{
+    glm::vec4 sphere = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+};
+
+// Triangles rasterized by the software occlusion culler, welded positions in
+// mesh space
+struct OccluderMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+// Marks the entity as an occluder, instances of a model share the mesh
+struct Occluder
+{
+    std::shared_ptr<const OccluderMesh> mesh;
+};
+
+// Replaces the per vertex material of every vertex in the instance
+struct MaterialOverride
+{
+    int32_t materialId = -1;
+};
+
+// Renderable whose draw state changed recently, it is drawn from the per
+// frame lists instead of the cached static draws. Counts down the updates
+// left until it is static again, see StaticDrawTracker.
+struct DynamicDraw
+{
+    uint32_t settleFrames = 0;
+};
+
+// Slot of the entity in the GPU visibility buffer, see VisibilitySlots
+struct VisibilitySlot
+{
+    uint32_t index = 0;
 };
 
 struct RenderInfo
 {
     VkDescriptorBufferInfo buffeInfo;
     std::vector<VkDescriptorImageInfo> imageInfos;
+    // Variant of the obj shaders it is drawn with, model::shaderfeature bits
+    uint32_t shaderFeatures = 0;
 };
 
 } // namespace core::scene::component
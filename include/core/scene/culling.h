@@ -0,0 +1,95 @@
+#pragma once
+
+#include "core/scene/frustum.h"
+
+#include "entt/entity/registry.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace core::scene
+{
+
+// World space bounding spheres packed as a structure of arrays so the frustum
+// test can load 4 (SSE) or 8 (AVX) spheres at a time
+struct SphereSoA
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+
+    [[nodiscard]] size_t size() const { return x.size(); }
+
+    void resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+    }
+
+    void set(size_t i, const glm::vec3& center, float r)
+    {
+        x[i] = center.x;
+        y[i] = center.y;
+        z[i] = center.z;
+        radius[i] = r;
+    }
+};
+
+// Test spheres [begin, end) against the frustum and write the indices of the
+// visible ones to visible, returns how many were written. Uses AVX when the
+// CPU has it, SSE otherwise and plain C++ on other architectures.
+size_t cullSpheres(
+        const SphereSoA& spheres,
+        const Frustum& frustum,
+        size_t begin,
+        size_t end,
+        uint32_t* visible);
+
+// Scalar reference implementation of cullSpheres
+size_t cullSpheresScalar(
+        const SphereSoA& spheres,
+        const Frustum& frustum,
+        size_t begin,
+        size_t end,
+        uint32_t* visible);
+
+// Move a mesh space Bounds sphere to world space with the same
+// translate(position) * transform the instance data uses. Negative radius
+// means no bounds and gives an infinite radius.
+[[nodiscard]] glm::vec4 toWorldSphere(
+        const glm::vec4& sphere,
+        const glm::vec4& position,
+        const glm::mat4& transform);
+
+// Keeps a world space bounding sphere for every renderable entity and produces
+// the list of entities inside the view frustum each frame. Large scenes are
+// split across the work queue.
+class CullingSystem final
+{
+public:
+    // Refresh the sphere store from Bounds, Position and Transform
+    void update(const entt::registry& registry);
+
+    // Visible entities keep the order they have in the store
+    void cull(const Frustum& frustum);
+
+    [[nodiscard]] const auto& getVisible() const { return m_Visible; }
+    [[nodiscard]] size_t getTestedCount() const { return m_Entities.size(); }
+
+private:
+    // Multiple of the widest SIMD batch
+    static constexpr size_t ENTITIES_PER_JOB = 16384;
+
+    void updateRange(const entt::registry& registry, size_t begin, size_t end);
+
+    std::vector<entt::entity> m_Entities;
+    SphereSoA m_Spheres;
+    std::vector<uint32_t> m_VisibleIndices;
+    std::vector<entt::entity> m_Visible;
+};
+
+} // namespace core::scene
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace core::scene
+{
+
+// 64-bit draw sort key, most significant field first
+//
+//   63..62  pass       opaque before transparent
+//   61..56  pipeline
+//   55..44  material
+//   43..24  mesh
+//   23..0   depth      front to back for opaque, back to front for
+//                      transparent
+//
+// Keys that only differ in depth share all state and the mesh, so they can
+// be drawn as one instanced batch.
+namespace sortkey
+{
+
+enum class Pass : uint64_t
+{
+    Opaque = 0,
+    Transparent = 1
+};
+
+constexpr uint32_t DEPTH_BITS = 24;
+constexpr uint32_t MESH_BITS = 20;
+constexpr uint32_t MATERIAL_BITS = 12;
+constexpr uint32_t PIPELINE_BITS = 6;
+
+constexpr uint32_t MESH_SHIFT = DEPTH_BITS;
+constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+constexpr uint32_t PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+constexpr uint32_t MAX_MESHES = 1u << MESH_BITS;
+constexpr uint32_t MAX_MATERIALS = 1u << MATERIAL_BITS;
+constexpr uint32_t MAX_PIPELINES = 1u << PIPELINE_BITS;
+
+// Non-negative view distance (or its square) quantized so that the order is
+// kept, only the lowest mantissa bits are lost
+[[nodiscard]] uint32_t quantizeDepth(float depth);
+
+[[nodiscard]] uint64_t make(
+        Pass pass,
+        uint32_t pipeline,
+        uint32_t material,
+        uint32_t mesh,
+        float depth);
+
+// Everything but the depth, equal for draws that can be batched together
+[[nodiscard]] constexpr uint64_t stateBits(uint64_t key)
+{
+    return key >> DEPTH_BITS;
+}
+
+} // namespace sortkey
+
+// Sort key with the index of what it draws
+struct DrawPacket
+{
+    uint64_t key = 0;
+    uint32_t index = 0;
+};
+
+// Stable LSD radix sort on the key, 8 bits per pass. Passes where every key
+// has the same digit are skipped, large inputs are histogrammed and
+// scattered in parallel on the work queue. Scratch is resized as needed and
+// can be kept between calls to avoid allocating.
+void radixSort(
+        std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch);
+
+} // namespace core::scene
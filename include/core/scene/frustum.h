@@ -0,0 +1,69 @@
+#pragma once
+
+#include "glm/geometric.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+
+#include <array>
+
+namespace core::scene
+{
+
+// View frustum as six inward facing planes (xyz normal, w distance), a point p
+// is inside when dot(plane.xyz, p) + plane.w >= 0 for every plane. Planes are
+// in the space the matrix transforms from, e.g. world space for proj * view.
+struct Frustum
+{
+    enum Plane
+    {
+        Left = 0,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+        Count
+    };
+
+    std::array<glm::vec4, Plane::Count> planes;
+
+    // Gribb-Hartmann extraction, expects zero to one clip space depth
+    [[nodiscard]] static Frustum fromMatrix(const glm::mat4& m)
+    {
+        const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[Left] = row3 + row0;
+        frustum.planes[Right] = row3 - row0;
+        frustum.planes[Bottom] = row3 + row1;
+        frustum.planes[Top] = row3 - row1;
+        frustum.planes[Near] = row2;
+        frustum.planes[Far] = row3 - row2;
+
+        for(auto& plane : frustum.planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+
+        return frustum;
+    }
+
+    [[nodiscard]] bool intersectsSphere(
+            const glm::vec3& center, float radius) const
+    {
+        for(const auto& plane : planes)
+        {
+            if(glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace core::scene
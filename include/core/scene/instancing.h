@@ -0,0 +1,139 @@
+#pragma once
+
+#include "core/scene/drawsort.h"
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "entt/entity/registry.hpp"
+#include "vulkan/vulkan.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace core::scene
+{
+
+// Per instance data read by the vertex shader, std430 layout matching
+// InstanceData in obj.vert
+struct InstanceData
+{
+    glm::mat4 transform = glm::mat4(1.0f);
+    // Mesh space, a negative radius is never culled
+    glm::vec4 boundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+    int32_t materialOverride = -1;
+    uint32_t entityId = 0;
+    // Index of the batch draw command used as the template for culled draws
+    uint32_t batchIndex = 0;
+    // Slot of the entity in the GPU visibility buffer kept between frames,
+    // see VisibilitySlots. Out of range ones are never occlusion culled.
+    uint32_t visibilityIndex = UINT32_MAX;
+};
+
+static_assert(sizeof(InstanceData) == 96, "InstanceData must match std430");
+
+// One instanced draw, instances are [firstInstance, firstInstance +
+// instanceCount) in the instance buffer
+struct InstanceBatch
+{
+    uint32_t indexCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    uint32_t firstInstance = 0;
+    uint32_t instanceCount = 0;
+    // Shader variant every instance is drawn with, batches of a variant are
+    // adjacent
+    uint32_t variant = 0;
+};
+
+// Groups renderable entities by mesh and material set so that every group
+// can be drawn with a single instanced draw call. Every renderable gets a
+// draw sort key, batches come out in state order and the instances of a
+// batch front to back from the view position.
+class InstanceBatcher final
+{
+public:
+    // Sort the renderables into batches, instance data is written by write()
+    void build(entt::registry& registry, const glm::vec3& viewPosition);
+
+    // Only batch the given entities, ones missing a renderable component are
+    // skipped
+    void build(
+            entt::registry& registry,
+            const std::vector<entt::entity>& entities,
+            const glm::vec3& viewPosition);
+
+    // Fill the instance data of every batch and one indexed indirect command
+    // per batch. Large scenes are split across the work queue, the registry
+    // must not be modified until this returns.
+    void write(
+            const entt::registry& registry,
+            InstanceData* instances,
+            VkDrawIndexedIndirectCommand* commands) const;
+
+    // Slots of the first instance and indirect command write() fills, so
+    // two batchers can share the buffers. Applies from the next build.
+    void setBase(uint32_t firstInstance, uint32_t firstCommand)
+    {
+        m_FirstInstance = firstInstance;
+        m_FirstCommand = firstCommand;
+    }
+
+    // Off puts every instance in a batch of its own, for comparing against
+    // one draw per entity. Applies from the next build.
+    void setInstancing(bool instancing) { m_Instancing = instancing; }
+
+    // Drop the mesh and material ids, for when models are unloaded. The ids
+    // of freed resources would otherwise pile up until the sort key runs out
+    // of them. Applies from the next build.
+    void forgetIds()
+    {
+        m_MaterialIds.clear();
+        m_MeshIds.clear();
+    }
+
+    [[nodiscard]] size_t getInstanceCount() const { return m_Sorted.size(); }
+    [[nodiscard]] uint32_t getFirstCommand() const { return m_FirstCommand; }
+    [[nodiscard]] const auto& getBatches() const { return m_Batches; }
+
+private:
+    static constexpr size_t INSTANCES_PER_JOB = 1024;
+
+    void addInstance(
+            const entt::registry& registry,
+            entt::entity entity,
+            const glm::vec3& viewPosition);
+    void sortBatches(const entt::registry& registry);
+
+    [[nodiscard]] uint32_t getMaterialId(VkBuffer materials);
+    [[nodiscard]] uint32_t getMeshId(uint32_t firstIndex, int32_t vertexOffset);
+
+    void writeInstances(
+            const entt::registry& registry,
+            InstanceData* instances,
+            size_t begin,
+            size_t end) const;
+
+    struct SortedInstance
+    {
+        entt::entity entity = entt::null;
+        uint32_t batchIndex = 0;
+    };
+
+    // Kept between frames so building the batches doesn't allocate
+    std::vector<entt::entity> m_Entities;
+    std::vector<DrawPacket> m_Packets;
+    std::vector<DrawPacket> m_Scratch;
+    std::vector<SortedInstance> m_Sorted;
+    std::vector<InstanceBatch> m_Batches;
+    uint32_t m_FirstInstance = 0;
+    uint32_t m_FirstCommand = 0;
+    bool m_Instancing = true;
+
+    // Compact ids for the sort keys, only compared within a build. Kept until
+    // forgetIds() so building doesn't allocate.
+    std::unordered_map<VkBuffer, uint32_t> m_MaterialIds;
+    std::unordered_map<uint64_t, uint32_t> m_MeshIds;
+};
+
+} // namespace core::scene
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "core/scene/components.h"
+
+#include "entt/entity/registry.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace core::scene
+{
+
+// Software occlusion culling. Occluder meshes are rasterized into a low
+// resolution depth buffer on the CPU (8 pixels at a time with AVX), then the
+// screen space bounds of every candidate are tested against it. A candidate
+// is culled only when every pixel under its bounds has an occluder closer than
+// the nearest point of the bounds.
+class OcclusionCuller final
+{
+public:
+    static constexpr uint32_t WIDTH = 256;
+    static constexpr uint32_t HEIGHT = 128;
+    static constexpr uint32_t TILE_WIDTH = 8;
+    static constexpr uint32_t TILE_HEIGHT = 4;
+
+    OcclusionCuller();
+
+    // Rasterize the occluders among the candidates and keep the candidates
+    // that are not hidden behind them, usually the output of CullingSystem
+    void update(
+            const entt::registry& registry,
+            const glm::mat4& viewProj,
+            const std::vector<entt::entity>& candidates);
+
+    // Visible candidates keep their order
+    [[nodiscard]] const auto& getVisible() const { return m_Visible; }
+    [[nodiscard]] size_t getOccluderCount() const { return m_OccluderCount; }
+    [[nodiscard]] size_t getCulledCount() const { return m_CulledCount; }
+
+    // Steps of update, clear, rasterize every occluder, then finalize before
+    // testing
+    void clear();
+    void rasterize(const glm::mat4& mvp, const component::OccluderMesh& mesh);
+    void finalize();
+
+    // World space box against the depth buffer, anything crossing the near
+    // plane or leaving the screen is treated as visible
+    [[nodiscard]] bool isVisible(
+            const glm::mat4& viewProj,
+            const glm::vec3& min,
+            const glm::vec3& max) const;
+
+    [[nodiscard]] float getDepth(uint32_t x, uint32_t y) const
+    {
+        return m_Depth[y * WIDTH + x];
+    }
+
+    // Scalar rasterizer is the reference for the SIMD one
+    void setUseSimd(bool useSimd) { m_UseSimd = useSimd; }
+
+private:
+    static constexpr uint32_t TILES_X = WIDTH / TILE_WIDTH;
+    static constexpr uint32_t TILES_Y = HEIGHT / TILE_HEIGHT;
+
+    void rasterizeTriangle(
+            const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+
+    // Row major, 0 near and 1 far
+    std::vector<float> m_Depth;
+    // Farthest depth in every tile, a whole tile is skipped when it is
+    // closer than the tested bounds
+    std::vector<float> m_TileMaxDepth;
+    std::vector<glm::vec4> m_ClipPositions;
+
+    std::vector<entt::entity> m_Visible;
+    size_t m_OccluderCount = 0;
+    size_t m_CulledCount = 0;
+    bool m_UseSimd = true;
+};
+
+} // namespace core::scene
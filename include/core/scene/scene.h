@@ -19,7 +19,7 @@ class Scene
 {
 public:
     Scene(entt::registry& registry, TrackBall* cam);
-    void loadModels(vk::Device* device);
+    void loadModels(vk::Device* device, int carCount);
     void addModel(vk::Device* device, const std::string& file);
     [[nodiscard]] const auto& getDrawList() const { return m_Models; }
     auto getDescriptorWrites() const { return true; }
@@ -60,9 +60,13 @@ public:
         for(auto entity : view)
         {
             const float rad = glm::radians((i + time) * 360.0f / 12);
-            auto& pos = view.get<scene::component::Position>(entity);
-            pos.pos =
-                    glm::vec4(glm::vec3(sin(rad), cos(rad), 0.0f) * 5.0f, 1.0f);
+            // Patched so the static draw tracking sees the move
+            m_Registry.patch<scene::component::Position>(
+                    entity, [rad](auto& pos) {
+                        pos.pos = glm::vec4(
+                                glm::vec3(sin(rad), cos(rad), 0.0f) * 5.0f,
+                                1.0f);
+                    });
             i += 1.0f;
         }
     }
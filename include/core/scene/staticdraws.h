@@ -0,0 +1,49 @@
+#pragma once
+
+#include "entt/entity/observer.hpp"
+#include "entt/entity/registry.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace core::scene
+{
+
+// Splits the renderable entities into static and dynamic ones so the draws
+// of the static part can be recorded once and reused. An entity becomes
+// dynamic (tagged DynamicDraw) when it turns renderable or its VertexInfo,
+// Position, RenderInfo or Transform is patched or replaced, and static again
+// after SETTLE_FRAMES updates without changes. Writes that bypass
+// registry.patch/replace are not seen.
+class StaticDrawTracker final
+{
+public:
+    static constexpr uint32_t SETTLE_FRAMES = 60;
+
+    explicit StaticDrawTracker(entt::registry& registry);
+    ~StaticDrawTracker();
+
+    StaticDrawTracker(const StaticDrawTracker&) = delete;
+    StaticDrawTracker(StaticDrawTracker&&) = delete;
+    StaticDrawTracker& operator=(const StaticDrawTracker&) = delete;
+    StaticDrawTracker& operator=(StaticDrawTracker&&) = delete;
+
+    // Once per frame, modifies the registry. Returns true and bumps the
+    // version when the static set changed.
+    bool update();
+
+    [[nodiscard]] const auto& getStatic() const { return m_Static; }
+    [[nodiscard]] uint64_t getVersion() const { return m_Version; }
+
+private:
+    void onRemove(entt::registry& registry, entt::entity entity);
+
+    entt::registry& m_Registry;
+    entt::observer m_Changed;
+    std::vector<entt::entity> m_Settled;
+    std::vector<entt::entity> m_Static;
+    uint64_t m_Version = 0;
+    bool m_StaticChanged = true;
+};
+
+} // namespace core::scene
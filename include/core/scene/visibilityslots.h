@@ -0,0 +1,52 @@
+#pragma once
+
+#include "entt/entity/registry.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace core::scene
+{
+
+// Hands every renderable (every entity with a VertexInfo) a slot of the GPU
+// visibility buffer, stored in its VisibilitySlot component. Slots of
+// destroyed renderables are reused, new owners must not inherit what the
+// slot held, so the slots handed out are collected until takeAllocated()
+// for the caller to clear. Entity indices are recycled by the registry and
+// can be far above the capacity, that is why they aren't used as slots.
+class VisibilitySlots final
+{
+public:
+    // Entities without a slot get this one, it is never tracked
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    VisibilitySlots(entt::registry& registry, uint32_t capacity);
+    ~VisibilitySlots();
+
+    VisibilitySlots(const VisibilitySlots&) = delete;
+    VisibilitySlots(VisibilitySlots&&) = delete;
+    VisibilitySlots& operator=(const VisibilitySlots&) = delete;
+    VisibilitySlots& operator=(VisibilitySlots&&) = delete;
+
+    // Slots handed out since the last call, sorted
+    [[nodiscard]] std::vector<uint32_t> takeAllocated();
+
+    [[nodiscard]] uint32_t getCapacity() const { return m_Capacity; }
+    [[nodiscard]] uint32_t getUsed() const
+    {
+        return m_Next - static_cast<uint32_t>(m_Free.size());
+    }
+
+private:
+    void onConstruct(entt::registry& registry, entt::entity entity);
+    void onDestroy(entt::registry& registry, entt::entity entity);
+
+    entt::registry& m_Registry;
+    uint32_t m_Capacity;
+    // Slots below m_Next were handed out before, m_Free the released ones
+    uint32_t m_Next = 0;
+    std::vector<uint32_t> m_Free;
+    std::vector<uint32_t> m_Allocated;
+};
+
+} // namespace core::scene
@@ -42,14 +42,24 @@ protected:
         descriptor = VkDescriptorImageInfo{sampler, view, layout};
     }
 
+    // Frames in flight may still sample the texture
     void clean()
     {
-        if(view)
-            vkDestroyImageView(device->getLogicalDevice(), view, nullptr);
-        if(image)
-            vmaDestroyImage(device->getAllocator(), image, memory);
-        if(sampler)
-            vkDestroySampler(device->getLogicalDevice(), sampler, nullptr);
+        if(!view && !image && !sampler)
+            return;
+
+        device->destroyLater([device = device,
+                              view = view,
+                              image = image,
+                              memory = memory,
+                              sampler = sampler]() {
+            if(view)
+                vkDestroyImageView(device->getLogicalDevice(), view, nullptr);
+            if(image)
+                vmaDestroyImage(device->getAllocator(), image, memory);
+            if(sampler)
+                vkDestroySampler(device->getLogicalDevice(), sampler, nullptr);
+        });
     }
 
     inline static logs::Logger m_Log;
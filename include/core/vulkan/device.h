@@ -4,18 +4,58 @@
 #include "GLFW/glfw3.h"
 
 #include "gpuopen/vkmemalloc.h"
+#include "core/vulkan/geometryarena.h"
 #include "logs/log.h"
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <memory>
-#include <vector>
+#include <mutex>
+#include <span>
 #include <string>
+#include <vector>
 
 namespace core::vk
 {
 
+enum class QueueType : uint32_t
+{
+    Graphics = 0,
+    Compute,
+    Transfer,
+    Count
+};
+
+// Every submit to a queue signals the next value of its timeline semaphore,
+// a point is reached once that submit and all before it have finished.
+// Value 0 is always reached.
+struct TimelinePoint
+{
+    QueueType queue = QueueType::Graphics;
+    uint64_t value = 0;
+};
+
+struct TimelineWait
+{
+    TimelinePoint point;
+    VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+
+// Binary semaphores are only left for the swapchain, which can't use
+// timeline semaphores
+struct SemaphoreWait
+{
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+
 class Device final
 {
 public:
+    // Without a window the device renders offscreen only, the swapchain
+    // extension is not enabled
     explicit Device(
             VkPhysicalDevice gpu, const std::shared_ptr<GLFWwindow>& window);
     ~Device();
@@ -38,6 +78,19 @@ public:
         return m_PhysicalDevice;
     }
     [[nodiscard]] VmaAllocator getAllocator() const { return m_Allocator; }
+    [[nodiscard]] const VkPhysicalDeviceProperties& getProperties() const
+    {
+        return m_PhysicalDeviceProperties;
+    }
+    [[nodiscard]] const VkPhysicalDeviceFeatures& getEnabledFeatures() const
+    {
+        return m_EnabledFeatures;
+    }
+    [[nodiscard]] const VkPhysicalDeviceVulkan12Features&
+    getEnabledFeatures12() const
+    {
+        return m_EnabledFeatures12;
+    }
 
     [[nodiscard]] uint32_t getGraphicsQueueFamily() const
     {
@@ -70,6 +123,22 @@ public:
         return m_CommandPools.transfer;
     }
 
+    // Loads the cache at path when it was written by this device and
+    // driver, an empty path keeps it in memory only
+    void createPipelineCache(const std::string& path);
+    // Every pipeline is created through this cache
+    [[nodiscard]] VkPipelineCache getPipelineCache() const
+    {
+        return m_PipelineCache;
+    }
+    // Writes the cache back when it has grown, replacing the old file
+    // atomically. Also done on destruction.
+    void savePipelineCache();
+
+    [[nodiscard]] VkCommandPool createCommandPool(
+            uint32_t queueFamilyIndex,
+            VkCommandPoolCreateFlags poolFlags) const;
+
     VkCommandBuffer createCommandBuffer(
             VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
             VkQueueFlags queueType = VK_QUEUE_GRAPHICS_BIT,
@@ -78,8 +147,37 @@ public:
     void beginCommandBuffer(
             VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags flags = 0);
 
+    // Submit, wait until done and optionally free from the pool of the queue
     void flushCommandBuffer(
-            VkCommandBuffer commandBuffer, VkQueue queue, bool free = true);
+            VkCommandBuffer commandBuffer,
+            QueueType queue,
+            bool free = true);
+
+    // Thread safe, submits are ordered by the value they signal
+    TimelinePoint submit(
+            QueueType queue,
+            std::span<const VkCommandBuffer> commandBuffers,
+            std::span<const TimelineWait> waits = {},
+            std::span<const SemaphoreWait> binaryWaits = {},
+            std::span<const VkSemaphore> binarySignals = {});
+
+    // One counter query, never blocks
+    [[nodiscard]] uint64_t getCompletedValue(QueueType queue) const;
+    [[nodiscard]] bool isComplete(TimelinePoint point) const
+    {
+        return point.value <= getCompletedValue(point.queue);
+    }
+    [[nodiscard]] TimelinePoint getLastSubmitted(QueueType queue);
+    void wait(TimelinePoint point) const;
+
+    // Runs destroy once everything submitted so far on any queue has
+    // finished, for resources that frames in flight may still use. Thread
+    // safe.
+    void destroyLater(std::function<void()> destroy);
+    // Once per frame, runs the deferred destroys that became safe
+    void destroyFinished();
+    // The device has to be idle
+    void destroyAllDeferred();
 
     void createBuffer(
             VkBufferUsageFlags usage,
@@ -90,6 +188,23 @@ public:
             VmaAllocation* bufferMemory,
             void* data = nullptr);
 
+    // Host visible buffer that stays mapped for its whole lifetime, returns
+    // the mapped pointer
+    void* createMappedBuffer(
+            VkBufferUsageFlags usage,
+            VkDeviceSize size,
+            VkBuffer* buffer,
+            VmaAllocation* bufferMemory,
+            bool shareWithCompute = false);
+
+    // Device local buffer accessed from both the graphics and compute queues
+    // without queue family ownership transfers
+    void createSharedBuffer(
+            VkBufferUsageFlags usage,
+            VkDeviceSize size,
+            VkBuffer* buffer,
+            VmaAllocation* bufferMemory);
+
     void createBufferOnGPU(
             VkBufferUsageFlags usage,
             VkDeviceSize size,
@@ -137,17 +252,55 @@ public:
 
     void createSampler(VkSampler* sampler);
 
+    // Totals for the render statistics, thread safe. The create functions
+    // count themselves, code that allocates or uploads on its own calls
+    // these.
+    void countAllocation()
+    {
+        m_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    void countUpload(VkDeviceSize bytes)
+    {
+        m_UploadedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t getAllocationCount() const
+    {
+        return m_AllocationCount.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t getUploadedBytes() const
+    {
+        return m_UploadedBytes.load(std::memory_order_relaxed);
+    }
+
+    // Shaders embedded in the binary are looked up by file name, the rest
+    // and every shader in development mode are mapped from disk
+    void setLoadShadersFromDisk(bool fromDisk)
+    {
+        m_ShadersFromDisk = fromDisk;
+    }
+    // The specialization info is only referenced, it has to outlive the
+    // pipeline creation
     VkPipelineShaderStageCreateInfo loadShaderFromFile(
-            const std::string& path, VkShaderStageFlagBits stage);
+            const std::string& path,
+            VkShaderStageFlagBits stage,
+            const VkSpecializationInfo* specialization = nullptr);
     uint32_t findMemoryType(
             uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
+    void createGeometryArena(
+            uint32_t vertexStride,
+            uint32_t vertexCapacity,
+            uint32_t indexCapacity);
+    [[nodiscard]] GeometryArena* getGeometryArena() const
+    {
+        return m_GeometryArena.get();
+    }
+
 private:
     [[nodiscard]] uint32_t getQueueFamilyIndex(
             VkQueueFlagBits queueFlags) const;
-    [[nodiscard]] VkCommandPool createCommandPool(
-            uint32_t queueFamilyIndex,
-            VkCommandPoolCreateFlags poolFlags) const;
+    void shareWithComputeQueue(VkBufferCreateInfo& bufferInfo) const;
+    void createTimelines();
 
     logs::Logger m_Log;
     std::shared_ptr<GLFWwindow> m_Window;
@@ -157,6 +310,9 @@ private:
 
     VkPhysicalDeviceProperties m_PhysicalDeviceProperties;
     VkPhysicalDeviceFeatures m_PhysicalDeviceFeatures;
+    VkPhysicalDeviceFeatures m_EnabledFeatures = {};
+    VkPhysicalDeviceVulkan12Features m_EnabledFeatures12 = {};
+    std::vector<uint32_t> m_SharedQueueFamilies;
     VkPhysicalDeviceMemoryProperties m_PhysicalDeviceMemoryProperties;
     std::vector<VkQueueFamilyProperties> m_QueueFamilyProperties;
 
@@ -181,5 +337,37 @@ private:
         VkCommandPool compute = VK_NULL_HANDLE;
         VkCommandPool transfer = VK_NULL_HANDLE;
     } m_CommandPools;
+
+    // Queue types that end up on the same VkQueue share one timeline, its
+    // submits have to be serialized anyway
+    struct Timeline
+    {
+        VkQueue queue = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t submitted = 0;
+        std::mutex mutex;
+    };
+    std::vector<std::unique_ptr<Timeline>> m_Timelines;
+    std::array<Timeline*, static_cast<size_t>(QueueType::Count)>
+            m_TimelineOf = {};
+
+    // Ordered by submission, the values only grow
+    struct DeferredDestroy
+    {
+        std::array<uint64_t, static_cast<size_t>(QueueType::Count)> after;
+        std::function<void()> destroy;
+    };
+    std::deque<DeferredDestroy> m_DeferredDestroys;
+    std::mutex m_DeferredMutex;
+
+    VkPipelineCache m_PipelineCache = VK_NULL_HANDLE;
+    std::string m_PipelineCachePath;
+    size_t m_PipelineCacheSavedSize = 0;
+    bool m_ShadersFromDisk = false;
+
+    std::atomic<uint64_t> m_AllocationCount = 0;
+    std::atomic<uint64_t> m_UploadedBytes = 0;
+
+    std::unique_ptr<GeometryArena> m_GeometryArena;
 };
 } // namespace core::vk
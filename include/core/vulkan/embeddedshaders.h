@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace core::vk
+{
+
+// SPIR-V compiled with the binary, see tools/embed_spirv.py
+struct EmbeddedShader
+{
+    // File name of the compiled shader, e.g. obj.frag.spv
+    std::string_view name;
+    std::span<const uint32_t> code;
+};
+
+// Defined in the source generated by data/shaders/meson.build, empty when
+// the build found no shader compiler
+[[nodiscard]] std::span<const EmbeddedShader> getEmbeddedShaders();
+
+// Empty when no shader of that name was embedded
+[[nodiscard]] std::span<const uint32_t> findEmbeddedShader(
+        std::string_view name);
+
+} // namespace core::vk
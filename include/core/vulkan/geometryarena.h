@@ -0,0 +1,74 @@
+#pragma once
+
+#include "utils/freelistallocator.h"
+#include "logs/log.h"
+
+#include "gpuopen/vkmemalloc.h"
+#include "vulkan/vulkan.h"
+
+#include <cstdint>
+#include <optional>
+
+namespace core::vk
+{
+
+class Device;
+
+// Location of one mesh inside the arena, offsets are in vertices and indices
+// so they can be passed straight to vkCmdDrawIndexed
+struct GeometryAllocation
+{
+    uint32_t vertexOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+};
+
+// One big vertex buffer and one big index buffer shared by every mesh in the
+// scene. Meshes are suballocated from them, so the whole scene can be drawn
+// with a single vertex/index buffer bind.
+class GeometryArena final
+{
+public:
+    GeometryArena(
+            Device* device,
+            uint32_t vertexStride,
+            uint32_t vertexCapacity,
+            uint32_t indexCapacity);
+    ~GeometryArena();
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena(GeometryArena&&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+    GeometryArena& operator=(GeometryArena&&) = delete;
+
+    // Upload vertices and indices, indices are relative to the first vertex
+    // of the mesh
+    [[nodiscard]] std::optional<GeometryAllocation> allocate(
+            const void* vertices,
+            uint32_t vertexCount,
+            const uint32_t* indices,
+            uint32_t indexCount);
+    void free(const GeometryAllocation& allocation);
+
+    void bind(VkCommandBuffer cmdBuf) const;
+
+    [[nodiscard]] VkBuffer getVertexBuffer() const { return m_VertexBuffer; }
+    [[nodiscard]] VkBuffer getIndexBuffer() const { return m_IndexBuffer; }
+    [[nodiscard]] uint32_t getVertexStride() const { return m_VertexStride; }
+
+private:
+    logs::Logger m_Log;
+    Device* m_Device;
+    uint32_t m_VertexStride;
+
+    utils::FreeListAllocator m_Vertices;
+    utils::FreeListAllocator m_Indices;
+
+    VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
+    VmaAllocation m_VertexMemory = VK_NULL_HANDLE;
+    VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+    VmaAllocation m_IndexMemory = VK_NULL_HANDLE;
+};
+
+} // namespace core::vk
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace core::vk
+{
+
+// What a pass does with a resource. Each maps to the pipeline stages, access
+// mask and image layout barriers are built from.
+enum class Access : uint8_t
+{
+    IndirectRead,
+    // Vertex and index buffers
+    VertexRead,
+    // Sampled images and storage buffers in vertex or fragment shaders
+    GraphicsShaderRead,
+    // Sampled images and storage buffers in compute shaders
+    ComputeShaderRead,
+    // Storage images and buffers in compute shaders, images in
+    // VK_IMAGE_LAYOUT_GENERAL
+    ComputeStorageRead,
+    ComputeShaderWrite,
+    ColorAttachment,
+    DepthAttachment,
+    // Depth test without writes
+    DepthAttachmentRead,
+    TransferRead,
+    TransferWrite,
+    // Only as the final access of an image
+    Present,
+    Count
+};
+
+struct AccessInfo
+{
+    VkPipelineStageFlags stages = 0;
+    VkAccessFlags access = 0;
+    // Buffers ignore it
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    bool write = false;
+};
+
+// Shader reads of depth images use the read only depth layout
+[[nodiscard]] AccessInfo getAccessInfo(
+        Access access, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+
+// Async compute passes run on the compute queue before the graphics passes
+// that depend on them. One that uses a resource a graphics pass used before
+// it is recorded on the graphics queue instead.
+enum class PassQueue : uint8_t
+{
+    Graphics,
+    AsyncCompute
+};
+
+using ResourceId = uint32_t;
+using PassId = uint32_t;
+
+// Transient resources are created by the executor. Ones whose lifetimes
+// don't overlap share memory.
+struct ImageDesc
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    bool operator==(const ImageDesc& other) const = default;
+};
+
+struct BufferDesc
+{
+    VkDeviceSize size = 0;
+
+    bool operator==(const BufferDesc& other) const = default;
+};
+
+struct ImageTransition
+{
+    ResourceId resource = 0;
+    VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkAccessFlags srcAccess = 0;
+    VkAccessFlags dstAccess = 0;
+};
+
+// Everything a pass waits for as one vkCmdPipelineBarrier. Buffers and
+// images that keep their layout share the global memory barrier.
+struct Barrier
+{
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    VkAccessFlags srcAccess = 0;
+    VkAccessFlags dstAccess = 0;
+    std::vector<ImageTransition> images;
+
+    [[nodiscard]] bool isEmpty() const { return dstStages == 0; }
+};
+
+struct CompiledPass
+{
+    PassId pass = 0;
+    // Graphics when an async compute pass had to be moved
+    PassQueue queue = PassQueue::Graphics;
+    // Recorded before the pass on its queue
+    Barrier barrier;
+};
+
+// Live range of a transient in CompiledGraph::passes
+struct TransientUse
+{
+    ResourceId resource = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    VkPipelineStageFlags firstStages = 0;
+    VkAccessFlags firstAccess = 0;
+    // Of the last use, what later users of its memory have to wait for
+    VkPipelineStageFlags lastStages = 0;
+    VkAccessFlags lastWriteAccess = 0;
+    bool onGraphics = false;
+    bool onCompute = false;
+};
+
+struct CompiledGraph
+{
+    // Live passes in execution order, culled ones are left out
+    std::vector<CompiledPass> passes;
+    // Recorded on the graphics queue after the last pass, for the final
+    // accesses of imported resources
+    Barrier finalBarrier;
+    // Graphics stages that wait for the async compute passes, zero when
+    // no graphics pass depends on them
+    VkPipelineStageFlags computeWaitStages = 0;
+    std::vector<TransientUse> transients;
+};
+
+// Memory of a transient as input to planAliasing
+struct TransientRange
+{
+    uint32_t first = 0;
+    uint32_t last = 0;
+    VkDeviceSize size = 0;
+    VkDeviceSize alignment = 1;
+    uint32_t memoryTypeBits = 0;
+    // Buffers and images never share a block, so buffer image granularity
+    // doesn't matter
+    bool image = false;
+    // Used on both queues, the queues overlap so it gets a block of its own
+    bool shared = false;
+    // Only ranges of the same queue alias
+    bool compute = false;
+};
+
+struct AliasBlock
+{
+    VkDeviceSize size = 0;
+    VkDeviceSize alignment = 1;
+    uint32_t memoryTypeBits = 0;
+};
+
+struct AliasPlacement
+{
+    uint32_t block = 0;
+    VkDeviceSize offset = 0;
+};
+
+struct AliasPlan
+{
+    std::vector<AliasBlock> blocks;
+    // Indexed like the ranges
+    std::vector<AliasPlacement> placements;
+};
+
+// Largest ranges first, each at the lowest offset of a compatible block
+// where it overlaps no range alive at the same time
+[[nodiscard]] AliasPlan planAliasing(const std::vector<TransientRange>& ranges);
+
+// A frame's passes and the resources they use, rebuilt every frame. Passes
+// are added in the order they run, compile() culls the ones nothing depends
+// on and works out the barriers between the rest.
+class RenderGraph final
+{
+public:
+    using Record = std::function<void(VkCommandBuffer)>;
+
+    // State of an imported resource is given by the last access before the
+    // graph, none when its contents don't matter. Images shared between the
+    // queues have to use concurrent sharing.
+    ResourceId importImage(
+            std::string name,
+            VkImage image,
+            VkImageAspectFlags aspect,
+            std::optional<Access> initial);
+    // Buffers are only synchronized through global memory barriers, they
+    // need no handle
+    ResourceId importBuffer(std::string name, std::optional<Access> initial);
+    // Transients, created and aliased by the executor. Context declares none
+    // yet, every per frame resource of the scene is imported, so aliasing is
+    // only exercised by the unit tests.
+    ResourceId createImage(std::string name, const ImageDesc& desc);
+    ResourceId createBuffer(std::string name, const BufferDesc& desc);
+
+    // Access the resource is left in after the graph, makes it an output so
+    // the passes writing it are kept
+    void setFinalAccess(ResourceId resource, Access access);
+
+    PassId addPass(std::string name, PassQueue queue, Record record);
+    // One access per resource and pass, writes include reads of the same
+    // stages
+    void use(PassId pass, ResourceId resource, Access access);
+    // Pass has effects outside the graph, it is never culled
+    void keep(PassId pass);
+
+    [[nodiscard]] CompiledGraph compile() const;
+
+    // The first use of every transient also waits for the last use of the
+    // ones it shares memory with
+    static void addAliasBarriers(
+            CompiledGraph& compiled,
+            const std::vector<TransientRange>& ranges,
+            const AliasPlan& plan);
+
+    [[nodiscard]] const std::string& getPassName(PassId pass) const
+    {
+        return m_Passes[pass].name;
+    }
+    [[nodiscard]] const std::string& getResourceName(ResourceId resource) const
+    {
+        return m_Resources[resource].name;
+    }
+    [[nodiscard]] size_t getPassCount() const { return m_Passes.size(); }
+
+    // Handles are set by the executor before recording for transients
+    [[nodiscard]] VkImage getImage(ResourceId resource) const
+    {
+        return m_Resources[resource].image;
+    }
+    [[nodiscard]] VkImageView getImageView(ResourceId resource) const
+    {
+        return m_Resources[resource].view;
+    }
+    [[nodiscard]] VkBuffer getBuffer(ResourceId resource) const
+    {
+        return m_Resources[resource].buffer;
+    }
+
+private:
+    friend class RenderGraphExecutor;
+
+    struct Resource
+    {
+        std::string name;
+        bool imported = false;
+        bool isImage = false;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        std::optional<Access> initial;
+        std::optional<Access> final;
+        ImageDesc imageDesc;
+        BufferDesc bufferDesc;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+    };
+
+    struct Use
+    {
+        ResourceId resource = 0;
+        Access access = Access::Count;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        PassQueue queue = PassQueue::Graphics;
+        Record record;
+        std::vector<Use> uses;
+        bool kept = false;
+    };
+
+    [[nodiscard]] std::vector<bool> findLivePasses() const;
+    [[nodiscard]] AccessInfo getInfo(const Use& use) const;
+
+    std::vector<Resource> m_Resources;
+    std::vector<Pass> m_Passes;
+};
+
+} // namespace core::vk
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "riften/thiefpool.hpp"
+#include "timer/profiler.h"
 #include "utils/singleton.h"
 
+#include <functional>
 #include <memory>
 #include <map>
 #include <mutex>
@@ -18,8 +20,22 @@ public:
     template<class F, class... Args>
     decltype(auto) submitWork(F&& f, Args&&... args)
     {
+#if PROFILER_ENABLED
+        // Every task is a profiler zone. Without zones the task is enqueued
+        // as is, no wrapper is created.
+        auto task = [f = std::forward<F>(f)](auto&&... args) mutable
+                -> decltype(auto) {
+            PROFILE_ZONE("WorkQueue task");
+            return std::invoke(
+                    std::move(f), std::forward<decltype(args)>(args)...);
+        };
+
+        std::unique_lock lock{m_Mutex};
+        return m_Pool.enqueue(std::move(task), std::forward<Args>(args)...);
+#else
         std::unique_lock lock{m_Mutex};
         return m_Pool.enqueue(std::forward<F>(f), std::forward<Args>(args)...);
+#endif
     }
 
 private:
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <vulkan/vulkan.h>
 
@@ -9,4 +10,12 @@ struct DescriptorSetAllocateEvent
 {
     std::function<void(VkDescriptorSet set)> callback;
 };
+
+// Triggered on the main thread once a requested pipeline has compiled
+struct PipelineReadyEvent
+{
+    uint32_t handle;
+    VkPipeline pipeline;
+    float compileMs;
+};
 } // namespace event
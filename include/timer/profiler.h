@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Zones compile out completely unless the build defines PROFILER_ENABLED=1,
+// see the profiler option in meson_options.txt
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 0
+#endif
+
+namespace profiler
+{
+
+// Zones kept per thread, the oldest are overwritten
+constexpr size_t ZONES_PER_THREAD = 16384;
+
+// Steady clock nanoseconds
+[[nodiscard]] int64_t now();
+
+// The name must outlive the profiler, string literals and __func__ do. Only
+// the calling thread writes its buffer, there are no locks after the first
+// zone of a thread.
+void record(const char* name, int64_t beginNs, int64_t endNs);
+
+// Shown for the calling thread in the trace, "Thread N" otherwise
+void setThreadName(const char* name);
+
+// Chrome trace event JSON of the zones of every thread, opened in
+// chrome://tracing or Perfetto. May run while other threads record, zones
+// overwritten during the export are left out. False when the file can't be
+// written.
+bool writeChromeTrace(const std::string& path);
+
+// Zones recorded by all threads since the start, including overwritten ones
+[[nodiscard]] uint64_t getRecordedCount();
+
+class ScopedZone final
+{
+public:
+    explicit ScopedZone(const char* name) : m_Name(name), m_Begin(now()) {}
+    ~ScopedZone() { record(m_Name, m_Begin, now()); }
+
+    ScopedZone(const ScopedZone&) = delete;
+    ScopedZone(ScopedZone&&) = delete;
+    ScopedZone& operator=(const ScopedZone&) = delete;
+    ScopedZone& operator=(ScopedZone&&) = delete;
+
+private:
+    const char* m_Name;
+    int64_t m_Begin;
+};
+
+} // namespace profiler
+
+#if PROFILER_ENABLED
+#define PROFILER_CONCAT_IMPL(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) \
+    const profiler::ScopedZone PROFILER_CONCAT(profilerZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) profiler::setThreadName(name)
+#else
+#define PROFILE_ZONE(name) (void)0
+#define PROFILE_FUNCTION() (void)0
+#define PROFILE_THREAD(name) (void)0
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "utils/statistics.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+// CPU phases of a frame, together they should account for most of it
+enum class FramePhase : uint8_t
+{
+    Events,
+    UiBuild,
+    SceneUpdate,
+    Record,
+    Submit,
+    // Waiting for the frame in flight to finish and for the next image
+    PresentWait,
+    Count
+};
+
+constexpr size_t FRAME_PHASE_COUNT = static_cast<size_t>(FramePhase::Count);
+
+[[nodiscard]] const char* getPhaseName(FramePhase phase);
+
+struct FrameSample
+{
+    uint64_t frame = 0;
+    float totalMs = 0.0f;
+    std::array<float, FRAME_PHASE_COUNT> phaseMs = {};
+};
+
+struct Hitch
+{
+    uint64_t frame = 0;
+    float totalMs = 0.0f;
+    // Of the window before the hitch
+    float medianMs = 0.0f;
+    // Phase that took the longest over its own median
+    FramePhase phase = FramePhase::Count;
+    float phaseExcessMs = 0.0f;
+};
+
+// Frame times of the last frames split into phases, with a log of the frames
+// that took much longer than the median
+class FrameStats final
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1000;
+    // Hitches are detected once the window holds this many frames
+    static constexpr size_t MIN_HITCH_FRAMES = 60;
+    static constexpr size_t MAX_HITCHES = 64;
+
+    // A frame is a hitch when it takes longer than hitchFactor times the
+    // median of the window
+    explicit FrameStats(
+            size_t capacity = DEFAULT_CAPACITY, float hitchFactor = 2.0f);
+
+    // Phase times accumulate until endFrame, phases may be added many times
+    void addPhase(FramePhase phase, float milliseconds);
+    void endFrame(uint64_t frame, float totalMs);
+
+    // Oldest first
+    [[nodiscard]] const std::deque<FrameSample>& getFrames() const
+    {
+        return m_Frames;
+    }
+    // Newest first
+    [[nodiscard]] const std::deque<Hitch>& getHitches() const
+    {
+        return m_Hitches;
+    }
+
+    // Sorts a copy of the window, call when the numbers are shown
+    [[nodiscard]] Summary summarizeTotal() const;
+    [[nodiscard]] Summary summarizePhase(FramePhase phase) const;
+
+    // Frame totals in binCount bins of binMs from 0, the last bin also
+    // counts the longer frames
+    [[nodiscard]] std::vector<uint32_t> getHistogram(
+            size_t binCount, float binMs) const;
+
+    // One line per frame of the window, false when the file can't be
+    // written
+    bool writeCsv(const std::string& path) const;
+
+private:
+    // Samples of the window into m_Scratch, the totals for FramePhase::Count
+    void gather(FramePhase phase) const;
+    [[nodiscard]] float median(FramePhase phase) const;
+
+    size_t m_Capacity;
+    float m_HitchFactor;
+
+    FrameSample m_Current;
+    std::deque<FrameSample> m_Frames;
+    std::deque<Hitch> m_Hitches;
+    // Reused by the per frame median
+    mutable std::vector<float> m_Scratch;
+};
+
+} // namespace utils
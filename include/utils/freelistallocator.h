@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <optional>
+
+namespace utils
+{
+
+// Offset allocator for carving ranges out of a fixed size linear resource,
+// like one big GPU buffer. Free ranges are kept sorted by offset so released
+// neighbours coalesce, and indexed by size for best-fit lookups.
+class FreeListAllocator final
+{
+public:
+    explicit FreeListAllocator(uint64_t capacity) : m_Capacity(capacity)
+    {
+        if(capacity > 0)
+        {
+            insertFreeRange(0, capacity);
+        }
+    }
+
+    [[nodiscard]] std::optional<uint64_t> allocate(
+            uint64_t size, uint64_t alignment = 1)
+    {
+        assert(alignment > 0);
+        if(size == 0)
+        {
+            return std::nullopt;
+        }
+
+        for(auto it = m_BySize.lower_bound(size); it != m_BySize.end(); ++it)
+        {
+            const auto [rangeSize, rangeOffset] = *it;
+            const uint64_t aligned = alignUp(rangeOffset, alignment);
+            const uint64_t padding = aligned - rangeOffset;
+            if(rangeSize < padding + size)
+            {
+                continue;
+            }
+
+            m_BySize.erase(it);
+            m_ByOffset.erase(rangeOffset);
+
+            if(padding > 0)
+            {
+                insertFreeRange(rangeOffset, padding);
+            }
+            if(const uint64_t tail = rangeSize - padding - size; tail > 0)
+            {
+                insertFreeRange(aligned + size, tail);
+            }
+
+            m_Used += size;
+            return aligned;
+        }
+
+        return std::nullopt;
+    }
+
+    void free(uint64_t offset, uint64_t size)
+    {
+        assert(size > 0);
+        assert(offset + size <= m_Capacity);
+        assert(m_Used >= size);
+
+        uint64_t mergedOffset = offset;
+        uint64_t mergedSize = size;
+
+        auto next = m_ByOffset.lower_bound(offset);
+        assert(next == m_ByOffset.end() || next->first >= offset + size);
+        if(next != m_ByOffset.end() && next->first == offset + size)
+        {
+            mergedSize += next->second;
+            next = eraseFreeRange(next);
+        }
+
+        if(next != m_ByOffset.begin())
+        {
+            auto prev = std::prev(next);
+            if(prev->first + prev->second == offset)
+            {
+                mergedOffset = prev->first;
+                mergedSize += prev->second;
+                eraseFreeRange(prev);
+            }
+        }
+
+        insertFreeRange(mergedOffset, mergedSize);
+        m_Used -= size;
+    }
+
+    [[nodiscard]] uint64_t getCapacity() const { return m_Capacity; }
+    [[nodiscard]] uint64_t getUsed() const { return m_Used; }
+    [[nodiscard]] size_t getFreeRangeCount() const { return m_ByOffset.size(); }
+    [[nodiscard]] uint64_t getLargestFreeRange() const
+    {
+        return m_BySize.empty() ? 0 : m_BySize.rbegin()->first;
+    }
+
+private:
+    using OffsetMap = std::map<uint64_t, uint64_t>;
+
+    static constexpr uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void insertFreeRange(uint64_t offset, uint64_t size)
+    {
+        m_ByOffset.emplace(offset, size);
+        m_BySize.emplace(size, offset);
+    }
+
+    OffsetMap::iterator eraseFreeRange(OffsetMap::iterator it)
+    {
+        auto [first, last] = m_BySize.equal_range(it->second);
+        for(; first != last; ++first)
+        {
+            if(first->second == it->first)
+            {
+                m_BySize.erase(first);
+                break;
+            }
+        }
+        return m_ByOffset.erase(it);
+    }
+
+    uint64_t m_Capacity = 0;
+    uint64_t m_Used = 0;
+
+    // offset -> size
+    OffsetMap m_ByOffset;
+    // size -> offset
+    std::multimap<uint64_t, uint64_t> m_BySize;
+};
+
+} // namespace utils
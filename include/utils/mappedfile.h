@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace utils
+{
+
+// Whole file mapped read only, the mapping is page aligned. Throws
+// std::runtime_error when the file can't be opened or mapped.
+class MappedFile final
+{
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    [[nodiscard]] const void* data() const { return m_Data; }
+    [[nodiscard]] size_t size() const { return m_Size; }
+
+private:
+    void unmap();
+
+    void* m_Data = nullptr;
+    size_t m_Size = 0;
+};
+
+} // namespace utils
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace utils
+{
+
+// Distribution of a set of samples, all zero when there are none
+struct Summary
+{
+    size_t count = 0;
+    float mean = 0.0f;
+    float min = 0.0f;
+    float p50 = 0.0f;
+    float p90 = 0.0f;
+    float p95 = 0.0f;
+    float p99 = 0.0f;
+    float max = 0.0f;
+};
+
+// Linearly interpolated between the closest ranks, p in [0, 100]. The
+// samples must be sorted ascending.
+[[nodiscard]] float percentile(std::span<const float> sorted, float p);
+
+[[nodiscard]] Summary summarize(std::vector<float> samples);
+
+} // namespace utils
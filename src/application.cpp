@@ -1,14 +1,37 @@
 #include "application.h"
+#include "benchmark.h"
 #include "logs/log.h"
+#include "timer/profiler.h"
 #include "timer/timer.h"
 #include "core/scene/components.h"
 
 #include "imgui/imgui_impl_glfw.h"
 #include "event/keyevent.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <iostream>
+#include <numbers>
+#include <vector>
+
 namespace app
 {
 
+namespace
+{
+// Benchmark frames advance the scene by a fixed step so runs are comparable
+constexpr float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+// Untimed frames after the pipelines have compiled, for the caches that are
+// filled during the first frames
+constexpr int BENCHMARK_WARMUP_FRAMES = 10;
+// Written by the export button of the GPU profiler window
+constexpr const char* GPU_PROFILE_PATH = "gpuprofile.csv";
+// Frame time histogram of the metrics window, 0 to 50 ms
+constexpr size_t FRAME_HISTOGRAM_BINS = 50;
+constexpr float FRAME_HISTOGRAM_MS = 1.0f;
+} // namespace
+
 Application::Application() :
     _log(logs::Log::create("Application")),
     _baseConfig(config::Config::getBaseConfig())
@@ -17,10 +40,22 @@ Application::Application() :
 
 Application::~Application()
 {
+    if(_baseConfig.traceOnExit != 0)
+    {
+        writeTrace();
+    }
+    if(_baseConfig.frameStatsOnExit != 0)
+    {
+        writeFrameStats();
+    }
+
     _vulkanContext->deviceWaitIdle();
     _scene->clear();
     _scene.reset();
-    ImGui_ImplGlfw_Shutdown();
+    if(_window)
+    {
+        ImGui_ImplGlfw_Shutdown();
+    }
     _log->info("Stopping");
     _vulkanContext.reset();
     _camera.reset();
@@ -30,14 +65,25 @@ Application::~Application()
 
 void Application::run()
 {
-    try
+    PROFILE_THREAD("Main");
+
+    if(_baseConfig.headless != 0)
     {
-        initilizeGLFW();
+        // Rendered offscreen, there is no window to take the size from
+        _frameBufferSize.width = static_cast<uint32_t>(_baseConfig.width);
+        _frameBufferSize.height = static_cast<uint32_t>(_baseConfig.height);
     }
-    catch(...)
+    else
     {
-        _log->error("Initialization failed, exiting...");
-        return;
+        try
+        {
+            initilizeGLFW();
+        }
+        catch(...)
+        {
+            _log->error("Initialization failed, exiting...");
+            return;
+        }
     }
 
     _camera = std::make_shared<core::scene::TrackBall>(_dispatcher);
@@ -50,7 +96,7 @@ void Application::run()
     _vulkanContext->init(_frameBufferSize);
     _uiLayer = std::make_unique<ui::UiLayer>(_dispatcher);
 
-    _scene->loadModels(_vulkanContext->getDevice());
+    _scene->loadModels(_vulkanContext->getDevice(), _baseConfig.sceneCars);
 
     {
         // append descriptor resources to context
@@ -58,6 +104,12 @@ void Application::run()
 
     _vulkanContext->generatePipelines();
 
+    if(!_window)
+    {
+        benchmarkloop();
+        return;
+    }
+
     ImGui_ImplGlfw_InitForVulkan(_window.get(), true);
 
     _log->info("Initialization complete, entering mainloop");
@@ -132,26 +184,62 @@ void Application::initilizeGLFW()
 
 void Application::mainloop()
 {
+    Timer phaseTimer;
+    auto endPhase = [this, &phaseTimer](utils::FramePhase phase) {
+        _frameStats.addPhase(phase, phaseTimer.elapsed() * 1000.0f);
+        phaseTimer = {};
+    };
+
     while(!glfwWindowShouldClose(_window.get()))
     {
         Timer timer;
-        glfwPollEvents();
+        PROFILE_ZONE("Frame");
+        phaseTimer = {};
+        {
+            PROFILE_ZONE("Events");
+            glfwPollEvents();
 
-        // Dispatch all enqueued events
-        _dispatcher.update();
+            // Dispatch all enqueued events
+            _dispatcher.update();
+        }
+        endPhase(utils::FramePhase::Events);
 
-        _camera->update(_frameTime);
+        {
+            PROFILE_ZONE("Scene update");
+            _camera->update(_frameTime);
+            _scene->updatePositions(_apprunTime);
+
+            // On the main thread, culling hands chunks of large scenes to
+            // the work queue and blocks until they are done. From a worker
+            // that could wait on jobs only it can run.
+            _vulkanContext->updateVisibility(_frameTime);
+        }
+        const auto cullingStats = _vulkanContext->getCullingStats();
+        endPhase(utils::FramePhase::SceneUpdate);
 
         _uiLayer->begin();
         { // UI related updates
+            PROFILE_ZONE("UI build");
             auto& io = ImGui::GetIO();
 
             ImGui::Begin("Performance metrics");
             ImGui::Text(
                     "%.3f ms / %.0f fps", 1000.0f / io.Framerate, io.Framerate);
             ImGui::Text("framecounter: %lu frame", _frameCounter);
+            ImGui::Text(
+                    "frustum culled: %zu / %zu",
+                    cullingStats.frustumCulled,
+                    cullingStats.tested);
+            ImGui::Text(
+                    "occlusion culled: %zu (%zu occluders)",
+                    cullingStats.occlusionCulled,
+                    cullingStats.occluders);
+            frameStatsSection();
+            renderStatsSection();
             ImGui::End();
 
+            gpuProfilerWindow();
+
             // ImGui::Begin("Settings");
             // if(auto filename = m_UiLayer->openFileButton("Load Model");
             //    !filename.empty())
@@ -163,16 +251,373 @@ void Application::mainloop()
             // ImGui::End();
         }
         _uiLayer->end();
+        endPhase(utils::FramePhase::UiBuild);
 
-        _scene->updatePositions(_apprunTime);
         _vulkanContext->renderFrame(_frameTime);
+        const auto timings = _vulkanContext->getFrameTimings();
+        _frameStats.addPhase(utils::FramePhase::Record, timings.recordMs);
+        _frameStats.addPhase(utils::FramePhase::Submit, timings.submitMs);
+        _frameStats.addPhase(
+                utils::FramePhase::PresentWait, timings.presentWaitMs);
 
         _frameTime = timer.elapsed();
+        _frameStats.endFrame(_frameCounter, _frameTime * 1000.0f);
         _apprunTime += _frameTime;
         _frameCounter += 1;
     }
 }
 
+// -----------------------------------------------------------------------------
+// Compute scopes get rows of their own below the graphics ones, the queues
+// run side by side
+//
+
+void Application::gpuProfilerWindow()
+{
+    ImGui::Begin("GPU profiler");
+    const auto* profiler = _vulkanContext->getGpuProfiler();
+    if(!profiler || profiler->getHistory().empty())
+    {
+        ImGui::Text("No timestamps");
+        ImGui::End();
+        return;
+    }
+
+    const auto& frame = profiler->getHistory().front();
+    if(ImGui::BeginTable("scopes", 3))
+    {
+        ImGui::TableSetupColumn("scope");
+        ImGui::TableSetupColumn("avg ms");
+        ImGui::TableSetupColumn("max ms");
+        ImGui::TableHeadersRow();
+        for(const auto& average : profiler->getAverages())
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(average.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", average.averageMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", average.maxMs);
+        }
+        ImGui::EndTable();
+    }
+
+    float frameMs = 0.0f;
+    uint32_t graphicsRows = 0;
+    uint32_t rows = 0;
+    for(const auto& scope : frame.scopes)
+    {
+        frameMs = std::max(frameMs, scope.beginMs + scope.durationMs);
+        if(scope.queue == core::vk::QueueType::Graphics)
+        {
+            graphicsRows = std::max(graphicsRows, scope.depth + 1);
+        }
+    }
+    ImGui::Text("Frame %lu, %.3f ms", frame.number, frameMs);
+
+    auto* drawList = ImGui::GetWindowDrawList();
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+    const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    const float msToPixels = width / std::max(frameMs, 0.001f);
+    for(const auto& scope : frame.scopes)
+    {
+        const bool graphics = scope.queue == core::vk::QueueType::Graphics;
+        const uint32_t row =
+                graphics ? scope.depth : graphicsRows + scope.depth;
+        rows = std::max(rows, row + 1);
+
+        const ImVec2 min = {
+                origin.x + scope.beginMs * msToPixels,
+                origin.y + static_cast<float>(row) * rowHeight};
+        const ImVec2 max = {
+                std::max(min.x + scope.durationMs * msToPixels, min.x + 1.0f),
+                min.y + rowHeight - 1.0f};
+        drawList->AddRectFilled(
+                min,
+                max,
+                graphics ? IM_COL32(70, 130, 180, 255)
+                         : IM_COL32(180, 120, 60, 255));
+        drawList->PushClipRect(min, max, true);
+        drawList->AddText(
+                {min.x + 2.0f, min.y},
+                IM_COL32(255, 255, 255, 255),
+                scope.name.c_str());
+        drawList->PopClipRect();
+
+        if(ImGui::IsMouseHoveringRect(min, max))
+        {
+            ImGui::SetTooltip(
+                    "%s\n%.3f ms", scope.name.c_str(), scope.durationMs);
+        }
+    }
+    ImGui::Dummy({width, static_cast<float>(rows) * rowHeight});
+
+    if(ImGui::Button("Export CSV"))
+    {
+        profiler->writeCsv(GPU_PROFILE_PATH);
+    }
+    ImGui::End();
+}
+
+// -----------------------------------------------------------------------------
+// Summaries sort the whole window, they are only computed while the section
+// is open
+//
+
+void Application::frameStatsSection()
+{
+    if(!ImGui::CollapsingHeader("Frame times"))
+    {
+        return;
+    }
+
+    const auto total = _frameStats.summarizeTotal();
+    ImGui::Text(
+            "%zu frames, p50 %.2f p95 %.2f p99 %.2f max %.2f ms",
+            total.count,
+            total.p50,
+            total.p95,
+            total.p99,
+            total.max);
+
+    const auto bins =
+            _frameStats.getHistogram(FRAME_HISTOGRAM_BINS, FRAME_HISTOGRAM_MS);
+    const std::vector<float> counts(bins.begin(), bins.end());
+    ImGui::PlotHistogram(
+            "##frametimes",
+            counts.data(),
+            static_cast<int>(counts.size()),
+            0,
+            "0 - 50 ms, longer frames in the last bin",
+            0.0f,
+            FLT_MAX,
+            {0.0f, 80.0f});
+
+    if(ImGui::BeginTable("phases", 4))
+    {
+        ImGui::TableSetupColumn("phase");
+        ImGui::TableSetupColumn("p50 ms");
+        ImGui::TableSetupColumn("p95 ms");
+        ImGui::TableSetupColumn("max ms");
+        ImGui::TableHeadersRow();
+        for(size_t i = 0; i < utils::FRAME_PHASE_COUNT; ++i)
+        {
+            const auto phase = static_cast<utils::FramePhase>(i);
+            const auto summary = _frameStats.summarizePhase(phase);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(utils::getPhaseName(phase));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", summary.p50);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", summary.p95);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", summary.max);
+        }
+        ImGui::EndTable();
+    }
+
+    const auto& hitches = _frameStats.getHitches();
+    ImGui::Text("Hitches: %zu", hitches.size());
+    ImGui::BeginChild("hitches", {0.0f, 100.0f}, true);
+    for(const auto& hitch : hitches)
+    {
+        ImGui::Text(
+                "frame %lu: %.2f ms (median %.2f), %s +%.2f ms",
+                hitch.frame,
+                hitch.totalMs,
+                hitch.medianMs,
+                utils::getPhaseName(hitch.phase),
+                hitch.phaseExcessMs);
+    }
+    ImGui::EndChild();
+
+    if(ImGui::Button("Dump frame stats"))
+    {
+        writeFrameStats();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Instances and triangles are of the draws the CPU knows the counts of, what
+// GPU culling draws only shows in the pipeline statistics
+//
+
+void Application::renderStatsSection()
+{
+    if(!ImGui::CollapsingHeader("Render stats"))
+    {
+        return;
+    }
+
+    const auto& stats = _vulkanContext->getRenderStats();
+    ImGui::Text("draw calls: %lu", stats.drawCalls);
+    ImGui::Text("instances: %lu", stats.instances);
+    ImGui::Text("triangles: %lu", stats.triangles);
+    ImGui::Text(
+            "binds: %lu pipeline, %lu vertex, %lu index, %lu descriptor",
+            stats.pipelineBinds,
+            stats.vertexBufferBinds,
+            stats.indexBufferBinds,
+            stats.descriptorUpdates);
+    ImGui::Text("uploaded: %.1f KiB", stats.bytesUploaded / 1024.0f);
+    ImGui::Text("allocations: %lu", stats.allocations);
+
+    const auto* profiler = _vulkanContext->getGpuProfiler();
+    const auto pipeline = profiler ? profiler->getResolvedStatistics()
+                                   : std::nullopt;
+    if(!pipeline)
+    {
+        ImGui::Text("No pipeline statistics");
+        return;
+    }
+    ImGui::Text("GPU input primitives: %lu", pipeline->inputPrimitives);
+    ImGui::Text("GPU vertex invocations: %lu", pipeline->vertexInvocations);
+    ImGui::Text("GPU clipping primitives: %lu", pipeline->clippingPrimitives);
+    ImGui::Text(
+            "GPU fragment invocations: %lu", pipeline->fragmentInvocations);
+}
+
+// -----------------------------------------------------------------------------
+//
+//
+
+void Application::writeFrameStats()
+{
+    if(_baseConfig.frameStatsOutput.empty())
+    {
+        return;
+    }
+
+    if(_frameStats.writeCsv(_baseConfig.frameStatsOutput))
+    {
+        _log->info(
+                "Wrote {} frames to {}",
+                _frameStats.getFrames().size(),
+                _baseConfig.frameStatsOutput);
+    }
+    else
+    {
+        _log->error(
+                "Failed to write frame stats to {}",
+                _baseConfig.frameStatsOutput);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Same frame as the mainloop without input and UI. The camera orbits the
+// scene once over the timed frames.
+//
+
+void Application::benchmarkloop()
+{
+    const int frameCount = std::max(_baseConfig.benchmarkFrames, 1);
+    _log->info("Benchmarking {} frames", frameCount);
+
+    _vulkanContext->renderImGui = false;
+    ImGui::GetIO().DisplaySize = ImVec2(
+            static_cast<float>(_frameBufferSize.width),
+            static_cast<float>(_frameBufferSize.height));
+
+    Benchmark benchmark;
+    auto renderFrame = [this, &benchmark](bool timed) {
+        Timer timer;
+        PROFILE_ZONE("Frame");
+        _dispatcher.update();
+
+        _camera->update(BENCHMARK_FRAME_TIME);
+        _scene->updatePositions(_apprunTime);
+        _vulkanContext->updateVisibility(BENCHMARK_FRAME_TIME);
+        _vulkanContext->renderFrame(BENCHMARK_FRAME_TIME);
+
+        if(timed)
+        {
+            const float cpuMs = timer.elapsed() * 1000.0f;
+            const auto timings = _vulkanContext->getFrameTimings();
+            _frameStats.addPhase(utils::FramePhase::Record, timings.recordMs);
+            _frameStats.addPhase(utils::FramePhase::Submit, timings.submitMs);
+            _frameStats.addPhase(
+                    utils::FramePhase::PresentWait, timings.presentWaitMs);
+            _frameStats.endFrame(_frameCounter, cpuMs);
+
+            benchmark.addCpuFrame(cpuMs);
+            // From the frame that finished, frames in flight behind
+            if(auto gpuMs = _vulkanContext->getGpuFrameMs())
+            {
+                benchmark.addGpuFrame(*gpuMs);
+            }
+        }
+        _apprunTime += BENCHMARK_FRAME_TIME;
+        _frameCounter += 1;
+    };
+
+    // The first frame requests the pipelines the scene needs, they are
+    // compiled before timing so compiles don't show up as frame time
+    renderFrame(false);
+    _vulkanContext->waitForPipelines();
+    for(int i = 0; i < BENCHMARK_WARMUP_FRAMES; ++i)
+    {
+        renderFrame(false);
+    }
+
+    const float orbitStep =
+            2.0f * std::numbers::pi_v<float> / static_cast<float>(frameCount);
+    for(int i = 0; i < frameCount; ++i)
+    {
+        _camera->orbit(orbitStep);
+        renderFrame(true);
+    }
+    _vulkanContext->deviceWaitIdle();
+
+    const auto& properties = _vulkanContext->getDevice()->getProperties();
+    const Benchmark::Info info = {
+            .device = properties.deviceName,
+            .width = _frameBufferSize.width,
+            .height = _frameBufferSize.height,
+            .pipelineCreationMs = _vulkanContext->getPipelineCreationMs()};
+
+    benchmark.writeJson(std::cout, info);
+    if(!_baseConfig.benchmarkOutput.empty())
+    {
+        std::ofstream file(_baseConfig.benchmarkOutput);
+        benchmark.writeJson(file, info);
+        if(!file)
+        {
+            _log->error(
+                    "Failed to write benchmark to {}",
+                    _baseConfig.benchmarkOutput);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// A build without the profiler option has no zones, the trace is still
+// written so scripts relying on the file keep working
+//
+
+void Application::writeTrace()
+{
+    if(!PROFILER_ENABLED)
+    {
+        _log->warn("Built without the profiler option, no zones recorded");
+    }
+    if(_baseConfig.traceOutput.empty())
+    {
+        return;
+    }
+
+    if(profiler::writeChromeTrace(_baseConfig.traceOutput))
+    {
+        _log->info("Wrote CPU trace to {}", _baseConfig.traceOutput);
+    }
+    else
+    {
+        _log->error("Failed to write CPU trace to {}", _baseConfig.traceOutput);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // GLFW Error callback
 //
@@ -191,6 +636,11 @@ void Application::handleKeyboardInput(int key, bool isPressed, int mods)
         glfwSetWindowShouldClose(_window.get(), true);
         return;
     }
+    if(key == GLFW_KEY_F9 && isPressed)
+    {
+        writeTrace();
+        return;
+    }
     if(key == GLFW_KEY_LEFT_SHIFT)
     {
         _keyboard.lShift = isPressed;
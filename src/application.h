@@ -7,6 +7,7 @@
 #include "event/sub.h"
 #include "logs/log.h"
 #include "ui/imguilayer.h"
+#include "utils/framestats.h"
 
 #include "entt/entt.hpp"
 #include "vulkan/vulkan.h"
@@ -26,6 +27,18 @@ public:
 private:
     void initilizeGLFW();
     void mainloop();
+    // Headless, renders a scripted orbit and writes the frame times as JSON
+    void benchmarkloop();
+    // Rolling averages and the last resolved frame as a timeline
+    void gpuProfilerWindow();
+    // Histogram, percentiles and hitches of the frame time window, drawn
+    // into the metrics window
+    void frameStatsSection();
+    // Counters of the last frame and its pipeline statistics if resolved
+    void renderStatsSection();
+    void writeFrameStats();
+    // CPU profiler zones of every thread to the configured trace file
+    void writeTrace();
 
     void handleKeyboardInput(int key, bool isPressed, int mods);
     void handleMouseButtonInput(int button, bool isPressed);
@@ -69,6 +82,9 @@ private:
 
     uint64_t _frameCounter = 0;
 
+    // Mainloop frames split into phases
+    utils::FrameStats _frameStats;
+
     // TODO move these away
     struct
     {
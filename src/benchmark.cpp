@@ -0,0 +1,61 @@
+#include "benchmark.h"
+
+#include "utils/statistics.h"
+
+namespace app
+{
+
+namespace
+{
+
+void writeSummary(std::ostream& out, const utils::Summary& summary)
+{
+    out << "{\"mean\": " << summary.mean << ", \"min\": " << summary.min
+        << ", \"p50\": " << summary.p50 << ", \"p90\": " << summary.p90
+        << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99
+        << ", \"max\": " << summary.max << "}";
+}
+
+void writeString(std::ostream& out, const std::string& value)
+{
+    out << '"';
+    for(char c : value)
+    {
+        if(c == '"' || c == '\\')
+        {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Benchmark::writeJson(std::ostream& out, const Info& info) const
+{
+    out << "{\n  \"device\": ";
+    writeString(out, info.device);
+    out << ",\n  \"width\": " << info.width;
+    out << ",\n  \"height\": " << info.height;
+    out << ",\n  \"frames\": " << m_CpuMs.size();
+    out << ",\n  \"pipelineCreationMs\": " << info.pipelineCreationMs;
+    out << ",\n  \"cpuMs\": ";
+    writeSummary(out, utils::summarize(m_CpuMs));
+    out << ",\n  \"gpuMs\": ";
+    if(m_GpuMs.empty())
+    {
+        out << "null";
+    }
+    else
+    {
+        writeSummary(out, utils::summarize(m_GpuMs));
+    }
+    out << "\n}\n";
+}
+
+} // namespace app
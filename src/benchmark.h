@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace app
+{
+
+// Frame times of a headless run, written as JSON so CI can track rendering
+// performance between builds
+class Benchmark final
+{
+public:
+    struct Info
+    {
+        std::string device;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        float pipelineCreationMs = 0.0f;
+    };
+
+    void addCpuFrame(float milliseconds) { m_CpuMs.push_back(milliseconds); }
+    void addGpuFrame(float milliseconds) { m_GpuMs.push_back(milliseconds); }
+
+    // gpuMs is null when the device has no timestamps
+    void writeJson(std::ostream& out, const Info& info) const;
+
+private:
+    std::vector<float> m_CpuMs;
+    std::vector<float> m_GpuMs;
+};
+
+} // namespace app
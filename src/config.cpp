@@ -40,6 +40,24 @@ void Config::init(std::string_view optionalConfigPath)
             auto section = m_IniStruct.get("base");
             fromchars(section.get("width"), config.width);
             fromchars(section.get("height"), config.height);
+            fromchars(section.get("headless"), config.headless);
+            fromchars(section.get("benchmarkframes"), config.benchmarkFrames);
+            if(section.has("benchmarkoutput"))
+            {
+                config.benchmarkOutput = section.get("benchmarkoutput");
+            }
+            if(section.has("traceoutput"))
+            {
+                config.traceOutput = section.get("traceoutput");
+            }
+            fromchars(section.get("traceonexit"), config.traceOnExit);
+            if(section.has("framestatsoutput"))
+            {
+                config.frameStatsOutput = section.get("framestatsoutput");
+            }
+            fromchars(
+                    section.get("framestatsonexit"), config.frameStatsOnExit);
+            fromchars(section.get("scenecars"), config.sceneCars);
         }
         else
         {
@@ -48,6 +66,14 @@ void Config::init(std::string_view optionalConfigPath)
 
         m_Log->info("base::width {}", config.width);
         m_Log->info("base::height {}", config.height);
+        m_Log->info("base::headless {}", config.headless);
+        m_Log->info("base::benchmarkframes {}", config.benchmarkFrames);
+        m_Log->info("base::benchmarkoutput {}", config.benchmarkOutput);
+        m_Log->info("base::traceoutput {}", config.traceOutput);
+        m_Log->info("base::traceonexit {}", config.traceOnExit);
+        m_Log->info("base::framestatsoutput {}", config.frameStatsOutput);
+        m_Log->info("base::framestatsonexit {}", config.frameStatsOnExit);
+        m_Log->info("base::scenecars {}", config.sceneCars);
 
         m_BaseConfig = config;
     }
@@ -58,9 +84,22 @@ void Config::init(std::string_view optionalConfigPath)
         {
             auto section = m_IniStruct.get("vulkan");
             fromchars(section["vsync"], config.vsync);
+            fromchars(section["framesinflight"], config.framesInFlight);
             fromchars(
                     section["validationlayers"], config.enableValidationLayers);
             fromchars(section["debugutils"], config.enableDebugUtils);
+            fromchars(section["indirectdraw"], config.indirectDraw);
+            fromchars(section["instancing"], config.instancing);
+            fromchars(section["gpuculling"], config.gpuCulling);
+            fromchars(
+                    section["occlusionculling"], config.occlusionCulling);
+            fromchars(section["hizculling"], config.hizCulling);
+            fromchars(section["staticdrawcache"], config.staticDrawCache);
+            fromchars(section["shadersfromdisk"], config.shadersFromDisk);
+            if(section.has("pipelinecache"))
+            {
+                config.pipelineCache = section.get("pipelinecache");
+            }
         }
         else
         {
@@ -68,9 +107,18 @@ void Config::init(std::string_view optionalConfigPath)
         }
 
         m_Log->info("vulkan::vsync {}", config.vsync);
+        m_Log->info("vulkan::framesinflight {}", config.framesInFlight);
         m_Log->info(
                 "vulkan::validationlayers {}", config.enableValidationLayers);
         m_Log->info("vulkan::debugutils {}", config.enableDebugUtils);
+        m_Log->info("vulkan::indirectdraw {}", config.indirectDraw);
+        m_Log->info("vulkan::instancing {}", config.instancing);
+        m_Log->info("vulkan::gpuculling {}", config.gpuCulling);
+        m_Log->info("vulkan::occlusionculling {}", config.occlusionCulling);
+        m_Log->info("vulkan::hizculling {}", config.hizCulling);
+        m_Log->info("vulkan::staticdrawcache {}", config.staticDrawCache);
+        m_Log->info("vulkan::pipelinecache {}", config.pipelineCache);
+        m_Log->info("vulkan::shadersfromdisk {}", config.shadersFromDisk);
         m_VulkanConfig = config;
     }
 }
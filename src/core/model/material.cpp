@@ -0,0 +1,49 @@
+#include "core/model/material.h"
+
+namespace core::model
+{
+
+// ----------------------------------------------------------------------------
+// Same tests obj.frag does per fragment in the generic variant
+//
+
+uint32_t getShaderFeatures(const MaterialUbo& material)
+{
+    uint32_t features = shaderfeature::SPECIALIZED;
+    if(material.diffuseTextureID >= 0)
+    {
+        features |= shaderfeature::TEXTURED;
+    }
+    if(material.normalTextureID >= 0)
+    {
+        features |= shaderfeature::NORMAL_MAPPED;
+    }
+    return features
+           | (material.flags
+              & (shaderfeature::ALPHA_TESTED | shaderfeature::UNLIT));
+}
+
+// ----------------------------------------------------------------------------
+// Materials are picked per vertex, a variant can only drop a branch when
+// every material takes the same side of it
+//
+
+uint32_t getShaderFeatures(std::span<const MaterialUbo> materials)
+{
+    if(materials.empty())
+    {
+        return shaderfeature::GENERIC;
+    }
+
+    const uint32_t features = getShaderFeatures(materials.front());
+    for(const auto& material : materials.subspan(1))
+    {
+        if(getShaderFeatures(material) != features)
+        {
+            return shaderfeature::GENERIC;
+        }
+    }
+    return features;
+}
+
+} // namespace core::model
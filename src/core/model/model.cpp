@@ -3,37 +3,45 @@
 #include "logs/log.h"
 #include "tinyobj/tiny_obj_loader.h"
 #include "core/scene/components.h"
+#include "timer/profiler.h"
 #include "utils/stringutils.h"
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
 
 namespace core::model
 {
 
 Model::~Model()
 {
-    if(m_VertexBuffer)
-    {
-        vmaDestroyBuffer(
-                m_Device->getAllocator(), m_VertexBuffer, m_VertexMemory);
-    }
-    if(m_IndexBuffer)
-    {
-        vmaDestroyBuffer(
-                m_Device->getAllocator(), m_IndexBuffer, m_IndexMemory);
-    }
-    if(m_MaterialBuffer)
-    {
-        vmaDestroyBuffer(
-                m_Device->getAllocator(), m_MaterialBuffer, m_MaterialMemory);
-    }
+    // Frames in flight may still draw the model, its arena ranges must not
+    // be handed out again before they finished either
+    m_Device->destroyLater([device = m_Device,
+                            geometry = m_Geometry,
+                            materialBuffer = m_MaterialBuffer,
+                            materialMemory = m_MaterialMemory]() {
+        if(geometry.indexCount > 0)
+        {
+            device->getGeometryArena()->free(geometry);
+        }
+        if(materialBuffer)
+        {
+            vmaDestroyBuffer(
+                    device->getAllocator(), materialBuffer, materialMemory);
+        }
+    });
 }
 
 void Model::load(const std::string& path)
 {
+    PROFILE_ZONE("Model::load");
     tinyobj::ObjReader reader;
     if(!reader.ParseFromFile(path))
     {
@@ -80,6 +88,12 @@ void Model::load(const std::string& path)
         m.dissolve = mat.dissolve;
         m.ior = mat.ior;
         m.illum = mat.illum;
+        // Cut out where the MTL gives an alpha map, dissolve alone keeps
+        // drawing opaque
+        if(!mat.alpha_texname.empty())
+        {
+            m.flags |= shaderfeature::ALPHA_TESTED;
+        }
 
         if(mat.roughness == 0.0f)
         {
@@ -127,6 +141,7 @@ void Model::load(const std::string& path)
     {
         m_Materials.emplace_back(MaterialUbo());
     }
+    m_ShaderFeatures = getShaderFeatures(m_Materials);
 
     for(const auto& shape : shapes)
     {
@@ -200,25 +215,61 @@ void Model::load(const std::string& path)
     }
 
 
-    { // Vertices
-        VkDeviceSize size = sizeof(VertexPNTC) * m_Vertices.size();
-        m_Device->createBufferOnGPU(
-                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                size,
-                &m_VertexBuffer,
-                &m_VertexMemory,
-                m_Vertices.data());
+    if(!m_Vertices.empty())
+    { // Bounding sphere around the AABB center, used for culling
+        glm::vec3 min = m_Vertices.front().p;
+        glm::vec3 max = m_Vertices.front().p;
+        for(const auto& vertex : m_Vertices)
+        {
+            min = glm::min(min, vertex.p);
+            max = glm::max(max, vertex.p);
+        }
+
+        const glm::vec3 center = (min + max) * 0.5f;
+        float radiusSq = 0.0f;
+        for(const auto& vertex : m_Vertices)
+        {
+            const glm::vec3 d = vertex.p - center;
+            radiusSq = std::max(radiusSq, glm::dot(d, d));
+        }
+        m_Bounds = glm::vec4(center, std::sqrt(radiusSq));
     }
 
+    { // Occluder, the same triangles with duplicate positions welded
+        auto occluder = std::make_shared<scene::component::OccluderMesh>();
+        std::map<std::tuple<float, float, float>, uint32_t> welded;
+        occluder->indices.reserve(m_Indices.size());
+        for(auto index : m_Indices)
+        {
+            const auto& p = m_Vertices[index].p;
+            auto [it, inserted] = welded.try_emplace(
+                    std::make_tuple(p.x, p.y, p.z),
+                    static_cast<uint32_t>(occluder->positions.size()));
+            if(inserted)
+            {
+                occluder->positions.push_back(p);
+            }
+            occluder->indices.push_back(it->second);
+        }
+        m_OccluderMesh = std::move(occluder);
+    }
 
-    { // Indices
-        VkDeviceSize size = sizeof(uint32_t) * m_Indices.size();
-        m_Device->createBufferOnGPU(
-                VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                size,
-                &m_IndexBuffer,
-                &m_IndexMemory,
-                m_Indices.data());
+    { // Vertices and indices
+        auto* arena = m_Device->getGeometryArena();
+        assert(arena);
+        assert(arena->getVertexStride() == sizeof(VertexPNTC));
+
+        auto geometry = arena->allocate(
+                m_Vertices.data(),
+                static_cast<uint32_t>(m_Vertices.size()),
+                m_Indices.data(),
+                static_cast<uint32_t>(m_Indices.size()));
+        if(!geometry)
+        {
+            m_Log->critical("Geometry arena is full, can't load {}", path);
+            throw std::runtime_error("Geometry arena is full");
+        }
+        m_Geometry = *geometry;
     }
 
     { // Materials
@@ -239,36 +290,48 @@ void Model::load(const std::string& path)
         texture.loadFromFile(m_Device, file, VK_FORMAT_R8G8B8A8_UNORM);
     }
 
-    std::vector<VkDescriptorImageInfo> infos;
+    m_Infos.clear();
     for(const auto& tex : m_Textures)
     {
         VkDescriptorImageInfo info = {};
         info.sampler = tex.sampler;
         info.imageView = tex.view;
         info.imageLayout = tex.layout;
-        infos.push_back(info);
+        m_Infos.push_back(info);
     }
+}
+
+entt::entity Model::createInstance(const glm::vec3& position)
+{
+    assert(m_Geometry.indexCount > 0);
 
     scene::component::VertexInfo vertexInfo{
-            .numIndices = m_Indices.size(),
-            .vertexBuffer = m_VertexBuffer,
-            .indexBuffer = m_IndexBuffer,
+            .indexCount = m_Geometry.indexCount,
+            .firstIndex = m_Geometry.firstIndex,
+            .vertexOffset = static_cast<int32_t>(m_Geometry.vertexOffset),
     };
 
     scene::component::RenderInfo renderInfo{
             .buffeInfo = {m_MaterialBuffer, 0, VK_WHOLE_SIZE},
-            .imageInfos = std::move(infos)};
+            .imageInfos = m_Infos,
+            .shaderFeatures = m_ShaderFeatures};
 
     auto ent = m_Registry.create();
-    auto transform = glm::mat4{1.0f};
-    auto position = glm::vec3{0.0f, 0.0f, 0.0f};
-
-    glm::translate(transform, position);
-
-    m_Registry.emplace<scene::component::Position>(ent, glm::vec4(position, 0.0f));
-    m_Registry.emplace<scene::component::Transform>(ent, transform);
+    m_Registry.emplace<scene::component::Position>(
+            ent, glm::vec4(position, 1.0f));
+    m_Registry.emplace<scene::component::Transform>(ent, glm::mat4{1.0f});
     m_Registry.emplace<scene::component::VertexInfo>(ent, vertexInfo);
     m_Registry.emplace<scene::component::RenderInfo>(ent, renderInfo);
+    m_Registry.emplace<scene::component::Bounds>(ent, m_Bounds);
+
+    return ent;
+}
+
+void Model::addOccluder(entt::entity entity)
+{
+    assert(m_OccluderMesh);
+    m_Registry.emplace_or_replace<scene::component::Occluder>(
+            entity, m_OccluderMesh);
 }
 
 } // namespace core::model
@@ -68,6 +68,15 @@ void TrackBall::updateRotation(float dtheta, float dphi)
 //
 //
 
+void TrackBall::orbit(float radians)
+{
+    updateRotation(radians / m_MouseSensitivity, 0.0f);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
 void TrackBall::updateZoom(float dradius)
 {
     m_Radius -= dradius * m_ScrollSensitivity;
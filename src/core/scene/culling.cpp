@@ -0,0 +1,343 @@
+#include "core/scene/culling.h"
+#include "core/scene/components.h"
+#include "core/workqueue.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <future>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define CULLING_SSE 1
+#if defined(__GNUC__)
+#define CULLING_AVX 1
+#endif
+#endif
+
+namespace core::scene
+{
+
+namespace
+{
+
+// ----------------------------------------------------------------------------
+// Append the set bits of an inside mask as sphere indices
+//
+
+inline size_t writeMask(
+        uint32_t mask, size_t base, uint32_t* visible, size_t count)
+{
+    while(mask != 0)
+    {
+        visible[count++] = static_cast<uint32_t>(base + std::countr_zero(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+#if CULLING_SSE
+
+// ----------------------------------------------------------------------------
+// 4 spheres per iteration, a sphere is inside when its signed distance to
+// every plane is >= -radius
+//
+
+size_t cullSpheresSSE(
+        const SphereSoA& spheres,
+        const Frustum& frustum,
+        size_t begin,
+        size_t end,
+        uint32_t* visible)
+{
+    __m128 a[Frustum::Count];
+    __m128 b[Frustum::Count];
+    __m128 c[Frustum::Count];
+    __m128 d[Frustum::Count];
+    for(size_t p = 0; p < Frustum::Count; ++p)
+    {
+        a[p] = _mm_set1_ps(frustum.planes[p].x);
+        b[p] = _mm_set1_ps(frustum.planes[p].y);
+        c[p] = _mm_set1_ps(frustum.planes[p].z);
+        d[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    size_t count = 0;
+    size_t i = begin;
+    for(; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(spheres.x.data() + i);
+        const __m128 y = _mm_loadu_ps(spheres.y.data() + i);
+        const __m128 z = _mm_loadu_ps(spheres.z.data() + i);
+        const __m128 negRadius = _mm_sub_ps(
+                _mm_setzero_ps(), _mm_loadu_ps(spheres.radius.data() + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(size_t p = 0; p < Frustum::Count; ++p)
+        {
+            __m128 dist = _mm_add_ps(_mm_mul_ps(a[p], x), d[p]);
+            dist = _mm_add_ps(dist, _mm_mul_ps(b[p], y));
+            dist = _mm_add_ps(dist, _mm_mul_ps(c[p], z));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negRadius));
+        }
+
+        count = writeMask(
+                static_cast<uint32_t>(_mm_movemask_ps(inside)),
+                i,
+                visible,
+                count);
+    }
+
+    return count + cullSpheresScalar(spheres, frustum, i, end, visible + count);
+}
+
+#endif
+
+#if CULLING_AVX
+
+// ----------------------------------------------------------------------------
+// 8 spheres per iteration, only called when the CPU reports AVX
+//
+
+__attribute__((target("avx"))) size_t cullSpheresAVX(
+        const SphereSoA& spheres,
+        const Frustum& frustum,
+        size_t begin,
+        size_t end,
+        uint32_t* visible)
+{
+    __m256 a[Frustum::Count];
+    __m256 b[Frustum::Count];
+    __m256 c[Frustum::Count];
+    __m256 d[Frustum::Count];
+    for(size_t p = 0; p < Frustum::Count; ++p)
+    {
+        a[p] = _mm256_set1_ps(frustum.planes[p].x);
+        b[p] = _mm256_set1_ps(frustum.planes[p].y);
+        c[p] = _mm256_set1_ps(frustum.planes[p].z);
+        d[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    size_t count = 0;
+    size_t i = begin;
+    for(; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(spheres.x.data() + i);
+        const __m256 y = _mm256_loadu_ps(spheres.y.data() + i);
+        const __m256 z = _mm256_loadu_ps(spheres.z.data() + i);
+        const __m256 negRadius = _mm256_sub_ps(
+                _mm256_setzero_ps(),
+                _mm256_loadu_ps(spheres.radius.data() + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(size_t p = 0; p < Frustum::Count; ++p)
+        {
+            __m256 dist = _mm256_add_ps(_mm256_mul_ps(a[p], x), d[p]);
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(b[p], y));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(c[p], z));
+            inside = _mm256_and_ps(
+                    inside, _mm256_cmp_ps(dist, negRadius, _CMP_GE_OQ));
+        }
+
+        count = writeMask(
+                static_cast<uint32_t>(_mm256_movemask_ps(inside)),
+                i,
+                visible,
+                count);
+    }
+
+    return count + cullSpheresScalar(spheres, frustum, i, end, visible + count);
+}
+
+#endif
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+size_t cullSpheresScalar(
+        const SphereSoA& spheres,
+        const Frustum& frustum,
+        size_t begin,
+        size_t end,
+        uint32_t* visible)
+{
+    assert(end <= spheres.size());
+
+    size_t count = 0;
+    for(size_t i = begin; i < end; ++i)
+    {
+        const glm::vec3 center(spheres.x[i], spheres.y[i], spheres.z[i]);
+        if(frustum.intersectsSphere(center, spheres.radius[i]))
+        {
+            visible[count++] = static_cast<uint32_t>(i);
+        }
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+size_t cullSpheres(
+        const SphereSoA& spheres,
+        const Frustum& frustum,
+        size_t begin,
+        size_t end,
+        uint32_t* visible)
+{
+    assert(begin <= end);
+    assert(end <= spheres.size());
+
+#if CULLING_AVX
+    static const bool hasAvx = __builtin_cpu_supports("avx");
+    if(hasAvx)
+    {
+        return cullSpheresAVX(spheres, frustum, begin, end, visible);
+    }
+#endif
+
+#if CULLING_SSE
+    return cullSpheresSSE(spheres, frustum, begin, end, visible);
+#else
+    return cullSpheresScalar(spheres, frustum, begin, end, visible);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void CullingSystem::update(const entt::registry& registry)
+{
+    m_Entities.clear();
+
+    auto view = registry.view<
+            const component::Bounds,
+            const component::Position,
+            const component::Transform>();
+    for(auto entity : view)
+    {
+        m_Entities.push_back(entity);
+    }
+
+    const size_t count = m_Entities.size();
+    m_Spheres.resize(count);
+
+    // The calling thread takes the first chunk, the rest go to the workers
+    std::vector<std::future<void>> jobs;
+    for(size_t begin = ENTITIES_PER_JOB; begin < count;
+        begin += ENTITIES_PER_JOB)
+    {
+        const size_t end = std::min(begin + ENTITIES_PER_JOB, count);
+        jobs.push_back(getWorkQueue().submitWork(
+                [this, &registry, begin, end]() {
+                    updateRange(registry, begin, end);
+                }));
+    }
+
+    updateRange(registry, 0, std::min(ENTITIES_PER_JOB, count));
+
+    for(auto& job : jobs)
+    {
+        job.get();
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+glm::vec4 toWorldSphere(
+        const glm::vec4& sphere,
+        const glm::vec4& position,
+        const glm::mat4& transform)
+{
+    if(sphere.w < 0.0f)
+    {
+        // No bounds, never culled
+        return glm::vec4(
+                glm::vec3(position), std::numeric_limits<float>::infinity());
+    }
+
+    const glm::vec3 center =
+            glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f))
+            + glm::vec3(position);
+    const float scale = std::max(
+            {glm::length(glm::vec3(transform[0])),
+             glm::length(glm::vec3(transform[1])),
+             glm::length(glm::vec3(transform[2]))});
+
+    return glm::vec4(center, sphere.w * scale);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void CullingSystem::updateRange(
+        const entt::registry& registry, size_t begin, size_t end)
+{
+    for(size_t i = begin; i < end; ++i)
+    {
+        const auto entity = m_Entities[i];
+        const glm::vec4 sphere = toWorldSphere(
+                registry.get<component::Bounds>(entity).sphere,
+                registry.get<component::Position>(entity).pos,
+                registry.get<component::Transform>(entity).transform);
+
+        m_Spheres.set(i, glm::vec3(sphere), sphere.w);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void CullingSystem::cull(const Frustum& frustum)
+{
+    const size_t count = m_Entities.size();
+    m_VisibleIndices.resize(count);
+    m_Visible.clear();
+
+    // Every chunk writes its indices at its own offset, then they are
+    // gathered in order
+    auto cullRange = [this, &frustum](size_t begin, size_t end) {
+        return cullSpheres(
+                m_Spheres,
+                frustum,
+                begin,
+                end,
+                m_VisibleIndices.data() + begin);
+    };
+
+    std::vector<std::future<size_t>> jobs;
+    for(size_t begin = ENTITIES_PER_JOB; begin < count;
+        begin += ENTITIES_PER_JOB)
+    {
+        const size_t end = std::min(begin + ENTITIES_PER_JOB, count);
+        jobs.push_back(getWorkQueue().submitWork(cullRange, begin, end));
+    }
+
+    const size_t firstCount = cullRange(0, std::min(ENTITIES_PER_JOB, count));
+    for(size_t i = 0; i < firstCount; ++i)
+    {
+        m_Visible.push_back(m_Entities[m_VisibleIndices[i]]);
+    }
+
+    for(size_t job = 0; job < jobs.size(); ++job)
+    {
+        const size_t begin = (job + 1) * ENTITIES_PER_JOB;
+        const size_t visibleCount = jobs[job].get();
+        for(size_t i = begin; i < begin + visibleCount; ++i)
+        {
+            m_Visible.push_back(m_Entities[m_VisibleIndices[i]]);
+        }
+    }
+}
+
+} // namespace core::scene
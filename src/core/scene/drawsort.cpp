@@ -0,0 +1,201 @@
+#include "core/scene/drawsort.h"
+#include "core/workqueue.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <future>
+
+namespace core::scene
+{
+
+namespace
+{
+
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX = 1u << RADIX_BITS;
+constexpr uint32_t DIGITS = 64 / RADIX_BITS;
+// Below this a single thread is faster than splitting the work
+constexpr size_t PACKETS_PER_JOB = 1u << 14;
+
+using Histogram = std::array<size_t, RADIX>;
+
+// ----------------------------------------------------------------------------
+//
+//
+
+constexpr uint32_t digitOf(uint64_t key, uint32_t digit)
+{
+    return static_cast<uint32_t>(key >> (digit * RADIX_BITS)) & (RADIX - 1);
+}
+
+// ----------------------------------------------------------------------------
+// Run fn(chunk) for every chunk, the calling thread takes the first one
+//
+
+template<class Fn> void forEachChunk(size_t chunkCount, Fn&& fn)
+{
+    std::vector<std::future<void>> jobs;
+    for(size_t chunk = 1; chunk < chunkCount; ++chunk)
+    {
+        jobs.push_back(getWorkQueue().submitWork([&fn, chunk]() { fn(chunk); }));
+    }
+
+    fn(0);
+
+    for(auto& job : jobs)
+    {
+        job.get();
+    }
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Bit patterns of non-negative floats sort like the floats themselves
+//
+
+uint32_t sortkey::quantizeDepth(float depth)
+{
+    if(!(depth > 0.0f))
+    {
+        return 0;
+    }
+    return std::bit_cast<uint32_t>(depth) >> (32 - DEPTH_BITS);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+uint64_t sortkey::make(
+        Pass pass,
+        uint32_t pipeline,
+        uint32_t material,
+        uint32_t mesh,
+        float depth)
+{
+    assert(pipeline < MAX_PIPELINES);
+    assert(material < MAX_MATERIALS);
+    assert(mesh < MAX_MESHES);
+
+    constexpr uint32_t maxDepth = (1u << DEPTH_BITS) - 1;
+    uint32_t depthBits = quantizeDepth(depth);
+    if(pass == Pass::Transparent)
+    {
+        depthBits = maxDepth - depthBits;
+    }
+
+    return (static_cast<uint64_t>(pass) << PASS_SHIFT)
+           | (uint64_t{pipeline} << PIPELINE_SHIFT)
+           | (uint64_t{material} << MATERIAL_SHIFT)
+           | (uint64_t{mesh} << MESH_SHIFT) | depthBits;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void radixSort(
+        std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch)
+{
+    const size_t count = packets.size();
+    if(count < 2)
+    {
+        return;
+    }
+    scratch.resize(count);
+
+    const size_t chunkCount = (count + PACKETS_PER_JOB - 1) / PACKETS_PER_JOB;
+    std::vector<size_t> chunkBegin(chunkCount + 1);
+    for(size_t chunk = 0; chunk <= chunkCount; ++chunk)
+    {
+        chunkBegin[chunk] = count * chunk / chunkCount;
+    }
+
+    // Digit counts don't change between passes, one read finds the digits
+    // where every key falls in the same bucket
+    std::vector<std::array<Histogram, DIGITS>> digitCounts(chunkCount);
+    forEachChunk(chunkCount, [&](size_t chunk) {
+        auto& counts = digitCounts[chunk];
+        for(auto& histogram : counts)
+        {
+            histogram.fill(0);
+        }
+        const size_t end = chunkBegin[chunk + 1];
+        for(size_t i = chunkBegin[chunk]; i < end; ++i)
+        {
+            const uint64_t key = packets[i].key;
+            for(uint32_t digit = 0; digit < DIGITS; ++digit)
+            {
+                counts[digit][digitOf(key, digit)] += 1;
+            }
+        }
+    });
+
+    std::vector<Histogram> offsets(chunkCount);
+    for(uint32_t digit = 0; digit < DIGITS; ++digit)
+    {
+        Histogram total = {};
+        for(const auto& counts : digitCounts)
+        {
+            for(uint32_t bucket = 0; bucket < RADIX; ++bucket)
+            {
+                total[bucket] += counts[digit][bucket];
+            }
+        }
+        if(std::find(total.begin(), total.end(), count) != total.end())
+        {
+            continue;
+        }
+
+        // Chunk histograms for this digit in the current order, a single
+        // chunk is the whole input and already counted
+        if(chunkCount == 1)
+        {
+            offsets[0] = total;
+        }
+        else
+        {
+            forEachChunk(chunkCount, [&](size_t chunk) {
+                Histogram histogram = {};
+                const size_t end = chunkBegin[chunk + 1];
+                for(size_t i = chunkBegin[chunk]; i < end; ++i)
+                {
+                    histogram[digitOf(packets[i].key, digit)] += 1;
+                }
+                offsets[chunk] = histogram;
+            });
+        }
+
+        // Bucket major, chunk minor so equal digits keep their order
+        size_t offset = 0;
+        for(uint32_t bucket = 0; bucket < RADIX; ++bucket)
+        {
+            for(auto& histogram : offsets)
+            {
+                const size_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+        }
+
+        forEachChunk(chunkCount, [&](size_t chunk) {
+            // Local copy, writes through scratch could alias it otherwise
+            Histogram next = offsets[chunk];
+            const DrawPacket* src = packets.data();
+            DrawPacket* dst = scratch.data();
+            const size_t end = chunkBegin[chunk + 1];
+            for(size_t i = chunkBegin[chunk]; i < end; ++i)
+            {
+                const DrawPacket packet = src[i];
+                dst[next[digitOf(packet.key, digit)]++] = packet;
+            }
+        });
+
+        packets.swap(scratch);
+    }
+}
+
+} // namespace core::scene
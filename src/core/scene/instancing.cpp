@@ -0,0 +1,255 @@
+#include "core/scene/instancing.h"
+#include "core/scene/components.h"
+#include "core/workqueue.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <future>
+#include <stdexcept>
+
+namespace core::scene
+{
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void InstanceBatcher::build(
+        entt::registry& registry, const glm::vec3& viewPosition)
+{
+    m_Entities.clear();
+    m_Packets.clear();
+
+    auto view = registry.view<
+            component::VertexInfo,
+            component::RenderInfo,
+            component::Position,
+            component::Transform>();
+
+    for(auto entity : view)
+    {
+        addInstance(registry, entity, viewPosition);
+    }
+
+    sortBatches(registry);
+}
+
+// ----------------------------------------------------------------------------
+// Same as above but only for the given entities, e.g. the output of the
+// culling system
+//
+
+void InstanceBatcher::build(
+        entt::registry& registry,
+        const std::vector<entt::entity>& entities,
+        const glm::vec3& viewPosition)
+{
+    m_Entities.clear();
+    m_Packets.clear();
+
+    for(auto entity : entities)
+    {
+        if(registry.all_of<
+                   component::VertexInfo,
+                   component::RenderInfo,
+                   component::Position,
+                   component::Transform>(entity))
+        {
+            addInstance(registry, entity, viewPosition);
+        }
+    }
+
+    sortBatches(registry);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void InstanceBatcher::addInstance(
+        const entt::registry& registry,
+        entt::entity entity,
+        const glm::vec3& viewPosition)
+{
+    const auto& vertexInfo = registry.get<component::VertexInfo>(entity);
+    const auto& renderInfo = registry.get<component::RenderInfo>(entity);
+    const auto& position = registry.get<component::Position>(entity);
+
+    // Shader variants are the only pipelines the scene is drawn with
+    const glm::vec3 toEntity = glm::vec3(position.pos) - viewPosition;
+    const uint64_t key = sortkey::make(
+            sortkey::Pass::Opaque,
+            renderInfo.shaderFeatures,
+            getMaterialId(renderInfo.buffeInfo.buffer),
+            getMeshId(vertexInfo.firstIndex, vertexInfo.vertexOffset),
+            glm::dot(toEntity, toEntity));
+
+    m_Packets.push_back({key, static_cast<uint32_t>(m_Entities.size())});
+    m_Entities.push_back(entity);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+uint32_t InstanceBatcher::getMaterialId(VkBuffer materials)
+{
+    auto [it, inserted] = m_MaterialIds.try_emplace(
+            materials, static_cast<uint32_t>(m_MaterialIds.size()));
+    if(it->second >= sortkey::MAX_MATERIALS)
+    {
+        assert(false);
+        throw std::runtime_error("Too many materials for the draw sort key");
+    }
+    return it->second;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+uint32_t InstanceBatcher::getMeshId(uint32_t firstIndex, int32_t vertexOffset)
+{
+    const uint64_t mesh = (uint64_t{firstIndex} << 32)
+                          | static_cast<uint32_t>(vertexOffset);
+    auto [it, inserted] = m_MeshIds.try_emplace(
+            mesh, static_cast<uint32_t>(m_MeshIds.size()));
+    if(it->second >= sortkey::MAX_MESHES)
+    {
+        assert(false);
+        throw std::runtime_error("Too many meshes for the draw sort key");
+    }
+    return it->second;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void InstanceBatcher::sortBatches(const entt::registry& registry)
+{
+    radixSort(m_Packets, m_Scratch);
+
+    m_Sorted.resize(m_Packets.size());
+    m_Batches.clear();
+
+    for(size_t i = 0; i < m_Packets.size(); ++i)
+    {
+        auto& instance = m_Sorted[i];
+        instance.entity = m_Entities[m_Packets[i].index];
+
+        // Sorted, so a new batch starts whenever anything but depth changes
+        if(i == 0 || !m_Instancing
+           || sortkey::stateBits(m_Packets[i - 1].key)
+                      != sortkey::stateBits(m_Packets[i].key))
+        {
+            const auto& vertexInfo =
+                    registry.get<component::VertexInfo>(instance.entity);
+
+            InstanceBatch batch;
+            batch.indexCount = vertexInfo.indexCount;
+            batch.firstIndex = vertexInfo.firstIndex;
+            batch.vertexOffset = vertexInfo.vertexOffset;
+            batch.firstInstance = m_FirstInstance + static_cast<uint32_t>(i);
+            batch.variant =
+                    registry.get<component::RenderInfo>(instance.entity)
+                            .shaderFeatures;
+            m_Batches.push_back(batch);
+        }
+
+        instance.batchIndex =
+                m_FirstCommand + static_cast<uint32_t>(m_Batches.size() - 1);
+        m_Batches.back().instanceCount += 1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void InstanceBatcher::write(
+        const entt::registry& registry,
+        InstanceData* instances,
+        VkDrawIndexedIndirectCommand* commands) const
+{
+    const size_t count = m_Sorted.size();
+
+    // The calling thread takes the first chunk, the rest go to the workers
+    std::vector<std::future<void>> jobs;
+    for(size_t begin = INSTANCES_PER_JOB; begin < count;
+        begin += INSTANCES_PER_JOB)
+    {
+        const size_t end = std::min(begin + INSTANCES_PER_JOB, count);
+        jobs.push_back(getWorkQueue().submitWork(
+                [this, &registry, instances, begin, end]() {
+                    writeInstances(registry, instances, begin, end);
+                }));
+    }
+
+    for(size_t i = 0; i < m_Batches.size(); ++i)
+    {
+        const auto& batch = m_Batches[i];
+        auto& command = commands[m_FirstCommand + i];
+        command.indexCount = batch.indexCount;
+        command.instanceCount = batch.instanceCount;
+        command.firstIndex = batch.firstIndex;
+        command.vertexOffset = batch.vertexOffset;
+        command.firstInstance = batch.firstInstance;
+    }
+
+    writeInstances(
+            registry, instances, 0, std::min(INSTANCES_PER_JOB, count));
+
+    for(auto& job : jobs)
+    {
+        job.get();
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void InstanceBatcher::writeInstances(
+        const entt::registry& registry,
+        InstanceData* instances,
+        size_t begin,
+        size_t end) const
+{
+    for(size_t i = begin; i < end; ++i)
+    {
+        const auto entity = m_Sorted[i].entity;
+        const auto& position = registry.get<component::Position>(entity);
+        const auto& transform = registry.get<component::Transform>(entity);
+
+        InstanceData instance;
+        instance.transform =
+                glm::translate(glm::mat4(1.0f), glm::vec3(position.pos))
+                * transform.transform;
+        instance.entityId = entt::to_integral(entity);
+        instance.batchIndex = m_Sorted[i].batchIndex;
+        if(const auto* slot =
+                   registry.try_get<component::VisibilitySlot>(entity))
+        {
+            instance.visibilityIndex = slot->index;
+        }
+        if(const auto* bounds = registry.try_get<component::Bounds>(entity))
+        {
+            instance.boundingSphere = bounds->sphere;
+        }
+        if(const auto* material =
+                   registry.try_get<component::MaterialOverride>(entity))
+        {
+            instance.materialOverride = material->materialId;
+        }
+
+        // Write whole instances, the destination is write combined memory
+        instances[m_FirstInstance + i] = instance;
+    }
+}
+
+} // namespace core::scene
@@ -0,0 +1,453 @@
+#include "core/scene/occlusion.h"
+#include "core/scene/culling.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define OCCLUSION_AVX 1
+#endif
+#endif
+
+namespace core::scene
+{
+
+namespace
+{
+
+// Clip space w below this is treated as crossing the near plane
+constexpr float MIN_W = 1e-5f;
+
+struct TriangleSetup
+{
+    // Edge functions a * x + b * y + c, a pixel center is inside when all
+    // three are >= 0
+    float a[3];
+    float b[3];
+    float c[3];
+    // Depth plane za * x + zb * y + zc
+    float za;
+    float zb;
+    float zc;
+    // Inclusive pixel bounds, clamped to the buffer
+    int32_t minX;
+    int32_t maxX;
+    int32_t minY;
+    int32_t maxY;
+};
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void rasterizeScalar(const TriangleSetup& t, float* depth)
+{
+    for(int32_t y = t.minY; y <= t.maxY; ++y)
+    {
+        const float py = static_cast<float>(y) + 0.5f;
+        const float row0 = t.b[0] * py + t.c[0];
+        const float row1 = t.b[1] * py + t.c[1];
+        const float row2 = t.b[2] * py + t.c[2];
+        const float rowZ = t.zb * py + t.zc;
+
+        float* row = depth + y * OcclusionCuller::WIDTH;
+        for(int32_t x = t.minX; x <= t.maxX; ++x)
+        {
+            const float px = static_cast<float>(x) + 0.5f;
+            if(t.a[0] * px + row0 >= 0.0f && t.a[1] * px + row1 >= 0.0f
+               && t.a[2] * px + row2 >= 0.0f)
+            {
+                row[x] = std::min(row[x], t.za * px + rowZ);
+            }
+        }
+    }
+}
+
+#if OCCLUSION_AVX
+
+// ----------------------------------------------------------------------------
+// Same math as the scalar version on 8 pixels of a row at a time, the buffer
+// width is a multiple of 8 so a span never leaves the row
+//
+
+__attribute__((target("avx"))) void rasterizeAVX(
+        const TriangleSetup& t, float* depth)
+{
+    const __m256 laneOffsets =
+            _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 a0 = _mm256_set1_ps(t.a[0]);
+    const __m256 a1 = _mm256_set1_ps(t.a[1]);
+    const __m256 a2 = _mm256_set1_ps(t.a[2]);
+    const __m256 za = _mm256_set1_ps(t.za);
+    const __m256 minPx = _mm256_set1_ps(static_cast<float>(t.minX) + 0.5f);
+    const __m256 maxPx = _mm256_set1_ps(static_cast<float>(t.maxX) + 0.5f);
+
+    const int32_t startX = t.minX & ~int32_t(7);
+
+    for(int32_t y = t.minY; y <= t.maxY; ++y)
+    {
+        const float py = static_cast<float>(y) + 0.5f;
+        const __m256 row0 = _mm256_set1_ps(t.b[0] * py + t.c[0]);
+        const __m256 row1 = _mm256_set1_ps(t.b[1] * py + t.c[1]);
+        const __m256 row2 = _mm256_set1_ps(t.b[2] * py + t.c[2]);
+        const __m256 rowZ = _mm256_set1_ps(t.zb * py + t.zc);
+
+        float* row = depth + y * OcclusionCuller::WIDTH;
+        for(int32_t x = startX; x <= t.maxX; x += 8)
+        {
+            const __m256 px = _mm256_add_ps(
+                    _mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+
+            // Lanes outside the bounds are masked so the result matches the
+            // scalar loop exactly
+            __m256 inside = _mm256_and_ps(
+                    _mm256_cmp_ps(px, minPx, _CMP_GE_OQ),
+                    _mm256_cmp_ps(px, maxPx, _CMP_LE_OQ));
+            inside = _mm256_and_ps(
+                    inside,
+                    _mm256_cmp_ps(
+                            _mm256_add_ps(_mm256_mul_ps(a0, px), row0),
+                            zero,
+                            _CMP_GE_OQ));
+            inside = _mm256_and_ps(
+                    inside,
+                    _mm256_cmp_ps(
+                            _mm256_add_ps(_mm256_mul_ps(a1, px), row1),
+                            zero,
+                            _CMP_GE_OQ));
+            inside = _mm256_and_ps(
+                    inside,
+                    _mm256_cmp_ps(
+                            _mm256_add_ps(_mm256_mul_ps(a2, px), row2),
+                            zero,
+                            _CMP_GE_OQ));
+
+            if(_mm256_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            const __m256 z = _mm256_add_ps(_mm256_mul_ps(za, px), rowZ);
+            const __m256 current = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(
+                    row + x,
+                    _mm256_blendv_ps(
+                            current, _mm256_min_ps(current, z), inside));
+        }
+    }
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+//
+//
+
+glm::vec3 toScreen(const glm::vec4& clip)
+{
+    const float invW = 1.0f / clip.w;
+    return glm::vec3(
+            (clip.x * invW * 0.5f + 0.5f) * OcclusionCuller::WIDTH,
+            (clip.y * invW * 0.5f + 0.5f) * OcclusionCuller::HEIGHT,
+            clip.z * invW);
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+OcclusionCuller::OcclusionCuller() :
+    m_Depth(WIDTH * HEIGHT, 1.0f), m_TileMaxDepth(TILES_X * TILES_Y, 1.0f)
+{
+    static_assert(WIDTH % TILE_WIDTH == 0 && HEIGHT % TILE_HEIGHT == 0);
+    static_assert(WIDTH % 8 == 0, "SIMD spans must not cross rows");
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void OcclusionCuller::update(
+        const entt::registry& registry,
+        const glm::mat4& viewProj,
+        const std::vector<entt::entity>& candidates)
+{
+    clear();
+
+    m_OccluderCount = 0;
+    for(auto entity : candidates)
+    {
+        const auto* occluder = registry.try_get<component::Occluder>(entity);
+        if(!occluder || !occluder->mesh)
+        {
+            continue;
+        }
+
+        const auto& position = registry.get<component::Position>(entity).pos;
+        const auto& transform =
+                registry.get<component::Transform>(entity).transform;
+        const glm::mat4 model =
+                glm::translate(glm::mat4(1.0f), glm::vec3(position))
+                * transform;
+
+        rasterize(viewProj * model, *occluder->mesh);
+        m_OccluderCount += 1;
+    }
+
+    finalize();
+
+    m_Visible.clear();
+    for(auto entity : candidates)
+    {
+        const auto* bounds = registry.try_get<component::Bounds>(entity);
+        if(!bounds)
+        {
+            m_Visible.push_back(entity);
+            continue;
+        }
+
+        const glm::vec4 sphere = toWorldSphere(
+                bounds->sphere,
+                registry.get<component::Position>(entity).pos,
+                registry.get<component::Transform>(entity).transform);
+        const glm::vec3 center(sphere);
+        const glm::vec3 extent(sphere.w);
+
+        if(std::isinf(sphere.w)
+           || isVisible(viewProj, center - extent, center + extent))
+        {
+            m_Visible.push_back(entity);
+        }
+    }
+
+    m_CulledCount = candidates.size() - m_Visible.size();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void OcclusionCuller::clear()
+{
+    std::fill(m_Depth.begin(), m_Depth.end(), 1.0f);
+    std::fill(m_TileMaxDepth.begin(), m_TileMaxDepth.end(), 1.0f);
+}
+
+// ----------------------------------------------------------------------------
+// Triangles touching the near plane are dropped rather than clipped, missing
+// occluders only make the culling less effective
+//
+
+void OcclusionCuller::rasterize(
+        const glm::mat4& mvp, const component::OccluderMesh& mesh)
+{
+    assert(mesh.indices.size() % 3 == 0);
+
+    m_ClipPositions.resize(mesh.positions.size());
+    for(size_t i = 0; i < mesh.positions.size(); ++i)
+    {
+        m_ClipPositions[i] = mvp * glm::vec4(mesh.positions[i], 1.0f);
+    }
+
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const auto& c0 = m_ClipPositions[mesh.indices[i + 0]];
+        const auto& c1 = m_ClipPositions[mesh.indices[i + 1]];
+        const auto& c2 = m_ClipPositions[mesh.indices[i + 2]];
+
+        if(c0.w < MIN_W || c1.w < MIN_W || c2.w < MIN_W || c0.z < 0.0f
+           || c1.z < 0.0f || c2.z < 0.0f)
+        {
+            continue;
+        }
+
+        rasterizeTriangle(toScreen(c0), toScreen(c1), toScreen(c2));
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void OcclusionCuller::rasterizeTriangle(
+        const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+{
+    // Both windings are drawn, the projection may mirror the screen
+    glm::vec3 v[3] = {v0, v1, v2};
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y)
+                 - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+    if(area < 0.0f)
+    {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+    if(area < 1e-6f)
+    {
+        return;
+    }
+
+    const float minX = std::max(
+            0.0f, std::ceil(std::min({v[0].x, v[1].x, v[2].x}) - 0.5f));
+    const float maxX = std::min(
+            static_cast<float>(WIDTH - 1),
+            std::floor(std::max({v[0].x, v[1].x, v[2].x}) - 0.5f));
+    const float minY = std::max(
+            0.0f, std::ceil(std::min({v[0].y, v[1].y, v[2].y}) - 0.5f));
+    const float maxY = std::min(
+            static_cast<float>(HEIGHT - 1),
+            std::floor(std::max({v[0].y, v[1].y, v[2].y}) - 0.5f));
+    if(minX > maxX || minY > maxY)
+    {
+        // Between pixel centers or off screen
+        return;
+    }
+
+    TriangleSetup setup;
+    setup.minX = static_cast<int32_t>(minX);
+    setup.maxX = static_cast<int32_t>(maxX);
+    setup.minY = static_cast<int32_t>(minY);
+    setup.maxY = static_cast<int32_t>(maxY);
+
+    // Edge i is opposite of vertex i and evaluates to area at it
+    for(int i = 0; i < 3; ++i)
+    {
+        const auto& from = v[(i + 1) % 3];
+        const auto& to = v[(i + 2) % 3];
+        setup.a[i] = from.y - to.y;
+        setup.b[i] = to.x - from.x;
+        setup.c[i] = -(setup.a[i] * from.x + setup.b[i] * from.y);
+    }
+
+    const float invArea = 1.0f / area;
+    setup.za = (setup.a[0] * v[0].z + setup.a[1] * v[1].z + setup.a[2] * v[2].z)
+               * invArea;
+    setup.zb = (setup.b[0] * v[0].z + setup.b[1] * v[1].z + setup.b[2] * v[2].z)
+               * invArea;
+    setup.zc = (setup.c[0] * v[0].z + setup.c[1] * v[1].z + setup.c[2] * v[2].z)
+               * invArea;
+
+#if OCCLUSION_AVX
+    static const bool hasAvx = __builtin_cpu_supports("avx");
+    if(m_UseSimd && hasAvx)
+    {
+        rasterizeAVX(setup, m_Depth.data());
+        return;
+    }
+#endif
+
+    rasterizeScalar(setup, m_Depth.data());
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void OcclusionCuller::finalize()
+{
+    for(uint32_t ty = 0; ty < TILES_Y; ++ty)
+    {
+        for(uint32_t tx = 0; tx < TILES_X; ++tx)
+        {
+            float maxDepth = 0.0f;
+            for(uint32_t y = ty * TILE_HEIGHT; y < (ty + 1) * TILE_HEIGHT; ++y)
+            {
+                const float* row = m_Depth.data() + y * WIDTH + tx * TILE_WIDTH;
+                maxDepth = std::max(
+                        maxDepth, *std::max_element(row, row + TILE_WIDTH));
+            }
+            m_TileMaxDepth[ty * TILES_X + tx] = maxDepth;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+bool OcclusionCuller::isVisible(
+        const glm::mat4& viewProj,
+        const glm::vec3& min,
+        const glm::vec3& max) const
+{
+    float minX = static_cast<float>(WIDTH);
+    float maxX = 0.0f;
+    float minY = static_cast<float>(HEIGHT);
+    float maxY = 0.0f;
+    float minZ = 1.0f;
+
+    for(int corner = 0; corner < 8; ++corner)
+    {
+        const glm::vec4 clip =
+                viewProj
+                * glm::vec4(
+                        (corner & 1) ? max.x : min.x,
+                        (corner & 2) ? max.y : min.y,
+                        (corner & 4) ? max.z : min.z,
+                        1.0f);
+        if(clip.w < MIN_W)
+        {
+            return true;
+        }
+
+        const glm::vec3 screen = toScreen(clip);
+        minX = std::min(minX, screen.x);
+        maxX = std::max(maxX, screen.x);
+        minY = std::min(minY, screen.y);
+        maxY = std::max(maxY, screen.y);
+        minZ = std::min(minZ, screen.z);
+    }
+
+    if(minZ <= 0.0f || maxX < 0.0f || maxY < 0.0f
+       || minX >= static_cast<float>(WIDTH)
+       || minY >= static_cast<float>(HEIGHT))
+    {
+        return true;
+    }
+
+    // Every pixel the box touches
+    const auto x0 = static_cast<uint32_t>(std::max(0.0f, std::floor(minX)));
+    const auto y0 = static_cast<uint32_t>(std::max(0.0f, std::floor(minY)));
+    const auto x1 = static_cast<uint32_t>(
+            std::min(static_cast<float>(WIDTH - 1), std::floor(maxX)));
+    const auto y1 = static_cast<uint32_t>(
+            std::min(static_cast<float>(HEIGHT - 1), std::floor(maxY)));
+
+    for(uint32_t ty = y0 / TILE_HEIGHT; ty <= y1 / TILE_HEIGHT; ++ty)
+    {
+        for(uint32_t tx = x0 / TILE_WIDTH; tx <= x1 / TILE_WIDTH; ++tx)
+        {
+            if(m_TileMaxDepth[ty * TILES_X + tx] < minZ)
+            {
+                continue;
+            }
+
+            const uint32_t beginY = std::max(y0, ty * TILE_HEIGHT);
+            const uint32_t endY = std::min(y1, (ty + 1) * TILE_HEIGHT - 1);
+            const uint32_t beginX = std::max(x0, tx * TILE_WIDTH);
+            const uint32_t endX = std::min(x1, (tx + 1) * TILE_WIDTH - 1);
+            for(uint32_t y = beginY; y <= endY; ++y)
+            {
+                for(uint32_t x = beginX; x <= endX; ++x)
+                {
+                    if(m_Depth[y * WIDTH + x] >= minZ)
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+} // namespace core::scene
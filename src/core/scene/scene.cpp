@@ -12,24 +12,20 @@ Scene::Scene(entt::registry& registry, TrackBall* cam) :
     m_Models.reserve(100);
 }
 
-void Scene::loadModels(vk::Device* device)
+void Scene::loadModels(vk::Device* device, int carCount)
 {
-    const int numHurjas = 12;
-    for(int i = 0; i < numHurjas; ++i)
-    {
-        auto& it = m_Models.emplace_back(device, m_Registry);
-        it.load("data/models/hurja.obj");
-    }
+    // One mesh drawn many times, the instances share geometry and materials.
+    // Every car also occludes the ones behind it.
+    auto& hurja = m_Models.emplace_back(device, m_Registry);
+    hurja.load("data/models/hurja.obj");
 
-    int i = 0;
-    auto view = m_Registry.view<scene::component::Position>();
-    for(auto entity : view)
+    for(int i = 0; i < carCount; ++i)
     {
         const float rad =
-                glm::radians(i * 360.0f / static_cast<uint32_t>(numHurjas));
-        auto& pos = view.get<scene::component::Position>(entity);
-        pos.pos = glm::vec4(glm::vec3(sin(rad), cos(rad), 0.0f) * 5.0f, 1.0f);
-        i += 1;
+                glm::radians(i * 360.0f / static_cast<uint32_t>(carCount));
+        auto entity = hurja.createInstance(
+                glm::vec3(sin(rad), cos(rad), 0.0f) * 5.0f);
+        hurja.addOccluder(entity);
     }
 }
 
@@ -37,6 +33,7 @@ void Scene::addModel(vk::Device* device, const std::string& file)
 {
     auto& it = m_Models.emplace_back(device, m_Registry);
     it.load(file);
+    it.createInstance(glm::vec3(0.0f));
 }
 
 } // namespace core::scene
@@ -0,0 +1,115 @@
+#include "core/scene/staticdraws.h"
+#include "core/scene/components.h"
+
+namespace core::scene
+{
+
+// ----------------------------------------------------------------------------
+//
+//
+
+StaticDrawTracker::StaticDrawTracker(entt::registry& registry) :
+    m_Registry(registry),
+    m_Changed(
+            registry,
+            entt::collector.update<component::VertexInfo>()
+                    .update<component::Position>()
+                    .update<component::RenderInfo>()
+                    .update<component::Transform>()
+                    .group<component::VertexInfo,
+                           component::RenderInfo,
+                           component::Position,
+                           component::Transform>())
+{
+    m_Registry.on_destroy<component::VertexInfo>()
+            .connect<&StaticDrawTracker::onRemove>(*this);
+    m_Registry.on_destroy<component::RenderInfo>()
+            .connect<&StaticDrawTracker::onRemove>(*this);
+    m_Registry.on_destroy<component::Position>()
+            .connect<&StaticDrawTracker::onRemove>(*this);
+    m_Registry.on_destroy<component::Transform>()
+            .connect<&StaticDrawTracker::onRemove>(*this);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+StaticDrawTracker::~StaticDrawTracker()
+{
+    m_Registry.on_destroy<component::VertexInfo>().disconnect(*this);
+    m_Registry.on_destroy<component::RenderInfo>().disconnect(*this);
+    m_Registry.on_destroy<component::Position>().disconnect(*this);
+    m_Registry.on_destroy<component::Transform>().disconnect(*this);
+}
+
+// ----------------------------------------------------------------------------
+// A static entity that stops being renderable has to leave the cached draws
+//
+
+void StaticDrawTracker::onRemove(entt::registry& registry, entt::entity entity)
+{
+    if(!registry.all_of<component::DynamicDraw>(entity))
+    {
+        m_StaticChanged = true;
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+bool StaticDrawTracker::update()
+{
+    // Settle first, a change this frame restarts the count
+    m_Settled.clear();
+    auto dynamic = m_Registry.view<component::DynamicDraw>();
+    for(auto entity : dynamic)
+    {
+        auto& draw = dynamic.get<component::DynamicDraw>(entity);
+        if(--draw.settleFrames == 0)
+        {
+            m_Settled.push_back(entity);
+        }
+    }
+    if(!m_Settled.empty())
+    {
+        m_Registry.remove<component::DynamicDraw>(
+                m_Settled.begin(), m_Settled.end());
+        m_StaticChanged = true;
+    }
+
+    for(auto entity : m_Changed)
+    {
+        // Static until now (or new), the static draws no longer match
+        if(!m_Registry.all_of<component::DynamicDraw>(entity))
+        {
+            m_StaticChanged = true;
+        }
+        m_Registry.emplace_or_replace<component::DynamicDraw>(
+                entity, SETTLE_FRAMES);
+    }
+    m_Changed.clear();
+
+    if(!m_StaticChanged)
+    {
+        return false;
+    }
+    m_StaticChanged = false;
+
+    m_Static.clear();
+    auto view = m_Registry.view<
+            component::VertexInfo,
+            component::RenderInfo,
+            component::Position,
+            component::Transform>(entt::exclude<component::DynamicDraw>);
+    for(auto entity : view)
+    {
+        m_Static.push_back(entity);
+    }
+
+    ++m_Version;
+    return true;
+}
+
+} // namespace core::scene
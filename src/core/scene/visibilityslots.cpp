@@ -0,0 +1,98 @@
+#include "core/scene/visibilityslots.h"
+#include "core/scene/components.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace core::scene
+{
+
+// ----------------------------------------------------------------------------
+// Renderables from before get their slots right away
+//
+
+VisibilitySlots::VisibilitySlots(entt::registry& registry, uint32_t capacity) :
+    m_Registry(registry), m_Capacity(capacity)
+{
+    m_Registry.on_construct<component::VertexInfo>()
+            .connect<&VisibilitySlots::onConstruct>(*this);
+    m_Registry.on_destroy<component::VisibilitySlot>()
+            .connect<&VisibilitySlots::onDestroy>(*this);
+
+    for(auto entity : m_Registry.view<component::VertexInfo>())
+    {
+        onConstruct(m_Registry, entity);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+VisibilitySlots::~VisibilitySlots()
+{
+    m_Registry.on_construct<component::VertexInfo>().disconnect(*this);
+    m_Registry.on_destroy<component::VisibilitySlot>().disconnect(*this);
+}
+
+// ----------------------------------------------------------------------------
+// A slot can be released and handed out again before it was taken
+//
+
+std::vector<uint32_t> VisibilitySlots::takeAllocated()
+{
+    std::sort(m_Allocated.begin(), m_Allocated.end());
+    m_Allocated.erase(
+            std::unique(m_Allocated.begin(), m_Allocated.end()),
+            m_Allocated.end());
+    return std::exchange(m_Allocated, {});
+}
+
+// ----------------------------------------------------------------------------
+// Released slots first so the used range stays dense
+//
+
+void VisibilitySlots::onConstruct(entt::registry& registry, entt::entity entity)
+{
+    if(registry.all_of<component::VisibilitySlot>(entity))
+    {
+        return;
+    }
+
+    uint32_t slot = NO_SLOT;
+    if(!m_Free.empty())
+    {
+        slot = m_Free.back();
+        m_Free.pop_back();
+    }
+    else
+    {
+        assert(m_Next < m_Capacity && "Out of visibility slots");
+        if(m_Next < m_Capacity)
+        {
+            slot = m_Next++;
+        }
+    }
+
+    if(slot != NO_SLOT)
+    {
+        m_Allocated.push_back(slot);
+    }
+    registry.emplace<component::VisibilitySlot>(entity, slot);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void VisibilitySlots::onDestroy(entt::registry& registry, entt::entity entity)
+{
+    const uint32_t slot = registry.get<component::VisibilitySlot>(entity).index;
+    if(slot != NO_SLOT)
+    {
+        m_Free.push_back(slot);
+    }
+}
+
+} // namespace core::scene
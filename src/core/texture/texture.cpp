@@ -4,6 +4,7 @@
 #include "stb/stb_image.h"
 #include "core/vulkan/utils.h"
 #include "logs/log.h"
+#include "timer/profiler.h"
 #include "utils/stringutils.h"
 
 #include <filesystem>
@@ -19,6 +20,7 @@ void Texture2d::loadFromFile(
         VkImageUsageFlags imageUsage,
         VkImageLayout imageLayout)
 {
+    PROFILE_ZONE("Texture2d::loadFromFile");
     std::string extension = utils::getExtension(file);
 
     // assert(this->device);
@@ -139,6 +141,7 @@ void Texture2d::loadFromFile(
                 &image,
                 &memory,
                 nullptr));
+        device->countAllocation();
     }
 
     VkImageSubresourceRange subresourceRange = {};
@@ -227,7 +230,7 @@ void Texture2d::loadFromFile(
     }
 
     // Submit & cleanup
-    device->flushCommandBuffer(cmdBuf, device->getTransferQueue(), false);
+    device->flushCommandBuffer(cmdBuf, vk::QueueType::Transfer, false);
     vkFreeCommandBuffers(
             device->getLogicalDevice(),
             device->getTransferCommandPool(),
@@ -399,7 +402,7 @@ void Texture2d::loadFromBuffer(
     }
 
     // Submit & cleanup
-    device->flushCommandBuffer(cmdBuf, device->getTransferQueue(), false);
+    device->flushCommandBuffer(cmdBuf, vk::QueueType::Transfer, false);
     vkFreeCommandBuffers(
             device->getLogicalDevice(),
             device->getTransferCommandPool(),
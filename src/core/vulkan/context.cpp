@@ -3,17 +3,89 @@
 #include "logs/log.h"
 #include "core/vulkan/utils.h"
 #include "core/scene/components.h"
+#include "core/workqueue.h"
+#include "timer/profiler.h"
+#include "timer/timer.h"
 
 #include "imgui/imgui_impl_glfw.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <glm/gtc/matrix_transform.hpp>
+#include <future>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <utility>
 
 namespace core::vk
 {
 
+namespace
+{
+// 48 MiB of VertexPNTC and 8 MiB of indices
+constexpr uint32_t GEOMETRY_ARENA_VERTEX_CAPACITY = 1u << 20;
+constexpr uint32_t GEOMETRY_ARENA_INDEX_CAPACITY = 1u << 21;
+// Instances drawn per frame, 96 bytes each plus a 20 byte indirect command
+// in the worst case
+constexpr uint32_t MAX_INSTANCES = 1u << 14;
+// Smallest share of the draws worth a secondary command buffer of its own
+constexpr size_t DRAWS_PER_RECORDING_JOB = 256;
+
+// Frames in flight allowed by the framesinflight config
+constexpr int MAX_FRAMES_IN_FLIGHT = 3;
+// Per frame uniforms and UI geometry, a busy UI is a few hundred KiB
+constexpr VkDeviceSize TRANSIENT_BUFFER_SIZE = 4u << 20;
+// Pipelines created later are written to disk within about a minute
+constexpr uint64_t PIPELINE_CACHE_SAVE_FRAMES = 3600;
+
+// Profiler scope around the whole graphics command buffer of a frame
+constexpr std::string_view FRAME_GPU_SCOPE = "Frame";
+
+// Specialization constants 1-3 of obj.frag
+const glm::vec3 SCENE_LIGHT_POSITION = glm::vec3(0.0f, 10.0f, 0.0f);
+
+// Secondary command buffers continue the first subpass of the render pass.
+// The framebuffer is optional, buffers reused with any swapchain image pass
+// VK_NULL_HANDLE.
+VkCommandBufferInheritanceInfo makeInheritanceInfo(
+        VkRenderPass renderPass,
+        VkFramebuffer framebuffer,
+        VkQueryPipelineStatisticFlags pipelineStatistics)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = nullptr;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
+    inheritanceInfo.occlusionQueryEnable = VK_FALSE;
+    inheritanceInfo.queryFlags = 0;
+    inheritanceInfo.pipelineStatistics = pipelineStatistics;
+    return inheritanceInfo;
+}
+
+// A draw call of the batch with all its instances
+void countBatch(const scene::InstanceBatch& batch, RenderStats& stats)
+{
+    stats.drawCalls += 1;
+    stats.instances += batch.instanceCount;
+    stats.triangles += uint64_t{batch.indexCount / 3} * batch.instanceCount;
+}
+
+// What write() of the batcher copies into the mapped draw buffers
+uint64_t getDrawBufferBytes(const scene::InstanceBatcher& batcher)
+{
+    return batcher.getInstanceCount() * sizeof(scene::InstanceData)
+           + batcher.getBatches().size()
+                     * sizeof(VkDrawIndexedIndirectCommand);
+}
+} // namespace
+
 // -----------------------------------------------------------------------------
 //
 //
@@ -28,22 +100,45 @@ Context::Context(
     m_Window(std::move(window)),
     m_Scene(scene),
     m_Registry(registry),
+    m_Dispatcher(dispatcher),
     m_conn(dispatcher, this)
 {
+    m_Registry.on_destroy<scene::component::RenderInfo>()
+            .connect<&Context::onRenderableDestroyed>(*this);
     m_Log->info("Vulkan context created");
 }
 
 Context::~Context()
 {
+    m_Registry.on_destroy<scene::component::RenderInfo>().disconnect(*this);
     vkDeviceWaitIdle(m_Device->getLogicalDevice());
+    m_Device->destroyAllDeferred();
     m_ui.reset();
-
-    for(size_t i = 0; i < m_UniformBuffer.size(); ++i)
+    m_PipelineManager.reset();
+    m_RecordingPools.reset();
+    m_StaticDrawPools.reset();
+    m_RenderGraph.reset();
+    m_GpuCulling.reset();
+    m_HiZCulling.reset();
+    m_VisibilitySlots.reset();
+    m_GpuProfiler.reset();
+
+    m_Transient.reset();
+
+    for(auto& frame : m_Frames)
     {
         vmaDestroyBuffer(
                 m_Device->getAllocator(),
-                m_UniformBuffer[i],
-                m_UniformMemory[i]);
+                frame.instanceBuffer,
+                frame.instanceMemory);
+        vmaDestroyBuffer(
+                m_Device->getAllocator(),
+                frame.indirectBuffer,
+                frame.indirectMemory);
+        vkDestroyCommandPool(
+                m_Device->getLogicalDevice(), frame.commandPool, nullptr);
+        vkDestroySemaphore(
+                m_Device->getLogicalDevice(), frame.imageAcquired, nullptr);
     }
 
     if(m_DescSetLayout != VK_NULL_HANDLE)
@@ -63,11 +158,6 @@ Context::~Context()
         vkDestroyPipelineLayout(
                 m_Device->getLogicalDevice(), m_PipelineLayout, nullptr);
     }
-    if(m_Pipelines.obj != VK_NULL_HANDLE)
-    {
-        vkDestroyPipeline(
-                m_Device->getLogicalDevice(), m_Pipelines.obj, nullptr);
-    }
     if(m_Pipelines.skybox != VK_NULL_HANDLE)
     {
         vkDestroyPipeline(
@@ -79,18 +169,18 @@ Context::~Context()
         vkDestroyRenderPass(
                 m_Device->getLogicalDevice(), m_Renderpass, nullptr);
     }
-
-    for(auto& fence : m_Fences)
+    if(m_EarlyRenderpass != VK_NULL_HANDLE)
     {
-        vkDestroyFence(m_Device->getLogicalDevice(), fence, nullptr);
+        vkDestroyRenderPass(
+                m_Device->getLogicalDevice(), m_EarlyRenderpass, nullptr);
     }
-
-    for(auto& semaphore : m_RenderingCompleteSemaphores)
+    if(m_LateRenderpass != VK_NULL_HANDLE)
     {
-        vkDestroySemaphore(m_Device->getLogicalDevice(), semaphore, nullptr);
+        vkDestroyRenderPass(
+                m_Device->getLogicalDevice(), m_LateRenderpass, nullptr);
     }
 
-    for(auto& semaphore : m_PresentCompleteSemaphores)
+    for(auto& semaphore : m_RenderingCompleteSemaphores)
     {
         vkDestroySemaphore(m_Device->getLogicalDevice(), semaphore, nullptr);
     }
@@ -145,6 +235,7 @@ void Context::init(VkExtent2D swapchainExtent)
     // Look for GPU's
     VkPhysicalDevice gpu = selectPhysicalDevice();
     m_Device = std::make_unique<Device>(gpu, m_Window);
+    m_Device->setLoadShadersFromDisk(m_Config.shadersFromDisk != 0);
 
     {
         std::vector<const char*> requestedExtensions = {};
@@ -155,28 +246,65 @@ void Context::init(VkExtent2D swapchainExtent)
         m_Device->createLogicalDevice(
                 m_Instance, requestedExtensions, queueFlags);
     }
-
-    // Create surface
-    m_Swapchain = std::make_unique<Swapchain>(m_Instance, m_Device.get());
-
-    // Check present support
-    VkBool32 supportPresent = VK_FALSE;
-    vkGetPhysicalDeviceSurfaceSupportKHR(
-            m_Device->getPhysicalDevice(),
-            m_Device->getGraphicsQueueFamily(),
-            m_Swapchain->getSurface(),
-            &supportPresent);
-
-    if(!supportPresent)
+    m_Device->createPipelineCache(m_Config.pipelineCache);
+    m_PipelineManager =
+            std::make_unique<PipelineManager>(m_Device.get(), m_Dispatcher);
+    m_conn.attach<event::PipelineReadyEvent>();
+
+    // Shared vertex/index storage for every mesh in the scene
+    m_Device->createGeometryArena(
+            sizeof(model::VertexPNTC),
+            GEOMETRY_ARENA_VERTEX_CAPACITY,
+            GEOMETRY_ARENA_INDEX_CAPACITY);
+
+    if(m_Window)
     {
-        m_Log->warn("Window surface does not support presenting!");
-        assert(false);
+        // Create surface
+        m_Swapchain = std::make_unique<Swapchain>(m_Instance, m_Device.get());
+
+        // Check present support
+        VkBool32 supportPresent = VK_FALSE;
+        vkGetPhysicalDeviceSurfaceSupportKHR(
+                m_Device->getPhysicalDevice(),
+                m_Device->getGraphicsQueueFamily(),
+                m_Swapchain->getSurface(),
+                &supportPresent);
+
+        if(!supportPresent)
+        {
+            m_Log->warn("Window surface does not support presenting!");
+            assert(false);
+        }
+    }
+    else
+    {
+        m_Swapchain =
+                std::make_unique<Swapchain>(m_Device.get(), m_SwapchainExtent);
     }
 
     m_Swapchain->create(m_Config.vsync);
 
-    createUniformBuffers();
+    // Independent of the swapchain image count, more frames add latency but
+    // let the CPU run further ahead of the GPU
+    m_Frames.resize(static_cast<size_t>(
+            std::clamp(m_Config.framesInFlight, 1, MAX_FRAMES_IN_FLIGHT)));
+    m_Log->info("Frames in flight: {}", m_Frames.size());
+
+    createTransientBuffers();
+    createDrawBuffers();
     createSynchronizationPrimitives();
+    if(GpuProfiler::isSupported(*m_Device))
+    {
+        m_GpuProfiler = std::make_unique<GpuProfiler>(
+                m_Device.get(), static_cast<uint32_t>(m_Frames.size()));
+    }
+    else
+    {
+        m_Log->info("No host query reset, GPU profiler disabled");
+    }
+    m_RenderGraph = std::make_unique<RenderGraphExecutor>(
+            m_Device.get(), static_cast<uint32_t>(m_Frames.size()));
+    createPresentSemaphores();
     createRenderPass();
 }
 
@@ -188,11 +316,36 @@ void Context::init(VkExtent2D swapchainExtent)
 void Context::generatePipelines()
 {
     setupDescriptors2();
+
+    m_PipelineTimer = {};
     createGraphicsPipeline();
-    m_Swapchain->createFrameBuffers(m_Renderpass);
-    allocateCommandBuffers();
     IMGUI_CHECKVERSION();
     m_ui = std::make_unique<ImGuiSetup>(m_Device.get(), m_Renderpass);
+
+    m_Swapchain->createFrameBuffers(m_Renderpass);
+    allocateCommandBuffers();
+}
+
+// -----------------------------------------------------------------------------
+//
+//
+
+std::optional<float> Context::getGpuFrameMs() const
+{
+    if(!m_GpuProfiler)
+    {
+        return std::nullopt;
+    }
+    return m_GpuProfiler->getResolvedMs(FRAME_GPU_SCOPE);
+}
+
+// -----------------------------------------------------------------------------
+// Published by the next renderFrame
+//
+
+void Context::waitForPipelines()
+{
+    m_PipelineManager->wait();
 }
 
 // -----------------------------------------------------------------------------
@@ -215,8 +368,6 @@ void Context::updateOverlay(float dt)
     // ImGui::ColorEdit3("Color", &color);
 
     // ImGui::Render();
-
-    m_ui->update();
 }
 
 // -----------------------------------------------------------------------------
@@ -225,31 +376,48 @@ void Context::updateOverlay(float dt)
 
 void Context::renderFrame(float dt)
 {
+    PROFILE_ZONE("Context::renderFrame");
     updateOverlay(dt);
 
     // /////////////////////////////////////////
 
-    vkWaitForFences(
-            m_Device->getLogicalDevice(),
-            1,
-            &m_Fences[m_FrameIndex],
-            VK_TRUE,
-            UINT64_MAX);
+    // Only the resources of this frame have to be free, the other frames in
+    // flight keep running
+    auto& frame = m_Frames[m_FrameIndex];
+    Timer phaseTimer;
+    {
+        PROFILE_ZONE("Wait for frame");
+        m_Device->wait(frame.submitted);
+    }
+    m_FrameTimings.presentWaitMs = phaseTimer.elapsed() * 1000.0f;
+    phaseTimer = {};
+    if(m_GpuProfiler)
+    {
+        m_GpuProfiler->beginFrame(m_FrameIndex);
+    }
+    m_Device->destroyFinished();
+    m_PipelineManager->update();
+    m_Transient->reset(m_FrameIndex);
+    if(frame.transientGeneration != m_Transient->getGeneration(m_FrameIndex))
+    {
+        bindTransientBuffer(m_FrameIndex);
+    }
 
     // /////////////////////////////////////////
 
+    m_FrameTimings.recordMs = phaseTimer.elapsed() * 1000.0f;
+    phaseTimer = {};
     uint32_t imageIndex = 0;
-    VkResult result = m_Swapchain->acquireNextImage(
-            m_PresentCompleteSemaphores[m_FrameIndex], &imageIndex);
+    VkResult result =
+            m_Swapchain->acquireNextImage(frame.imageAcquired, &imageIndex);
     if(result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
     {
-        vkDeviceWaitIdle(m_Device->getLogicalDevice());
         recreateSwapchain();
 
         // imageIndex received previously is stale, reacquire (or could just
         // bail out)
         result = m_Swapchain->acquireNextImage(
-                m_PresentCompleteSemaphores[m_FrameIndex], &imageIndex);
+                frame.imageAcquired, &imageIndex);
     }
     else if(result != VK_SUCCESS)
     {
@@ -259,62 +427,35 @@ void Context::renderFrame(float dt)
                 utils::errorString(result));
         assert(false);
     }
-
-    if(m_ImagesInFlight[imageIndex] != VK_NULL_HANDLE)
-    {
-        vkWaitForFences(
-                m_Device->getLogicalDevice(),
-                1,
-                &m_ImagesInFlight[imageIndex],
-                VK_TRUE,
-                UINT64_MAX);
-    }
-
-    m_ImagesInFlight[imageIndex] = m_Fences[m_FrameIndex];
-
-    updateUniformBuffers(dt);
-    recordCommandBuffers(imageIndex);
-
-    VkCommandBuffer cmdBuffers[] = {m_RenderingCommandBuffers[imageIndex]};
-    VkPipelineStageFlags graphicsWaitStages[] = {
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    VkSemaphore graphicsWaitSemaphores[] = {
-            m_PresentCompleteSemaphores[m_FrameIndex]};
-
-    VkSemaphore graphicsSignalSemaphores[] = {
-            m_RenderingCompleteSemaphores[m_FrameIndex]};
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pNext = nullptr;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = graphicsWaitSemaphores;
-    submitInfo.pWaitDstStageMask = graphicsWaitStages;
-    submitInfo.commandBufferCount = 1; //////
-    submitInfo.pCommandBuffers = cmdBuffers;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = graphicsSignalSemaphores;
-
-    vkResetFences(m_Device->getLogicalDevice(), 1, &m_Fences[m_FrameIndex]);
-
-    result = vkQueueSubmit(
-            m_Device->getGraphicsQueue(),
-            1,
-            &submitInfo,
-            m_Fences[m_FrameIndex]);
-
-    if(result != VK_SUCCESS)
-    {
-        m_Log->warn(
-                "renderFrame::vkQueueSubmit {}", utils::errorString(result));
-        assert(false);
-    }
+    m_FrameTimings.presentWaitMs += phaseTimer.elapsed() * 1000.0f;
+    phaseTimer = {};
+
+    updateUniformBuffers();
+    m_ui->update(*m_Transient);
+    updateDrawBuffers(m_FrameIndex);
+    requestSceneVariants();
+    const auto computeDone = recordCommandBuffers(imageIndex);
+    m_FrameTimings.recordMs += phaseTimer.elapsed() * 1000.0f;
+    phaseTimer = {};
+
+    const SemaphoreWait acquired = {
+            frame.imageAcquired, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+    // Offscreen images are neither acquired nor presented
+    const uint32_t presenting = m_Swapchain->isOffscreen() ? 0u : 1u;
+
+    // Presenting has no timeline, the semaphore belongs to the image so it
+    // is not signalled again before the previous present of the image waited
+    frame.submitted = m_Device->submit(
+            QueueType::Graphics,
+            {&frame.commandBuffer, 1},
+            {computeDone ? &*computeDone : nullptr, computeDone ? 1u : 0u},
+            {&acquired, presenting},
+            {&m_RenderingCompleteSemaphores[imageIndex], presenting});
 
     result = m_Swapchain->queuePresent(
             m_Device->getGraphicsQueue(),
             &imageIndex,
-            &m_RenderingCompleteSemaphores[m_FrameIndex]);
+            &m_RenderingCompleteSemaphores[imageIndex]);
 
     if(result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR
        || m_FrameBufferResized)
@@ -328,8 +469,24 @@ void Context::renderFrame(float dt)
                 "renderFrame::vkQueuePresent {}", utils::errorString(result));
         assert(false);
     }
-
-    m_FrameIndex = imageIndex;
+    m_FrameTimings.submitMs = phaseTimer.elapsed() * 1000.0f;
+
+    // Whatever was allocated or uploaded since the last frame ended counts
+    // for this one, loading included
+    const uint64_t uploadedBytes = m_Device->getUploadedBytes();
+    const uint64_t allocations = m_Device->getAllocationCount();
+    m_RecordingStats.bytesUploaded = uploadedBytes - m_UploadedBytesSeen;
+    m_RecordingStats.allocations = allocations - m_AllocationsSeen;
+    m_UploadedBytesSeen = uploadedBytes;
+    m_AllocationsSeen = allocations;
+    m_RenderStats = m_RecordingStats;
+    m_RecordingStats = {};
+
+    m_FrameIndex = (m_FrameIndex + 1) % static_cast<uint32_t>(m_Frames.size());
+    if(++m_FrameNumber % PIPELINE_CACHE_SAVE_FRAMES == 0)
+    {
+        m_Device->savePipelineCache();
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -341,7 +498,10 @@ void Context::createInstance()
     std::vector<const char*> instanceExtensions = {};
     std::vector<const char*> instanceLayers = {};
 
-    { // GLFW should ask for VK_KHR_SURFACE and platform depended surface
+    // GLFW should ask for VK_KHR_SURFACE and platform depended surface,
+    // offscreen rendering needs neither
+    if(m_Window)
+    {
         uint32_t count = 0;
         const char** glfwExtensions = nullptr;
         glfwExtensions = glfwGetRequiredInstanceExtensions(&count);
@@ -521,39 +681,59 @@ VkPhysicalDevice Context::selectPhysicalDevice()
 
 void Context::createSynchronizationPrimitives()
 {
-    const uint32_t imageCount = m_Swapchain->getImageCount();
-    m_PresentCompleteSemaphores.resize(imageCount);
-    m_RenderingCompleteSemaphores.resize(imageCount);
-    m_Fences.resize(imageCount);
-    m_ImagesInFlight.resize(imageCount, VK_NULL_HANDLE);
-
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     semaphoreInfo.pNext = nullptr;
     semaphoreInfo.flags = 0;
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.pNext = nullptr;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for(uint32_t i = 0; i < imageCount; ++i)
+    for(auto& frame : m_Frames)
     {
         VK_CHECK(vkCreateSemaphore(
                 m_Device->getLogicalDevice(),
                 &semaphoreInfo,
                 nullptr,
-                &m_PresentCompleteSemaphores[i]));
+                &frame.imageAcquired));
+
+        // Reset as a whole at the start of the frame
+        frame.commandPool = m_Device->createCommandPool(
+                m_Device->getGraphicsQueueFamily(),
+                VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.pNext = nullptr;
+        allocateInfo.commandPool = frame.commandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(
+                m_Device->getLogicalDevice(),
+                &allocateInfo,
+                &frame.commandBuffer));
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Presenting an image waits on the semaphore of that image, it follows the
+// swapchain
+//
+
+void Context::createPresentSemaphores()
+{
+    m_RenderingCompleteSemaphores.resize(m_Swapchain->getImageCount());
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = nullptr;
+    semaphoreInfo.flags = 0;
+
+    for(auto& semaphore : m_RenderingCompleteSemaphores)
+    {
         VK_CHECK(vkCreateSemaphore(
                 m_Device->getLogicalDevice(),
                 &semaphoreInfo,
                 nullptr,
-                &m_RenderingCompleteSemaphores[i]));
-        VK_CHECK(vkCreateFence(
-                m_Device->getLogicalDevice(),
-                &fenceInfo,
-                nullptr,
-                &m_Fences[i]));
+                &semaphore));
     }
 }
 
@@ -572,7 +752,7 @@ void Context::createRenderPass()
     attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachments[0].finalLayout = m_Swapchain->getFinalLayout();
     attachments[1].flags = 0;
     attachments[1].format = VK_FORMAT_D32_SFLOAT;
     attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -638,265 +818,303 @@ void Context::createRenderPass()
             &renderpassInfo,
             nullptr,
             &m_Renderpass));
+
+    if(m_HiZCulling)
+    {
+        createHiZRenderPasses();
+    }
 }
 
 // ----------------------------------------------------------------------------
-//
+// Early pass leaves the color attachment for the late pass to finish. Depth
+// stays in the attachment layout across both, the render graph moves it to
+// and from the read only layout of the pyramid build and waits for it.
+// Attachments and subpass match m_Renderpass so its framebuffers and pipelines
+// can be used.
 //
 
-void Context::createGraphicsPipeline()
+void Context::createHiZRenderPasses()
 {
-    const auto bindingDescription = model::VertexPNTC::getBindingDescription();
-    const auto attributeDescription =
-            model::VertexPNTC::getAttributeDescription();
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.pNext = nullptr;
-    vertexInputInfo.flags = 0;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount =
-            static_cast<uint32_t>(attributeDescription.size());
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
-
-    // --
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-    inputAssembly.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.pNext = nullptr;
-    inputAssembly.flags = 0;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    // --
-
-    VkViewport viewport = {};
-    viewport.x = 0;
-    viewport.y = 0;
-    viewport.width = static_cast<float>(m_SwapchainExtent.width);
-    viewport.height = static_cast<float>(m_SwapchainExtent.height);
-    ;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    // --
-
-    VkRect2D scissor = {};
-    scissor.offset = {0, 0};
-    scissor.extent = m_SwapchainExtent;
-
-    // --
-
-    VkPipelineViewportStateCreateInfo viewportState = {};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.pNext = nullptr;
-    viewportState.flags = 0;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    // --
-
-    VkPipelineRasterizationStateCreateInfo rasterizer = {};
-    rasterizer.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.pNext = nullptr;
-    rasterizer.flags = 0;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.cullMode = VK_CULL_MODE_NONE;
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-    rasterizer.lineWidth = 1.0f;
-
-    // --
-
-    VkPipelineMultisampleStateCreateInfo multisampling = {};
-    multisampling.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.pNext = nullptr;
-    multisampling.flags = 0;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.minSampleShading = 1.0f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    // --
-
-    VkPipelineDepthStencilStateCreateInfo depthInfo = {};
-    depthInfo.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthInfo.pNext = nullptr;
-    depthInfo.flags = 0;
-    depthInfo.depthTestEnable = VK_TRUE;
-    depthInfo.depthWriteEnable = VK_TRUE;
-    depthInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthInfo.depthBoundsTestEnable = VK_FALSE;
-    depthInfo.stencilTestEnable = VK_FALSE;
-    // depthInfo.front;
-    // depthInfo.back;
-    depthInfo.minDepthBounds = 0.0f;
-    depthInfo.maxDepthBounds = 1.0f;
+    std::array<VkAttachmentDescription, 2> attachments = {};
+    attachments[0].flags = 0;
+    attachments[0].format = m_Swapchain->getImageFormat();
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[1].flags = 0;
+    attachments[1].format = VK_FORMAT_D32_SFLOAT;
+    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].finalLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-    // --
+    std::array<VkAttachmentReference, 2> attachmentReferences = {};
+    attachmentReferences[0].attachment = 0;
+    attachmentReferences[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachmentReferences[1].attachment = 1;
+    attachmentReferences[1].layout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-    colorBlendAttachment.blendEnable = VK_FALSE;
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.colorWriteMask = 0xF;
+    VkSubpassDescription subpassDescription = {};
+    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDescription.colorAttachmentCount = 1;
+    subpassDescription.pColorAttachments = &attachmentReferences[0];
+    subpassDescription.pDepthStencilAttachment = &attachmentReferences[1];
 
-    // --
+    // Only the color attachment, the barriers around depth come from the
+    // render graph
+    std::array<VkSubpassDependency, 2> subpassDependencies = {};
+    subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    subpassDependencies[0].dstSubpass = 0;
+    subpassDependencies[0].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpassDependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpassDependencies[0].srcAccessMask = 0;
+    subpassDependencies[0].dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpassDependencies[0].dependencyFlags = 0;
+    subpassDependencies[1].srcSubpass = 0;
+    subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    subpassDependencies[1].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpassDependencies[1].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpassDependencies[1].srcAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpassDependencies[1].dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpassDependencies[1].dependencyFlags = 0;
 
-    VkPipelineColorBlendStateCreateInfo colorBlending = {};
-    colorBlending.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.pNext = nullptr;
-    colorBlending.flags = 0;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    // colorBlending.blendConstants;
+    VkRenderPassCreateInfo renderpassInfo = {};
+    renderpassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderpassInfo.pNext = nullptr;
+    renderpassInfo.flags = 0;
+    renderpassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderpassInfo.pAttachments = attachments.data();
+    renderpassInfo.subpassCount = 1;
+    renderpassInfo.pSubpasses = &subpassDescription;
+    renderpassInfo.dependencyCount =
+            static_cast<uint32_t>(subpassDependencies.size());
+    renderpassInfo.pDependencies = subpassDependencies.data();
 
-    // --
+    VK_CHECK(vkCreateRenderPass(
+            m_Device->getLogicalDevice(),
+            &renderpassInfo,
+            nullptr,
+            &m_EarlyRenderpass));
 
-    std::array<VkDynamicState, 2> dynStates{
-            VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    // Late pass continues on top of the early one and presents
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[0].finalLayout = m_Swapchain->getFinalLayout();
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    attachments[1].finalLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-    VkPipelineDynamicStateCreateInfo dynamicState = {};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.pNext = nullptr;
-    dynamicState.flags = 0;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynStates.size());
-    dynamicState.pDynamicStates = dynStates.data();
+    subpassDependencies[0].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpassDependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpassDependencies[0].srcAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpassDependencies[0].dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpassDependencies[1].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    subpassDependencies[1].srcAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 
-    // --
+    VK_CHECK(vkCreateRenderPass(
+            m_Device->getLogicalDevice(),
+            &renderpassInfo,
+            nullptr,
+            &m_LateRenderpass));
+}
 
-    VkPushConstantRange pushConstantRange = {};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(glm::vec4);
+// ----------------------------------------------------------------------------
+//
+//
 
+void Context::createGraphicsPipeline()
+{
     VkPipelineLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     layoutInfo.pNext = nullptr;
     layoutInfo.flags = 0;
     layoutInfo.setLayoutCount = 1;
     layoutInfo.pSetLayouts = &m_DescSetLayout;
-    layoutInfo.pushConstantRangeCount = 1;
-    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    layoutInfo.pushConstantRangeCount = 0;
+    layoutInfo.pPushConstantRanges = nullptr;
 
     VK_CHECK(vkCreatePipelineLayout(
             m_Device->getLogicalDevice(),
             &layoutInfo,
             nullptr,
             &m_PipelineLayout));
-    // --
-
-    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {};
-
-    VkGraphicsPipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.pNext = nullptr;
-    pipelineInfo.flags = 0;
-    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-    pipelineInfo.pStages = shaderStages.data();
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pTessellationState = nullptr;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = &depthInfo;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = m_PipelineLayout;
-    pipelineInfo.renderPass = m_Renderpass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    {
-        shaderStages[0] = m_Device->loadShaderFromFile(
-                "data/shaders/obj.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-        shaderStages[1] = m_Device->loadShaderFromFile(
-                "data/shaders/obj.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-    }
-
-    VK_CHECK(vkCreateGraphicsPipelines(
-            m_Device->getLogicalDevice(),
-            nullptr,
-            1,
-            &pipelineInfo,
-            nullptr,
-            &m_Pipelines.obj));
-
-    for(auto& shader : shaderStages)
-    {
-        vkDestroyShaderModule(
-                m_Device->getLogicalDevice(), shader.module, nullptr);
-    }
 
     // --
+
+    // Compiles on the work queue, the scene is drawn from the frame that
+    // follows its PipelineReadyEvent. The specialized variants are requested
+    // once something is drawn with them.
+    m_SceneVariants.fill(INVALID_PIPELINE);
+    m_ScenePipeline = requestSceneVariant(model::shaderfeature::GENERIC);
 }
 
 // ----------------------------------------------------------------------------
-//
+// Variants differ only in the fragment specialization, the pipeline manager
+// returns the existing handle for one that was requested before
 //
 
-void Context::allocateCommandBuffers()
+PipelineHandle Context::requestSceneVariant(uint32_t features)
 {
-    m_RenderingCommandBuffers.resize(m_Swapchain->getImageCount());
+    assert(features < model::shaderfeature::VARIANT_COUNT);
 
-    VkCommandBufferAllocateInfo allocateInfo = {};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocateInfo.pNext = nullptr;
-    allocateInfo.commandPool = m_Device->getGraphicsCommandPool();
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocateInfo.commandBufferCount = m_Swapchain->getImageCount();
+    const auto attributeDescription =
+            model::VertexPNTC::getAttributeDescription();
 
-    VK_CHECK(vkAllocateCommandBuffers(
-            m_Device->getLogicalDevice(),
-            &allocateInfo,
-            m_RenderingCommandBuffers.data()));
+    GraphicsPipelineDesc desc;
+    desc.vertexShader = "data/shaders/obj.vert.spv";
+    desc.fragmentShader = "data/shaders/obj.frag.spv";
+    desc.fragmentConstants.set(0, features);
+    desc.fragmentConstants.set(1, SCENE_LIGHT_POSITION.x);
+    desc.fragmentConstants.set(2, SCENE_LIGHT_POSITION.y);
+    desc.fragmentConstants.set(3, SCENE_LIGHT_POSITION.z);
+    desc.bindings = {model::VertexPNTC::getBindingDescription()};
+    desc.attributes = {
+            attributeDescription.begin(), attributeDescription.end()};
+    desc.layout = m_PipelineLayout;
+    desc.renderPass = m_Renderpass;
+
+    m_SceneVariants[features] = m_PipelineManager->request(std::move(desc));
+    return m_SceneVariants[features];
 }
 
 // ----------------------------------------------------------------------------
-// Record command buffer for single frame
+// Main thread, before recording. The GPU culled paths draw every batch with
+// one call and always use the generic variant.
 //
 
-void Context::recordCommandBuffers(uint32_t nextImageIndex)
+void Context::requestSceneVariants()
 {
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.pNext = nullptr;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {{0.1f, 0.1f, 0.1f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
+    if(m_HiZCulling || m_GpuCulling)
+    {
+        return;
+    }
+
+    auto request = [this](const scene::InstanceBatcher& batcher) {
+        for(const auto& batch : batcher.getBatches())
+        {
+            if(m_SceneVariants[batch.variant] == INVALID_PIPELINE)
+            {
+                requestSceneVariant(batch.variant);
+            }
+        }
+    };
+    request(m_InstanceBatcher);
+    if(m_StaticDraws)
+    {
+        request(m_StaticBatcher);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Variants still compiling are drawn with the generic one
+//
+
+VkPipeline Context::getSceneVariant(uint32_t variant) const
+{
+    const PipelineHandle handle = m_SceneVariants[variant];
+    if(handle != INVALID_PIPELINE && m_PipelineManager->isReady(handle))
+    {
+        return m_PipelineManager->get(handle);
+    }
+    return m_Pipelines.obj;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Context::allocateCommandBuffers()
+{
+    const auto frameCount = static_cast<uint32_t>(m_Frames.size());
+
+    // A slot per worker and the calling thread, plus one for the UI
+    const uint32_t workerCount =
+            std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Replaced pools hold secondaries of frames in flight
+    if(m_RecordingPools || m_StaticDrawPools)
+    {
+        m_Device->destroyLater(
+                [recording = std::shared_ptr<RecordingPools>(
+                         std::move(m_RecordingPools)),
+                 staticDraws = std::shared_ptr<RecordingPools>(
+                         std::move(m_StaticDrawPools))]() {});
+    }
+    m_RecordingPools = std::make_unique<RecordingPools>(
+            m_Device.get(), frameCount, workerCount + 2);
+
+    // Cached static draws reference the render pass, pipelines and the
+    // swapchain extent, new pools leave every frame to record them again
+    if(m_StaticDraws)
+    {
+        m_StaticDrawPools = std::make_unique<RecordingPools>(
+                m_Device.get(), frameCount, 1, 0);
+        for(auto& frame : m_Frames)
+        {
+            frame.staticDrawVersion = 0;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Record command buffer for single frame. The existing render passes keep
+// handling their attachments, the graph orders the culling and pyramid
+// passes around them.
+//
+
+std::optional<TimelineWait> Context::recordCommandBuffers(uint32_t imageIndex)
+{
+    PROFILE_ZONE("Context::recordCommandBuffers");
+    const auto& frame = m_Frames[m_FrameIndex];
+    // Until the scene pipeline has compiled the frame only clears and draws
+    // the UI, culling included so no pass reads depth that wasn't drawn
+    const bool sceneReady = m_Pipelines.obj != VK_NULL_HANDLE;
+    const bool useHiZ = m_HiZCulling && sceneReady;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pNext = nullptr;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = {{0.1f, 0.1f, 0.1f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
 
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassBeginInfo.pNext = nullptr;
-    renderPassBeginInfo.renderPass = m_Renderpass;
-    renderPassBeginInfo.framebuffer =
-            m_Swapchain->getFrameBuffer(nextImageIndex);
+    renderPassBeginInfo.renderPass = useHiZ ? m_LateRenderpass : m_Renderpass;
+    renderPassBeginInfo.framebuffer = m_Swapchain->getFrameBuffer(imageIndex);
     renderPassBeginInfo.renderArea.offset = {0, 0};
     renderPassBeginInfo.renderArea.extent = m_SwapchainExtent;
     renderPassBeginInfo.clearValueCount =
@@ -917,29 +1135,243 @@ void Context::recordCommandBuffers(uint32_t nextImageIndex)
     scissor.extent = m_SwapchainExtent;
 
     {
-        VkCommandBuffer cmdBuf = m_RenderingCommandBuffers[nextImageIndex];
+        // The frame's submit has been waited on, nothing recorded from
+        // its pool is still executing
+        VK_CHECK(vkResetCommandPool(
+                m_Device->getLogicalDevice(), frame.commandPool, 0));
+
+        VkCommandBuffer cmdBuf = frame.commandBuffer;
         vkBeginCommandBuffer(cmdBuf, &beginInfo);
+        m_BoundState = {};
 
-        vkCmdBeginRenderPass(
-                cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(
-                cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipelines.obj);
+        const auto frameScope = beginGpuScope(cmdBuf, FRAME_GPU_SCOPE);
+        // Outside of any render pass, the query spans the whole frame
+        if(m_GpuProfiler)
+        {
+            m_GpuProfiler->beginStatistics(cmdBuf);
+        }
 
-        vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
-        vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+        RenderGraph graph;
+        const auto instanceCount =
+                static_cast<uint32_t>(m_InstanceBatcher.getInstanceCount());
+
+        // Draw buffers are rewritten every frame before they are read
+        std::optional<ResourceId> sceneDraws;
+        // Only when the late pass continues on the early pass's depth
+        std::optional<ResourceId> sceneDepth;
+        // Instances the culled draws index, when not the frame's own
+        std::optional<ResourceId> sceneInstances;
+        if(m_GpuCulling)
+        {
+            sceneDraws = graph.importBuffer("Culled draws", std::nullopt);
+            sceneInstances =
+                    graph.importBuffer("Culled instances", std::nullopt);
+            const auto batchCount = static_cast<uint32_t>(
+                    m_InstanceBatcher.getBatches().size());
+            const auto pass = graph.addPass(
+                    "GPU culling",
+                    PassQueue::AsyncCompute,
+                    [this, instanceCount, batchCount](
+                            VkCommandBuffer computeCmdBuf) {
+                        m_GpuCulling->record(
+                                computeCmdBuf,
+                                m_FrameIndex,
+                                instanceCount,
+                                batchCount,
+                                scene::Frustum::fromMatrix(m_CullMatrix));
+                    });
+            graph.use(pass, *sceneDraws, Access::ComputeShaderWrite);
+            graph.use(pass, *sceneInstances, Access::ComputeShaderWrite);
+        }
 
-        vkCmdBindDescriptorSets(
+        if(useHiZ)
+        {
+            // What was visible last frame, then the pyramid from its depth
+            // for the late cull
+            const auto earlyDraws =
+                    graph.importBuffer("HiZ early draws", std::nullopt);
+            sceneDraws = graph.importBuffer("HiZ late draws", std::nullopt);
+            // Last read by the previous frame's late cull
+            const auto pyramid = graph.importImage(
+                    "Depth pyramid",
+                    m_HiZCulling->getPyramidImage(),
+                    VK_IMAGE_ASPECT_COLOR_BIT,
+                    Access::ComputeStorageRead);
+            // Every render pass leaves it as a written attachment
+            const auto depth = graph.importImage(
+                    "Depth",
+                    m_Swapchain->getDepthImage(),
+                    VK_IMAGE_ASPECT_DEPTH_BIT,
+                    Access::DepthAttachment);
+            sceneDepth = depth;
+
+            auto pass = graph.addPass(
+                    "HiZ early cull",
+                    PassQueue::Graphics,
+                    [this, instanceCount](VkCommandBuffer passCmdBuf) {
+                        m_HiZCulling->resetVisibility(
+                                passCmdBuf,
+                                m_VisibilitySlots->takeAllocated());
+                        m_HiZCulling->cull(
+                                passCmdBuf,
+                                m_FrameIndex,
+                                HiZCulling::Early,
+                                instanceCount,
+                                m_CullMatrix);
+                    });
+            graph.use(pass, earlyDraws, Access::ComputeShaderWrite);
+
+            pass = graph.addPass(
+                    "Early pass",
+                    PassQueue::Graphics,
+                    [&](VkCommandBuffer passCmdBuf) {
+                        VkRenderPassBeginInfo earlyBeginInfo =
+                                renderPassBeginInfo;
+                        earlyBeginInfo.renderPass = m_EarlyRenderpass;
+                        vkCmdBeginRenderPass(
+                                passCmdBuf,
+                                &earlyBeginInfo,
+                                VK_SUBPASS_CONTENTS_INLINE);
+                        bindScenePipeline(
+                                passCmdBuf,
+                                m_FrameIndex,
+                                viewport,
+                                scissor,
+                                m_BoundState);
+                        m_HiZCulling->draw(
+                                passCmdBuf, m_FrameIndex, HiZCulling::Early);
+                        m_BoundState.stats.drawCalls += 1;
+                        vkCmdEndRenderPass(passCmdBuf);
+                    });
+            graph.use(pass, earlyDraws, Access::IndirectRead);
+            graph.use(pass, depth, Access::DepthAttachment);
+
+            pass = graph.addPass(
+                    "Depth pyramid",
+                    PassQueue::Graphics,
+                    [this](VkCommandBuffer passCmdBuf) {
+                        m_HiZCulling->buildDepthPyramid(passCmdBuf);
+                    });
+            graph.use(pass, depth, Access::ComputeShaderRead);
+            graph.use(pass, pyramid, Access::ComputeShaderWrite);
+
+            pass = graph.addPass(
+                    "HiZ late cull",
+                    PassQueue::Graphics,
+                    [this, instanceCount](VkCommandBuffer passCmdBuf) {
+                        m_HiZCulling->cull(
+                                passCmdBuf,
+                                m_FrameIndex,
+                                HiZCulling::Late,
+                                instanceCount,
+                                m_CullMatrix);
+                    });
+            graph.use(pass, pyramid, Access::ComputeStorageRead);
+            graph.use(pass, *sceneDraws, Access::ComputeShaderWrite);
+        }
+
+        // The render pass, UI included
+        const auto scenePass = graph.addPass(
+                "Scene pass",
+                PassQueue::Graphics,
+                [&](VkCommandBuffer passCmdBuf) {
+                    recordScenePass(
+                            passCmdBuf,
+                            renderPassBeginInfo,
+                            viewport,
+                            scissor,
+                            sceneReady);
+                });
+        if(sceneDraws && sceneReady)
+        {
+            graph.use(scenePass, *sceneDraws, Access::IndirectRead);
+        }
+        if(sceneInstances && sceneReady)
+        {
+            graph.use(
+                    scenePass, *sceneInstances, Access::GraphicsShaderRead);
+        }
+        if(sceneDepth)
+        {
+            graph.use(scenePass, *sceneDepth, Access::DepthAttachment);
+        }
+        graph.keep(scenePass);
+
+        const auto computeDone = m_RenderGraph->execute(
+                graph, m_FrameIndex, cmdBuf, m_GpuProfiler.get());
+
+        if(m_GpuProfiler)
+        {
+            m_GpuProfiler->endStatistics(cmdBuf);
+        }
+        endGpuScope(cmdBuf, frameScope);
+        VK_CHECK(vkEndCommandBuffer(cmdBuf));
+        m_RecordingStats += m_BoundState.stats;
+        return computeDone;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// The viewport is flipped for the scene, the UI is drawn with the plain one
+//
+
+void Context::recordScenePass(
+        VkCommandBuffer cmdBuf,
+        const VkRenderPassBeginInfo& renderPassBeginInfo,
+        VkViewport viewport,
+        const VkRect2D& scissor,
+        bool sceneReady)
+{
+    // Per batch draws are the only path with enough calls to be worth
+    // splitting, the others are a handful of indirect draws
+    const bool recordInParallel =
+            sceneReady && !m_HiZCulling && !m_GpuCulling
+            && !m_UseMultiDrawIndirect
+            && m_InstanceBatcher.getBatches().size()
+                       >= 2 * DRAWS_PER_RECORDING_JOB;
+
+    // The static draws are only set up on the per batch paths
+    if((sceneReady && m_StaticDraws) || recordInParallel)
+    {
+        vkCmdBeginRenderPass(
                 cmdBuf,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                m_PipelineLayout,
-                0,
-                1,
-                &m_DescriptorSet[nextImageIndex],
-                0,
-                nullptr);
+                &renderPassBeginInfo,
+                VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        auto secondaries = recordSceneSecondaries(
+                m_FrameIndex,
+                renderPassBeginInfo,
+                viewport,
+                scissor,
+                m_BoundState.stats);
+        if(m_StaticDraws)
+        {
+            secondaries.insert(
+                    secondaries.begin(),
+                    recordStaticDraws(
+                            m_FrameIndex,
+                            renderPassBeginInfo,
+                            viewport,
+                            scissor,
+                            m_BoundState.stats));
+        }
+        vkCmdExecuteCommands(
+                cmdBuf,
+                static_cast<uint32_t>(secondaries.size()),
+                secondaries.data());
+    }
+    else
+    {
+        vkCmdBeginRenderPass(
+                cmdBuf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        if(sceneReady)
+        {
+            bindScenePipeline(
+                    cmdBuf, m_FrameIndex, viewport, scissor, m_BoundState);
 
-        // Draw scene
-        renderSceneItems(cmdBuf);
+            // Draw scene
+            renderSceneItems(cmdBuf, m_FrameIndex, m_BoundState);
+        }
 
         viewport.y = 0;
         viewport.height = static_cast<float>(m_SwapchainExtent.height);
@@ -948,43 +1380,112 @@ void Context::recordCommandBuffers(uint32_t nextImageIndex)
 
         if(renderImGui)
         {
-            m_ui->draw(cmdBuf);
+            const auto uiScope = beginGpuScope(cmdBuf, "UI");
+            m_ui->draw(cmdBuf, m_BoundState.stats);
+            endGpuScope(cmdBuf, uiScope);
         }
+    }
 
-        vkCmdEndRenderPass(cmdBuf);
-        VK_CHECK(vkEndCommandBuffer(cmdBuf));
+    vkCmdEndRenderPass(cmdBuf);
+}
+
+// ----------------------------------------------------------------------------
+// Zero without a profiler or without support for inherited queries
+//
+
+VkQueryPipelineStatisticFlags Context::getInheritedStatistics() const
+{
+    return m_GpuProfiler ? m_GpuProfiler->getStatisticsFlags() : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Scopes are dropped without a profiler
+//
+
+GpuProfiler::ScopeId Context::beginGpuScope(
+        VkCommandBuffer cmdBuf, std::string_view name, QueueType queue)
+{
+    if(!m_GpuProfiler)
+    {
+        return GpuProfiler::INVALID_SCOPE;
     }
+    return m_GpuProfiler->begin(cmdBuf, name, queue);
 }
 
 // ----------------------------------------------------------------------------
 //
 //
 
-void Context::renderSceneItems(VkCommandBuffer cmdBuf)
+void Context::endGpuScope(VkCommandBuffer cmdBuf, GpuProfiler::ScopeId scope)
 {
-    assert(m_Scene);
-    VkDeviceSize offsets[] = {0};
+    if(m_GpuProfiler)
+    {
+        m_GpuProfiler->end(cmdBuf, scope);
+    }
+}
 
-    auto view = m_Registry
-                        .view<scene::component::VertexInfo,
-                              scene::component::Position>();
-    for(auto entity : view)
+// ----------------------------------------------------------------------------
+// Bound state survives render pass boundaries within a command buffer, so
+// only what changed since the last bind is recorded
+//
+
+void Context::bindScenePipeline(
+        VkCommandBuffer cmdBuf,
+        uint32_t frameIndex,
+        const VkViewport& viewport,
+        const VkRect2D& scissor,
+        BoundState& bound)
+{
+    if(bound.pipeline != m_Pipelines.obj)
     {
-        auto vertexInfo = view.get<scene::component::VertexInfo>(entity);
-        auto pos = view.get<scene::component::Position>(entity).pos;
-        const auto* vb = &vertexInfo.vertexBuffer;
-        const auto& ib = vertexInfo.indexBuffer;
-        vkCmdBindVertexBuffers(cmdBuf, 0, 1, vb, offsets);
-        vkCmdBindIndexBuffer(cmdBuf, ib, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindPipeline(
+                cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipelines.obj);
+        bound.pipeline = m_Pipelines.obj;
+        bound.stats.pipelineBinds += 1;
+    }
+
+    vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+    vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
 
-        vkCmdPushConstants(
+    if(bound.descriptorSet != m_Frames[frameIndex].descriptorSet)
+    {
+        vkCmdBindDescriptorSets(
                 cmdBuf,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
                 m_PipelineLayout,
-                VK_SHADER_STAGE_VERTEX_BIT,
                 0,
-                sizeof(glm::vec4),
-                &pos[0]);
-        vkCmdDrawIndexed(cmdBuf, vertexInfo.numIndices, 1, 0, 0, 0);
+                1,
+                &m_Frames[frameIndex].descriptorSet,
+                1,
+                &m_Frames[frameIndex].uniformOffset);
+        bound.descriptorSet = m_Frames[frameIndex].descriptorSet;
+        bound.stats.descriptorUpdates += 1;
+    }
+
+    // All meshes live in the geometry arena, bind it once for the whole
+    // command buffer
+    if(!bound.geometryArena)
+    {
+        m_Device->getGeometryArena()->bind(cmdBuf);
+        bound.geometryArena = true;
+        bound.stats.vertexBufferBinds += 1;
+        bound.stats.indexBufferBinds += 1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Variants share the pipeline layout, bound descriptor sets stay valid
+//
+
+void Context::bindSceneVariant(
+        VkCommandBuffer cmdBuf, uint32_t variant, BoundState& bound)
+{
+    const VkPipeline pipeline = getSceneVariant(variant);
+    if(bound.pipeline != pipeline)
+    {
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        bound.pipeline = pipeline;
+        bound.stats.pipelineBinds += 1;
     }
 }
 
@@ -992,219 +1493,553 @@ void Context::renderSceneItems(VkCommandBuffer cmdBuf)
 //
 //
 
-void Context::createUniformBuffers()
+void Context::renderSceneItems(
+        VkCommandBuffer cmdBuf, uint32_t frameIndex, BoundState& bound)
 {
-    m_UniformBuffer.resize(m_Swapchain->getImageCount());
-    m_UniformMemory.resize(m_Swapchain->getImageCount());
+    assert(m_Scene);
 
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    const auto& batches = m_InstanceBatcher.getBatches();
+    const auto drawCount = static_cast<uint32_t>(batches.size());
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
 
-    for(size_t i = 0; i < m_UniformBuffer.size(); ++i)
+    if(m_HiZCulling)
+    {
+        // Only what became visible since last frame, the rest was drawn in
+        // the early pass
+        m_HiZCulling->draw(cmdBuf, frameIndex, HiZCulling::Late);
+        bound.stats.drawCalls += 1;
+    }
+    else if(m_GpuCulling)
+    {
+        // Draw count was produced by the cull pass on the compute queue
+        m_GpuCulling->draw(cmdBuf, frameIndex);
+        bound.stats.drawCalls += 1;
+    }
+    else if(m_UseMultiDrawIndirect)
+    {
+        // One call per shader variant, batches are sorted by variant
+        const uint32_t maxDrawCount =
+                m_Device->getProperties().limits.maxDrawIndirectCount;
+        uint32_t runEnd = 0;
+        for(uint32_t first = 0; first < drawCount; first = runEnd)
+        {
+            runEnd = first + 1;
+            while(runEnd < drawCount
+                  && batches[runEnd].variant == batches[first].variant
+                  && runEnd - first < maxDrawCount)
+            {
+                ++runEnd;
+            }
+
+            bindSceneVariant(cmdBuf, batches[first].variant, bound);
+            vkCmdDrawIndexedIndirect(
+                    cmdBuf,
+                    m_Frames[frameIndex].indirectBuffer,
+                    VkDeviceSize{first} * stride,
+                    runEnd - first,
+                    stride);
+            // One call however many draws it makes
+            RenderStats run;
+            for(uint32_t i = first; i < runEnd; ++i)
+            {
+                countBatch(batches[i], run);
+            }
+            run.drawCalls = 1;
+            bound.stats += run;
+        }
+    }
+    else
     {
-        m_Device->createBuffer(
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VMA_MEMORY_USAGE_CPU_TO_GPU,
-                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-                        | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                bufferSize,
-                &m_UniformBuffer[i],
-                &m_UniformMemory[i]);
+        drawBatches(
+                cmdBuf, frameIndex, m_InstanceBatcher, 0, drawCount, bound);
     }
 }
 
 // ----------------------------------------------------------------------------
+// Batches [first, last) of the batcher with one draw call each, the part of
+// the scene that can be split across secondary command buffers
 //
+
+void Context::drawBatches(
+        VkCommandBuffer cmdBuf,
+        uint32_t frameIndex,
+        const scene::InstanceBatcher& batcher,
+        size_t first,
+        size_t last,
+        BoundState& bound)
+{
+    const auto& batches = batcher.getBatches();
+    assert(last <= batches.size());
+
+    if(m_UseIndirectDraw)
+    {
+        const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        for(size_t i = first; i < last; ++i)
+        {
+            bindSceneVariant(cmdBuf, batches[i].variant, bound);
+            vkCmdDrawIndexedIndirect(
+                    cmdBuf,
+                    m_Frames[frameIndex].indirectBuffer,
+                    (batcher.getFirstCommand() + VkDeviceSize{i}) * stride,
+                    1,
+                    stride);
+            countBatch(batches[i], bound.stats);
+        }
+    }
+    else
+    {
+        // One instanced draw per unique mesh and material set
+        for(size_t i = first; i < last; ++i)
+        {
+            const auto& batch = batches[i];
+            bindSceneVariant(cmdBuf, batch.variant, bound);
+            vkCmdDrawIndexed(
+                    cmdBuf,
+                    batch.indexCount,
+                    batch.instanceCount,
+                    batch.firstIndex,
+                    batch.vertexOffset,
+                    batch.firstInstance);
+            countBatch(batch, bound.stats);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Draws of the static entities, only re-recorded when the static set changed
+// since this frame last recorded them. The buffer is reused with whatever
+// image the frame renders to, waiting on the frame's submit guarantees it
+// has finished executing.
 //
 
-void Context::updateUniformBuffers(float dt)
+VkCommandBuffer Context::recordStaticDraws(
+        uint32_t frameIndex,
+        const VkRenderPassBeginInfo& renderPassInfo,
+        const VkViewport& viewport,
+        const VkRect2D& scissor,
+        RenderStats& stats)
 {
-    UniformBufferObject ubo;
+    auto& frame = m_Frames[frameIndex];
+    VkCommandBuffer secondary = m_StaticDrawPools->get(frameIndex, 0);
+    if(frame.staticDrawVersion == m_StaticDraws->getVersion()
+       && frame.staticDrawUniformOffset == frame.uniformOffset)
+    {
+        stats += frame.staticDrawStats;
+        return secondary;
+    }
 
-    static float timepass = 0.0f;
-    timepass += dt;
+    m_StaticDrawPools->reset(frameIndex);
 
-    const auto* camera = m_Scene->getCamera();
+    const auto inheritanceInfo = makeInheritanceInfo(
+            renderPassInfo.renderPass,
+            VK_NULL_HANDLE,
+            getInheritedStatistics());
 
-    ubo.model = glm::mat4(1.0f);
-    ubo.model = glm::translate(
-            ubo.model, glm::vec3(std::sin(timepass), 0.0f, 0.0f));
-    ubo.view = camera->matrices.view;
-    ubo.proj = camera->matrices.proj;
-    ubo.proj[0][0] *= -1.0f;
-    ubo.modelInverse = glm::inverse(ubo.model);
-    ubo.projViewInverse = glm::inverse(ubo.view) * glm::inverse(ubo.proj);
-    ubo.time = timepass;
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pNext = nullptr;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+
+    BoundState bound;
+    bindScenePipeline(secondary, frameIndex, viewport, scissor, bound);
+    drawBatches(
+            secondary,
+            frameIndex,
+            m_StaticBatcher,
+            0,
+            m_StaticBatcher.getBatches().size(),
+            bound);
 
-    void* data;
-    vmaMapMemory(
-            m_Device->getAllocator(), m_UniformMemory[m_FrameIndex], &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vmaUnmapMemory(m_Device->getAllocator(), m_UniformMemory[m_FrameIndex]);
+    VK_CHECK(vkEndCommandBuffer(secondary));
+
+    frame.staticDrawVersion = m_StaticDraws->getVersion();
+    frame.staticDrawUniformOffset = frame.uniformOffset;
+    frame.staticDrawStats = bound.stats;
+    stats += bound.stats;
+    return secondary;
 }
 
 // ----------------------------------------------------------------------------
-//
+// Split the batches across the work queue, every job records a secondary
+// command buffer from its own pool. The UI gets the last slot and is
+// recorded on the calling thread while the jobs run. Returns the buffers in
+// execution order.
 //
 
-void Context::setupDescriptors()
+std::vector<VkCommandBuffer> Context::recordSceneSecondaries(
+        uint32_t frameIndex,
+        const VkRenderPassBeginInfo& renderPassInfo,
+        const VkViewport& viewport,
+        const VkRect2D& scissor,
+        RenderStats& stats)
 {
-    { // Descriptor pool
-        std::array<VkDescriptorPoolSize, 3> poolSizes = {};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = m_Swapchain->getImageCount();
-
-        // TODO: why this is needed?
-        poolSizes[0].descriptorCount += 5;
-
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = m_Swapchain->getImageCount();
-        // poolSizes[1].descriptorCount += 5;
-
-        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        poolSizes[2].descriptorCount = 1;
-
-        VkDescriptorPoolCreateInfo poolInfo = {};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.pNext = nullptr;
-        poolInfo.flags = 0;
-        // poolInfo.maxSets = 5 * static_cast<uint32_t>(m_UniformBuffer.size());
-        poolInfo.maxSets = 100;
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.data();
-
-        VK_CHECK(vkCreateDescriptorPool(
-                m_Device->getLogicalDevice(),
-                &poolInfo,
-                nullptr,
-                &m_DescriptorPool));
-    }
-
-    { // Descripor set layout
-        std::array<VkDescriptorSetLayoutBinding, 3> layoutBindings = {};
-        layoutBindings[0].binding = 0;
-        layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        layoutBindings[0].descriptorCount = 1;
-        layoutBindings[0].stageFlags =
-                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-        layoutBindings[0].pImmutableSamplers = nullptr;
-
-        layoutBindings[1].binding = 1;
-        layoutBindings[1].descriptorType =
-                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        layoutBindings[1].descriptorCount =
-                1; // TODO count as many as there is textures
-        layoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        layoutBindings[1].pImmutableSamplers = nullptr;
-
-        layoutBindings[2].binding = 2;
-        layoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        layoutBindings[2].descriptorCount = 1;
-        layoutBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        layoutBindings[2].pImmutableSamplers = nullptr;
-
-        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.flags = 0;
-        layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
-        layoutInfo.pBindings = layoutBindings.data();
-
-        // TODO AWAW alloc for every image
-        VK_CHECK(vkCreateDescriptorSetLayout(
-                m_Device->getLogicalDevice(),
-                &layoutInfo,
-                nullptr,
-                &m_DescSetLayout));
+    m_RecordingPools->reset(frameIndex);
+
+    const size_t batchCount = m_InstanceBatcher.getBatches().size();
+    const uint32_t uiSlot = m_RecordingPools->getSlotCount() - 1;
+    const auto jobCount = static_cast<uint32_t>(std::clamp<size_t>(
+            (batchCount + DRAWS_PER_RECORDING_JOB - 1)
+                    / DRAWS_PER_RECORDING_JOB,
+            1,
+            uiSlot));
+
+    const auto inheritanceInfo = makeInheritanceInfo(
+            renderPassInfo.renderPass,
+            renderPassInfo.framebuffer,
+            getInheritedStatistics());
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pNext = nullptr;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+                      | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    // Secondaries inherit no state, each binds what it uses. Every job
+    // counts into a slot of its own.
+    std::vector<RenderStats> jobStats(jobCount);
+    auto recordRange = [&, this](uint32_t job) {
+        VkCommandBuffer secondary = m_RecordingPools->get(frameIndex, job);
+        VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+
+        BoundState bound;
+        bindScenePipeline(secondary, frameIndex, viewport, scissor, bound);
+        drawBatches(
+                secondary,
+                frameIndex,
+                m_InstanceBatcher,
+                batchCount * job / jobCount,
+                batchCount * (job + 1) / jobCount,
+                bound);
+
+        VK_CHECK(vkEndCommandBuffer(secondary));
+        jobStats[job] = bound.stats;
+    };
+
+    std::vector<std::future<void>> jobs;
+    for(uint32_t job = 1; job < jobCount; ++job)
+    {
+        jobs.push_back(getWorkQueue().submitWork(recordRange, job));
     }
 
-    { // Allocate descriptor sets
-        m_DescriptorSet.resize(m_Swapchain->getImageCount());
-        std::vector<VkDescriptorSetLayout> layouts(
-                m_Swapchain->getImageCount(), m_DescSetLayout);
+    recordRange(0);
 
-        VkDescriptorSetAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.descriptorPool = m_DescriptorPool;
-        allocInfo.descriptorSetCount = layouts.size();
-        allocInfo.pSetLayouts = layouts.data();
+    std::vector<VkCommandBuffer> secondaries;
+    for(uint32_t job = 0; job < jobCount; ++job)
+    {
+        secondaries.push_back(m_RecordingPools->get(frameIndex, job));
+    }
 
-        VK_CHECK(vkAllocateDescriptorSets(
-                m_Device->getLogicalDevice(),
-                &allocInfo,
-                m_DescriptorSet.data()));
+    if(renderImGui)
+    {
+        VkCommandBuffer secondary = m_RecordingPools->get(frameIndex, uiSlot);
+        VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+
+        VkViewport uiViewport = viewport;
+        uiViewport.y = 0;
+        uiViewport.height = static_cast<float>(m_SwapchainExtent.height);
+        vkCmdSetViewport(secondary, 0, 1, &uiViewport);
+        vkCmdSetScissor(secondary, 0, 1, &scissor);
+        const auto uiScope = beginGpuScope(secondary, "UI");
+        m_ui->draw(secondary, stats);
+        endGpuScope(secondary, uiScope);
+
+        VK_CHECK(vkEndCommandBuffer(secondary));
+        secondaries.push_back(secondary);
+    }
+
+    for(auto& job : jobs)
+    {
+        job.get();
+    }
+    for(const auto& counted : jobStats)
+    {
+        stats += counted;
+    }
+
+    return secondaries;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Context::createTransientBuffers()
+{
+    m_Transient = std::make_unique<TransientAllocator>(
+            m_Device.get(),
+            static_cast<uint32_t>(m_Frames.size()),
+            TRANSIENT_BUFFER_SIZE);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Context::createDrawBuffers()
+{
+    std::vector<VkBuffer> instanceBuffers;
+    std::vector<VkBuffer> indirectBuffers;
+
+    for(auto& frame : m_Frames)
+    {
+        // Both are read by the cull pass on the compute queue
+        frame.instances =
+                static_cast<scene::InstanceData*>(m_Device->createMappedBuffer(
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        sizeof(scene::InstanceData) * MAX_INSTANCES,
+                        &frame.instanceBuffer,
+                        &frame.instanceMemory,
+                        true));
+
+        // Worst case every instance is a batch of its own
+        frame.indirectCommands = static_cast<VkDrawIndexedIndirectCommand*>(
+                m_Device->createMappedBuffer(
+                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                                | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        sizeof(VkDrawIndexedIndirectCommand) * MAX_INSTANCES,
+                        &frame.indirectBuffer,
+                        &frame.indirectMemory,
+                        true));
+
+        instanceBuffers.push_back(frame.instanceBuffer);
+        indirectBuffers.push_back(frame.indirectBuffer);
     }
 
-    std::vector<VkWriteDescriptorSet> descriptorWrites;
-    const auto& imageInfos = m_Scene->getImageInfos();
-    const auto& materialBufferInfos = m_Scene->getbufferinfos();
-    std::vector<VkDescriptorBufferInfo> uniformInfos;
+    if(m_Config.hizCulling && HiZCulling::isSupported(*m_Device))
+    {
+        m_HiZCulling = std::make_unique<HiZCulling>(
+                m_Device.get(),
+                instanceBuffers,
+                indirectBuffers,
+                MAX_INSTANCES);
+        m_HiZCulling->setDepth(
+                m_Swapchain->getDepthView(), m_Swapchain->getExtent());
+        m_VisibilitySlots = std::make_unique<scene::VisibilitySlots>(
+                m_Registry, HiZCulling::VISIBILITY_SLOTS);
+    }
+    else if(m_Config.gpuCulling && GpuCulling::isSupported(*m_Device))
+    {
+        m_GpuCulling = std::make_unique<GpuCulling>(
+                m_Device.get(),
+                instanceBuffers,
+                indirectBuffers,
+                MAX_INSTANCES);
+    }
 
-    for(const auto& ub : m_UniformBuffer)
+    // gl_InstanceIndex carries the instance offset, so indirect draws need a
+    // non-zero firstInstance
+    const auto& features = m_Device->getEnabledFeatures();
+    m_UseIndirectDraw =
+            m_Config.indirectDraw && features.drawIndirectFirstInstance;
+    m_UseMultiDrawIndirect = m_UseIndirectDraw && features.multiDrawIndirect;
+    m_InstanceBatcher.setInstancing(m_Config.instancing != 0);
+    m_StaticBatcher.setInstancing(m_Config.instancing != 0);
+
+    // The other paths record a handful of commands whatever the scene
+    if(m_Config.staticDrawCache && !m_GpuCulling && !m_HiZCulling
+       && !m_UseMultiDrawIndirect)
     {
-        VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = ub;
-        bufferInfo.offset = 0;
-        bufferInfo.range = VK_WHOLE_SIZE;
-        uniformInfos.push_back(bufferInfo);
+        m_StaticDraws = std::make_unique<scene::StaticDrawTracker>(m_Registry);
     }
 
-    for(uint32_t i = 0; i < m_Swapchain->getImageCount(); ++i)
+    // Occlusion needs the frustum culled list, the compute pass then only
+    // sees what survived both
+    m_UseCpuCulling =
+            !(m_GpuCulling || m_HiZCulling) || m_Config.occlusionCulling;
+
+    m_Log->info(
+            "Scene submission: {}",
+            m_HiZCulling             ? "two pass HiZ culled indirect count"
+            : m_GpuCulling           ? "GPU culled indirect count"
+            : m_UseMultiDrawIndirect ? "multi draw indirect"
+            : m_UseIndirectDraw      ? "draw indirect"
+                                     : "direct");
+    m_Log->info("Static draw cache: {}", m_StaticDraws ? "on" : "off");
+    m_Log->info(
+            "CPU culling: {}",
+            !m_UseCpuCulling             ? "off"
+            : m_Config.occlusionCulling ? "frustum and occlusion"
+                                        : "frustum");
+}
+
+// ----------------------------------------------------------------------------
+// Group the scene (only the visible part when culling on the CPU) into
+// instanced batches and write the instance data and indirect commands for
+// the frame about to be recorded
+//
+
+void Context::updateDrawBuffers(uint32_t frameIndex)
+{
+    // Instances of a batch are drawn front to back from here
+    const glm::vec3 viewPosition = m_Scene->getCamera()->getPosition();
+
+    if(m_ForgetDrawIds)
     {
-        { // Uniform buffer
-            VkWriteDescriptorSet descriptorWrite = {};
-            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrite.pNext = nullptr;
-            descriptorWrite.dstSet = m_DescriptorSet[i];
-            descriptorWrite.dstBinding = 0;
-            descriptorWrite.dstArrayElement = 0;
-            descriptorWrite.descriptorCount = 1;
-            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrite.pBufferInfo = &uniformInfos[i];
+        m_InstanceBatcher.forgetIds();
+        m_StaticBatcher.forgetIds();
+        m_ForgetDrawIds = false;
+    }
 
-            descriptorWrites.push_back(descriptorWrite);
+    if(m_StaticDraws)
+    {
+        // Static instances and commands go first in the buffers, the per
+        // frame ones follow. The static batches are sorted from where the
+        // camera was when they last changed.
+        if(m_StaticDraws->update())
+        {
+            m_StaticBatcher.build(
+                    m_Registry, m_StaticDraws->getStatic(), viewPosition);
         }
+        m_InstanceBatcher.setBase(
+                static_cast<uint32_t>(m_StaticBatcher.getInstanceCount()),
+                static_cast<uint32_t>(m_StaticBatcher.getBatches().size()));
+    }
 
-        if(imageInfos.size())
+    if(!m_UseCpuCulling)
+    {
+        // Everything goes to the compute pass, it does the culling
+        m_InstanceBatcher.build(m_Registry, viewPosition);
+    }
+    else
+    {
+        const auto& visible = m_Config.occlusionCulling
+                                      ? m_OcclusionCuller.getVisible()
+                                      : m_CullingSystem.getVisible();
+        if(m_StaticDraws)
         {
-            VkWriteDescriptorSet descriptorWrite = {};
-            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrite.pNext = nullptr;
-            descriptorWrite.dstSet = m_DescriptorSet[i];
-            descriptorWrite.dstBinding = 1;
-            descriptorWrite.dstArrayElement = 0;
-            descriptorWrite.descriptorCount =
-                    static_cast<uint32_t>(imageInfos.size());
-            descriptorWrite.descriptorType =
-                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrite.pImageInfo = imageInfos.data();
-
-            descriptorWrites.push_back(descriptorWrite);
+            m_DynamicVisible.clear();
+            std::copy_if(
+                    visible.begin(),
+                    visible.end(),
+                    std::back_inserter(m_DynamicVisible),
+                    [this](auto entity) {
+                        return m_Registry.all_of<scene::component::DynamicDraw>(
+                                entity);
+                    });
+            m_InstanceBatcher.build(m_Registry, m_DynamicVisible, viewPosition);
         }
-
-        { // Material buffer
-            VkWriteDescriptorSet descriptorWrite = {};
-            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrite.pNext = nullptr;
-            descriptorWrite.dstSet = m_DescriptorSet[i];
-            descriptorWrite.dstBinding = 2;
-            descriptorWrite.dstArrayElement = 0;
-            descriptorWrite.descriptorCount =
-                    static_cast<uint32_t>(materialBufferInfos.size());
-            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            descriptorWrite.pBufferInfo = materialBufferInfos.data();
-
-            descriptorWrites.push_back(descriptorWrite);
+        else
+        {
+            m_InstanceBatcher.build(m_Registry, visible, viewPosition);
         }
     }
 
-    vkUpdateDescriptorSets(
-            m_Device->getLogicalDevice(),
-            static_cast<uint32_t>(descriptorWrites.size()),
-            descriptorWrites.data(),
-            0,
-            nullptr);
+    const size_t instanceCount = m_InstanceBatcher.getInstanceCount()
+                                 + m_StaticBatcher.getInstanceCount();
+    if(instanceCount > MAX_INSTANCES)
+    {
+        m_Log->critical(
+                "{} instances exceeds the limit of {}",
+                instanceCount,
+                MAX_INSTANCES);
+        assert(false);
+        throw std::runtime_error("Too many instances");
+    }
+
+    // Written straight into the persistently mapped buffers of this frame
+    auto& frame = m_Frames[frameIndex];
+    if(m_StaticDraws && frame.staticDrawVersion != m_StaticDraws->getVersion())
+    {
+        m_StaticBatcher.write(
+                m_Registry, frame.instances, frame.indirectCommands);
+        m_Device->countUpload(getDrawBufferBytes(m_StaticBatcher));
+    }
+    m_InstanceBatcher.write(
+            m_Registry, frame.instances, frame.indirectCommands);
+    m_Device->countUpload(getDrawBufferBytes(m_InstanceBatcher));
 }
 
+// ----------------------------------------------------------------------------
+// Unloading a model destroys the entities drawing it first, the ids of its
+// mesh and material buffers are dropped on the next update
+//
+
+void Context::onRenderableDestroyed(
+        entt::registry& registry, entt::entity entity)
+{
+    (void)registry;
+    (void)entity;
+    m_ForgetDrawIds = true;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Context::updateVisibility(float dt)
+{
+    PROFILE_ZONE("Context::updateVisibility");
+    auto& ubo = m_Ubo;
+
+    m_Timepass += dt;
+
+    const auto* camera = m_Scene->getCamera();
+
+    ubo.model = glm::mat4(1.0f);
+    ubo.model = glm::translate(
+            ubo.model, glm::vec3(std::sin(m_Timepass), 0.0f, 0.0f));
+    ubo.view = camera->matrices.view;
+    ubo.proj = camera->matrices.proj;
+    ubo.proj[0][0] *= -1.0f;
+    ubo.modelInverse = glm::inverse(ubo.model);
+    ubo.projViewInverse = glm::inverse(ubo.view) * glm::inverse(ubo.proj);
+    ubo.time = m_Timepass;
+
+    // Culling uses the same clip space as obj.vert, frustum planes extracted
+    // from it end up in world space
+    m_CullMatrix = ubo.proj * ubo.view * ubo.model;
+
+    if(!m_UseCpuCulling)
+    {
+        m_CullingStats = {};
+        return;
+    }
+
+    m_CullingSystem.update(m_Registry);
+    m_CullingSystem.cull(scene::Frustum::fromMatrix(m_CullMatrix));
+
+    m_CullingStats.tested = m_CullingSystem.getTestedCount();
+    m_CullingStats.frustumCulled =
+            m_CullingStats.tested - m_CullingSystem.getVisible().size();
+
+    if(m_Config.occlusionCulling)
+    {
+        m_OcclusionCuller.update(
+                m_Registry, m_CullMatrix, m_CullingSystem.getVisible());
+        m_CullingStats.occluders = m_OcclusionCuller.getOccluderCount();
+        m_CullingStats.occlusionCulled = m_OcclusionCuller.getCulledCount();
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Context::updateUniformBuffers()
+{
+    PROFILE_ZONE("Context::updateUniformBuffers");
+    // First allocation of the frame, so it lands in the buffer the
+    // descriptor set points at
+    const auto uniforms = m_Transient->allocate(
+            sizeof(m_Ubo),
+            m_Device->getProperties().limits.minUniformBufferOffsetAlignment);
+    assert(uniforms.buffer == m_Transient->getBuffer(m_FrameIndex));
+
+    // Whole struct at once, the buffer is write combined memory
+    memcpy(uniforms.data, &m_Ubo, sizeof(m_Ubo));
+    m_Device->countUpload(sizeof(m_Ubo));
+    m_Frames[m_FrameIndex].uniformOffset =
+            static_cast<uint32_t>(uniforms.offset);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
 void Context::setupDescriptors2()
 {
     m_DescriptorSetGenerator = std::make_unique<DescriptorSetGenerator>(
@@ -1213,7 +2048,7 @@ void Context::setupDescriptors2()
     m_DescriptorSetGenerator->addBinding(
             0, // binding
             1, // count
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
             VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
     m_DescriptorSetGenerator->addBinding(
@@ -1228,14 +2063,18 @@ void Context::setupDescriptors2()
             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             VK_SHADER_STAGE_FRAGMENT_BIT);
 
+    m_DescriptorSetGenerator->addBinding(
+            3, // binding
+            1, // count
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_VERTEX_BIT);
+
     m_DescriptorPool = m_DescriptorSetGenerator->generatePool(100);
     m_DescSetLayout = m_DescriptorSetGenerator->generateLayout();
 
-    m_DescriptorSet.resize(m_Swapchain->getImageCount());
-
-    for(auto& set : m_DescriptorSet)
+    for(auto& frame : m_Frames)
     {
-        set = m_DescriptorSetGenerator->generateSet(
+        frame.descriptorSet = m_DescriptorSetGenerator->generateSet(
                 m_DescriptorPool, m_DescSetLayout);
     }
 
@@ -1264,29 +2103,92 @@ void Context::updateDescriptorSets()
         // TODO AWAW this breaks without break
     }
 
-    for(std::size_t i = 0; i < m_DescriptorSet.size(); ++i)
+    for(uint32_t i = 0; i < m_Frames.size(); ++i)
     {
-        // Uniform buffer info
+        const auto& frame = m_Frames[i];
+
+        // Transient buffer of the frame, the block moves with the dynamic
+        // offset
         VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = m_UniformBuffer[i];
+        bufferInfo.buffer = m_Transient->getBuffer(i);
         bufferInfo.offset = 0;
-        bufferInfo.range = VK_WHOLE_SIZE;
+        bufferInfo.range = sizeof(UniformBufferObject);
 
-        m_DescriptorSetGenerator->bind(m_DescriptorSet[i], 0, {bufferInfo});
-        m_DescriptorSetGenerator->bind(m_DescriptorSet[i], 1, imageInfos);
         m_DescriptorSetGenerator->bind(
-                m_DescriptorSet[i], 2, materialBufferInfos);
+                frame.descriptorSet, 0, {bufferInfo}, true);
+        m_DescriptorSetGenerator->bind(frame.descriptorSet, 1, imageInfos);
+        m_DescriptorSetGenerator->bind(
+                frame.descriptorSet, 2, materialBufferInfos);
+
+        // GPU culled draws only see the instances that survived
+        VkDescriptorBufferInfo instanceInfo = {};
+        instanceInfo.buffer =
+                m_GpuCulling ? m_GpuCulling->getVisibleInstanceBuffer(i)
+                             : frame.instanceBuffer;
+        instanceInfo.offset = 0;
+        instanceInfo.range = VK_WHOLE_SIZE;
+
+        m_DescriptorSetGenerator->bind(frame.descriptorSet, 3, {instanceInfo});
     }
     m_DescriptorSetGenerator->updateSetContents();
 }
 
+// ----------------------------------------------------------------------------
+// The transient buffer of the frame was replaced by a larger one. Only the
+// set of this frame is written, the others may be in use by frames in
+// flight.
+//
+
+void Context::bindTransientBuffer(uint32_t frameIndex)
+{
+    auto& frame = m_Frames[frameIndex];
+
+    VkDescriptorBufferInfo bufferInfo = {};
+    bufferInfo.buffer = m_Transient->getBuffer(frameIndex);
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+
+    // Keep the generator in sync for later full updates
+    m_DescriptorSetGenerator->bind(frame.descriptorSet, 0, {bufferInfo}, true);
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstSet = frame.descriptorSet;
+    write.dstBinding = 0;
+    write.dstArrayElement = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(
+            m_Device->getLogicalDevice(), 1, &write, 0, nullptr);
+    m_RecordingStats.descriptorUpdates += 1;
+
+    frame.transientGeneration = m_Transient->getGeneration(frameIndex);
+    // Cached static draws bound the set before the update
+    frame.staticDrawVersion = 0;
+}
+
 // ----------------------------------------------------------------------------
 //
 //
 
 void Context::recreateSwapchain()
 {
-    vkDeviceWaitIdle(m_Device->getLogicalDevice());
+    // Offscreen images are never out of date
+    assert(m_Window);
+
+    // The HiZ descriptor sets of every frame are rewritten in place for the
+    // new depth pyramid, so its frames in flight have to finish first.
+    // Everything else is replaced and the old objects destroyed later.
+    if(m_HiZCulling)
+    {
+        m_Device->wait(m_Device->getLastSubmitted(QueueType::Graphics));
+        m_Device->wait(m_Device->getLastSubmitted(QueueType::Compute));
+    }
+    // Compiles still running reference the old render pass, new requests
+    // use the new one
+    m_PipelineManager->wait();
     cleanupSwapchain();
 
     int width, height;
@@ -1301,6 +2203,12 @@ void Context::recreateSwapchain()
             static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
 
     m_Swapchain->create(m_Config.vsync);
+    if(m_HiZCulling)
+    {
+        m_HiZCulling->setDepth(
+                m_Swapchain->getDepthView(), m_Swapchain->getExtent());
+    }
+    createPresentSemaphores();
     createRenderPass();
     m_Swapchain->createFrameBuffers(m_Renderpass);
     allocateCommandBuffers();
@@ -1313,13 +2221,33 @@ void Context::recreateSwapchain()
 void Context::cleanupSwapchain()
 {
     m_Swapchain->destroyFrameBuffers();
-    vkFreeCommandBuffers(
-            m_Device->getLogicalDevice(),
-            m_Device->getGraphicsCommandPool(),
-            static_cast<uint32_t>(m_RenderingCommandBuffers.size()),
-            m_RenderingCommandBuffers.data());
 
-    vkDestroyRenderPass(m_Device->getLogicalDevice(), m_Renderpass, nullptr);
+    // Frames in flight still wait on the semaphores and render with the
+    // render passes
+    m_Device->destroyLater([device = m_Device->getLogicalDevice(),
+                            semaphores = std::move(
+                                    m_RenderingCompleteSemaphores),
+                            renderpass = m_Renderpass,
+                            earlyRenderpass = m_EarlyRenderpass,
+                            lateRenderpass = m_LateRenderpass]() {
+        for(auto semaphore : semaphores)
+        {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        vkDestroyRenderPass(device, renderpass, nullptr);
+        if(earlyRenderpass != VK_NULL_HANDLE)
+        {
+            vkDestroyRenderPass(device, earlyRenderpass, nullptr);
+        }
+        if(lateRenderpass != VK_NULL_HANDLE)
+        {
+            vkDestroyRenderPass(device, lateRenderpass, nullptr);
+        }
+    });
+    m_RenderingCompleteSemaphores.clear();
+    m_Renderpass = VK_NULL_HANDLE;
+    m_EarlyRenderpass = VK_NULL_HANDLE;
+    m_LateRenderpass = VK_NULL_HANDLE;
 }
 
 void Context::onEvent(event::DescriptorSetAllocateEvent const& event)
@@ -1329,4 +2257,35 @@ void Context::onEvent(event::DescriptorSetAllocateEvent const& event)
     event.callback(set);
 }
 
+// ----------------------------------------------------------------------------
+// Called from PipelineManager::update at the start of renderFrame, the
+// frame being recorded already draws with the new pipeline
+//
+
+void Context::onEvent(event::PipelineReadyEvent const& event)
+{
+    if(std::find(m_SceneVariants.begin(), m_SceneVariants.end(), event.handle)
+       == m_SceneVariants.end())
+    {
+        return;
+    }
+
+    // Cached static draws still use the variant they were substituted with
+    for(auto& frame : m_Frames)
+    {
+        frame.staticDrawVersion = 0;
+    }
+    if(event.handle != m_ScenePipeline)
+    {
+        return;
+    }
+
+    m_Pipelines.obj = event.pipeline;
+    m_PipelineCreationMs = m_PipelineTimer.elapsed() * 1000.0f;
+    m_Log->info(
+            "Scene pipeline ready {:.1f} ms after generatePipelines",
+            m_PipelineCreationMs);
+    m_Device->savePipelineCache();
+}
+
 } // namespace core::vk
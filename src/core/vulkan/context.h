@@ -4,26 +4,43 @@
 #include "config/config.h"
 #include "core/model/model.h"
 #include "core/scene/camera.h"
+#include "core/scene/culling.h"
+#include "core/scene/occlusion.h"
+#include "core/scene/instancing.h"
 #include "core/scene/scene.h"
+#include "core/scene/staticdraws.h"
+#include "core/scene/visibilityslots.h"
 #include "core/texture/texture.h"
 #include "core/vulkan/descriptorgen.h"
 #include "core/vulkan/device.h"
 #include "debugutils.h"
+#include "gpuculling.h"
+#include "gpuprofiler.h"
+#include "hizculling.h"
 #include "event/sub.h"
 #include "event/setupevents.h"
 #include "imguisetup.h"
+#include "pipelinemanager.h"
+#include "recordingpools.h"
+#include "rendergraphexecutor.h"
+#include "renderstats.h"
 #include "swapchain.h"
+#include "transientallocator.h"
 
 #include "logs/log.h"
+#include "timer/timer.h"
 #include "entt/entity/registry.hpp"
 
 #include <GLFW/glfw3.h>
 #include <glm/mat4x4.hpp>
 #include <vulkan/vulkan.h>
 
+#include <array>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #define PRINT_QUEUE_INFO
@@ -41,33 +58,156 @@ public:
     ~Context();
 
     void init(VkExtent2D swapchainExtent);
+
+    // Camera and CPU culling for the next frame, must return before
+    // renderFrame. Large scenes are culled in jobs on the work queue that
+    // it waits for, so it must not run on a worker itself.
+    void updateVisibility(float dt);
     void renderFrame(float dt);
     void deviceWaitIdle() { vkDeviceWaitIdle(m_Device->getLogicalDevice()); }
     void generatePipelines();
+    // Blocks until every pipeline requested so far has compiled
+    void waitForPipelines();
     void recreateSwapchain();
 
     [[nodiscard]] auto* getDevice() { return m_Device.get(); }
     [[nodiscard]] const auto* getDevice() const { return m_Device.get(); }
 
+    struct CullingStats
+    {
+        size_t tested = 0;
+        size_t frustumCulled = 0;
+        size_t occluders = 0;
+        size_t occlusionCulled = 0;
+    };
+
+    // Counts from the last updateVisibility
+    [[nodiscard]] CullingStats getCullingStats() const
+    {
+        return m_CullingStats;
+    }
+
+    // Time from generatePipelines until the scene pipeline was ready, mostly
+    // decided by pipeline cache hits. 0 until then.
+    [[nodiscard]] float getPipelineCreationMs() const
+    {
+        return m_PipelineCreationMs;
+    }
+
+    // GPU time of the graphics command buffer of the frame that finished
+    // during the last renderFrame, frames in flight behind the CPU. Empty
+    // without a profiler or when no frame finished.
+    [[nodiscard]] std::optional<float> getGpuFrameMs() const;
+    // CPU time spent in the parts of the last renderFrame
+    struct FrameTimings
+    {
+        // Waiting for the frame in flight and acquiring the image
+        float presentWaitMs = 0.0f;
+        // Per frame updates, culling and command buffer recording
+        float recordMs = 0.0f;
+        // Queue submit and present
+        float submitMs = 0.0f;
+    };
+    [[nodiscard]] FrameTimings getFrameTimings() const
+    {
+        return m_FrameTimings;
+    }
+    // Recorded by the last renderFrame, with what was allocated and
+    // uploaded since the one before
+    [[nodiscard]] const RenderStats& getRenderStats() const
+    {
+        return m_RenderStats;
+    }
+
+    // Null when the device can't reset queries from the host
+    [[nodiscard]] const GpuProfiler* getGpuProfiler() const
+    {
+        return m_GpuProfiler.get();
+    }
+
     bool m_FrameBufferResized = false;
     bool renderImGui = true;
 
     void onEvent(event::DescriptorSetAllocateEvent const& event);
+    void onEvent(event::PipelineReadyEvent const& event);
 
 private:
     void updateOverlay(float dt);
     void createInstance();
     [[nodiscard]] VkPhysicalDevice selectPhysicalDevice();
     void createSynchronizationPrimitives();
+    void createPresentSemaphores();
     void createRenderPass();
+    void createHiZRenderPasses();
     void createGraphicsPipeline();
+    PipelineHandle requestSceneVariant(uint32_t features);
+    void requestSceneVariants();
+    [[nodiscard]] VkPipeline getSceneVariant(uint32_t variant) const;
     void allocateCommandBuffers();
-    void recordCommandBuffers(uint32_t nextImageIndex);
-    void renderSceneItems(VkCommandBuffer cmdBuf);
+    // Graphics state already recorded into a command buffer
+    struct BoundState
+    {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        bool geometryArena = false;
+        // Work recorded into the command buffer
+        RenderStats stats;
+    };
+
+    // The frame's passes as a render graph, the async compute ones are
+    // submitted here. Returns what the graphics submit has to wait for.
+    [[nodiscard]] std::optional<TimelineWait> recordCommandBuffers(
+            uint32_t imageIndex);
+    void recordScenePass(
+            VkCommandBuffer cmdBuf,
+            const VkRenderPassBeginInfo& renderPassBeginInfo,
+            VkViewport viewport,
+            const VkRect2D& scissor,
+            bool sceneReady);
+    // The recorded work is added to stats
+    [[nodiscard]] std::vector<VkCommandBuffer> recordSceneSecondaries(
+            uint32_t frameIndex,
+            const VkRenderPassBeginInfo& renderPassInfo,
+            const VkViewport& viewport,
+            const VkRect2D& scissor,
+            RenderStats& stats);
+    [[nodiscard]] VkCommandBuffer recordStaticDraws(
+            uint32_t frameIndex,
+            const VkRenderPassBeginInfo& renderPassInfo,
+            const VkViewport& viewport,
+            const VkRect2D& scissor,
+            RenderStats& stats);
+    // Pipeline statistics secondary command buffers have to inherit
+    [[nodiscard]] VkQueryPipelineStatisticFlags getInheritedStatistics() const;
+    void bindScenePipeline(
+            VkCommandBuffer cmdBuf,
+            uint32_t frameIndex,
+            const VkViewport& viewport,
+            const VkRect2D& scissor,
+            BoundState& bound);
+    [[nodiscard]] GpuProfiler::ScopeId beginGpuScope(
+            VkCommandBuffer cmdBuf,
+            std::string_view name,
+            QueueType queue = QueueType::Graphics);
+    void endGpuScope(VkCommandBuffer cmdBuf, GpuProfiler::ScopeId scope);
+    void bindSceneVariant(
+            VkCommandBuffer cmdBuf, uint32_t variant, BoundState& bound);
+    void renderSceneItems(
+            VkCommandBuffer cmdBuf, uint32_t frameIndex, BoundState& bound);
+    void drawBatches(
+            VkCommandBuffer cmdBuf,
+            uint32_t frameIndex,
+            const scene::InstanceBatcher& batcher,
+            size_t first,
+            size_t last,
+            BoundState& bound);
 
-    void createUniformBuffers();
-    void updateUniformBuffers(float dt);
-    void setupDescriptors();
+    void createTransientBuffers();
+    void bindTransientBuffer(uint32_t frameIndex);
+    void updateUniformBuffers();
+    void createDrawBuffers();
+    void updateDrawBuffers(uint32_t frameIndex);
+    void onRenderableDestroyed(entt::registry& registry, entt::entity entity);
     void setupDescriptors2();
     void updateDescriptorSets();
 
@@ -100,30 +240,113 @@ private:
 
     scene::Scene* m_Scene = nullptr;
     entt::registry& m_Registry;
+    entt::dispatcher& m_Dispatcher;
     event::Subs<Context> m_conn;
 
     VkInstance m_Instance = VK_NULL_HANDLE;
     VkRenderPass m_Renderpass = VK_NULL_HANDLE;
+    // Compatible with m_Renderpass, the frame is split around the depth
+    // pyramid build when culling with HiZCulling
+    VkRenderPass m_EarlyRenderpass = VK_NULL_HANDLE;
+    VkRenderPass m_LateRenderpass = VK_NULL_HANDLE;
     VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
-    uint32_t m_FrameIndex = 0;
+    // Owns m_Pipelines.obj, which stays null until it has compiled
+    std::unique_ptr<PipelineManager> m_PipelineManager;
+    // Generic obj variant, m_Pipelines.obj once ready
+    PipelineHandle m_ScenePipeline = INVALID_PIPELINE;
+    // Indexed by model::shaderfeature bits, INVALID_PIPELINE until used
+    std::array<PipelineHandle, model::shaderfeature::VARIANT_COUNT>
+            m_SceneVariants;
 
     VkExtent2D m_SwapchainExtent = {0, 0};
 
-    std::vector<VkSemaphore> m_PresentCompleteSemaphores;
+    // Everything a frame in flight writes or records, reused once its last
+    // graphics submit has been reached on the timeline. Frames are used round
+    // robin whatever swapchain image they render to.
+    struct FrameData
+    {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        TimelinePoint submitted;
+        VkSemaphore imageAcquired = VK_NULL_HANDLE;
+
+        // Dynamic offset of the uniform block in the transient buffer
+        uint32_t uniformOffset = 0;
+        // Transient buffer generation the descriptor set points at
+        uint64_t transientGeneration = 0;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        VkBuffer instanceBuffer = VK_NULL_HANDLE;
+        VmaAllocation instanceMemory = VK_NULL_HANDLE;
+        scene::InstanceData* instances = nullptr;
+        VkBuffer indirectBuffer = VK_NULL_HANDLE;
+        VmaAllocation indirectMemory = VK_NULL_HANDLE;
+        VkDrawIndexedIndirectCommand* indirectCommands = nullptr;
+
+        // Static set version the buffers and the cached static draws of
+        // the frame hold, 0 for none
+        uint64_t staticDrawVersion = 0;
+        // Uniform offset the cached static draws bound
+        uint32_t staticDrawUniformOffset = 0;
+        // Work of the cached static draws, counted every frame they run
+        RenderStats staticDrawStats;
+    };
+
+    std::vector<FrameData> m_Frames;
+    uint32_t m_FrameIndex = 0;
+    // Frames rendered since startup
+    uint64_t m_FrameNumber = 0;
+    // Per swapchain image, signalled by the submit and waited by present
     std::vector<VkSemaphore> m_RenderingCompleteSemaphores;
-    std::vector<VkFence> m_Fences;
-    std::vector<VkFence> m_ImagesInFlight;
-    std::vector<VkCommandBuffer> m_RenderingCommandBuffers;
+    // Primary buffer being recorded
+    BoundState m_BoundState;
+    // Secondary buffers for recording the scene on the work queue
+    std::unique_ptr<RecordingPools> m_RecordingPools;
 
     std::unique_ptr<DescriptorSetGenerator> m_DescriptorSetGenerator;
     VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
     VkDescriptorSetLayout m_DescSetLayout = VK_NULL_HANDLE;
-    std::vector<VkDescriptorSet> m_DescriptorSet;
 
     std::unique_ptr<ImGuiSetup> m_ui;
 
-    std::vector<VkBuffer> m_UniformBuffer;
-    std::vector<VmaAllocation> m_UniformMemory;
+    // Per frame uniforms and UI geometry
+    std::unique_ptr<TransientAllocator> m_Transient;
+
+    scene::InstanceBatcher m_InstanceBatcher;
+    // Entities that haven't changed for a while, drawn from secondary
+    // command buffers recorded once per change
+    std::unique_ptr<scene::StaticDrawTracker> m_StaticDraws;
+    scene::InstanceBatcher m_StaticBatcher;
+    std::unique_ptr<RecordingPools> m_StaticDrawPools;
+    std::vector<entt::entity> m_DynamicVisible;
+    // Set when renderables go away, the batchers then forget their ids
+    bool m_ForgetDrawIds = false;
+    bool m_UseIndirectDraw = false;
+    bool m_UseMultiDrawIndirect = false;
+
+    std::unique_ptr<RenderGraphExecutor> m_RenderGraph;
+    std::unique_ptr<GpuCulling> m_GpuCulling;
+    std::unique_ptr<HiZCulling> m_HiZCulling;
+    // Slots of the HiZ visibility buffer
+    std::unique_ptr<scene::VisibilitySlots> m_VisibilitySlots;
+    scene::CullingSystem m_CullingSystem;
+    scene::OcclusionCuller m_OcclusionCuller;
+    bool m_UseCpuCulling = true;
+    CullingStats m_CullingStats;
+    FrameTimings m_FrameTimings;
+    // Counted during renderFrame, published as m_RenderStats at its end
+    RenderStats m_RecordingStats;
+    RenderStats m_RenderStats;
+    // Device totals at the end of the last frame
+    uint64_t m_UploadedBytesSeen = 0;
+    uint64_t m_AllocationsSeen = 0;
+    float m_PipelineCreationMs = 0.0f;
+    std::unique_ptr<GpuProfiler> m_GpuProfiler;
+    Timer<> m_PipelineTimer;
+    UniformBufferObject m_Ubo = {};
+    // Sum of the dt passed to updateVisibility, animates the model matrix
+    float m_Timepass = 0.0f;
+    glm::mat4 m_CullMatrix = glm::mat4(1.0f);
 
     // std::optional<DescriptorSetGenerator> gen;
 };
@@ -0,0 +1,435 @@
+#include "depthpyramid.h"
+
+#include "core/vulkan/utils.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace core::vk
+{
+
+namespace
+{
+constexpr uint32_t REDUCE_GROUP_SIZE = 8;
+constexpr VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+DepthPyramid::DepthPyramid(Device* device) :
+    m_Log(logs::Log::create("Depth Pyramid")), m_Device(device)
+{
+    assert(m_Device);
+    assert(isSupported(*m_Device));
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+DepthPyramid::~DepthPyramid()
+{
+    destroy();
+}
+
+// ----------------------------------------------------------------------------
+// Depth is sampled in the first reduction, the pyramid itself is written as
+// a storage image and sampled by the following levels and culling
+//
+
+bool DepthPyramid::isSupported(const Device& device)
+{
+    VkFormatProperties depthProperties;
+    vkGetPhysicalDeviceFormatProperties(
+            device.getPhysicalDevice(), DEPTH_FORMAT, &depthProperties);
+
+    VkFormatProperties pyramidProperties;
+    vkGetPhysicalDeviceFormatProperties(
+            device.getPhysicalDevice(), PYRAMID_FORMAT, &pyramidProperties);
+
+    const VkFormatFeatureFlags pyramidFeatures =
+            VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT
+            | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+    return (depthProperties.optimalTilingFeatures
+            & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)
+                   != 0
+           && (pyramidProperties.optimalTilingFeatures & pyramidFeatures)
+                      == pyramidFeatures;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void DepthPyramid::create(VkImageView depthView, VkExtent2D depthExtent)
+{
+    assert(depthView != VK_NULL_HANDLE);
+    assert(depthExtent.width > 0 && depthExtent.height > 0);
+
+    destroy();
+
+    m_DepthExtent = depthExtent;
+    m_Extent = {
+            std::bit_floor(depthExtent.width),
+            std::bit_floor(depthExtent.height)};
+    m_LevelCount = std::bit_width(std::max(m_Extent.width, m_Extent.height));
+
+    createImage();
+    createDescriptors(depthView);
+    createPipeline();
+
+    m_Log->info(
+            "{}x{} with {} levels",
+            m_Extent.width,
+            m_Extent.height,
+            m_LevelCount);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void DepthPyramid::createImage()
+{
+    m_Device->createImage(
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY,
+            PYRAMID_FORMAT,
+            VK_IMAGE_TILING_OPTIMAL,
+            m_Extent,
+            &m_Image,
+            &m_Memory,
+            0,
+            0,
+            m_LevelCount);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.pNext = nullptr;
+    viewInfo.flags = 0;
+    viewInfo.image = m_Image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = PYRAMID_FORMAT;
+    viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    viewInfo.subresourceRange = {
+            VK_IMAGE_ASPECT_COLOR_BIT, 0, m_LevelCount, 0, 1};
+
+    VK_CHECK(vkCreateImageView(
+            m_Device->getLogicalDevice(), &viewInfo, nullptr, &m_View));
+
+    m_LevelViews.resize(m_LevelCount);
+    for(uint32_t level = 0; level < m_LevelCount; ++level)
+    {
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        VK_CHECK(vkCreateImageView(
+                m_Device->getLogicalDevice(),
+                &viewInfo,
+                nullptr,
+                &m_LevelViews[level]));
+    }
+
+    // Texels are fetched directly, the sampler only has to be valid
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.pNext = nullptr;
+    samplerInfo.flags = 0;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.mipLodBias = 0.0f;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(m_LevelCount);
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+    VK_CHECK(vkCreateSampler(
+            m_Device->getLogicalDevice(), &samplerInfo, nullptr, &m_Sampler));
+
+    // Layout never changes after this
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_Image;
+    barrier.subresourceRange = {
+            VK_IMAGE_ASPECT_COLOR_BIT, 0, m_LevelCount, 0, 1};
+
+    VkCommandBuffer cmdBuf = m_Device->createCommandBuffer();
+    vkCmdPipelineBarrier(
+            cmdBuf,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &barrier);
+    m_Device->flushCommandBuffer(cmdBuf, QueueType::Graphics, true);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void DepthPyramid::createDescriptors(VkImageView depthView)
+{
+    m_DescriptorSetGenerator = std::make_unique<DescriptorSetGenerator>(
+            m_Device->getLogicalDevice());
+    m_DescriptorSetGenerator->addBinding(
+            0,
+            1,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT);
+    m_DescriptorSetGenerator->addBinding(
+            1, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_DescriptorPool = m_DescriptorSetGenerator->generatePool(m_LevelCount);
+    m_DescSetLayout = m_DescriptorSetGenerator->generateLayout();
+
+    m_DescriptorSets.resize(m_LevelCount);
+    for(uint32_t level = 0; level < m_LevelCount; ++level)
+    {
+        m_DescriptorSets[level] = m_DescriptorSetGenerator->generateSet(
+                m_DescriptorPool, m_DescSetLayout);
+
+        VkDescriptorImageInfo srcInfo = {};
+        srcInfo.sampler = m_Sampler;
+        if(level == 0)
+        {
+            srcInfo.imageView = depthView;
+            srcInfo.imageLayout =
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        }
+        else
+        {
+            srcInfo.imageView = m_LevelViews[level - 1];
+            srcInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        VkDescriptorImageInfo dstInfo = {};
+        dstInfo.sampler = VK_NULL_HANDLE;
+        dstInfo.imageView = m_LevelViews[level];
+        dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        m_DescriptorSetGenerator->bind(
+                m_DescriptorSets[level],
+                0,
+                std::vector<VkDescriptorImageInfo>{srcInfo});
+        m_DescriptorSetGenerator->bind(
+                m_DescriptorSets[level],
+                1,
+                std::vector<VkDescriptorImageInfo>{dstInfo});
+    }
+    m_DescriptorSetGenerator->updateSetContents();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void DepthPyramid::createPipeline()
+{
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstantBlock);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = nullptr;
+    layoutInfo.flags = 0;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_DescSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(
+            m_Device->getLogicalDevice(),
+            &layoutInfo,
+            nullptr,
+            &m_PipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage = m_Device->loadShaderFromFile(
+            "data/shaders/hiz.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    pipelineInfo.layout = m_PipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VK_CHECK(vkCreateComputePipelines(
+            m_Device->getLogicalDevice(),
+            m_Device->getPipelineCache(),
+            1,
+            &pipelineInfo,
+            nullptr,
+            &m_Pipeline));
+
+    vkDestroyShaderModule(
+            m_Device->getLogicalDevice(), pipelineInfo.stage.module, nullptr);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void DepthPyramid::destroy()
+{
+    VkDevice device = m_Device->getLogicalDevice();
+
+    if(m_Pipeline != VK_NULL_HANDLE)
+    {
+        vkDestroyPipeline(device, m_Pipeline, nullptr);
+        m_Pipeline = VK_NULL_HANDLE;
+    }
+    if(m_PipelineLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineLayout(device, m_PipelineLayout, nullptr);
+        m_PipelineLayout = VK_NULL_HANDLE;
+    }
+    if(m_DescSetLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(device, m_DescSetLayout, nullptr);
+        m_DescSetLayout = VK_NULL_HANDLE;
+    }
+    if(m_DescriptorPool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(device, m_DescriptorPool, nullptr);
+        m_DescriptorPool = VK_NULL_HANDLE;
+    }
+    m_DescriptorSets.clear();
+    m_DescriptorSetGenerator.reset();
+
+    if(m_Sampler != VK_NULL_HANDLE)
+    {
+        vkDestroySampler(device, m_Sampler, nullptr);
+        m_Sampler = VK_NULL_HANDLE;
+    }
+    for(auto view : m_LevelViews)
+    {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    m_LevelViews.clear();
+    if(m_View != VK_NULL_HANDLE)
+    {
+        vkDestroyImageView(device, m_View, nullptr);
+        m_View = VK_NULL_HANDLE;
+    }
+    if(m_Image != VK_NULL_HANDLE)
+    {
+        vmaDestroyImage(m_Device->getAllocator(), m_Image, m_Memory);
+        m_Image = VK_NULL_HANDLE;
+        m_Memory = VK_NULL_HANDLE;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// One dispatch per level, each waits for the writes of the level below.
+// What comes before and after the build is up to the render graph.
+//
+
+void DepthPyramid::build(VkCommandBuffer cmdBuf) const
+{
+    assert(m_Pipeline != VK_NULL_HANDLE);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+
+    VkExtent2D srcExtent = m_DepthExtent;
+    VkExtent2D dstExtent = m_Extent;
+    for(uint32_t level = 0; level < m_LevelCount; ++level)
+    {
+        PushConstantBlock pushConstants = {};
+        pushConstants.srcSize[0] = static_cast<int32_t>(srcExtent.width);
+        pushConstants.srcSize[1] = static_cast<int32_t>(srcExtent.height);
+        pushConstants.dstSize[0] = static_cast<int32_t>(dstExtent.width);
+        pushConstants.dstSize[1] = static_cast<int32_t>(dstExtent.height);
+
+        vkCmdBindDescriptorSets(
+                cmdBuf,
+                VK_PIPELINE_BIND_POINT_COMPUTE,
+                m_PipelineLayout,
+                0,
+                1,
+                &m_DescriptorSets[level],
+                0,
+                nullptr);
+        vkCmdPushConstants(
+                cmdBuf,
+                m_PipelineLayout,
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                0,
+                sizeof(PushConstantBlock),
+                &pushConstants);
+        vkCmdDispatch(
+                cmdBuf,
+                (dstExtent.width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+                (dstExtent.height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+                1);
+
+        if(level + 1 < m_LevelCount)
+        {
+            vkCmdPipelineBarrier(
+                    cmdBuf,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    0,
+                    1,
+                    &barrier,
+                    0,
+                    nullptr,
+                    0,
+                    nullptr);
+        }
+
+        srcExtent = dstExtent;
+        dstExtent = {
+                std::max(dstExtent.width / 2, 1u),
+                std::max(dstExtent.height / 2, 1u)};
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+VkDescriptorImageInfo DepthPyramid::getDescriptorInfo() const
+{
+    VkDescriptorImageInfo info = {};
+    info.sampler = m_Sampler;
+    info.imageView = m_View;
+    info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    return info;
+}
+
+} // namespace core::vk
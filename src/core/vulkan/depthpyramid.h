@@ -0,0 +1,84 @@
+#pragma once
+
+#include "core/vulkan/descriptorgen.h"
+#include "core/vulkan/device.h"
+#include "logs/log.h"
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <vector>
+
+namespace core::vk
+{
+
+// Hierarchical depth buffer. Every texel holds the farthest depth of the
+// texels it covers in the level below, level 0 is built from the depth
+// attachment at the previous power of two of its size so every further level
+// halves exactly. All levels stay in VK_IMAGE_LAYOUT_GENERAL, the reduction
+// writes them as storage images and culling samples them.
+class DepthPyramid final
+{
+public:
+    explicit DepthPyramid(Device* device);
+    ~DepthPyramid();
+
+    DepthPyramid(const DepthPyramid&) = delete;
+    DepthPyramid(DepthPyramid&&) = delete;
+    DepthPyramid& operator=(const DepthPyramid&) = delete;
+    DepthPyramid& operator=(DepthPyramid&&) = delete;
+
+    [[nodiscard]] static bool isSupported(const Device& device);
+
+    // (Re)create the pyramid for a depth attachment, the view has to stay
+    // alive until the next create. Device has to be idle.
+    void create(VkImageView depthView, VkExtent2D depthExtent);
+
+    // Depth has to be in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL with
+    // its writes made visible to the compute stage, and earlier reads of the
+    // pyramid have to be finished. The levels are written at
+    // VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, readers have to wait for them.
+    void build(VkCommandBuffer cmdBuf) const;
+
+    // Whole mip chain with its sampler, for binding as a combined image
+    // sampler
+    [[nodiscard]] VkDescriptorImageInfo getDescriptorInfo() const;
+    [[nodiscard]] VkImage getImage() const { return m_Image; }
+    [[nodiscard]] VkExtent2D getExtent() const { return m_Extent; }
+    [[nodiscard]] uint32_t getLevelCount() const { return m_LevelCount; }
+
+private:
+    struct PushConstantBlock
+    {
+        int32_t srcSize[2];
+        int32_t dstSize[2];
+    };
+
+    void createImage();
+    void createDescriptors(VkImageView depthView);
+    void createPipeline();
+    void destroy();
+
+    logs::Logger m_Log;
+    Device* m_Device;
+
+    VkExtent2D m_DepthExtent = {0, 0};
+    VkExtent2D m_Extent = {0, 0};
+    uint32_t m_LevelCount = 0;
+
+    VkImage m_Image = VK_NULL_HANDLE;
+    VmaAllocation m_Memory = VK_NULL_HANDLE;
+    VkImageView m_View = VK_NULL_HANDLE;
+    std::vector<VkImageView> m_LevelViews;
+    VkSampler m_Sampler = VK_NULL_HANDLE;
+
+    std::unique_ptr<DescriptorSetGenerator> m_DescriptorSetGenerator;
+    VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_DescSetLayout = VK_NULL_HANDLE;
+    // One per level, the level below (or the depth attachment) as input
+    std::vector<VkDescriptorSet> m_DescriptorSets;
+    VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_Pipeline = VK_NULL_HANDLE;
+};
+
+} // namespace core::vk
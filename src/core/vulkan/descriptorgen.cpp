@@ -38,11 +38,13 @@ VkDescriptorPool DescriptorSetGenerator::generatePool(std::uint32_t maxSets)
     std::vector<VkDescriptorPoolSize> poolSizes;
     poolSizes.reserve(m_Bindings.size());
 
+    // Enough for every set to use every binding, with some headroom for
+    // small pools
     for(const auto& [index, bindingLayout] : m_Bindings)
     {
         poolSizes.push_back(
                 {bindingLayout.descriptorType,
-                 bindingLayout.descriptorCount * 5});
+                 bindingLayout.descriptorCount * std::max(maxSets, 5u)});
     }
 
     VkDescriptorPoolCreateInfo poolInfo = {};
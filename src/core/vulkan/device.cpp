@@ -1,16 +1,52 @@
 #include "core/vulkan/device.h"
 
 #include "logs/log.h"
+#include "core/vulkan/embeddedshaders.h"
 #include "core/vulkan/utils.h"
+#include "utils/mappedfile.h"
 
 #include <cassert>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <optional>
 #include <set>
 #include <sstream>
 
 namespace core::vk
 {
 
+namespace
+{
+
+// ----------------------------------------------------------------------------
+// Version one header: size, version, vendor, device and the cache UUID that
+// changes with the driver
+//
+
+bool isCompatiblePipelineCache(
+        const std::vector<char>& data, const VkPhysicalDeviceProperties& gpu)
+{
+    constexpr size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+    if(data.size() < headerSize)
+    {
+        return false;
+    }
+
+    uint32_t fields[4];
+    std::memcpy(fields, data.data(), sizeof(fields));
+    return fields[0] >= headerSize
+           && fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+           && fields[2] == gpu.vendorID && fields[3] == gpu.deviceID
+           && std::memcmp(
+                      data.data() + sizeof(fields),
+                      gpu.pipelineCacheUUID,
+                      VK_UUID_SIZE)
+                      == 0;
+}
+
+} // namespace
+
 // ----------------------------------------------------------------------------
 //
 //
@@ -20,7 +56,6 @@ Device::Device(
     m_Log(logs::Log::create("Vulkan Device"))
 {
     assert(gpu);
-    assert(window);
     m_Window = window;
     m_PhysicalDevice = gpu;
 
@@ -43,6 +78,24 @@ Device::Device(
 
 Device::~Device()
 {
+    // Arena buffers are owned by the allocator, release them first
+    if(m_LogicalDevice)
+    {
+        vkDeviceWaitIdle(m_LogicalDevice);
+        destroyAllDeferred();
+    }
+    if(m_PipelineCache)
+    {
+        savePipelineCache();
+        vkDestroyPipelineCache(m_LogicalDevice, m_PipelineCache, nullptr);
+    }
+    m_GeometryArena.reset();
+
+    for(const auto& timeline : m_Timelines)
+    {
+        vkDestroySemaphore(m_LogicalDevice, timeline->semaphore, nullptr);
+    }
+
     if(m_CommandPools.graphics)
     {
         vkDestroyCommandPool(m_LogicalDevice, m_CommandPools.graphics, nullptr);
@@ -125,22 +178,50 @@ void Device::createLogicalDevice(
         queueCreateInfos.push_back(queueInfo);
     }
 
-    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
-    indexingFeatures.sType =
-            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
-    indexingFeatures.pNext = nullptr;
-    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+    supportedFeatures12.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supportedFeatures12.pNext = nullptr;
+
+    VkPhysicalDeviceFeatures2 supportedFeatures = {};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &supportedFeatures12;
+    vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &supportedFeatures);
+
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.pNext = nullptr;
+    features12.runtimeDescriptorArray = VK_TRUE;
+    features12.timelineSemaphore = VK_TRUE;
+    // Optional, GPU culling is disabled without it
+    features12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
+    // Optional, the GPU profiler is disabled without it
+    features12.hostQueryReset = supportedFeatures12.hostQueryReset;
 
     VkPhysicalDeviceFeatures2KHR requestedFeatures = {};
     requestedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
     requestedFeatures.features.samplerAnisotropy = VK_TRUE;
-    requestedFeatures.pNext = &indexingFeatures;
-
-    requestedExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    // Optional, the GPU profiler skips the pipeline statistics without them
+    requestedFeatures.features.pipelineStatisticsQuery =
+            m_PhysicalDeviceFeatures.pipelineStatisticsQuery;
+    requestedFeatures.features.inheritedQueries =
+            m_PhysicalDeviceFeatures.inheritedQueries;
+    // Optional, the indirect scene submission falls back to direct draws
+    requestedFeatures.features.multiDrawIndirect =
+            m_PhysicalDeviceFeatures.multiDrawIndirect;
+    requestedFeatures.features.drawIndirectFirstInstance =
+            m_PhysicalDeviceFeatures.drawIndirectFirstInstance;
+    requestedFeatures.pNext = &features12;
+
+    // Offscreen rendering has nothing to present to
+    if(m_Window)
+    {
+        requestedExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.pNext = &indexingFeatures;
+    createInfo.pNext = &features12;
     createInfo.flags = 0;
     createInfo.queueCreateInfoCount =
             static_cast<uint32_t>(queueCreateInfos.size());
@@ -154,6 +235,15 @@ void Device::createLogicalDevice(
 
     VK_CHECK(vkCreateDevice(
             m_PhysicalDevice, &createInfo, nullptr, &m_LogicalDevice));
+    m_EnabledFeatures = requestedFeatures.features;
+    m_EnabledFeatures12 = features12;
+    m_EnabledFeatures12.pNext = nullptr;
+
+    m_SharedQueueFamilies = {m_QueueFamilyIndices.graphics};
+    if(m_QueueFamilyIndices.compute != m_QueueFamilyIndices.graphics)
+    {
+        m_SharedQueueFamilies.push_back(m_QueueFamilyIndices.compute);
+    }
 
     assert(m_PhysicalDevice);
     assert(m_LogicalDevice);
@@ -203,6 +293,155 @@ void Device::createLogicalDevice(
             m_QueueFamilyIndices.transfer,
             0,
             &m_Queue.transfer);
+
+    createTimelines();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Device::createPipelineCache(const std::string& path)
+{
+    assert(m_LogicalDevice);
+    m_PipelineCachePath = path;
+
+    std::vector<char> data;
+    if(!path.empty())
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if(file)
+        {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), static_cast<std::streamsize>(data.size()));
+            if(!file)
+            {
+                data.clear();
+            }
+        }
+    }
+
+    if(!data.empty()
+       && !isCompatiblePipelineCache(data, m_PhysicalDeviceProperties))
+    {
+        m_Log->info(
+                "Pipeline cache {} is from another device or driver", path);
+        data.clear();
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.pNext = nullptr;
+    createInfo.flags = 0;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    VK_CHECK(vkCreatePipelineCache(
+            m_LogicalDevice, &createInfo, nullptr, &m_PipelineCache));
+    m_PipelineCacheSavedSize = data.size();
+
+    m_Log->info("Pipeline cache starts with {} bytes", data.size());
+}
+
+// ----------------------------------------------------------------------------
+// The cache is written next to the old file and renamed over it, so a crash
+// never leaves a partial cache behind
+//
+
+void Device::savePipelineCache()
+{
+    if(!m_PipelineCache || m_PipelineCachePath.empty())
+    {
+        return;
+    }
+
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(
+            m_LogicalDevice, m_PipelineCache, &size, nullptr));
+    if(size == m_PipelineCacheSavedSize)
+    {
+        return;
+    }
+
+    std::vector<char> data(size);
+    const VkResult result = vkGetPipelineCacheData(
+            m_LogicalDevice, m_PipelineCache, &size, data.data());
+    if(result != VK_SUCCESS && result != VK_INCOMPLETE)
+    {
+        m_Log->warn("vkGetPipelineCacheData {}", utils::errorString(result));
+        return;
+    }
+
+    const std::string tmpPath = m_PipelineCachePath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        if(!file)
+        {
+            m_Log->warn("Failed to write pipeline cache {}", tmpPath);
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpPath, m_PipelineCachePath, error);
+    if(error)
+    {
+        m_Log->warn(
+                "Failed to replace pipeline cache {}: {}",
+                m_PipelineCachePath,
+                error.message());
+        return;
+    }
+
+    m_PipelineCacheSavedSize = size;
+    m_Log->info("Pipeline cache saved, {} bytes", size);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Device::createTimelines()
+{
+    const VkQueue queues[] = {
+            m_Queue.graphics, m_Queue.compute, m_Queue.transfer};
+    for(size_t type = 0; type < m_TimelineOf.size(); ++type)
+    {
+        for(const auto& timeline : m_Timelines)
+        {
+            if(timeline->queue == queues[type])
+            {
+                m_TimelineOf[type] = timeline.get();
+            }
+        }
+        if(m_TimelineOf[type])
+        {
+            continue;
+        }
+
+        VkSemaphoreTypeCreateInfo typeInfo = {};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.pNext = nullptr;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        semaphoreInfo.flags = 0;
+
+        auto timeline = std::make_unique<Timeline>();
+        timeline->queue = queues[type];
+        VK_CHECK(vkCreateSemaphore(
+                m_LogicalDevice,
+                &semaphoreInfo,
+                nullptr,
+                &timeline->semaphore));
+        m_TimelineOf[type] = timeline.get();
+        m_Timelines.push_back(std::move(timeline));
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -317,40 +556,230 @@ void Device::beginCommandBuffer(
 //
 
 void Device::flushCommandBuffer(
-        VkCommandBuffer commandBuffer, VkQueue queue, bool free)
+        VkCommandBuffer commandBuffer, QueueType queue, bool free)
 {
     VK_CHECK(vkEndCommandBuffer(commandBuffer));
 
+    wait(submit(queue, {&commandBuffer, 1}));
+
+    if(free)
+    {
+        VkCommandPool pool = m_CommandPools.graphics;
+        if(queue == QueueType::Compute)
+        {
+            pool = m_CommandPools.compute;
+        }
+        else if(queue == QueueType::Transfer)
+        {
+            pool = m_CommandPools.transfer;
+        }
+        vkFreeCommandBuffers(m_LogicalDevice, pool, 1, &commandBuffer);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Timeline waits come first, binary semaphores are waited and signalled with
+// a value of 0 which the driver ignores
+//
+
+TimelinePoint Device::submit(
+        QueueType queue,
+        std::span<const VkCommandBuffer> commandBuffers,
+        std::span<const TimelineWait> waits,
+        std::span<const SemaphoreWait> binaryWaits,
+        std::span<const VkSemaphore> binarySignals)
+{
+    constexpr size_t maxSemaphores = 8;
+    assert(waits.size() + binaryWaits.size() <= maxSemaphores);
+    assert(binarySignals.size() + 1 <= maxSemaphores);
+
+    std::array<VkSemaphore, maxSemaphores> waitSemaphores;
+    std::array<uint64_t, maxSemaphores> waitValues;
+    std::array<VkPipelineStageFlags, maxSemaphores> waitStages;
+    uint32_t waitCount = 0;
+    for(const auto& wait : waits)
+    {
+        waitSemaphores[waitCount] =
+                m_TimelineOf[static_cast<size_t>(wait.point.queue)]->semaphore;
+        waitValues[waitCount] = wait.point.value;
+        waitStages[waitCount] = wait.stage;
+        ++waitCount;
+    }
+    for(const auto& wait : binaryWaits)
+    {
+        waitSemaphores[waitCount] = wait.semaphore;
+        waitValues[waitCount] = 0;
+        waitStages[waitCount] = wait.stage;
+        ++waitCount;
+    }
+
+    Timeline& timeline = *m_TimelineOf[static_cast<size_t>(queue)];
+
+    std::array<VkSemaphore, maxSemaphores> signalSemaphores;
+    std::array<uint64_t, maxSemaphores> signalValues;
+    uint32_t signalCount = 1;
+    signalSemaphores[0] = timeline.semaphore;
+    for(auto semaphore : binarySignals)
+    {
+        signalSemaphores[signalCount] = semaphore;
+        signalValues[signalCount] = 0;
+        ++signalCount;
+    }
+
+    // The value is taken under the lock so values and submission order agree
+    std::lock_guard lock(timeline.mutex);
+    signalValues[0] = timeline.submitted + 1;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.pNext = nullptr;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pNext = nullptr;
-    submitInfo.waitSemaphoreCount = 0;
-    submitInfo.pWaitSemaphores = nullptr;
-    submitInfo.pWaitDstStageMask = nullptr;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    submitInfo.signalSemaphoreCount = 0;
-    submitInfo.pSignalSemaphores = nullptr;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount =
+            static_cast<uint32_t>(commandBuffers.size());
+    submitInfo.pCommandBuffers = commandBuffers.data();
+    submitInfo.signalSemaphoreCount = signalCount;
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    VK_CHECK(vkQueueSubmit(timeline.queue, 1, &submitInfo, VK_NULL_HANDLE));
+    timeline.submitted = signalValues[0];
+
+    return {queue, timeline.submitted};
+}
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.pNext = nullptr;
-    fenceInfo.flags = 0;
+// ----------------------------------------------------------------------------
+//
+//
 
-    VkFence fence;
-    VK_CHECK(vkCreateFence(m_LogicalDevice, &fenceInfo, nullptr, &fence));
+uint64_t Device::getCompletedValue(QueueType queue) const
+{
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(
+            m_LogicalDevice,
+            m_TimelineOf[static_cast<size_t>(queue)]->semaphore,
+            &value));
+    return value;
+}
 
-    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, fence));
+// ----------------------------------------------------------------------------
+//
+//
 
-    VK_CHECK(vkWaitForFences(m_LogicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+TimelinePoint Device::getLastSubmitted(QueueType queue)
+{
+    Timeline& timeline = *m_TimelineOf[static_cast<size_t>(queue)];
+    std::lock_guard lock(timeline.mutex);
+    return {queue, timeline.submitted};
+}
 
-    vkDestroyFence(m_LogicalDevice, fence, nullptr);
+// ----------------------------------------------------------------------------
+//
+//
 
-    if(free)
+void Device::wait(TimelinePoint point) const
+{
+    if(point.value == 0)
     {
-        // TODO: cmdbuf may be alloceted from other than graphics pool
-        vkFreeCommandBuffers(
-                m_LogicalDevice, m_CommandPools.graphics, 1, &commandBuffer);
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.pNext = nullptr;
+    waitInfo.flags = 0;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores =
+            &m_TimelineOf[static_cast<size_t>(point.queue)]->semaphore;
+    waitInfo.pValues = &point.value;
+    VK_CHECK(vkWaitSemaphores(m_LogicalDevice, &waitInfo, UINT64_MAX));
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Device::destroyLater(std::function<void()> destroy)
+{
+    DeferredDestroy deferred;
+    for(size_t type = 0; type < deferred.after.size(); ++type)
+    {
+        deferred.after[type] =
+                getLastSubmitted(static_cast<QueueType>(type)).value;
+    }
+    deferred.destroy = std::move(destroy);
+
+    std::lock_guard lock(m_DeferredMutex);
+    m_DeferredDestroys.push_back(std::move(deferred));
+}
+
+// ----------------------------------------------------------------------------
+// One counter query per queue, then everything up to the first destroy
+// that is still waiting for its queues
+//
+
+void Device::destroyFinished()
+{
+    std::vector<std::function<void()>> finished;
+    {
+        std::lock_guard lock(m_DeferredMutex);
+        if(m_DeferredDestroys.empty())
+        {
+            return;
+        }
+
+        std::array<uint64_t, static_cast<size_t>(QueueType::Count)> completed;
+        for(size_t type = 0; type < completed.size(); ++type)
+        {
+            completed[type] = getCompletedValue(static_cast<QueueType>(type));
+        }
+
+        while(!m_DeferredDestroys.empty())
+        {
+            const auto& after = m_DeferredDestroys.front().after;
+            bool done = true;
+            for(size_t type = 0; type < completed.size(); ++type)
+            {
+                done = done && after[type] <= completed[type];
+            }
+            if(!done)
+            {
+                break;
+            }
+            finished.push_back(std::move(m_DeferredDestroys.front().destroy));
+            m_DeferredDestroys.pop_front();
+        }
+    }
+
+    // Outside the lock, a destroy may defer more work
+    for(auto& destroy : finished)
+    {
+        destroy();
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Device::destroyAllDeferred()
+{
+    std::deque<DeferredDestroy> deferred;
+    {
+        std::lock_guard lock(m_DeferredMutex);
+        deferred.swap(m_DeferredDestroys);
+    }
+    for(auto& entry : deferred)
+    {
+        entry.destroy();
     }
 }
 
@@ -384,12 +813,14 @@ void Device::createBuffer(
             buffer,
             bufferMemory,
             nullptr));
+    countAllocation();
 
     if(srcData)
     {
         void* dstData;
         vmaMapMemory(m_Allocator, *bufferMemory, &dstData);
         memcpy(dstData, srcData, size);
+        countUpload(size);
         vmaUnmapMemory(m_Allocator, *bufferMemory);
         if((properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
         {
@@ -528,7 +959,7 @@ void Device::createImageOnGPU(
                 &imageBarrier);
     }
 
-    flushCommandBuffer(cmdBuf, m_Queue.graphics, true);
+    flushCommandBuffer(cmdBuf, QueueType::Graphics, true);
     vmaDestroyBuffer(m_Allocator, stagingBuffer, stagingBufferMemory);
 }
 
@@ -536,6 +967,101 @@ void Device::createImageOnGPU(
 //
 //
 
+void* Device::createMappedBuffer(
+        VkBufferUsageFlags usage,
+        VkDeviceSize size,
+        VkBuffer* buffer,
+        VmaAllocation* bufferMemory,
+        bool shareWithCompute)
+{
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.pNext = nullptr;
+    bufferInfo.flags = 0;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    bufferInfo.queueFamilyIndexCount = 0;
+    bufferInfo.pQueueFamilyIndices = nullptr;
+    if(shareWithCompute)
+    {
+        shareWithComputeQueue(bufferInfo);
+    }
+
+    // Coherent memory is required so writes need no explicit flush
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                              | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VmaAllocationInfo allocationInfo = {};
+    VK_CHECK(vmaCreateBuffer(
+            m_Allocator,
+            &bufferInfo,
+            &allocInfo,
+            buffer,
+            bufferMemory,
+            &allocationInfo));
+    countAllocation();
+
+    assert(allocationInfo.pMappedData);
+    return allocationInfo.pMappedData;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Device::createSharedBuffer(
+        VkBufferUsageFlags usage,
+        VkDeviceSize size,
+        VkBuffer* buffer,
+        VmaAllocation* bufferMemory)
+{
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.pNext = nullptr;
+    bufferInfo.flags = 0;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    shareWithComputeQueue(bufferInfo);
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    VK_CHECK(vmaCreateBuffer(
+            m_Allocator, &bufferInfo, &allocInfo, buffer, bufferMemory, nullptr));
+    countAllocation();
+}
+
+// ----------------------------------------------------------------------------
+// Concurrent sharing is only needed when compute has a family of its own
+//
+
+void Device::shareWithComputeQueue(VkBufferCreateInfo& bufferInfo) const
+{
+    assert(!m_SharedQueueFamilies.empty());
+    if(m_SharedQueueFamilies.size() > 1)
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount =
+                static_cast<uint32_t>(m_SharedQueueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = m_SharedQueueFamilies.data();
+    }
+    else
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        bufferInfo.queueFamilyIndexCount = 0;
+        bufferInfo.pQueueFamilyIndices = nullptr;
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
 void Device::copyBuffer(
         VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 {
@@ -547,7 +1073,7 @@ void Device::copyBuffer(
     VkCommandBuffer commandBuffer = createCommandBuffer(
             VK_COMMAND_BUFFER_LEVEL_PRIMARY, VK_QUEUE_TRANSFER_BIT);
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-    flushCommandBuffer(commandBuffer, m_Queue.transfer, false);
+    flushCommandBuffer(commandBuffer, QueueType::Transfer, false);
     vkFreeCommandBuffers(
             m_LogicalDevice, m_CommandPools.transfer, 1, &commandBuffer);
 }
@@ -585,7 +1111,7 @@ void Device::copyBufferToImage(
             1,
             &copyRegion);
 
-    flushCommandBuffer(commandBuffer, m_Queue.transfer, false);
+    flushCommandBuffer(commandBuffer, QueueType::Transfer, false);
     vkFreeCommandBuffers(
             m_LogicalDevice, m_CommandPools.transfer, 1, &commandBuffer);
 }
@@ -675,6 +1201,7 @@ void Device::createImage(
 
     VK_CHECK(vmaCreateImage(
             m_Allocator, &imageInfo, &allocInfo, image, memory, nullptr));
+    countAllocation();
 }
 
 // ----------------------------------------------------------------------------
@@ -711,33 +1238,54 @@ void Device::createSampler(VkSampler* sampler)
 //
 
 VkPipelineShaderStageCreateInfo Device::loadShaderFromFile(
-        const std::string& path, VkShaderStageFlagBits stage)
+        const std::string& path,
+        VkShaderStageFlagBits stage,
+        const VkSpecializationInfo* specialization)
 {
-    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
-    if(!file)
+    std::span<const uint32_t> code;
+    if(!m_ShadersFromDisk)
+    {
+        code = findEmbeddedShader(
+                std::filesystem::path(path).filename().string());
+    }
+
+    // Only kept until the module is created, the mapping is page aligned
+    std::optional<utils::MappedFile> file;
+    if(code.empty())
     {
-        m_Log->warn("Unable to open shader file {}", path);
-        assert(false);
-        throw std::runtime_error("");
+        try
+        {
+            file.emplace(path);
+        }
+        catch(const std::runtime_error&)
+        {
+            m_Log->warn("Unable to open shader file {}", path);
+            assert(false);
+            throw;
+        }
+        if(file->size() == 0 || file->size() % sizeof(uint32_t) != 0)
+        {
+            m_Log->warn("Shader file {} is not SPIR-V", path);
+            throw std::runtime_error("Invalid SPIR-V size in " + path);
+        }
+        m_Log->info("Load shader {}", path);
+        code = {static_cast<const uint32_t*>(file->data()),
+                file->size() / sizeof(uint32_t)};
     }
-    m_Log->info("Load shader {}", path);
-    std::ostringstream oss;
-    oss << file.rdbuf();
-    const auto code = oss.str();
 
     VkPipelineShaderStageCreateInfo shaderStageInfo = {};
     shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStageInfo.pNext = nullptr;
     shaderStageInfo.stage = stage;
     shaderStageInfo.pName = "main";
-    shaderStageInfo.pSpecializationInfo = nullptr;
+    shaderStageInfo.pSpecializationInfo = specialization;
 
     VkShaderModuleCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.pNext = nullptr;
     createInfo.flags = 0;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.c_str());
+    createInfo.codeSize = code.size_bytes();
+    createInfo.pCode = code.data();
     VK_CHECK(vkCreateShaderModule(
             m_LogicalDevice, &createInfo, nullptr, &shaderStageInfo.module));
     return shaderStageInfo;
@@ -772,4 +1320,18 @@ const std::shared_ptr<GLFWwindow>& Device::getGLFWwindow() const
 {
     return m_Window;
 }
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Device::createGeometryArena(
+        uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    assert(m_Allocator);
+    assert(!m_GeometryArena);
+    m_GeometryArena = std::make_unique<GeometryArena>(
+            this, vertexStride, vertexCapacity, indexCapacity);
+}
+
 } // namespace core::vk
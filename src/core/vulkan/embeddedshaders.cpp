@@ -0,0 +1,22 @@
+#include "core/vulkan/embeddedshaders.h"
+
+#include <algorithm>
+
+namespace core::vk
+{
+
+// ----------------------------------------------------------------------------
+// A handful of shaders, a linear search is enough
+//
+
+std::span<const uint32_t> findEmbeddedShader(std::string_view name)
+{
+    const auto shaders = getEmbeddedShaders();
+    const auto it = std::find_if(
+            shaders.begin(), shaders.end(), [name](const auto& shader) {
+                return shader.name == name;
+            });
+    return it != shaders.end() ? it->code : std::span<const uint32_t>();
+}
+
+} // namespace core::vk
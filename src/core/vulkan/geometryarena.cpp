@@ -0,0 +1,181 @@
+#include "core/vulkan/geometryarena.h"
+
+#include "core/vulkan/device.h"
+#include "core/vulkan/utils.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace core::vk
+{
+
+// ----------------------------------------------------------------------------
+//
+//
+
+GeometryArena::GeometryArena(
+        Device* device,
+        uint32_t vertexStride,
+        uint32_t vertexCapacity,
+        uint32_t indexCapacity) :
+    m_Log(logs::Log::create("Geometry Arena")),
+    m_Device(device),
+    m_VertexStride(vertexStride),
+    m_Vertices(vertexCapacity),
+    m_Indices(indexCapacity)
+{
+    assert(m_Device);
+    assert(vertexStride > 0);
+
+    m_Device->createBuffer(
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                    | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            VkDeviceSize{vertexCapacity} * vertexStride,
+            &m_VertexBuffer,
+            &m_VertexMemory);
+
+    m_Device->createBuffer(
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            VkDeviceSize{indexCapacity} * sizeof(uint32_t),
+            &m_IndexBuffer,
+            &m_IndexMemory);
+
+    m_Log->info(
+            "Created with room for {} vertices ({} bytes each) and {} "
+            "indices",
+            vertexCapacity,
+            vertexStride,
+            indexCapacity);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+GeometryArena::~GeometryArena()
+{
+    if(m_VertexBuffer)
+    {
+        vmaDestroyBuffer(
+                m_Device->getAllocator(), m_VertexBuffer, m_VertexMemory);
+    }
+    if(m_IndexBuffer)
+    {
+        vmaDestroyBuffer(
+                m_Device->getAllocator(), m_IndexBuffer, m_IndexMemory);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+std::optional<GeometryAllocation> GeometryArena::allocate(
+        const void* vertices,
+        uint32_t vertexCount,
+        const uint32_t* indices,
+        uint32_t indexCount)
+{
+    assert(vertices && vertexCount > 0);
+    assert(indices && indexCount > 0);
+
+    const auto vertexOffset = m_Vertices.allocate(vertexCount);
+    if(!vertexOffset)
+    {
+        m_Log->warn("Out of vertex space, {} vertices requested", vertexCount);
+        return std::nullopt;
+    }
+
+    const auto firstIndex = m_Indices.allocate(indexCount);
+    if(!firstIndex)
+    {
+        m_Vertices.free(*vertexOffset, vertexCount);
+        m_Log->warn("Out of index space, {} indices requested", indexCount);
+        return std::nullopt;
+    }
+
+    const VkDeviceSize vertexSize = VkDeviceSize{vertexCount} * m_VertexStride;
+    const VkDeviceSize indexSize = VkDeviceSize{indexCount} * sizeof(uint32_t);
+
+    // Both ranges go through one staging buffer and one submit
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VmaAllocation stagingMemory = VK_NULL_HANDLE;
+    m_Device->createBuffer(
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VMA_MEMORY_USAGE_CPU_ONLY,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            vertexSize + indexSize,
+            &stagingBuffer,
+            &stagingMemory);
+
+    void* data = nullptr;
+    VK_CHECK(vmaMapMemory(m_Device->getAllocator(), stagingMemory, &data));
+    std::memcpy(data, vertices, vertexSize);
+    std::memcpy(static_cast<uint8_t*>(data) + vertexSize, indices, indexSize);
+    vmaUnmapMemory(m_Device->getAllocator(), stagingMemory);
+    m_Device->countUpload(vertexSize + indexSize);
+
+    VkBufferCopy vertexCopy = {};
+    vertexCopy.srcOffset = 0;
+    vertexCopy.dstOffset = *vertexOffset * m_VertexStride;
+    vertexCopy.size = vertexSize;
+
+    VkBufferCopy indexCopy = {};
+    indexCopy.srcOffset = vertexSize;
+    indexCopy.dstOffset = *firstIndex * sizeof(uint32_t);
+    indexCopy.size = indexSize;
+
+    VkCommandBuffer cmdBuf = m_Device->createCommandBuffer(
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY, VK_QUEUE_TRANSFER_BIT);
+    vkCmdCopyBuffer(cmdBuf, stagingBuffer, m_VertexBuffer, 1, &vertexCopy);
+    vkCmdCopyBuffer(cmdBuf, stagingBuffer, m_IndexBuffer, 1, &indexCopy);
+    m_Device->flushCommandBuffer(cmdBuf, QueueType::Transfer, false);
+    vkFreeCommandBuffers(
+            m_Device->getLogicalDevice(),
+            m_Device->getTransferCommandPool(),
+            1,
+            &cmdBuf);
+
+    vmaDestroyBuffer(m_Device->getAllocator(), stagingBuffer, stagingMemory);
+
+    GeometryAllocation allocation;
+    allocation.vertexOffset = static_cast<uint32_t>(*vertexOffset);
+    allocation.vertexCount = vertexCount;
+    allocation.firstIndex = static_cast<uint32_t>(*firstIndex);
+    allocation.indexCount = indexCount;
+    return allocation;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GeometryArena::free(const GeometryAllocation& allocation)
+{
+    if(allocation.vertexCount > 0)
+    {
+        m_Vertices.free(allocation.vertexOffset, allocation.vertexCount);
+    }
+    if(allocation.indexCount > 0)
+    {
+        m_Indices.free(allocation.firstIndex, allocation.indexCount);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GeometryArena::bind(VkCommandBuffer cmdBuf) const
+{
+    const VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cmdBuf, 0, 1, &m_VertexBuffer, offsets);
+    vkCmdBindIndexBuffer(cmdBuf, m_IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+} // namespace core::vk
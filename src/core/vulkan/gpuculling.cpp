@@ -0,0 +1,348 @@
+#include "gpuculling.h"
+
+#include "core/scene/instancing.h"
+#include "core/vulkan/utils.h"
+
+#include <cassert>
+
+namespace core::vk
+{
+
+namespace
+{
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+constexpr uint32_t BINDING_COUNT = 6;
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+GpuCulling::GpuCulling(
+        Device* device,
+        const std::vector<VkBuffer>& instanceBuffers,
+        const std::vector<VkBuffer>& batchBuffers,
+        uint32_t maxDraws) :
+    m_Log(logs::Log::create("GPU Culling")),
+    m_Device(device),
+    m_MaxDraws(maxDraws)
+{
+    assert(m_Device);
+    assert(instanceBuffers.size() == batchBuffers.size());
+    assert(isSupported(*m_Device));
+
+    const size_t frameCount = instanceBuffers.size();
+
+    m_DescriptorSetGenerator = std::make_unique<DescriptorSetGenerator>(
+            m_Device->getLogicalDevice());
+    for(uint32_t binding = 0; binding < BINDING_COUNT; ++binding)
+    {
+        m_DescriptorSetGenerator->addBinding(
+                binding,
+                1,
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+
+    m_DescriptorPool = m_DescriptorSetGenerator->generatePool(
+            static_cast<uint32_t>(frameCount));
+    m_DescSetLayout = m_DescriptorSetGenerator->generateLayout();
+
+    m_DescriptorSets.resize(frameCount);
+    m_DrawBuffer.resize(frameCount);
+    m_DrawMemory.resize(frameCount);
+    m_CountBuffer.resize(frameCount);
+    m_CountMemory.resize(frameCount);
+    m_VisibleInstanceBuffer.resize(frameCount);
+    m_VisibleInstanceMemory.resize(frameCount);
+    m_BatchCountBuffer.resize(frameCount);
+    m_BatchCountMemory.resize(frameCount);
+
+    for(size_t i = 0; i < frameCount; ++i)
+    {
+        m_Device->createSharedBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                        | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                sizeof(VkDrawIndexedIndirectCommand) * m_MaxDraws,
+                &m_DrawBuffer[i],
+                &m_DrawMemory[i]);
+
+        m_Device->createSharedBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                        | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                        | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                sizeof(uint32_t),
+                &m_CountBuffer[i],
+                &m_CountMemory[i]);
+
+        // Laid out like the instance buffer, read by the vertex shader
+        m_Device->createSharedBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                sizeof(scene::InstanceData) * m_MaxDraws,
+                &m_VisibleInstanceBuffer[i],
+                &m_VisibleInstanceMemory[i]);
+
+        // Only used on the compute queue
+        m_Device->createBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                        | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                sizeof(uint32_t) * m_MaxDraws,
+                &m_BatchCountBuffer[i],
+                &m_BatchCountMemory[i]);
+
+        m_DescriptorSets[i] = m_DescriptorSetGenerator->generateSet(
+                m_DescriptorPool, m_DescSetLayout);
+
+        const VkBuffer buffers[] = {
+                instanceBuffers[i],
+                batchBuffers[i],
+                m_DrawBuffer[i],
+                m_CountBuffer[i],
+                m_VisibleInstanceBuffer[i],
+                m_BatchCountBuffer[i]};
+        for(uint32_t binding = 0; binding < BINDING_COUNT; ++binding)
+        {
+            VkDescriptorBufferInfo bufferInfo = {};
+            bufferInfo.buffer = buffers[binding];
+            bufferInfo.offset = 0;
+            bufferInfo.range = VK_WHOLE_SIZE;
+            m_DescriptorSetGenerator->bind(
+                    m_DescriptorSets[i], binding, {bufferInfo});
+        }
+    }
+    m_DescriptorSetGenerator->updateSetContents();
+
+    createPipeline();
+
+    m_Log->info("Culling up to {} draws on the compute queue", m_MaxDraws);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+GpuCulling::~GpuCulling()
+{
+    VkDevice device = m_Device->getLogicalDevice();
+
+    for(size_t i = 0; i < m_DrawBuffer.size(); ++i)
+    {
+        vmaDestroyBuffer(
+                m_Device->getAllocator(), m_DrawBuffer[i], m_DrawMemory[i]);
+        vmaDestroyBuffer(
+                m_Device->getAllocator(), m_CountBuffer[i], m_CountMemory[i]);
+        vmaDestroyBuffer(
+                m_Device->getAllocator(),
+                m_VisibleInstanceBuffer[i],
+                m_VisibleInstanceMemory[i]);
+        vmaDestroyBuffer(
+                m_Device->getAllocator(),
+                m_BatchCountBuffer[i],
+                m_BatchCountMemory[i]);
+    }
+
+    if(m_Pipeline != VK_NULL_HANDLE)
+    {
+        vkDestroyPipeline(device, m_Pipeline, nullptr);
+    }
+    if(m_PipelineLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineLayout(device, m_PipelineLayout, nullptr);
+    }
+    if(m_DescSetLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(device, m_DescSetLayout, nullptr);
+    }
+    if(m_DescriptorPool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(device, m_DescriptorPool, nullptr);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Culled draws reference their instance through firstInstance and the draw
+// count lives on the GPU
+//
+
+bool GpuCulling::isSupported(const Device& device)
+{
+    return device.getEnabledFeatures().drawIndirectFirstInstance
+           && device.getEnabledFeatures12().drawIndirectCount;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GpuCulling::createPipeline()
+{
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstantBlock);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = nullptr;
+    layoutInfo.flags = 0;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_DescSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(
+            m_Device->getLogicalDevice(),
+            &layoutInfo,
+            nullptr,
+            &m_PipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage = m_Device->loadShaderFromFile(
+            "data/shaders/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    pipelineInfo.layout = m_PipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VK_CHECK(vkCreateComputePipelines(
+            m_Device->getLogicalDevice(),
+            m_Device->getPipelineCache(),
+            1,
+            &pipelineInfo,
+            nullptr,
+            &m_Pipeline));
+
+    vkDestroyShaderModule(
+            m_Device->getLogicalDevice(), pipelineInfo.stage.module, nullptr);
+}
+
+// ----------------------------------------------------------------------------
+// The cull phase counts the visible instances of every batch, the emit phase
+// turns the counts into draws once all of them are in
+//
+
+void GpuCulling::record(
+        VkCommandBuffer cmdBuf,
+        uint32_t frameIndex,
+        uint32_t instanceCount,
+        uint32_t batchCount,
+        const scene::Frustum& frustum) const
+{
+    assert(frameIndex < m_DescriptorSets.size());
+    assert(instanceCount <= m_MaxDraws);
+    assert(batchCount <= instanceCount);
+
+    vkCmdFillBuffer(cmdBuf, m_CountBuffer[frameIndex], 0, sizeof(uint32_t), 0);
+    if(batchCount > 0)
+    {
+        vkCmdFillBuffer(
+                cmdBuf,
+                m_BatchCountBuffer[frameIndex],
+                0,
+                sizeof(uint32_t) * batchCount,
+                0);
+    }
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+            cmdBuf,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1,
+            &barrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+    if(instanceCount == 0)
+    {
+        return;
+    }
+
+    PushConstantBlock pushConstants;
+    for(size_t i = 0; i < frustum.planes.size(); ++i)
+    {
+        pushConstants.planes[i] = frustum.planes[i];
+    }
+    pushConstants.instanceCount = instanceCount;
+    pushConstants.batchCount = batchCount;
+    pushConstants.phase = Cull;
+
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+    vkCmdBindDescriptorSets(
+            cmdBuf,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            m_PipelineLayout,
+            0,
+            1,
+            &m_DescriptorSets[frameIndex],
+            0,
+            nullptr);
+    vkCmdPushConstants(
+            cmdBuf,
+            m_PipelineLayout,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            0,
+            sizeof(PushConstantBlock),
+            &pushConstants);
+    vkCmdDispatch(
+            cmdBuf,
+            (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE,
+            1,
+            1);
+
+    // Batch counts are complete
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+            cmdBuf,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1,
+            &barrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+    pushConstants.phase = Emit;
+    vkCmdPushConstants(
+            cmdBuf,
+            m_PipelineLayout,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            0,
+            sizeof(PushConstantBlock),
+            &pushConstants);
+    vkCmdDispatch(
+            cmdBuf, (batchCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GpuCulling::draw(VkCommandBuffer cmdBuf, uint32_t frameIndex) const
+{
+    vkCmdDrawIndexedIndirectCount(
+            cmdBuf,
+            m_DrawBuffer[frameIndex],
+            0,
+            m_CountBuffer[frameIndex],
+            0,
+            m_MaxDraws,
+            sizeof(VkDrawIndexedIndirectCommand));
+}
+
+} // namespace core::vk
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "core/scene/frustum.h"
+#include "core/vulkan/descriptorgen.h"
+#include "core/vulkan/device.h"
+#include "logs/log.h"
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <vector>
+
+namespace core::vk
+{
+
+// Frustum culling for the compute queue. Every frame in flight has its own
+// instance and batch buffers as inputs. Visible instances are compacted per
+// batch into a visible instance buffer, at the batch's firstInstance, and
+// every batch with visible instances becomes one instanced draw in an
+// indirect draw buffer. Its atomic draw count is consumed by the graphics
+// pass with vkCmdDrawIndexedIndirectCount.
+class GpuCulling final
+{
+public:
+    GpuCulling(
+            Device* device,
+            const std::vector<VkBuffer>& instanceBuffers,
+            const std::vector<VkBuffer>& batchBuffers,
+            uint32_t maxDraws);
+    ~GpuCulling();
+
+    GpuCulling(const GpuCulling&) = delete;
+    GpuCulling(GpuCulling&&) = delete;
+    GpuCulling& operator=(const GpuCulling&) = delete;
+    GpuCulling& operator=(GpuCulling&&) = delete;
+
+    [[nodiscard]] static bool isSupported(const Device& device);
+
+    // Record the cull dispatches, meant for an async compute pass of the
+    // render graph. Batches are read from the start of the batch buffer. The
+    // draw and visible instance buffers of the frame are written at
+    // VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT.
+    void record(
+            VkCommandBuffer cmdBuf,
+            uint32_t frameIndex,
+            uint32_t instanceCount,
+            uint32_t batchCount,
+            const scene::Frustum& frustum) const;
+
+    void draw(VkCommandBuffer cmdBuf, uint32_t frameIndex) const;
+
+    // The culled draws index this instead of the frame's instance buffer
+    [[nodiscard]] VkBuffer getVisibleInstanceBuffer(uint32_t frameIndex) const
+    {
+        return m_VisibleInstanceBuffer[frameIndex];
+    }
+
+private:
+    enum Phase : uint32_t
+    {
+        Cull = 0,
+        Emit
+    };
+
+    struct PushConstantBlock
+    {
+        glm::vec4 planes[scene::Frustum::Count];
+        uint32_t instanceCount = 0;
+        uint32_t batchCount = 0;
+        uint32_t phase = 0;
+    };
+
+    void createPipeline();
+
+    logs::Logger m_Log;
+    Device* m_Device;
+    uint32_t m_MaxDraws;
+
+    std::unique_ptr<DescriptorSetGenerator> m_DescriptorSetGenerator;
+    VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_DescSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_Pipeline = VK_NULL_HANDLE;
+
+    std::vector<VkDescriptorSet> m_DescriptorSets;
+
+    std::vector<VkBuffer> m_DrawBuffer;
+    std::vector<VmaAllocation> m_DrawMemory;
+    std::vector<VkBuffer> m_CountBuffer;
+    std::vector<VmaAllocation> m_CountMemory;
+    std::vector<VkBuffer> m_VisibleInstanceBuffer;
+    std::vector<VmaAllocation> m_VisibleInstanceMemory;
+    std::vector<VkBuffer> m_BatchCountBuffer;
+    std::vector<VmaAllocation> m_BatchCountMemory;
+};
+
+} // namespace core::vk
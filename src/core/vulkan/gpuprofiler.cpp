@@ -0,0 +1,436 @@
+#include "gpuprofiler.h"
+
+#include "core/vulkan/utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iterator>
+
+namespace core::vk
+{
+
+namespace
+{
+// Scopes per frame, two timestamps each
+constexpr uint32_t MAX_SCOPES = 32;
+
+// Results come in the order of the bits, as in PipelineStatistics
+constexpr VkQueryPipelineStatisticFlags STATISTICS_FLAGS =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+const char* getQueueName(QueueType queue)
+{
+    switch(queue)
+    {
+    case QueueType::Graphics:
+        return "graphics";
+    case QueueType::Compute:
+        return "compute";
+    case QueueType::Transfer:
+        return "transfer";
+    default:
+        return "unknown";
+    }
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Timestamps of queues with no valid bits are never written, scopes on them
+// are dropped
+//
+
+GpuProfiler::GpuProfiler(Device* device, uint32_t frameCount) :
+    m_Log(logs::Log::create("Vulkan GpuProfiler")), m_Device(device)
+{
+    assert(isSupported(*m_Device));
+    m_TimestampPeriod = m_Device->getProperties().limits.timestampPeriod;
+
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(
+            m_Device->getPhysicalDevice(), &count, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+            m_Device->getPhysicalDevice(), &count, queueFamilies.data());
+
+    const std::array<uint32_t, static_cast<size_t>(QueueType::Count)>
+            families = {
+                    m_Device->getGraphicsQueueFamily(),
+                    m_Device->getComputeQueueFamily(),
+                    m_Device->getTransferQueueFamily()};
+    for(size_t i = 0; i < families.size(); ++i)
+    {
+        const uint32_t validBits =
+                queueFamilies[families[i]].timestampValidBits;
+        m_TimestampMasks[i] = validBits < 64 ? (uint64_t{1} << validBits) - 1
+                                             : ~uint64_t{0};
+        m_Log->info(
+                "{} queue timestamps: {} bits, {} ns per tick",
+                getQueueName(static_cast<QueueType>(i)),
+                validBits,
+                m_TimestampPeriod);
+    }
+
+    VkQueryPoolCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.pNext = nullptr;
+    createInfo.flags = 0;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = MAX_SCOPES * 2;
+
+    m_Slots.resize(frameCount);
+    for(auto& slot : m_Slots)
+    {
+        VK_CHECK(vkCreateQueryPool(
+                m_Device->getLogicalDevice(),
+                &createInfo,
+                nullptr,
+                &slot.pool));
+        vkResetQueryPool(
+                m_Device->getLogicalDevice(),
+                slot.pool,
+                0,
+                createInfo.queryCount);
+        slot.scopes.reserve(MAX_SCOPES);
+    }
+
+    // Scenes recorded into secondary command buffers need the statistics
+    // to be inherited
+    const auto& features = m_Device->getEnabledFeatures();
+    if(features.pipelineStatisticsQuery == VK_FALSE
+       || features.inheritedQueries == VK_FALSE)
+    {
+        m_Log->info("Pipeline statistics not supported");
+        return;
+    }
+
+    m_StatisticsFlags = STATISTICS_FLAGS;
+    createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    createInfo.queryCount = 1;
+    createInfo.pipelineStatistics = m_StatisticsFlags;
+    for(auto& slot : m_Slots)
+    {
+        VK_CHECK(vkCreateQueryPool(
+                m_Device->getLogicalDevice(),
+                &createInfo,
+                nullptr,
+                &slot.statisticsPool));
+        vkResetQueryPool(
+                m_Device->getLogicalDevice(), slot.statisticsPool, 0, 1);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+GpuProfiler::~GpuProfiler()
+{
+    for(auto& slot : m_Slots)
+    {
+        vkDestroyQueryPool(m_Device->getLogicalDevice(), slot.pool, nullptr);
+        if(slot.statisticsPool)
+        {
+            vkDestroyQueryPool(
+                    m_Device->getLogicalDevice(), slot.statisticsPool, nullptr);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Pools are reset from the host, so the frame's scopes can be recorded into
+// command buffers of different queues in any submission order
+//
+
+bool GpuProfiler::isSupported(const Device& device)
+{
+    return device.getEnabledFeatures12().hostQueryReset == VK_TRUE;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GpuProfiler::beginFrame(uint32_t frameIndex)
+{
+    assert(frameIndex < m_Slots.size());
+    assert(m_OpenScopes == 0);
+
+    m_Resolved = false;
+    m_FrameIndex = frameIndex;
+
+    auto& slot = m_Slots[frameIndex];
+    resolveStatistics(slot);
+    if(!slot.scopes.empty())
+    {
+        resolve(slot);
+        vkResetQueryPool(
+                m_Device->getLogicalDevice(),
+                slot.pool,
+                0,
+                static_cast<uint32_t>(slot.scopes.size()) * 2);
+        slot.scopes.clear();
+    }
+    slot.frameNumber = m_FrameNumber++;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+GpuProfiler::ScopeId GpuProfiler::begin(
+        VkCommandBuffer cmdBuf, std::string_view name, QueueType queue)
+{
+    auto& slot = m_Slots[m_FrameIndex];
+    if(slot.scopes.size() == MAX_SCOPES
+       || m_TimestampMasks[static_cast<size_t>(queue)] == 0)
+    {
+        return INVALID_SCOPE;
+    }
+
+    const auto scope = static_cast<ScopeId>(slot.scopes.size());
+    slot.scopes.push_back({std::string(name), queue, m_OpenScopes});
+    ++m_OpenScopes;
+
+    vkCmdWriteTimestamp(
+            cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.pool, scope * 2);
+    return scope;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GpuProfiler::end(VkCommandBuffer cmdBuf, ScopeId scope)
+{
+    if(scope == INVALID_SCOPE)
+    {
+        return;
+    }
+
+    assert(m_OpenScopes > 0);
+    --m_OpenScopes;
+    vkCmdWriteTimestamp(
+            cmdBuf,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            m_Slots[m_FrameIndex].pool,
+            scope * 2 + 1);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GpuProfiler::beginStatistics(VkCommandBuffer cmdBuf)
+{
+    auto& slot = m_Slots[m_FrameIndex];
+    if(!slot.statisticsPool)
+    {
+        return;
+    }
+
+    assert(!slot.statisticsRecorded);
+    vkCmdBeginQuery(cmdBuf, slot.statisticsPool, 0, 0);
+    slot.statisticsRecorded = true;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GpuProfiler::endStatistics(VkCommandBuffer cmdBuf)
+{
+    const auto& slot = m_Slots[m_FrameIndex];
+    if(slot.statisticsRecorded)
+    {
+        vkCmdEndQuery(cmdBuf, slot.statisticsPool, 0);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+std::optional<float> GpuProfiler::getResolvedMs(std::string_view name) const
+{
+    if(!m_Resolved)
+    {
+        return std::nullopt;
+    }
+
+    for(const auto& scope : m_History.front().scopes)
+    {
+        if(scope.name == name)
+        {
+            return scope.durationMs;
+        }
+    }
+    return std::nullopt;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+bool GpuProfiler::writeCsv(const std::string& path) const
+{
+    std::ofstream file(path);
+    file << "frame,scope,queue,depth,begin_ms,duration_ms\n";
+    for(auto frame = m_History.rbegin(); frame != m_History.rend(); ++frame)
+    {
+        for(const auto& scope : frame->scopes)
+        {
+            file << frame->number << ',' << scope.name << ','
+                 << getQueueName(scope.queue) << ',' << scope.depth << ','
+                 << scope.beginMs << ',' << scope.durationMs << '\n';
+        }
+    }
+
+    if(!file)
+    {
+        m_Log->warn("Failed to write {}", path);
+        return false;
+    }
+    m_Log->info("Wrote {} frames to {}", m_History.size(), path);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Timestamps of different queues are assumed to share a clock, true on the
+// drivers we run on though the spec doesn't promise it
+//
+
+void GpuProfiler::resolve(Slot& slot)
+{
+    std::array<uint64_t, MAX_SCOPES * 2> ticks = {};
+    const auto queryCount = static_cast<uint32_t>(slot.scopes.size()) * 2;
+
+    // Not ready only when a scope was never ended or its command buffer
+    // never submitted, the frame is dropped
+    const VkResult result = vkGetQueryPoolResults(
+            m_Device->getLogicalDevice(),
+            slot.pool,
+            0,
+            queryCount,
+            queryCount * sizeof(uint64_t),
+            ticks.data(),
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+    if(result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    uint64_t first = ~uint64_t{0};
+    for(size_t i = 0; i < slot.scopes.size(); ++i)
+    {
+        const auto mask =
+                m_TimestampMasks[static_cast<size_t>(slot.scopes[i].queue)];
+        first = std::min(first, ticks[i * 2] & mask);
+    }
+
+    const double msPerTick = m_TimestampPeriod * 1e-6;
+    Frame frame;
+    frame.number = slot.frameNumber;
+    frame.scopes.reserve(slot.scopes.size());
+    for(size_t i = 0; i < slot.scopes.size(); ++i)
+    {
+        const auto& pending = slot.scopes[i];
+        const auto mask = m_TimestampMasks[static_cast<size_t>(pending.queue)];
+        const uint64_t begin = ticks[i * 2] & mask;
+        const uint64_t end = ticks[i * 2 + 1] & mask;
+
+        Scope scope;
+        scope.name = pending.name;
+        scope.queue = pending.queue;
+        scope.depth = pending.depth;
+        scope.beginMs = static_cast<float>(
+                static_cast<double>(begin - first) * msPerTick);
+        scope.durationMs = static_cast<float>(
+                static_cast<double>((end - begin) & mask) * msPerTick);
+        frame.scopes.push_back(std::move(scope));
+    }
+
+    m_History.push_front(std::move(frame));
+    if(m_History.size() > HISTORY_FRAMES)
+    {
+        m_History.pop_back();
+    }
+    m_Resolved = true;
+    updateAverages();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void GpuProfiler::resolveStatistics(Slot& slot)
+{
+    m_Statistics.reset();
+    if(!slot.statisticsRecorded)
+    {
+        return;
+    }
+
+    std::array<uint64_t, 4> counts = {};
+    const VkResult result = vkGetQueryPoolResults(
+            m_Device->getLogicalDevice(),
+            slot.statisticsPool,
+            0,
+            1,
+            sizeof(counts),
+            counts.data(),
+            sizeof(counts),
+            VK_QUERY_RESULT_64_BIT);
+    if(result == VK_SUCCESS)
+    {
+        m_Statistics = PipelineStatistics{
+                counts[0], counts[1], counts[2], counts[3]};
+    }
+
+    vkResetQueryPool(m_Device->getLogicalDevice(), slot.statisticsPool, 0, 1);
+    slot.statisticsRecorded = false;
+}
+
+// ----------------------------------------------------------------------------
+// Averaged over the frames a scope was recorded in
+//
+
+void GpuProfiler::updateAverages()
+{
+    std::vector<uint32_t> counts;
+    m_Averages.clear();
+    for(auto frame = m_History.rbegin(); frame != m_History.rend(); ++frame)
+    {
+        for(const auto& scope : frame->scopes)
+        {
+            auto average = std::find_if(
+                    m_Averages.begin(),
+                    m_Averages.end(),
+                    [&scope](const Average& average) {
+                        return average.name == scope.name;
+                    });
+            if(average == m_Averages.end())
+            {
+                m_Averages.push_back({scope.name, 0.0f, 0.0f});
+                counts.push_back(0);
+                average = std::prev(m_Averages.end());
+            }
+
+            const auto index = std::distance(m_Averages.begin(), average);
+            counts[static_cast<size_t>(index)] += 1;
+            average->averageMs += scope.durationMs;
+            average->maxMs = std::max(average->maxMs, scope.durationMs);
+        }
+    }
+
+    for(size_t i = 0; i < m_Averages.size(); ++i)
+    {
+        m_Averages[i].averageMs /= static_cast<float>(counts[i]);
+    }
+}
+
+} // namespace core::vk
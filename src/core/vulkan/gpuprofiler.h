@@ -0,0 +1,162 @@
+#pragma once
+
+#include "core/vulkan/device.h"
+#include "logs/log.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace core::vk
+{
+
+// Timestamp queries around named scopes of a frame, one query pool per frame
+// in flight. A frame's results are read when its slot comes around again,
+// after its submits have been waited on, so reading never stalls. Scopes are
+// recorded from the main thread only, into command buffers of any queue.
+class GpuProfiler final
+{
+public:
+    using ScopeId = uint32_t;
+    static constexpr ScopeId INVALID_SCOPE = ~0u;
+    // Frames kept for the averages and the CSV export
+    static constexpr size_t HISTORY_FRAMES = 240;
+
+    struct Scope
+    {
+        std::string name;
+        QueueType queue = QueueType::Graphics;
+        // Scopes open when this one began
+        uint32_t depth = 0;
+        // From the first timestamp of the frame
+        float beginMs = 0.0f;
+        float durationMs = 0.0f;
+    };
+
+    struct Frame
+    {
+        uint64_t number = 0;
+        std::vector<Scope> scopes;
+    };
+
+    struct Average
+    {
+        std::string name;
+        float averageMs = 0.0f;
+        float maxMs = 0.0f;
+    };
+
+    // Counted by the GPU over the graphics command buffer of a frame
+    struct PipelineStatistics
+    {
+        uint64_t inputPrimitives = 0;
+        uint64_t vertexInvocations = 0;
+        uint64_t clippingPrimitives = 0;
+        uint64_t fragmentInvocations = 0;
+    };
+
+    // Needs the hostQueryReset feature
+    GpuProfiler(Device* device, uint32_t frameCount);
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler(GpuProfiler&&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(GpuProfiler&&) = delete;
+
+    [[nodiscard]] static bool isSupported(const Device& device);
+
+    // Every submit of the frame that last used the slot must have finished,
+    // its results are resolved and the slot is reused
+    void beginFrame(uint32_t frameIndex);
+
+    // INVALID_SCOPE when the frame is out of queries, end ignores it
+    [[nodiscard]] ScopeId begin(
+            VkCommandBuffer cmdBuf, std::string_view name, QueueType queue);
+    void end(VkCommandBuffer cmdBuf, ScopeId scope);
+
+    // 0 without the pipelineStatisticsQuery and inheritedQueries features,
+    // secondary command buffers executed during the query must inherit
+    // these
+    [[nodiscard]] VkQueryPipelineStatisticFlags getStatisticsFlags() const
+    {
+        return m_StatisticsFlags;
+    }
+    // Once per frame around a graphics command buffer, outside render
+    // passes. Does nothing when the statistics aren't supported.
+    void beginStatistics(VkCommandBuffer cmdBuf);
+    void endStatistics(VkCommandBuffer cmdBuf);
+
+    // Newest frame first
+    [[nodiscard]] const std::deque<Frame>& getHistory() const
+    {
+        return m_History;
+    }
+    // Over the history, in the order the scopes were first seen
+    [[nodiscard]] const std::vector<Average>& getAverages() const
+    {
+        return m_Averages;
+    }
+    // Duration of the scope in the frame resolved by the last beginFrame,
+    // empty when no frame was resolved or the scope wasn't recorded
+    [[nodiscard]] std::optional<float> getResolvedMs(
+            std::string_view name) const;
+    // Of the frame resolved by the last beginFrame
+    [[nodiscard]] const std::optional<PipelineStatistics>&
+    getResolvedStatistics() const
+    {
+        return m_Statistics;
+    }
+
+    // One line per scope of every frame in the history, false when the file
+    // can't be written
+    bool writeCsv(const std::string& path) const;
+
+private:
+    struct PendingScope
+    {
+        std::string name;
+        QueueType queue = QueueType::Graphics;
+        uint32_t depth = 0;
+    };
+
+    struct Slot
+    {
+        VkQueryPool pool = VK_NULL_HANDLE;
+        uint64_t frameNumber = 0;
+        std::vector<PendingScope> scopes;
+        VkQueryPool statisticsPool = VK_NULL_HANDLE;
+        bool statisticsRecorded = false;
+    };
+
+    void resolve(Slot& slot);
+    void resolveStatistics(Slot& slot);
+    void updateAverages();
+
+    logs::Logger m_Log;
+    Device* m_Device;
+    // Nanoseconds per tick
+    double m_TimestampPeriod = 1.0;
+    // Indexed by QueueType, masks off the bits the queue doesn't write
+    std::array<uint64_t, static_cast<size_t>(QueueType::Count)>
+            m_TimestampMasks = {};
+
+    std::vector<Slot> m_Slots;
+    uint32_t m_FrameIndex = 0;
+    uint64_t m_FrameNumber = 0;
+    uint32_t m_OpenScopes = 0;
+    bool m_Resolved = false;
+
+    VkQueryPipelineStatisticFlags m_StatisticsFlags = 0;
+    std::optional<PipelineStatistics> m_Statistics;
+
+    std::deque<Frame> m_History;
+    std::vector<Average> m_Averages;
+};
+
+} // namespace core::vk
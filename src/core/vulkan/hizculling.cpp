@@ -0,0 +1,396 @@
+#include "hizculling.h"
+
+#include "core/vulkan/utils.h"
+#include "gpuculling.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace core::vk
+{
+
+namespace
+{
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+constexpr uint32_t PYRAMID_BINDING = 5;
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+HiZCulling::HiZCulling(
+        Device* device,
+        const std::vector<VkBuffer>& instanceBuffers,
+        const std::vector<VkBuffer>& batchBuffers,
+        uint32_t maxDraws) :
+    m_Log(logs::Log::create("HiZ Culling")),
+    m_Device(device),
+    m_MaxDraws(maxDraws),
+    m_DepthPyramid(device)
+{
+    assert(m_Device);
+    assert(instanceBuffers.size() == batchBuffers.size());
+    assert(isSupported(*m_Device));
+
+    const size_t setCount = instanceBuffers.size() * PhaseCount;
+
+    m_DescriptorSetGenerator = std::make_unique<DescriptorSetGenerator>(
+            m_Device->getLogicalDevice());
+    for(uint32_t binding = 0; binding < PYRAMID_BINDING; ++binding)
+    {
+        m_DescriptorSetGenerator->addBinding(
+                binding,
+                1,
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+    m_DescriptorSetGenerator->addBinding(
+            PYRAMID_BINDING,
+            1,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT);
+
+    m_DescriptorPool = m_DescriptorSetGenerator->generatePool(
+            static_cast<uint32_t>(setCount));
+    m_DescSetLayout = m_DescriptorSetGenerator->generateLayout();
+
+    m_Device->createBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                    | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            sizeof(uint32_t) * VISIBILITY_SLOTS,
+            &m_VisibilityBuffer,
+            &m_VisibilityMemory);
+
+    // Nothing was visible before the first frame, the early pass draws
+    // nothing and the late pass everything that passes the test
+    VkCommandBuffer clearCmdBuf = m_Device->createCommandBuffer();
+    vkCmdFillBuffer(clearCmdBuf, m_VisibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+    m_Device->flushCommandBuffer(clearCmdBuf, QueueType::Graphics, true);
+
+    m_DescriptorSets.resize(setCount);
+    m_DrawBuffer.resize(setCount);
+    m_DrawMemory.resize(setCount);
+    m_CountBuffer.resize(setCount);
+    m_CountMemory.resize(setCount);
+
+    for(size_t i = 0; i < setCount; ++i)
+    {
+        const size_t frame = i / PhaseCount;
+
+        m_Device->createSharedBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                        | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                sizeof(VkDrawIndexedIndirectCommand) * m_MaxDraws,
+                &m_DrawBuffer[i],
+                &m_DrawMemory[i]);
+
+        m_Device->createSharedBuffer(
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                        | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                        | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                sizeof(uint32_t),
+                &m_CountBuffer[i],
+                &m_CountMemory[i]);
+
+        m_DescriptorSets[i] = m_DescriptorSetGenerator->generateSet(
+                m_DescriptorPool, m_DescSetLayout);
+
+        const VkBuffer buffers[] = {
+                instanceBuffers[frame],
+                batchBuffers[frame],
+                m_DrawBuffer[i],
+                m_CountBuffer[i],
+                m_VisibilityBuffer};
+        for(uint32_t binding = 0; binding < PYRAMID_BINDING; ++binding)
+        {
+            VkDescriptorBufferInfo bufferInfo = {};
+            bufferInfo.buffer = buffers[binding];
+            bufferInfo.offset = 0;
+            bufferInfo.range = VK_WHOLE_SIZE;
+            m_DescriptorSetGenerator->bind(
+                    m_DescriptorSets[i], binding, {bufferInfo});
+        }
+    }
+    m_DescriptorSetGenerator->updateSetContents();
+
+    createPipeline();
+
+    m_Log->info(
+            "Culling up to {} draws in two passes, {} entities tracked",
+            m_MaxDraws,
+            VISIBILITY_SLOTS);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+HiZCulling::~HiZCulling()
+{
+    VkDevice device = m_Device->getLogicalDevice();
+
+    for(size_t i = 0; i < m_DrawBuffer.size(); ++i)
+    {
+        vmaDestroyBuffer(
+                m_Device->getAllocator(), m_DrawBuffer[i], m_DrawMemory[i]);
+        vmaDestroyBuffer(
+                m_Device->getAllocator(), m_CountBuffer[i], m_CountMemory[i]);
+    }
+    vmaDestroyBuffer(
+            m_Device->getAllocator(), m_VisibilityBuffer, m_VisibilityMemory);
+
+    if(m_Pipeline != VK_NULL_HANDLE)
+    {
+        vkDestroyPipeline(device, m_Pipeline, nullptr);
+    }
+    if(m_PipelineLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineLayout(device, m_PipelineLayout, nullptr);
+    }
+    if(m_DescSetLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(device, m_DescSetLayout, nullptr);
+    }
+    if(m_DescriptorPool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(device, m_DescriptorPool, nullptr);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Same draw path as the frustum culling pass, plus a sampled depth pyramid
+//
+
+bool HiZCulling::isSupported(const Device& device)
+{
+    return GpuCulling::isSupported(device) && DepthPyramid::isSupported(device);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void HiZCulling::setDepth(VkImageView depthView, VkExtent2D depthExtent)
+{
+    m_DepthPyramid.create(depthView, depthExtent);
+
+    const VkDescriptorImageInfo pyramidInfo =
+            m_DepthPyramid.getDescriptorInfo();
+    for(auto set : m_DescriptorSets)
+    {
+        m_DescriptorSetGenerator->bind(
+                set,
+                PYRAMID_BINDING,
+                std::vector<VkDescriptorImageInfo>{pyramidInfo},
+                true);
+    }
+    m_DescriptorSetGenerator->updateSetContents();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void HiZCulling::createPipeline()
+{
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstantBlock);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = nullptr;
+    layoutInfo.flags = 0;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_DescSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(
+            m_Device->getLogicalDevice(),
+            &layoutInfo,
+            nullptr,
+            &m_PipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage = m_Device->loadShaderFromFile(
+            "data/shaders/hizcull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    pipelineInfo.layout = m_PipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VK_CHECK(vkCreateComputePipelines(
+            m_Device->getLogicalDevice(),
+            m_Device->getPipelineCache(),
+            1,
+            &pipelineInfo,
+            nullptr,
+            &m_Pipeline));
+
+    vkDestroyShaderModule(
+            m_Device->getLogicalDevice(), pipelineInfo.stage.module, nullptr);
+}
+
+// ----------------------------------------------------------------------------
+// Slots are sorted, runs of adjacent ones are cleared with one fill
+//
+
+void HiZCulling::resetVisibility(
+        VkCommandBuffer cmdBuf, const std::vector<uint32_t>& slots) const
+{
+    assert(std::is_sorted(slots.begin(), slots.end()));
+    if(slots.empty())
+    {
+        return;
+    }
+
+    // The previous late pass may still be writing the slots
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+            cmdBuf,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            1,
+            &barrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+    size_t first = 0;
+    while(first < slots.size() && slots[first] < VISIBILITY_SLOTS)
+    {
+        size_t last = first + 1;
+        while(last < slots.size() && slots[last] == slots[last - 1] + 1
+              && slots[last] < VISIBILITY_SLOTS)
+        {
+            ++last;
+        }
+        vkCmdFillBuffer(
+                cmdBuf,
+                m_VisibilityBuffer,
+                sizeof(uint32_t) * slots[first],
+                sizeof(uint32_t) * (last - first),
+                0);
+        first = last;
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void HiZCulling::cull(
+        VkCommandBuffer cmdBuf,
+        uint32_t frameIndex,
+        Phase phase,
+        uint32_t instanceCount,
+        const glm::mat4& viewProj) const
+{
+    assert(slot(frameIndex, phase) < m_DescriptorSets.size());
+    assert(instanceCount <= m_MaxDraws);
+
+    const size_t index = slot(frameIndex, phase);
+
+    vkCmdFillBuffer(cmdBuf, m_CountBuffer[index], 0, sizeof(uint32_t), 0);
+
+    // Covers the count reset and the visibility reset or written by the
+    // previous late pass
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask =
+            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+            cmdBuf,
+            VK_PIPELINE_STAGE_TRANSFER_BIT
+                    | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1,
+            &barrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+    if(instanceCount > 0)
+    {
+        const VkExtent2D pyramidExtent = m_DepthPyramid.getExtent();
+
+        PushConstantBlock pushConstants;
+        pushConstants.viewProj = viewProj;
+        pushConstants.pyramidSize[0] = static_cast<float>(pyramidExtent.width);
+        pushConstants.pyramidSize[1] =
+                static_cast<float>(pyramidExtent.height);
+        pushConstants.instanceCount = instanceCount;
+        pushConstants.phase = phase;
+
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+        vkCmdBindDescriptorSets(
+                cmdBuf,
+                VK_PIPELINE_BIND_POINT_COMPUTE,
+                m_PipelineLayout,
+                0,
+                1,
+                &m_DescriptorSets[index],
+                0,
+                nullptr);
+        vkCmdPushConstants(
+                cmdBuf,
+                m_PipelineLayout,
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                0,
+                sizeof(PushConstantBlock),
+                &pushConstants);
+        vkCmdDispatch(
+                cmdBuf,
+                (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE,
+                1,
+                1);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void HiZCulling::buildDepthPyramid(VkCommandBuffer cmdBuf) const
+{
+    m_DepthPyramid.build(cmdBuf);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void HiZCulling::draw(
+        VkCommandBuffer cmdBuf, uint32_t frameIndex, Phase phase) const
+{
+    const size_t index = slot(frameIndex, phase);
+
+    vkCmdDrawIndexedIndirectCount(
+            cmdBuf,
+            m_DrawBuffer[index],
+            0,
+            m_CountBuffer[index],
+            0,
+            m_MaxDraws,
+            sizeof(VkDrawIndexedIndirectCommand));
+}
+
+} // namespace core::vk
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "core/vulkan/descriptorgen.h"
+#include "core/vulkan/device.h"
+#include "depthpyramid.h"
+#include "logs/log.h"
+
+#include <glm/mat4x4.hpp>
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <vector>
+
+namespace core::vk
+{
+
+// Two pass occlusion culling against a hierarchical depth buffer, recorded
+// in the graphics command buffer. The early pass draws what was visible last
+// frame, its depth is reduced into the pyramid and the late pass tests every
+// instance against it, drawing only the ones that became visible. Visibility
+// is kept per entity between frames in a GPU only buffer indexed by
+// InstanceData::visibilityIndex.
+class HiZCulling final
+{
+public:
+    enum Phase : uint32_t
+    {
+        Early = 0,
+        Late,
+        PhaseCount
+    };
+
+    // Size of the visibility buffer, larger indices are never occlusion
+    // culled
+    static constexpr uint32_t VISIBILITY_SLOTS = 1u << 20;
+
+    HiZCulling(
+            Device* device,
+            const std::vector<VkBuffer>& instanceBuffers,
+            const std::vector<VkBuffer>& batchBuffers,
+            uint32_t maxDraws);
+    ~HiZCulling();
+
+    HiZCulling(const HiZCulling&) = delete;
+    HiZCulling(HiZCulling&&) = delete;
+    HiZCulling& operator=(const HiZCulling&) = delete;
+    HiZCulling& operator=(HiZCulling&&) = delete;
+
+    [[nodiscard]] static bool isSupported(const Device& device);
+
+    // Pyramid follows the depth attachment, call again whenever it is
+    // recreated. Device has to be idle.
+    void setDepth(VkImageView depthView, VkExtent2D depthExtent);
+
+    // Marks the slots as not visible last frame, for slots that were handed
+    // to new entities. Has to be recorded outside a render pass before the
+    // early cull().
+    void resetVisibility(
+            VkCommandBuffer cmdBuf, const std::vector<uint32_t>& slots) const;
+
+    // Fill the draw buffer of a phase, has to be recorded outside a render
+    // pass before draw(). The late phase reads the pyramid so it comes after
+    // buildDepthPyramid(). The draw buffers are written at
+    // VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, the render graph waits for them.
+    void cull(
+            VkCommandBuffer cmdBuf,
+            uint32_t frameIndex,
+            Phase phase,
+            uint32_t instanceCount,
+            const glm::mat4& viewProj) const;
+
+    void buildDepthPyramid(VkCommandBuffer cmdBuf) const;
+    [[nodiscard]] VkImage getPyramidImage() const
+    {
+        return m_DepthPyramid.getImage();
+    }
+
+    void draw(VkCommandBuffer cmdBuf, uint32_t frameIndex, Phase phase) const;
+
+private:
+    struct PushConstantBlock
+    {
+        glm::mat4 viewProj;
+        float pyramidSize[2];
+        uint32_t instanceCount = 0;
+        uint32_t phase = 0;
+    };
+
+    [[nodiscard]] size_t slot(uint32_t frameIndex, Phase phase) const
+    {
+        return frameIndex * PhaseCount + phase;
+    }
+
+    void createPipeline();
+
+    logs::Logger m_Log;
+    Device* m_Device;
+    uint32_t m_MaxDraws;
+
+    DepthPyramid m_DepthPyramid;
+
+    std::unique_ptr<DescriptorSetGenerator> m_DescriptorSetGenerator;
+    VkDescriptorPool m_DescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_DescSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_Pipeline = VK_NULL_HANDLE;
+
+    // Indexed by slot()
+    std::vector<VkDescriptorSet> m_DescriptorSets;
+    std::vector<VkBuffer> m_DrawBuffer;
+    std::vector<VmaAllocation> m_DrawMemory;
+    std::vector<VkBuffer> m_CountBuffer;
+    std::vector<VmaAllocation> m_CountMemory;
+
+    VkBuffer m_VisibilityBuffer = VK_NULL_HANDLE;
+    VmaAllocation m_VisibilityMemory = VK_NULL_HANDLE;
+};
+
+} // namespace core::vk
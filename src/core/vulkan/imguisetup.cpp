@@ -298,7 +298,7 @@ ImGuiSetup::ImGuiSetup(Device* device, VkRenderPass renderpass) :
 
         VK_CHECK(vkCreateGraphicsPipelines(
                 m_Device->getLogicalDevice(),
-                nullptr,
+                m_Device->getPipelineCache(),
                 1,
                 &pipelineInfo,
                 nullptr,
@@ -315,16 +315,6 @@ ImGuiSetup::ImGuiSetup(Device* device, VkRenderPass renderpass) :
 ImGuiSetup::~ImGuiSetup()
 {
     ImGui::DestroyContext();
-    if(m_VertexBuffer)
-    {
-        vmaDestroyBuffer(
-                m_Device->getAllocator(), m_VertexBuffer, m_VertexMemory);
-    }
-    if(m_IndexBuffer)
-    {
-        vmaDestroyBuffer(
-                m_Device->getAllocator(), m_IndexBuffer, m_IndexMemory);
-    }
     if(m_Pipeline)
     {
         vkDestroyPipeline(m_Device->getLogicalDevice(), m_Pipeline, nullptr);
@@ -379,100 +369,52 @@ void ImGuiSetup::setDarkTheme()
     colors[ImGuiCol_TitleBgCollapsed] = ImVec4{0.15f, 0.1505f, 0.151f, 1.0f};
 }
 
-void ImGuiSetup::update()
+void ImGuiSetup::update(TransientAllocator& transient)
 {
-    auto* drawData = ImGui::GetDrawData();
+    vertexCount = 0;
+    indexCount = 0;
 
-    if(drawData)
+    auto* drawData = ImGui::GetDrawData();
+    if(!drawData || drawData->TotalVtxCount == 0
+       || drawData->TotalIdxCount == 0)
     {
-        VkDeviceSize vertexBufferSize =
-                drawData->TotalVtxCount * sizeof(ImDrawVert);
-        VkDeviceSize indexBufferSize =
-                drawData->TotalIdxCount * sizeof(ImDrawIdx);
-
-        // assert(vertexBufferSize > 0 && indexBufferSize > 0);
-
-        // Check if ImGui buffers need to be updated
-        if(m_VertexBuffer == VK_NULL_HANDLE
-           || vertexCount != drawData->TotalVtxCount
-           || m_IndexBuffer == VK_NULL_HANDLE
-           || drawData->TotalIdxCount != indexCount)
-        {
-            vertexCount = drawData->TotalVtxCount;
-            indexCount = drawData->TotalIdxCount;
-
-            if(vertexBufferSize == 0 || indexBufferSize == 0)
-                return;
-
-            // TODO Instead of devicewaitidle could this use a ringbuffer to
-            // swap active buffers
-            vkDeviceWaitIdle(m_Device->getLogicalDevice());
-            if(m_VertexBuffer)
-            {
-                vmaDestroyBuffer(
-                        m_Device->getAllocator(),
-                        m_VertexBuffer,
-                        m_VertexMemory);
-            }
-            if(m_IndexBuffer)
-            {
-                vmaDestroyBuffer(
-                        m_Device->getAllocator(), m_IndexBuffer, m_IndexMemory);
-            }
-
-            m_Device->createBuffer(
-                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                    VMA_MEMORY_USAGE_CPU_TO_GPU,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                    vertexBufferSize,
-                    &m_VertexBuffer,
-                    &m_VertexMemory);
-
-            m_Device->createBuffer(
-                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                    VMA_MEMORY_USAGE_CPU_TO_GPU,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                    indexBufferSize,
-                    &m_IndexBuffer,
-                    &m_IndexMemory);
-        }
-
-        void* vertexDst;
-        void* indexDst;
-
-        vmaMapMemory(m_Device->getAllocator(), m_VertexMemory, &vertexDst);
-        vmaMapMemory(m_Device->getAllocator(), m_IndexMemory, &indexDst);
-
-        for(int32_t n = 0; n < drawData->CmdListsCount; ++n)
-        {
-            const ImDrawList* cmdList = drawData->CmdLists[n];
-            std::memcpy(
-                    vertexDst,
-                    cmdList->VtxBuffer.Data,
-                    cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
-
-            std::memcpy(
-                    indexDst,
-                    cmdList->IdxBuffer.Data,
-                    cmdList->IdxBuffer.Size * sizeof(ImDrawIdx));
-
-            vertexDst = static_cast<ImDrawVert*>(vertexDst)
-                        + cmdList->VtxBuffer.Size;
-            indexDst =
-                    static_cast<ImDrawIdx*>(indexDst) + cmdList->IdxBuffer.Size;
-        }
-
-        vmaUnmapMemory(m_Device->getAllocator(), m_VertexMemory);
-        vmaUnmapMemory(m_Device->getAllocator(), m_IndexMemory);
+        return;
+    }
 
-        vmaFlushAllocation(
-                m_Device->getAllocator(), m_VertexMemory, 0, VK_WHOLE_SIZE);
-        vmaFlushAllocation(
-                m_Device->getAllocator(), m_IndexMemory, 0, VK_WHOLE_SIZE);
+    // Written straight into the frame's transient buffer, it is persistently
+    // mapped and coherent so there is nothing to map or flush. It grows with
+    // the UI and is only released once the frame has finished.
+    m_Vertices = transient.allocate(
+            drawData->TotalVtxCount * sizeof(ImDrawVert), sizeof(float));
+    m_Indices = transient.allocate(
+            drawData->TotalIdxCount * sizeof(ImDrawIdx), sizeof(uint32_t));
+
+    auto* vertexDst = static_cast<ImDrawVert*>(m_Vertices.data);
+    auto* indexDst = static_cast<ImDrawIdx*>(m_Indices.data);
+    for(int32_t n = 0; n < drawData->CmdListsCount; ++n)
+    {
+        const ImDrawList* cmdList = drawData->CmdLists[n];
+        std::memcpy(
+                vertexDst,
+                cmdList->VtxBuffer.Data,
+                cmdList->VtxBuffer.Size * sizeof(ImDrawVert));
+        std::memcpy(
+                indexDst,
+                cmdList->IdxBuffer.Data,
+                cmdList->IdxBuffer.Size * sizeof(ImDrawIdx));
+
+        vertexDst += cmdList->VtxBuffer.Size;
+        indexDst += cmdList->IdxBuffer.Size;
     }
+    m_Device->countUpload(
+            drawData->TotalVtxCount * sizeof(ImDrawVert)
+            + drawData->TotalIdxCount * sizeof(ImDrawIdx));
+
+    vertexCount = drawData->TotalVtxCount;
+    indexCount = drawData->TotalIdxCount;
 }
 
-void ImGuiSetup::draw(VkCommandBuffer cmdBuf)
+void ImGuiSetup::draw(VkCommandBuffer cmdBuf, RenderStats& stats)
 {
 
     if(vertexCount == 0 || indexCount == 0)
@@ -489,9 +431,14 @@ void ImGuiSetup::draw(VkCommandBuffer cmdBuf)
             0,
             nullptr);
 
-    const VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(cmdBuf, 0, 1, &m_VertexBuffer, offsets);
-    vkCmdBindIndexBuffer(cmdBuf, m_IndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    vkCmdBindVertexBuffers(
+            cmdBuf, 0, 1, &m_Vertices.buffer, &m_Vertices.offset);
+    vkCmdBindIndexBuffer(
+            cmdBuf, m_Indices.buffer, m_Indices.offset, VK_INDEX_TYPE_UINT16);
+    stats.pipelineBinds += 1;
+    stats.descriptorUpdates += 1;
+    stats.vertexBufferBinds += 1;
+    stats.indexBufferBinds += 1;
 
     vkCmdPushConstants(
             cmdBuf,
@@ -522,6 +469,9 @@ void ImGuiSetup::draw(VkCommandBuffer cmdBuf)
             vkCmdDrawIndexed(
                     cmdBuf, pcmd->ElemCount, 1, indexOffset, vertexOffset, 0);
             indexOffset += pcmd->ElemCount;
+            stats.drawCalls += 1;
+            stats.instances += 1;
+            stats.triangles += pcmd->ElemCount / 3;
         }
         vertexOffset += cmd_list->VtxBuffer.Size;
     }
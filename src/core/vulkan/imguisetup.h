@@ -4,6 +4,8 @@
 #include "core/vulkan/utils.h"
 #include "core/texture/texture.h"
 #include "logs/log.h"
+#include "renderstats.h"
+#include "transientallocator.h"
 
 #include "glm/vec2.hpp"
 #include "imgui/imgui.h"
@@ -22,8 +24,10 @@ public:
     ImGuiSetup(Device* device, VkRenderPass renderpass);
     ~ImGuiSetup();
 
-    void update();
-    void draw(VkCommandBuffer cmdBuf);
+    // Copies the UI geometry of the frame into the transient buffer
+    void update(TransientAllocator& transient);
+    // Counts the recorded work into stats
+    void draw(VkCommandBuffer cmdBuf, RenderStats& stats);
 
     struct PushConstantBlock
     {
@@ -40,11 +44,8 @@ private:
     int32_t vertexCount = 0;
     int32_t indexCount = 0;
 
-    VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
-    VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
-
-    VmaAllocation m_VertexMemory = VK_NULL_HANDLE;
-    VmaAllocation m_IndexMemory = VK_NULL_HANDLE;
+    TransientAllocation m_Vertices;
+    TransientAllocation m_Indices;
 
     texture::Texture2d m_FontTexture;
 
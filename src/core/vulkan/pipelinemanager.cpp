@@ -0,0 +1,442 @@
+#include "pipelinemanager.h"
+
+#include "core/vulkan/utils.h"
+#include "core/workqueue.h"
+#include "event/setupevents.h"
+#include "timer/timer.h"
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <type_traits>
+
+namespace core::vk
+{
+
+namespace
+{
+
+// FNV-1a over the bytes of every field, the hashed structs have no padding
+class DescHasher
+{
+public:
+    template<typename T> void add(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        addBytes(&value, sizeof(T));
+    }
+    template<typename T> void add(const std::vector<T>& values)
+    {
+        add(values.size());
+        addBytes(values.data(), values.size() * sizeof(T));
+    }
+    void add(const std::string& value)
+    {
+        add(value.size());
+        addBytes(value.data(), value.size());
+    }
+
+    [[nodiscard]] uint64_t get() const { return m_Hash; }
+
+private:
+    void addBytes(const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for(size_t i = 0; i < size; ++i)
+        {
+            m_Hash = (m_Hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    }
+
+    uint64_t m_Hash = 0xcbf29ce484222325ull;
+};
+
+// ----------------------------------------------------------------------------
+// Shaders, specialization and render state, everything the pipeline is built
+// from
+//
+
+uint64_t hashDesc(const GraphicsPipelineDesc& desc)
+{
+    DescHasher hasher;
+    hasher.add(desc.vertexShader);
+    hasher.add(desc.fragmentShader);
+    hasher.add(desc.fragmentConstants.entries);
+    hasher.add(desc.fragmentConstants.data);
+    hasher.add(desc.bindings);
+    hasher.add(desc.attributes);
+    hasher.add(desc.layout);
+    hasher.add(desc.renderPass);
+    hasher.add(desc.topology);
+    hasher.add(desc.cullMode);
+    hasher.add(desc.frontFace);
+    hasher.add(desc.depthTest);
+    hasher.add(desc.depthWrite);
+    hasher.add(desc.depthCompareOp);
+    hasher.add(desc.alphaBlend);
+    return hasher.get();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+template<typename T>
+bool sameBytes(const std::vector<T>& lhs, const std::vector<T>& rhs)
+{
+    return lhs.size() == rhs.size()
+           && (lhs.empty()
+               || std::memcmp(lhs.data(), rhs.data(), lhs.size() * sizeof(T))
+                          == 0);
+}
+
+// ----------------------------------------------------------------------------
+// Guards against hash collisions
+//
+
+bool isSameDesc(
+        const GraphicsPipelineDesc& lhs, const GraphicsPipelineDesc& rhs)
+{
+    return lhs.vertexShader == rhs.vertexShader
+           && lhs.fragmentShader == rhs.fragmentShader
+           && sameBytes(
+                   lhs.fragmentConstants.entries, rhs.fragmentConstants.entries)
+           && lhs.fragmentConstants.data == rhs.fragmentConstants.data
+           && sameBytes(lhs.bindings, rhs.bindings)
+           && sameBytes(lhs.attributes, rhs.attributes)
+           && lhs.layout == rhs.layout && lhs.renderPass == rhs.renderPass
+           && lhs.topology == rhs.topology && lhs.cullMode == rhs.cullMode
+           && lhs.frontFace == rhs.frontFace && lhs.depthTest == rhs.depthTest
+           && lhs.depthWrite == rhs.depthWrite
+           && lhs.depthCompareOp == rhs.depthCompareOp
+           && lhs.alphaBlend == rhs.alphaBlend;
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+PipelineManager::PipelineManager(Device* device, entt::dispatcher& dispatcher) :
+    m_Log(logs::Log::create("Pipeline Manager")),
+    m_Device(device),
+    m_Dispatcher(dispatcher)
+{
+    assert(m_Device);
+}
+
+// ----------------------------------------------------------------------------
+// Workers still hold the device, every compile has to return first
+//
+
+PipelineManager::~PipelineManager()
+{
+    for(auto& entry : m_Entries)
+    {
+        if(entry.job.valid())
+        {
+            try
+            {
+                entry.pipeline = entry.job.get().pipeline;
+            }
+            catch(const std::exception&)
+            {
+                // Already failed, nothing to destroy
+            }
+        }
+        if(entry.pipeline != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(
+                    m_Device->getLogicalDevice(), entry.pipeline, nullptr);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// The description is copied to the job, the caller can drop it right away
+//
+
+PipelineHandle PipelineManager::request(GraphicsPipelineDesc desc)
+{
+    assert(desc.layout != VK_NULL_HANDLE);
+    assert(desc.renderPass != VK_NULL_HANDLE);
+
+    const uint64_t hash = hashDesc(desc);
+    auto [first, last] = m_Variants.equal_range(hash);
+    for(auto it = first; it != last; ++it)
+    {
+        if(isSameDesc(m_Entries[it->second].desc, desc))
+        {
+            return it->second;
+        }
+    }
+
+    const auto handle = static_cast<PipelineHandle>(m_Entries.size());
+    auto& entry = m_Entries.emplace_back();
+    entry.desc = std::move(desc);
+    entry.job = getWorkQueue().submitWork(
+            [this, desc = entry.desc]() { return compile(desc); });
+    m_Variants.emplace(hash, handle);
+    ++m_PendingCount;
+    return handle;
+}
+
+// ----------------------------------------------------------------------------
+// Failed compiles are logged and stay not ready, draws using them are
+// skipped for good
+//
+
+void PipelineManager::update()
+{
+    if(m_PendingCount == 0)
+    {
+        return;
+    }
+
+    for(size_t i = 0; i < m_Entries.size(); ++i)
+    {
+        auto& entry = m_Entries[i];
+        if(!entry.job.valid()
+           || entry.job.wait_for(std::chrono::seconds(0))
+                      != std::future_status::ready)
+        {
+            continue;
+        }
+
+        --m_PendingCount;
+        Compiled compiled;
+        try
+        {
+            compiled = entry.job.get();
+        }
+        catch(const std::exception& e)
+        {
+            m_Log->error("Pipeline {} failed to compile: {}", i, e.what());
+            continue;
+        }
+
+        entry.pipeline = compiled.pipeline;
+        m_Log->info(
+                "Pipeline {} compiled in {:.1f} ms", i, compiled.milliseconds);
+        m_Dispatcher.trigger(event::PipelineReadyEvent{
+                static_cast<uint32_t>(i),
+                compiled.pipeline,
+                compiled.milliseconds});
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void PipelineManager::wait()
+{
+    for(auto& entry : m_Entries)
+    {
+        if(entry.job.valid())
+        {
+            entry.job.wait();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Shader modules and the pipeline cache are safe to use from any thread, the
+// cache is internally synchronized
+//
+
+PipelineManager::Compiled PipelineManager::compile(
+        const GraphicsPipelineDesc& desc) const
+{
+    Timer compileTimer;
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    vertexInputInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.pNext = nullptr;
+    vertexInputInfo.flags = 0;
+    vertexInputInfo.vertexBindingDescriptionCount =
+            static_cast<uint32_t>(desc.bindings.size());
+    vertexInputInfo.pVertexBindingDescriptions = desc.bindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount =
+            static_cast<uint32_t>(desc.attributes.size());
+    vertexInputInfo.pVertexAttributeDescriptions = desc.attributes.data();
+
+    // --
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+    inputAssembly.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.pNext = nullptr;
+    inputAssembly.flags = 0;
+    inputAssembly.topology = desc.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // --
+
+    // Viewport and scissor are dynamic
+    VkPipelineViewportStateCreateInfo viewportState = {};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.pNext = nullptr;
+    viewportState.flags = 0;
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = nullptr;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = nullptr;
+
+    // --
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.pNext = nullptr;
+    rasterizer.flags = 0;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.cullMode = desc.cullMode;
+    rasterizer.frontFace = desc.frontFace;
+    rasterizer.depthBiasEnable = VK_FALSE;
+    rasterizer.depthBiasConstantFactor = 0.0f;
+    rasterizer.depthBiasClamp = 0.0f;
+    rasterizer.depthBiasSlopeFactor = 0.0f;
+    rasterizer.lineWidth = 1.0f;
+
+    // --
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.pNext = nullptr;
+    multisampling.flags = 0;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.minSampleShading = 1.0f;
+    multisampling.pSampleMask = nullptr;
+    multisampling.alphaToCoverageEnable = VK_FALSE;
+    multisampling.alphaToOneEnable = VK_FALSE;
+
+    // --
+
+    VkPipelineDepthStencilStateCreateInfo depthInfo = {};
+    depthInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthInfo.pNext = nullptr;
+    depthInfo.flags = 0;
+    depthInfo.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+    depthInfo.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+    depthInfo.depthCompareOp = desc.depthCompareOp;
+    depthInfo.depthBoundsTestEnable = VK_FALSE;
+    depthInfo.stencilTestEnable = VK_FALSE;
+    depthInfo.minDepthBounds = 0.0f;
+    depthInfo.maxDepthBounds = 1.0f;
+
+    // --
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.colorWriteMask = 0xF;
+    if(desc.alphaBlend)
+    {
+        colorBlendAttachment.blendEnable = VK_TRUE;
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        colorBlendAttachment.dstColorBlendFactor =
+                VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        colorBlendAttachment.srcAlphaBlendFactor =
+                VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    }
+    else
+    {
+        colorBlendAttachment.blendEnable = VK_FALSE;
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    }
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {};
+    colorBlending.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.pNext = nullptr;
+    colorBlending.flags = 0;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    // --
+
+    std::array<VkDynamicState, 2> dynStates{
+            VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.pNext = nullptr;
+    dynamicState.flags = 0;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynStates.size());
+    dynamicState.pDynamicStates = dynStates.data();
+
+    // --
+
+    const auto& constants = desc.fragmentConstants;
+    VkSpecializationInfo specialization = {};
+    specialization.mapEntryCount =
+            static_cast<uint32_t>(constants.entries.size());
+    specialization.pMapEntries = constants.entries.data();
+    specialization.dataSize = constants.data.size();
+    specialization.pData = constants.data.data();
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+            m_Device->loadShaderFromFile(
+                    desc.vertexShader, VK_SHADER_STAGE_VERTEX_BIT),
+            m_Device->loadShaderFromFile(
+                    desc.fragmentShader,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    constants.entries.empty() ? nullptr : &specialization)};
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pTessellationState = nullptr;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthInfo;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.renderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    Compiled compiled;
+    const VkResult result = vkCreateGraphicsPipelines(
+            m_Device->getLogicalDevice(),
+            m_Device->getPipelineCache(),
+            1,
+            &pipelineInfo,
+            nullptr,
+            &compiled.pipeline);
+
+    for(auto& shader : shaderStages)
+    {
+        vkDestroyShaderModule(
+                m_Device->getLogicalDevice(), shader.module, nullptr);
+    }
+    VK_CHECK(result);
+
+    compiled.milliseconds = compileTimer.elapsed() * 1000.0f;
+    return compiled;
+}
+
+} // namespace core::vk
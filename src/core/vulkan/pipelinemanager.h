@@ -0,0 +1,130 @@
+#pragma once
+
+#include "core/vulkan/device.h"
+#include "logs/log.h"
+
+#include "entt/signal/dispatcher.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstring>
+#include <future>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace core::vk
+{
+
+// Values for the constant_id specialization constants of a shader stage
+struct SpecializationConstants
+{
+    std::vector<VkSpecializationMapEntry> entries;
+    std::vector<uint8_t> data;
+
+    template<typename T>
+    void set(uint32_t constantId, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        entries.push_back(
+                {constantId, static_cast<uint32_t>(data.size()), sizeof(T)});
+        data.resize(data.size() + sizeof(T));
+        std::memcpy(data.data() + data.size() - sizeof(T), &value, sizeof(T));
+    }
+};
+
+// Graphics pipeline with one subpass, one color attachment and dynamic
+// viewport and scissor. The layout and render pass must stay alive until the
+// pipeline is ready.
+struct GraphicsPipelineDesc
+{
+    std::string vertexShader;
+    std::string fragmentShader;
+    SpecializationConstants fragmentConstants;
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+    // Source alpha over destination
+    bool alphaBlend = false;
+};
+
+using PipelineHandle = uint32_t;
+constexpr PipelineHandle INVALID_PIPELINE = ~0u;
+
+// Compiles graphics pipelines on the work queue through the device pipeline
+// cache. Requests return at once with a handle, update() publishes the
+// finished pipelines on the main thread and triggers a PipelineReadyEvent
+// for each. Requesting a description again returns the handle of the first
+// request, so variants are only compiled once. Pipelines live until the
+// manager is destroyed.
+class PipelineManager final
+{
+public:
+    PipelineManager(Device* device, entt::dispatcher& dispatcher);
+    // Waits for compiles still running, the device must be idle
+    ~PipelineManager();
+
+    PipelineManager(const PipelineManager&) = delete;
+    PipelineManager(PipelineManager&&) = delete;
+    PipelineManager& operator=(const PipelineManager&) = delete;
+    PipelineManager& operator=(PipelineManager&&) = delete;
+
+    [[nodiscard]] PipelineHandle request(GraphicsPipelineDesc desc);
+
+    // Main thread, once per frame. Never blocks on a compile.
+    void update();
+    // Blocks until every requested pipeline has compiled, they are still
+    // published by the next update()
+    void wait();
+
+    // VK_NULL_HANDLE until the pipeline has been published
+    [[nodiscard]] VkPipeline get(PipelineHandle handle) const
+    {
+        return handle < m_Entries.size() ? m_Entries[handle].pipeline
+                                         : VK_NULL_HANDLE;
+    }
+    [[nodiscard]] bool isReady(PipelineHandle handle) const
+    {
+        return get(handle) != VK_NULL_HANDLE;
+    }
+    [[nodiscard]] size_t getPendingCount() const { return m_PendingCount; }
+
+private:
+    struct Compiled
+    {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        float milliseconds = 0.0f;
+    };
+
+    struct Entry
+    {
+        GraphicsPipelineDesc desc;
+        std::future<Compiled> job;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+    };
+
+    // Runs on a worker thread
+    [[nodiscard]] Compiled compile(const GraphicsPipelineDesc& desc) const;
+
+    logs::Logger m_Log;
+    Device* m_Device;
+    entt::dispatcher& m_Dispatcher;
+
+    // Indexed by handle
+    std::vector<Entry> m_Entries;
+    // Description hash to the entries with that hash
+    std::unordered_multimap<uint64_t, PipelineHandle> m_Variants;
+    size_t m_PendingCount = 0;
+};
+
+} // namespace core::vk
@@ -0,0 +1,74 @@
+#include "recordingpools.h"
+
+#include "core/vulkan/utils.h"
+
+#include <cassert>
+
+namespace core::vk
+{
+
+// ----------------------------------------------------------------------------
+//
+//
+
+RecordingPools::RecordingPools(
+        Device* device,
+        uint32_t frameCount,
+        uint32_t slotCount,
+        VkCommandPoolCreateFlags flags) :
+    m_Device(device), m_SlotCount(slotCount)
+{
+    assert(m_Device);
+    assert(frameCount > 0 && slotCount > 0);
+
+    m_Pools.resize(size_t{frameCount} * slotCount);
+    m_CommandBuffers.resize(m_Pools.size());
+
+    for(size_t i = 0; i < m_Pools.size(); ++i)
+    {
+        // Reset as a whole, never per buffer
+        m_Pools[i] = m_Device->createCommandPool(
+                m_Device->getGraphicsQueueFamily(), flags);
+
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.pNext = nullptr;
+        allocateInfo.commandPool = m_Pools[i];
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(
+                m_Device->getLogicalDevice(),
+                &allocateInfo,
+                &m_CommandBuffers[i]));
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Destroying a pool frees its command buffers
+//
+
+RecordingPools::~RecordingPools()
+{
+    for(auto pool : m_Pools)
+    {
+        vkDestroyCommandPool(m_Device->getLogicalDevice(), pool, nullptr);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void RecordingPools::reset(uint32_t frameIndex)
+{
+    for(uint32_t slot = 0; slot < m_SlotCount; ++slot)
+    {
+        VK_CHECK(vkResetCommandPool(
+                m_Device->getLogicalDevice(),
+                m_Pools[frameIndex * m_SlotCount + slot],
+                0));
+    }
+}
+
+} // namespace core::vk
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "core/vulkan/device.h"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+namespace core::vk
+{
+
+// One command pool per recording slot and frame in flight, so secondary
+// command buffers can be recorded on the work queue without sharing a pool
+// between threads. Every slot owns one secondary command buffer that is
+// recycled when the pools of its frame are reset.
+class RecordingPools final
+{
+public:
+    // Pools are transient by default, buffers kept for many frames should
+    // pass 0
+    RecordingPools(
+            Device* device,
+            uint32_t frameCount,
+            uint32_t slotCount,
+            VkCommandPoolCreateFlags flags =
+                    VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    ~RecordingPools();
+
+    RecordingPools(const RecordingPools&) = delete;
+    RecordingPools(RecordingPools&&) = delete;
+    RecordingPools& operator=(const RecordingPools&) = delete;
+    RecordingPools& operator=(RecordingPools&&) = delete;
+
+    // Buffers of the frame must have finished executing
+    void reset(uint32_t frameIndex);
+
+    // Only one thread at a time may record into a slot
+    [[nodiscard]] VkCommandBuffer get(uint32_t frameIndex, uint32_t slot) const
+    {
+        return m_CommandBuffers[frameIndex * m_SlotCount + slot];
+    }
+    [[nodiscard]] uint32_t getSlotCount() const { return m_SlotCount; }
+
+private:
+    Device* m_Device;
+    uint32_t m_SlotCount;
+
+    // Indexed by frameIndex * m_SlotCount + slot
+    std::vector<VkCommandPool> m_Pools;
+    std::vector<VkCommandBuffer> m_CommandBuffers;
+};
+
+} // namespace core::vk
@@ -0,0 +1,659 @@
+#include "core/vulkan/rendergraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace core::vk
+{
+
+namespace
+{
+// What a resource went through so far, barriers are built against it
+struct ResourceState
+{
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    bool used = false;
+    PassQueue queue = PassQueue::Graphics;
+    // Last write, a layout transition counts as one without access
+    VkPipelineStageFlags writeStages = 0;
+    VkAccessFlags writeAccess = 0;
+    // Reads since the last write, a write after them has to wait
+    VkPipelineStageFlags readStages = 0;
+    // What the last write has already been made visible to
+    VkPipelineStageFlags visibleStages = 0;
+    VkAccessFlags visibleAccess = 0;
+};
+
+constexpr VkAccessFlags ALL_ACCESS = ~VkAccessFlags{0};
+// Only writes have to be made available
+constexpr VkAccessFlags WRITE_ACCESS =
+        VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+void addDependency(
+        Barrier& barrier,
+        VkPipelineStageFlags srcStages,
+        VkAccessFlags srcAccess,
+        VkPipelineStageFlags dstStages,
+        VkAccessFlags dstAccess)
+{
+    barrier.srcStages |= srcStages;
+    barrier.srcAccess |= srcAccess;
+    barrier.dstStages |= dstStages;
+    barrier.dstAccess |= dstAccess;
+}
+
+VkDeviceSize alignUp(VkDeviceSize offset, VkDeviceSize alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+bool overlapsInTime(const TransientRange& a, const TransientRange& b)
+{
+    return a.first <= b.last && b.first <= a.last;
+}
+
+bool overlapsInMemory(
+        VkDeviceSize offsetA,
+        VkDeviceSize sizeA,
+        VkDeviceSize offsetB,
+        VkDeviceSize sizeB)
+{
+    return offsetA < offsetB + sizeB && offsetB < offsetA + sizeA;
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+AccessInfo getAccessInfo(Access access, VkImageAspectFlags aspect)
+{
+    const VkImageLayout readLayout =
+            (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0
+                    ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                    : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    constexpr VkPipelineStageFlags fragmentTests =
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+            | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+    switch(access)
+    {
+    case Access::IndirectRead:
+        return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                false};
+    case Access::VertexRead:
+        return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                false};
+    case Access::GraphicsShaderRead:
+        return {VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                        | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT,
+                readLayout,
+                false};
+    case Access::ComputeShaderRead:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT,
+                readLayout,
+                false};
+    case Access::ComputeStorageRead:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT,
+                VK_IMAGE_LAYOUT_GENERAL,
+                false};
+    case Access::ComputeShaderWrite:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_GENERAL,
+                true};
+    case Access::ColorAttachment:
+        return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+                        | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                true};
+    case Access::DepthAttachment:
+        return {fragmentTests,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+                        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                true};
+    case Access::DepthAttachmentRead:
+        return {fragmentTests,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                false};
+    case Access::TransferRead:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                false};
+    case Access::TransferWrite:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                true};
+    case Access::Present:
+        return {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                false};
+    default:
+        assert(false);
+        return {};
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Largest first, so the small ones fill the gaps between them
+//
+
+AliasPlan planAliasing(const std::vector<TransientRange>& ranges)
+{
+    AliasPlan plan;
+    plan.placements.resize(ranges.size());
+
+    std::vector<size_t> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&ranges](auto a, auto b) {
+        return ranges[a].size > ranges[b].size;
+    });
+
+    // Ranges placed in every block, and the range that opened it to tell
+    // which others fit
+    std::vector<std::vector<size_t>> placed;
+    std::vector<size_t> firstRange;
+
+    for(const size_t i : order)
+    {
+        const auto& range = ranges[i];
+        assert(range.alignment > 0);
+
+        uint32_t block = 0;
+        while(block < plan.blocks.size())
+        {
+            const auto& other = ranges[firstRange[block]];
+            if(!range.shared && !other.shared
+               && other.memoryTypeBits == range.memoryTypeBits
+               && other.image == range.image
+               && other.compute == range.compute)
+            {
+                break;
+            }
+            ++block;
+        }
+        if(block == plan.blocks.size())
+        {
+            plan.blocks.push_back({0, 1, range.memoryTypeBits});
+            placed.emplace_back();
+            firstRange.push_back(i);
+        }
+
+        // The lowest offset is either 0 or right after a range alive at the
+        // same time
+        std::vector<VkDeviceSize> candidates = {0};
+        for(const size_t j : placed[block])
+        {
+            if(overlapsInTime(range, ranges[j]))
+            {
+                candidates.push_back(
+                        plan.placements[j].offset + ranges[j].size);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        VkDeviceSize offset = 0;
+        for(const VkDeviceSize candidate : candidates)
+        {
+            offset = alignUp(candidate, range.alignment);
+            const bool fits = std::none_of(
+                    placed[block].begin(),
+                    placed[block].end(),
+                    [&](size_t j) {
+                        return overlapsInTime(range, ranges[j])
+                               && overlapsInMemory(
+                                       offset,
+                                       range.size,
+                                       plan.placements[j].offset,
+                                       ranges[j].size);
+                    });
+            if(fits)
+            {
+                break;
+            }
+        }
+
+        plan.placements[i] = {block, offset};
+        placed[block].push_back(i);
+        auto& aliasBlock = plan.blocks[block];
+        aliasBlock.size = std::max(aliasBlock.size, offset + range.size);
+        aliasBlock.alignment = std::max(aliasBlock.alignment, range.alignment);
+    }
+
+    return plan;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+ResourceId RenderGraph::importImage(
+        std::string name,
+        VkImage image,
+        VkImageAspectFlags aspect,
+        std::optional<Access> initial)
+{
+    Resource resource;
+    resource.name = std::move(name);
+    resource.imported = true;
+    resource.isImage = true;
+    resource.aspect = aspect;
+    resource.initial = initial;
+    resource.image = image;
+    m_Resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(m_Resources.size() - 1);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+ResourceId RenderGraph::importBuffer(
+        std::string name, std::optional<Access> initial)
+{
+    Resource resource;
+    resource.name = std::move(name);
+    resource.imported = true;
+    resource.initial = initial;
+    m_Resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(m_Resources.size() - 1);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+ResourceId RenderGraph::createImage(std::string name, const ImageDesc& desc)
+{
+    assert(desc.extent.width > 0 && desc.extent.height > 0);
+
+    Resource resource;
+    resource.name = std::move(name);
+    resource.isImage = true;
+    resource.aspect = desc.aspect;
+    resource.imageDesc = desc;
+    m_Resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(m_Resources.size() - 1);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+ResourceId RenderGraph::createBuffer(std::string name, const BufferDesc& desc)
+{
+    assert(desc.size > 0);
+
+    Resource resource;
+    resource.name = std::move(name);
+    resource.bufferDesc = desc;
+    m_Resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(m_Resources.size() - 1);
+}
+
+// ----------------------------------------------------------------------------
+// Transients don't outlive the graph, there is nothing to leave them in
+//
+
+void RenderGraph::setFinalAccess(ResourceId resource, Access access)
+{
+    assert(resource < m_Resources.size());
+    assert(m_Resources[resource].imported);
+    m_Resources[resource].final = access;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+PassId RenderGraph::addPass(std::string name, PassQueue queue, Record record)
+{
+    Pass pass;
+    pass.name = std::move(name);
+    pass.queue = queue;
+    pass.record = std::move(record);
+    m_Passes.push_back(std::move(pass));
+    return static_cast<PassId>(m_Passes.size() - 1);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void RenderGraph::use(PassId pass, ResourceId resource, Access access)
+{
+    assert(pass < m_Passes.size());
+    assert(resource < m_Resources.size());
+    assert(access != Access::Present);
+
+    auto& uses = m_Passes[pass].uses;
+    assert(std::none_of(uses.begin(), uses.end(), [resource](const Use& use) {
+        return use.resource == resource;
+    }));
+    uses.push_back({resource, access});
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void RenderGraph::keep(PassId pass)
+{
+    assert(pass < m_Passes.size());
+    m_Passes[pass].kept = true;
+}
+
+// ----------------------------------------------------------------------------
+// Async compute passes only depend on each other and on the state before
+// the graph, so their whole queue can run ahead of the graphics one. The
+// graphics passes that read their results wait on a semaphore, which makes
+// the writes visible at the waiting stages, and only the layout is changed
+// on the graphics side.
+//
+
+CompiledGraph RenderGraph::compile() const
+{
+    const auto live = findLivePasses();
+
+    CompiledGraph compiled;
+    std::vector<bool> usedOnGraphics(m_Resources.size(), false);
+    for(PassId i = 0; i < m_Passes.size(); ++i)
+    {
+        if(!live[i])
+        {
+            continue;
+        }
+
+        const auto& pass = m_Passes[i];
+        auto queue = pass.queue;
+        if(queue == PassQueue::AsyncCompute
+           && std::any_of(
+                   pass.uses.begin(),
+                   pass.uses.end(),
+                   [&usedOnGraphics](const Use& use) {
+                       return usedOnGraphics[use.resource];
+                   }))
+        {
+            queue = PassQueue::Graphics;
+        }
+        if(queue == PassQueue::Graphics)
+        {
+            for(const auto& use : pass.uses)
+            {
+                usedOnGraphics[use.resource] = true;
+            }
+        }
+        compiled.passes.push_back({i, queue, {}});
+    }
+
+    std::vector<ResourceState> states(m_Resources.size());
+    for(size_t i = 0; i < m_Resources.size(); ++i)
+    {
+        const auto& resource = m_Resources[i];
+        if(!resource.initial)
+        {
+            continue;
+        }
+
+        const auto info = getAccessInfo(*resource.initial, resource.aspect);
+        auto& state = states[i];
+        state.layout = resource.isImage ? info.layout
+                                        : VK_IMAGE_LAYOUT_UNDEFINED;
+        if(info.write)
+        {
+            state.writeStages = info.stages;
+            state.writeAccess = info.access & WRITE_ACCESS;
+        }
+        else
+        {
+            state.readStages = info.stages;
+        }
+    }
+
+    auto apply = [&](Barrier& barrier,
+                     PassQueue queue,
+                     ResourceId resourceId,
+                     const AccessInfo& info) {
+        const auto& resource = m_Resources[resourceId];
+        auto& state = states[resourceId];
+
+        if(state.used && state.queue != queue)
+        {
+            // Compute ran ahead, the semaphore wait at these stages stands
+            // in for the barrier
+            assert(queue == PassQueue::Graphics);
+            compiled.computeWaitStages |= info.stages;
+            state.writeStages = info.stages;
+            state.writeAccess = 0;
+            state.readStages = 0;
+            state.visibleStages = info.stages;
+            state.visibleAccess = ALL_ACCESS;
+        }
+        state.used = true;
+        state.queue = queue;
+
+        if(resource.isImage && info.layout != state.layout)
+        {
+            const VkPipelineStageFlags srcStages =
+                    state.writeStages | state.readStages;
+            addDependency(
+                    barrier,
+                    srcStages != 0 ? srcStages
+                                   : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    0,
+                    info.stages,
+                    0);
+            barrier.images.push_back(
+                    {resourceId,
+                     state.layout,
+                     info.layout,
+                     state.writeAccess,
+                     info.access});
+
+            state.layout = info.layout;
+            state.writeStages = info.stages;
+            state.writeAccess = info.write ? info.access & WRITE_ACCESS : 0;
+            state.readStages = info.write ? 0 : info.stages;
+            state.visibleStages = info.write ? 0 : info.stages;
+            state.visibleAccess = info.write ? 0 : info.access;
+        }
+        else if(info.write)
+        {
+            if(state.readStages != 0)
+            {
+                // The reads came after the last write, waiting for them
+                // covers it too
+                addDependency(barrier, state.readStages, 0, info.stages, 0);
+            }
+            else if(state.writeStages != 0)
+            {
+                addDependency(
+                        barrier,
+                        state.writeStages,
+                        state.writeAccess,
+                        info.stages,
+                        info.access);
+            }
+            state.writeStages = info.stages;
+            state.writeAccess = info.access & WRITE_ACCESS;
+            state.readStages = 0;
+            state.visibleStages = 0;
+            state.visibleAccess = 0;
+        }
+        else
+        {
+            const bool visible =
+                    (info.stages & ~state.visibleStages) == 0
+                    && (info.access & ~state.visibleAccess) == 0;
+            if(state.writeStages != 0 && !visible)
+            {
+                addDependency(
+                        barrier,
+                        state.writeStages,
+                        state.writeAccess,
+                        info.stages,
+                        info.access);
+                state.visibleStages |= info.stages;
+                state.visibleAccess |= info.access;
+            }
+            state.readStages |= info.stages;
+        }
+    };
+
+    std::vector<int32_t> transientIndex(m_Resources.size(), -1);
+    for(uint32_t index = 0; index < compiled.passes.size(); ++index)
+    {
+        auto& compiledPass = compiled.passes[index];
+        for(const auto& use : m_Passes[compiledPass.pass].uses)
+        {
+            const auto info = getInfo(use);
+            apply(compiledPass.barrier, compiledPass.queue, use.resource, info);
+
+            if(m_Resources[use.resource].imported)
+            {
+                continue;
+            }
+            if(transientIndex[use.resource] < 0)
+            {
+                transientIndex[use.resource] =
+                        static_cast<int32_t>(compiled.transients.size());
+                TransientUse transient;
+                transient.resource = use.resource;
+                transient.first = index;
+                transient.firstStages = info.stages;
+                transient.firstAccess = info.access;
+                compiled.transients.push_back(transient);
+            }
+            auto& transient = compiled.transients[transientIndex[use.resource]];
+            transient.last = index;
+            transient.onGraphics |= compiledPass.queue == PassQueue::Graphics;
+            transient.onCompute |=
+                    compiledPass.queue == PassQueue::AsyncCompute;
+        }
+    }
+
+    for(auto& transient : compiled.transients)
+    {
+        const auto& state = states[transient.resource];
+        transient.lastStages = state.writeStages | state.readStages;
+        transient.lastWriteAccess = state.writeAccess;
+    }
+
+    for(ResourceId i = 0; i < m_Resources.size(); ++i)
+    {
+        const auto& resource = m_Resources[i];
+        if(resource.final)
+        {
+            apply(compiled.finalBarrier,
+                  PassQueue::Graphics,
+                  i,
+                  getAccessInfo(*resource.final, resource.aspect));
+        }
+    }
+
+    return compiled;
+}
+
+// ----------------------------------------------------------------------------
+// Ranges alias only on one queue, so the barrier goes on that queue too
+//
+
+void RenderGraph::addAliasBarriers(
+        CompiledGraph& compiled,
+        const std::vector<TransientRange>& ranges,
+        const AliasPlan& plan)
+{
+    assert(ranges.size() == compiled.transients.size());
+    assert(plan.placements.size() == ranges.size());
+
+    for(size_t i = 0; i < ranges.size(); ++i)
+    {
+        const auto& placement = plan.placements[i];
+        auto& barrier = compiled.passes[ranges[i].first].barrier;
+        for(size_t j = 0; j < ranges.size(); ++j)
+        {
+            const auto& other = plan.placements[j];
+            if(other.block != placement.block
+               || ranges[j].last >= ranges[i].first
+               || !overlapsInMemory(
+                       placement.offset,
+                       ranges[i].size,
+                       other.offset,
+                       ranges[j].size))
+            {
+                continue;
+            }
+
+            const auto& previous = compiled.transients[j];
+            addDependency(
+                    barrier,
+                    previous.lastStages,
+                    previous.lastWriteAccess,
+                    compiled.transients[i].firstStages,
+                    compiled.transients[i].firstAccess);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Walks back from the outputs and the kept passes, a pass is live when a
+// later live pass uses what it writes
+//
+
+std::vector<bool> RenderGraph::findLivePasses() const
+{
+    std::vector<bool> needed(m_Resources.size(), false);
+    for(size_t i = 0; i < m_Resources.size(); ++i)
+    {
+        needed[i] = m_Resources[i].final.has_value();
+    }
+
+    std::vector<bool> live(m_Passes.size(), false);
+    for(size_t i = m_Passes.size(); i-- > 0;)
+    {
+        const auto& pass = m_Passes[i];
+        live[i] = pass.kept
+                  || std::any_of(
+                          pass.uses.begin(),
+                          pass.uses.end(),
+                          [&](const Use& use) {
+                              return getInfo(use).write
+                                     && needed[use.resource];
+                          });
+        if(live[i])
+        {
+            for(const auto& use : pass.uses)
+            {
+                needed[use.resource] = true;
+            }
+        }
+    }
+    return live;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+AccessInfo RenderGraph::getInfo(const Use& use) const
+{
+    return getAccessInfo(use.access, m_Resources[use.resource].aspect);
+}
+
+} // namespace core::vk
@@ -0,0 +1,493 @@
+#include "rendergraphexecutor.h"
+
+#include "core/vulkan/utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+namespace core::vk
+{
+
+namespace
+{
+
+// ----------------------------------------------------------------------------
+// Image or buffer usage flags a transient needs for an access
+//
+
+VkFlags getUsage(Access access, bool isImage)
+{
+    switch(access)
+    {
+    case Access::IndirectRead:
+        assert(!isImage);
+        return VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    case Access::VertexRead:
+        assert(!isImage);
+        return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+               | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    case Access::GraphicsShaderRead:
+    case Access::ComputeShaderRead:
+        return isImage ? VK_IMAGE_USAGE_SAMPLED_BIT
+                       : VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    case Access::ComputeStorageRead:
+    case Access::ComputeShaderWrite:
+        return isImage ? VK_IMAGE_USAGE_STORAGE_BIT
+                       : VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    case Access::ColorAttachment:
+        assert(isImage);
+        return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    case Access::DepthAttachment:
+    case Access::DepthAttachmentRead:
+        assert(isImage);
+        return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    case Access::TransferRead:
+        return isImage ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+                       : VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    case Access::TransferWrite:
+        return isImage ? VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                       : VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    default:
+        assert(false);
+        return 0;
+    }
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+RenderGraphExecutor::RenderGraphExecutor(Device* device, uint32_t frameCount) :
+    m_Device(device)
+{
+    assert(m_Device);
+    assert(frameCount > 0);
+
+    m_Frames.resize(frameCount);
+    for(auto& frame : m_Frames)
+    {
+        frame.computeCommandBuffer = m_Device->createCommandBuffer(
+                VK_COMMAND_BUFFER_LEVEL_PRIMARY, VK_QUEUE_COMPUTE_BIT, false);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Device has to be idle
+//
+
+RenderGraphExecutor::~RenderGraphExecutor()
+{
+    for(auto& frame : m_Frames)
+    {
+        destroyTransients(frame);
+        vkFreeCommandBuffers(
+                m_Device->getLogicalDevice(),
+                m_Device->getComputeCommandPool(),
+                1,
+                &frame.computeCommandBuffer);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// The async compute passes are submitted before the graphics ones are
+// recorded, they never wait for the graphics queue
+//
+
+std::optional<TimelineWait> RenderGraphExecutor::execute(
+        RenderGraph& graph,
+        uint32_t frameIndex,
+        VkCommandBuffer cmdBuf,
+        GpuProfiler* profiler)
+{
+    assert(frameIndex < m_Frames.size());
+
+    auto compiled = graph.compile();
+    auto& frame = m_Frames[frameIndex];
+
+    // Graphics only waits for the compute submit when it depends on it
+    m_Device->wait(frame.computeSubmitted);
+
+    auto keys = getTransientKeys(graph, compiled);
+    if(keys != frame.keys)
+    {
+        createTransients(frame, compiled, std::move(keys));
+    }
+    bindTransients(frame, graph, compiled);
+    RenderGraph::addAliasBarriers(compiled, frame.ranges, frame.plan);
+
+    const bool hasCompute = std::any_of(
+            compiled.passes.begin(),
+            compiled.passes.end(),
+            [](const CompiledPass& pass) {
+                return pass.queue == PassQueue::AsyncCompute;
+            });
+    if(hasCompute)
+    {
+        VkCommandBuffer computeCmdBuf = frame.computeCommandBuffer;
+        m_Device->beginCommandBuffer(
+                computeCmdBuf, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        for(const auto& compiledPass : compiled.passes)
+        {
+            if(compiledPass.queue == PassQueue::AsyncCompute)
+            {
+                recordPass(computeCmdBuf, graph, compiledPass, profiler);
+            }
+        }
+        VK_CHECK(vkEndCommandBuffer(computeCmdBuf));
+        frame.computeSubmitted =
+                m_Device->submit(QueueType::Compute, {&computeCmdBuf, 1});
+    }
+
+    for(const auto& compiledPass : compiled.passes)
+    {
+        if(compiledPass.queue == PassQueue::Graphics)
+        {
+            recordPass(cmdBuf, graph, compiledPass, profiler);
+        }
+    }
+    recordBarrier(cmdBuf, graph, compiled.finalBarrier);
+
+    if(!hasCompute || compiled.computeWaitStages == 0)
+    {
+        return std::nullopt;
+    }
+    return TimelineWait{frame.computeSubmitted, compiled.computeWaitStages};
+}
+
+// ----------------------------------------------------------------------------
+// Usage is collected over every live use, lifetimes come from the compiled
+// passes
+//
+
+std::vector<RenderGraphExecutor::TransientKey>
+RenderGraphExecutor::getTransientKeys(
+        const RenderGraph& graph, const CompiledGraph& compiled) const
+{
+    std::vector<int32_t> transientIndex(graph.m_Resources.size(), -1);
+    std::vector<TransientKey> keys(compiled.transients.size());
+    for(size_t i = 0; i < compiled.transients.size(); ++i)
+    {
+        const auto& transient = compiled.transients[i];
+        const auto& resource = graph.m_Resources[transient.resource];
+        transientIndex[transient.resource] = static_cast<int32_t>(i);
+
+        auto& key = keys[i];
+        key.first = transient.first;
+        key.last = transient.last;
+        key.isImage = resource.isImage;
+        key.imageDesc = resource.imageDesc;
+        key.bufferDesc = resource.bufferDesc;
+        key.shared = transient.onGraphics && transient.onCompute;
+        key.compute = transient.onCompute && !transient.onGraphics;
+    }
+
+    for(const auto& compiledPass : compiled.passes)
+    {
+        for(const auto& use : graph.m_Passes[compiledPass.pass].uses)
+        {
+            const int32_t index = transientIndex[use.resource];
+            if(index >= 0)
+            {
+                keys[index].usage |=
+                        getUsage(use.access, keys[index].isImage);
+            }
+        }
+    }
+    return keys;
+}
+
+// ----------------------------------------------------------------------------
+// The previous resources of the frame are no longer in use. Every alias
+// block is one allocation, the resources are bound at their offsets.
+//
+
+void RenderGraphExecutor::createTransients(
+        Frame& frame,
+        const CompiledGraph& compiled,
+        std::vector<TransientKey> keys)
+{
+    destroyTransients(frame);
+
+    VkDevice device = m_Device->getLogicalDevice();
+    const std::array<uint32_t, 2> families = {
+            m_Device->getGraphicsQueueFamily(),
+            m_Device->getComputeQueueFamily()};
+    const bool sameFamily = families[0] == families[1];
+
+    const size_t count = keys.size();
+    frame.images.assign(count, VK_NULL_HANDLE);
+    frame.views.assign(count, VK_NULL_HANDLE);
+    frame.buffers.assign(count, VK_NULL_HANDLE);
+    frame.ranges.assign(count, {});
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const auto& key = keys[i];
+        const bool concurrent = key.shared && !sameFamily;
+
+        VkMemoryRequirements requirements = {};
+        if(key.isImage)
+        {
+            VkImageCreateInfo imageInfo = {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.pNext = nullptr;
+            imageInfo.flags = 0;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = key.imageDesc.format;
+            imageInfo.extent.width = key.imageDesc.extent.width;
+            imageInfo.extent.height = key.imageDesc.extent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = key.usage;
+            imageInfo.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT
+                                               : VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.queueFamilyIndexCount = concurrent ? 2 : 0;
+            imageInfo.pQueueFamilyIndices = families.data();
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            VK_CHECK(vkCreateImage(
+                    device, &imageInfo, nullptr, &frame.images[i]));
+            vkGetImageMemoryRequirements(
+                    device, frame.images[i], &requirements);
+        }
+        else
+        {
+            VkBufferCreateInfo bufferInfo = {};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.pNext = nullptr;
+            bufferInfo.flags = 0;
+            bufferInfo.size = key.bufferDesc.size;
+            bufferInfo.usage = key.usage;
+            bufferInfo.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT
+                                                : VK_SHARING_MODE_EXCLUSIVE;
+            bufferInfo.queueFamilyIndexCount = concurrent ? 2 : 0;
+            bufferInfo.pQueueFamilyIndices = families.data();
+
+            VK_CHECK(vkCreateBuffer(
+                    device, &bufferInfo, nullptr, &frame.buffers[i]));
+            vkGetBufferMemoryRequirements(
+                    device, frame.buffers[i], &requirements);
+        }
+
+        auto& range = frame.ranges[i];
+        range.first = compiled.transients[i].first;
+        range.last = compiled.transients[i].last;
+        range.size = requirements.size;
+        range.alignment = requirements.alignment;
+        range.memoryTypeBits = requirements.memoryTypeBits;
+        range.image = key.isImage;
+        range.shared = key.shared;
+        range.compute = key.compute;
+    }
+
+    frame.plan = planAliasing(frame.ranges);
+
+    frame.blocks.resize(frame.plan.blocks.size());
+    for(size_t i = 0; i < frame.plan.blocks.size(); ++i)
+    {
+        const auto& block = frame.plan.blocks[i];
+
+        VkMemoryRequirements requirements = {};
+        requirements.size = block.size;
+        requirements.alignment = block.alignment;
+        requirements.memoryTypeBits = block.memoryTypeBits;
+
+        VmaAllocationCreateInfo allocInfo = {};
+        allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        VK_CHECK(vmaAllocateMemory(
+                m_Device->getAllocator(),
+                &requirements,
+                &allocInfo,
+                &frame.blocks[i],
+                nullptr));
+        m_Device->countAllocation();
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const auto& placement = frame.plan.placements[i];
+        VmaAllocation block = frame.blocks[placement.block];
+        if(keys[i].isImage)
+        {
+            VK_CHECK(vmaBindImageMemory2(
+                    m_Device->getAllocator(),
+                    block,
+                    placement.offset,
+                    frame.images[i],
+                    nullptr));
+            m_Device->createImageView(
+                    frame.images[i],
+                    keys[i].imageDesc.format,
+                    keys[i].imageDesc.aspect,
+                    &frame.views[i]);
+        }
+        else
+        {
+            VK_CHECK(vmaBindBufferMemory2(
+                    m_Device->getAllocator(),
+                    block,
+                    placement.offset,
+                    frame.buffers[i],
+                    nullptr));
+        }
+    }
+
+    frame.keys = std::move(keys);
+}
+
+// ----------------------------------------------------------------------------
+// Passes look up their transients through the graph
+//
+
+void RenderGraphExecutor::bindTransients(
+        const Frame& frame,
+        RenderGraph& graph,
+        const CompiledGraph& compiled) const
+{
+    for(size_t i = 0; i < compiled.transients.size(); ++i)
+    {
+        auto& resource = graph.m_Resources[compiled.transients[i].resource];
+        resource.image = frame.images[i];
+        resource.view = frame.views[i];
+        resource.buffer = frame.buffers[i];
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void RenderGraphExecutor::destroyTransients(Frame& frame)
+{
+    VkDevice device = m_Device->getLogicalDevice();
+
+    for(size_t i = 0; i < frame.keys.size(); ++i)
+    {
+        if(frame.views[i] != VK_NULL_HANDLE)
+        {
+            vkDestroyImageView(device, frame.views[i], nullptr);
+        }
+        if(frame.images[i] != VK_NULL_HANDLE)
+        {
+            vkDestroyImage(device, frame.images[i], nullptr);
+        }
+        if(frame.buffers[i] != VK_NULL_HANDLE)
+        {
+            vkDestroyBuffer(device, frame.buffers[i], nullptr);
+        }
+    }
+    for(auto& block : frame.blocks)
+    {
+        vmaFreeMemory(m_Device->getAllocator(), block);
+    }
+
+    frame.keys.clear();
+    frame.images.clear();
+    frame.views.clear();
+    frame.buffers.clear();
+    frame.ranges.clear();
+    frame.plan = {};
+    frame.blocks.clear();
+}
+
+// ----------------------------------------------------------------------------
+// Layouts of images are changed over their whole subresource range
+//
+
+void RenderGraphExecutor::recordBarrier(
+        VkCommandBuffer cmdBuf,
+        const RenderGraph& graph,
+        const Barrier& barrier) const
+{
+    if(barrier.isEmpty())
+    {
+        return;
+    }
+
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.pNext = nullptr;
+    memoryBarrier.srcAccessMask = barrier.srcAccess;
+    memoryBarrier.dstAccessMask = barrier.dstAccess;
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    imageBarriers.reserve(barrier.images.size());
+    for(const auto& transition : barrier.images)
+    {
+        const auto& resource = graph.m_Resources[transition.resource];
+        assert(resource.image != VK_NULL_HANDLE);
+
+        VkImageMemoryBarrier imageBarrier = {};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.pNext = nullptr;
+        imageBarrier.srcAccessMask = transition.srcAccess;
+        imageBarrier.dstAccessMask = transition.dstAccess;
+        imageBarrier.oldLayout = transition.oldLayout;
+        imageBarrier.newLayout = transition.newLayout;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = resource.image;
+        imageBarrier.subresourceRange = {
+                resource.aspect,
+                0,
+                VK_REMAINING_MIP_LEVELS,
+                0,
+                VK_REMAINING_ARRAY_LAYERS};
+        imageBarriers.push_back(imageBarrier);
+    }
+
+    // Execution only dependencies need no memory barrier
+    const uint32_t memoryBarrierCount = barrier.srcAccess != 0 ? 1 : 0;
+    vkCmdPipelineBarrier(
+            cmdBuf,
+            barrier.srcStages,
+            barrier.dstStages,
+            0,
+            memoryBarrierCount,
+            &memoryBarrier,
+            0,
+            nullptr,
+            static_cast<uint32_t>(imageBarriers.size()),
+            imageBarriers.data());
+}
+
+// ----------------------------------------------------------------------------
+// Scopes are named after the pass
+//
+
+void RenderGraphExecutor::recordPass(
+        VkCommandBuffer cmdBuf,
+        RenderGraph& graph,
+        const CompiledPass& compiledPass,
+        GpuProfiler* profiler) const
+{
+    recordBarrier(cmdBuf, graph, compiledPass.barrier);
+
+    auto& pass = graph.m_Passes[compiledPass.pass];
+    auto scope = GpuProfiler::INVALID_SCOPE;
+    if(profiler)
+    {
+        scope = profiler->begin(
+                cmdBuf,
+                pass.name,
+                compiledPass.queue == PassQueue::AsyncCompute
+                        ? QueueType::Compute
+                        : QueueType::Graphics);
+    }
+
+    pass.record(cmdBuf);
+
+    if(profiler)
+    {
+        profiler->end(cmdBuf, scope);
+    }
+}
+
+} // namespace core::vk
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "core/vulkan/device.h"
+#include "core/vulkan/rendergraph.h"
+#include "gpuprofiler.h"
+
+#include <vulkan/vulkan.h>
+
+#include <optional>
+#include <vector>
+
+namespace core::vk
+{
+
+// Runs a compiled RenderGraph. Every frame in flight keeps the transients
+// of its last graph, they are only recreated when the graph asks for
+// different ones. Async compute passes are recorded into a command buffer
+// of the frame and submitted before the graphics passes are recorded.
+class RenderGraphExecutor final
+{
+public:
+    RenderGraphExecutor(Device* device, uint32_t frameCount);
+    ~RenderGraphExecutor();
+
+    RenderGraphExecutor(const RenderGraphExecutor&) = delete;
+    RenderGraphExecutor(RenderGraphExecutor&&) = delete;
+    RenderGraphExecutor& operator=(const RenderGraphExecutor&) = delete;
+    RenderGraphExecutor& operator=(RenderGraphExecutor&&) = delete;
+
+    // The graphics submit of the frame's previous use has finished. Records
+    // the graphics passes and the final barrier into cmdBuf, which has to be
+    // outside a render pass. The graphics submit has to wait for the
+    // returned point, none when no graphics pass depends on async compute.
+    // The profiler is optional.
+    [[nodiscard]] std::optional<TimelineWait> execute(
+            RenderGraph& graph,
+            uint32_t frameIndex,
+            VkCommandBuffer cmdBuf,
+            GpuProfiler* profiler = nullptr);
+
+private:
+    // What the transients were created and placed for, the frame's
+    // resources are reused while it stays the same
+    struct TransientKey
+    {
+        uint32_t first = 0;
+        uint32_t last = 0;
+        bool isImage = false;
+        ImageDesc imageDesc;
+        BufferDesc bufferDesc;
+        VkFlags usage = 0;
+        bool shared = false;
+        bool compute = false;
+
+        bool operator==(const TransientKey& other) const = default;
+    };
+
+    struct Frame
+    {
+        VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+        TimelinePoint computeSubmitted;
+
+        // Indexed like CompiledGraph::transients
+        std::vector<TransientKey> keys;
+        std::vector<VkImage> images;
+        std::vector<VkImageView> views;
+        std::vector<VkBuffer> buffers;
+        std::vector<TransientRange> ranges;
+        AliasPlan plan;
+        std::vector<VmaAllocation> blocks;
+    };
+
+    [[nodiscard]] std::vector<TransientKey> getTransientKeys(
+            const RenderGraph& graph, const CompiledGraph& compiled) const;
+    void createTransients(
+            Frame& frame,
+            const CompiledGraph& compiled,
+            std::vector<TransientKey> keys);
+    void bindTransients(
+            const Frame& frame,
+            RenderGraph& graph,
+            const CompiledGraph& compiled) const;
+    void destroyTransients(Frame& frame);
+
+    void recordBarrier(
+            VkCommandBuffer cmdBuf,
+            const RenderGraph& graph,
+            const Barrier& barrier) const;
+    void recordPass(
+            VkCommandBuffer cmdBuf,
+            RenderGraph& graph,
+            const CompiledPass& compiledPass,
+            GpuProfiler* profiler) const;
+
+    Device* m_Device;
+    std::vector<Frame> m_Frames;
+};
+
+} // namespace core::vk
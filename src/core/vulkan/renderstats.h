@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+namespace core::vk
+{
+
+// Work recorded into the command buffers of a frame, counted on the CPU.
+// Every recording thread counts into its own copy, they are summed after
+// the recording jobs have joined.
+struct RenderStats
+{
+    // API calls, an indirect call counts once however many draws it makes
+    uint64_t drawCalls = 0;
+    // Only of the draws whose counts the CPU knows, GPU culled draws are in
+    // the pipeline statistics instead
+    uint64_t instances = 0;
+    uint64_t triangles = 0;
+    uint64_t vertexBufferBinds = 0;
+    uint64_t indexBufferBinds = 0;
+    uint64_t pipelineBinds = 0;
+    // Descriptor set binds and vkUpdateDescriptorSets writes
+    uint64_t descriptorUpdates = 0;
+    // Per frame data written to mapped buffers and staging uploads
+    uint64_t bytesUploaded = 0;
+    // Device memory allocations
+    uint64_t allocations = 0;
+
+    RenderStats& operator+=(const RenderStats& other)
+    {
+        drawCalls += other.drawCalls;
+        instances += other.instances;
+        triangles += other.triangles;
+        vertexBufferBinds += other.vertexBufferBinds;
+        indexBufferBinds += other.indexBufferBinds;
+        pipelineBinds += other.pipelineBinds;
+        descriptorUpdates += other.descriptorUpdates;
+        bytesUploaded += other.bytesUploaded;
+        allocations += other.allocations;
+        return *this;
+    }
+};
+
+} // namespace core::vk
@@ -8,6 +8,13 @@
 namespace core::vk
 {
 
+namespace
+{
+// Enough for every frame in flight to render into an image of its own, a
+// frame waits for the frame that used its image before it records
+constexpr uint32_t OFFSCREEN_IMAGE_COUNT = 3;
+} // namespace
+
 // ----------------------------------------------------------------------------
 //
 //
@@ -46,6 +53,22 @@ Swapchain::Swapchain(VkInstance instance, Device* device) :
 //
 //
 
+Swapchain::Swapchain(Device* device, VkExtent2D extent) :
+    m_Log(logs::Log::create("Vulkan Swapchain")),
+    m_Device(device),
+    m_Instance(VK_NULL_HANDLE),
+    m_SurfaceCapabilities{},
+    m_Extent(extent),
+    m_SurfaceFormat(VK_FORMAT_B8G8R8A8_UNORM)
+{
+    assert(extent.width > 0 && extent.height > 0);
+    m_Log->info("Offscreen ({}, {})", extent.width, extent.height);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
 Swapchain::~Swapchain()
 {
     if(m_Depth.view)
@@ -72,6 +95,11 @@ Swapchain::~Swapchain()
             vkDestroyImageView(m_Device->getLogicalDevice(), view, nullptr);
         }
     }
+    for(size_t i = 0; i < m_ImageMemory.size(); ++i)
+    {
+        vmaDestroyImage(
+                m_Device->getAllocator(), m_Images[i], m_ImageMemory[i]);
+    }
     if(m_Swapchain != VK_NULL_HANDLE)
     {
         vkDestroySwapchainKHR(
@@ -90,6 +118,13 @@ Swapchain::~Swapchain()
 VkResult Swapchain::acquireNextImage(
         VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex)
 {
+    if(isOffscreen())
+    {
+        *imageIndex = m_NextImage;
+        m_NextImage = (m_NextImage + 1) % m_ImageCount;
+        return VK_SUCCESS;
+    }
+
     return vkAcquireNextImageKHR(
             m_Device->getLogicalDevice(),
             m_Swapchain,
@@ -106,6 +141,11 @@ VkResult Swapchain::acquireNextImage(
 VkResult Swapchain::queuePresent(
         VkQueue queue, uint32_t* imageIndex, VkSemaphore* waitSemaphore)
 {
+    if(isOffscreen())
+    {
+        return VK_SUCCESS;
+    }
+
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.pNext = nullptr;
@@ -124,6 +164,23 @@ VkResult Swapchain::queuePresent(
 //
 
 void Swapchain::create(bool vsync)
+{
+    if(isOffscreen())
+    {
+        createOffscreenImages();
+    }
+    else
+    {
+        createSwapchainImages(vsync);
+    }
+    createDepth();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Swapchain::createSwapchainImages(bool vsync)
 {
     assert(m_Surface);
 
@@ -253,16 +310,20 @@ void Swapchain::create(bool vsync)
     // TODO: remove
     m_ImageCount = minImageCount;
 
-    // Clean up old swapchain and associated views
+    // Clean up old swapchain and associated views once frames in flight
+    // are done with its images
     if(oldSwapchain)
     {
-        for(auto& view : m_ImageViews)
-        {
-            vkDestroyImageView(m_Device->getLogicalDevice(), view, nullptr);
-        }
-
-        vkDestroySwapchainKHR(
-                m_Device->getLogicalDevice(), oldSwapchain, nullptr);
+        m_Device->destroyLater([device = m_Device->getLogicalDevice(),
+                                views = std::move(m_ImageViews),
+                                oldSwapchain]() {
+            for(auto view : views)
+            {
+                vkDestroyImageView(device, view, nullptr);
+            }
+            vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+        });
+        m_ImageViews.clear();
     }
 
     // Get handles for new swapchain images
@@ -286,18 +347,64 @@ void Swapchain::create(bool vsync)
                 VK_IMAGE_ASPECT_COLOR_BIT,
                 &m_ImageViews[i]);
     }
+}
+
+// ----------------------------------------------------------------------------
+// Same usage as swapchain images, plus copying from for readbacks
+//
+
+void Swapchain::createOffscreenImages()
+{
+    // The extent never changes without a window
+    assert(m_Images.empty());
 
+    m_ImageCount = OFFSCREEN_IMAGE_COUNT;
+    m_Images.resize(m_ImageCount);
+    m_ImageMemory.resize(m_ImageCount);
+    m_ImageViews.resize(m_ImageCount);
+    for(uint32_t i = 0; i < m_ImageCount; ++i)
+    {
+        m_Device->createImage(
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                        | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY,
+                m_SurfaceFormat,
+                VK_IMAGE_TILING_OPTIMAL,
+                m_Extent,
+                &m_Images[i],
+                &m_ImageMemory[i],
+                VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+
+        m_Device->createImageView(
+                m_Images[i],
+                m_SurfaceFormat,
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                &m_ImageViews[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void Swapchain::createDepth()
+{
     // (re)create Depth buffer
     if(m_Depth.image)
     {
-        vkDestroyImageView(m_Device->getLogicalDevice(), m_Depth.view, nullptr);
-        vmaDestroyImage(
-                m_Device->getAllocator(), m_Depth.image, m_Depth.memory);
+        m_Device->destroyLater([device = m_Device,
+                                view = m_Depth.view,
+                                image = m_Depth.image,
+                                memory = m_Depth.memory]() {
+            vkDestroyImageView(device->getLogicalDevice(), view, nullptr);
+            vmaDestroyImage(device->getAllocator(), image, memory);
+        });
     }
 
     m_Device->createImage(
             VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
-                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+                    | VK_IMAGE_USAGE_SAMPLED_BIT,
             VMA_MEMORY_USAGE_GPU_ONLY,
             m_Depth.format,
             VK_IMAGE_TILING_OPTIMAL,
@@ -339,8 +446,7 @@ void Swapchain::create(bool vsync)
             1,
             &barrier);
 
-    m_Device->flushCommandBuffer(
-            commandBuffer, m_Device->getGraphicsQueue(), true);
+    m_Device->flushCommandBuffer(commandBuffer, QueueType::Graphics, true);
 }
 
 // ----------------------------------------------------------------------------
@@ -382,10 +488,14 @@ void Swapchain::createFrameBuffers(VkRenderPass renderpass)
 
 void Swapchain::destroyFrameBuffers()
 {
-    for(auto& fb : m_FrameBuffers)
-    {
-        vkDestroyFramebuffer(m_Device->getLogicalDevice(), fb, nullptr);
-    }
+    m_Device->destroyLater([device = m_Device->getLogicalDevice(),
+                            frameBuffers = std::move(m_FrameBuffers)]() {
+        for(auto fb : frameBuffers)
+        {
+            vkDestroyFramebuffer(device, fb, nullptr);
+        }
+    });
+    m_FrameBuffers.clear();
 }
 
 } // namespace core::vk
@@ -13,7 +13,11 @@ namespace core::vk
 class Swapchain
 {
 public:
+    // Presents to the window of the device
     Swapchain(VkInstance instance, Device* device);
+    // Renders into images of its own and never presents, for running
+    // without a window
+    Swapchain(Device* device, VkExtent2D extent);
     ~Swapchain();
 
     [[nodiscard]] auto getSurface() const { return m_Surface; }
@@ -24,6 +28,21 @@ public:
         return m_FrameBuffers[i];
     }
     [[nodiscard]] auto getExtent() const { return m_Extent; }
+    [[nodiscard]] auto getDepthImage() const { return m_Depth.image; }
+    [[nodiscard]] auto getDepthView() const { return m_Depth.view; }
+    [[nodiscard]] bool isOffscreen() const
+    {
+        return m_Surface == VK_NULL_HANDLE;
+    }
+    // Layout a frame leaves the image in, ready to present or to copy from
+    [[nodiscard]] VkImageLayout getFinalLayout() const
+    {
+        return isOffscreen() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                             : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+
+    // Offscreen the images are handed out round robin, the semaphore is not
+    // signalled and presenting does nothing
 
     [[nodiscard]] VkResult acquireNextImage(
             VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex);
@@ -39,6 +58,10 @@ public:
     }
 
 private:
+    void createSwapchainImages(bool vsync);
+    void createOffscreenImages();
+    void createDepth();
+
     logs::Logger m_Log;
     Device* m_Device;
     VkInstance m_Instance;
@@ -60,6 +83,9 @@ private:
     } m_Depth;
 
     std::vector<VkImage> m_Images;
+    // Only offscreen images are allocated here
+    std::vector<VmaAllocation> m_ImageMemory;
+    uint32_t m_NextImage = 0;
     std::vector<VkFramebuffer> m_FrameBuffers;
     std::vector<VkImageView> m_ImageViews;
     std::vector<VkPresentModeKHR> m_PresentModeList;
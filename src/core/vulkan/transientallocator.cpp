@@ -0,0 +1,181 @@
+#include "transientallocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace core::vk
+{
+
+namespace
+{
+
+// ----------------------------------------------------------------------------
+//
+//
+
+constexpr VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+TransientAllocator::TransientAllocator(
+        Device* device, uint32_t frameCount, VkDeviceSize capacity) :
+    m_Device(device), m_Capacity(capacity), m_Frames(frameCount)
+{
+    assert(m_Device);
+    assert(frameCount > 0 && capacity > 0);
+
+    for(auto& frame : m_Frames)
+    {
+        frame.buffer = createBlock(m_Capacity);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+TransientAllocator::~TransientAllocator()
+{
+    for(auto& frame : m_Frames)
+    {
+        destroyBlock(frame.buffer);
+        for(auto& block : frame.overflow)
+        {
+            destroyBlock(block);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// The previous use of the frame has finished, so its overflow blocks and a
+// buffer that is too small can be destroyed right away
+//
+
+void TransientAllocator::reset(uint32_t frameIndex)
+{
+    assert(frameIndex < m_Frames.size());
+
+    std::lock_guard lock(m_Mutex);
+    auto& frame = m_Frames[frameIndex];
+
+    VkDeviceSize used = std::min(frame.offset.load(), frame.buffer.capacity);
+    for(auto& block : frame.overflow)
+    {
+        used += block.offset;
+        destroyBlock(block);
+    }
+    frame.overflow.clear();
+
+    if(used > m_Capacity)
+    {
+        while(m_Capacity < 2 * used)
+        {
+            m_Capacity *= 2;
+        }
+    }
+    if(frame.buffer.capacity < m_Capacity)
+    {
+        destroyBlock(frame.buffer);
+        frame.buffer = createBlock(m_Capacity);
+        ++frame.generation;
+    }
+
+    frame.offset = 0;
+    m_FrameIndex = frameIndex;
+}
+
+// ----------------------------------------------------------------------------
+// Reserving the worst case padding up front lets a single fetch_add claim
+// the range, a compare and swap loop would be needed to pad exactly
+//
+
+TransientAllocation TransientAllocator::allocate(
+        VkDeviceSize size, VkDeviceSize alignment)
+{
+    assert(alignment > 0);
+
+    auto& frame = m_Frames[m_FrameIndex];
+    const VkDeviceSize reserved = size + alignment - 1;
+    const VkDeviceSize start =
+            frame.offset.fetch_add(reserved, std::memory_order_relaxed);
+    if(start + reserved > frame.buffer.capacity)
+    {
+        return allocateOverflow(frame, size, alignment);
+    }
+
+    const VkDeviceSize offset = alignUp(start, alignment);
+    return {frame.buffer.buffer, offset, frame.buffer.data + offset};
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+TransientAllocation TransientAllocator::allocateOverflow(
+        Frame& frame, VkDeviceSize size, VkDeviceSize alignment)
+{
+    std::lock_guard lock(m_Mutex);
+
+    Block* block = nullptr;
+    VkDeviceSize offset = 0;
+    if(!frame.overflow.empty())
+    {
+        block = &frame.overflow.back();
+        offset = alignUp(block->offset, alignment);
+    }
+
+    if(!block || offset + size > block->capacity)
+    {
+        const VkDeviceSize previous =
+                block ? block->capacity : frame.buffer.capacity;
+        VkDeviceSize capacity = 2 * previous;
+        while(capacity < size)
+        {
+            capacity *= 2;
+        }
+        frame.overflow.push_back(createBlock(capacity));
+        block = &frame.overflow.back();
+        offset = 0;
+    }
+
+    block->offset = offset + size;
+    return {block->buffer, offset, block->data + offset};
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+TransientAllocator::Block TransientAllocator::createBlock(VkDeviceSize capacity)
+{
+    Block block;
+    block.capacity = capacity;
+    block.data = static_cast<std::byte*>(m_Device->createMappedBuffer(
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+                    | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                    | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                    | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            capacity,
+            &block.buffer,
+            &block.memory));
+    return block;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void TransientAllocator::destroyBlock(Block& block)
+{
+    vmaDestroyBuffer(m_Device->getAllocator(), block.buffer, block.memory);
+    block = {};
+}
+
+} // namespace core::vk
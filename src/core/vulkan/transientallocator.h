@@ -0,0 +1,106 @@
+#pragma once
+
+#include "core/vulkan/device.h"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace core::vk
+{
+
+// Sub-range of a transient buffer of the current frame, valid until the
+// frame is reset
+struct TransientAllocation
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    void* data = nullptr;
+
+    explicit operator bool() const { return data != nullptr; }
+};
+
+// Linear allocator over one persistently mapped buffer per frame in flight.
+// Per frame data (uniforms, UI geometry, ...) is written straight into the
+// mapped memory and bound with an offset, all of it is released at once
+// when the frame comes around again.
+//
+// Allocations from the frame's buffer are a lock free bump of an atomic
+// offset, each one padded by alignment - 1 bytes so the bump doesn't have
+// to know where it lands. A frame that runs out of space continues in
+// overflow blocks, those are handed out under a mutex. On its next
+// reset the frame's buffer is replaced by one at least twice as large as
+// needed, and every frame grows to that high-water mark. Buffers never
+// shrink.
+class TransientAllocator final
+{
+public:
+    TransientAllocator(
+            Device* device, uint32_t frameCount, VkDeviceSize capacity);
+    ~TransientAllocator();
+
+    TransientAllocator(const TransientAllocator&) = delete;
+    TransientAllocator(TransientAllocator&&) = delete;
+    TransientAllocator& operator=(const TransientAllocator&) = delete;
+    TransientAllocator& operator=(TransientAllocator&&) = delete;
+
+    // Buffers of the frame must no longer be read by the GPU, they are
+    // released or replaced here. Must not run concurrently with allocate().
+    void reset(uint32_t frameIndex);
+
+    // Thread safe, alignment doesn't have to be a power of two. The first
+    // allocations of a frame come from getBuffer(frameIndex), later ones
+    // may come from an overflow block.
+    [[nodiscard]] TransientAllocation allocate(
+            VkDeviceSize size, VkDeviceSize alignment);
+
+    [[nodiscard]] VkBuffer getBuffer(uint32_t frameIndex) const
+    {
+        return m_Frames[frameIndex].buffer.buffer;
+    }
+    // Changes when the buffer of the frame is replaced, descriptors that
+    // point at it have to be written again
+    [[nodiscard]] uint64_t getGeneration(uint32_t frameIndex) const
+    {
+        return m_Frames[frameIndex].generation;
+    }
+    [[nodiscard]] VkDeviceSize getCapacity() const { return m_Capacity; }
+
+private:
+    struct Block
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VmaAllocation memory = VK_NULL_HANDLE;
+        std::byte* data = nullptr;
+        VkDeviceSize capacity = 0;
+        VkDeviceSize offset = 0;
+    };
+
+    struct Frame
+    {
+        // buffer.offset is unused, the bump goes through offset. It passes
+        // the capacity once the buffer is full.
+        Block buffer;
+        std::atomic<VkDeviceSize> offset = 0;
+        std::vector<Block> overflow;
+        uint64_t generation = 0;
+    };
+
+    [[nodiscard]] Block createBlock(VkDeviceSize capacity);
+    void destroyBlock(Block& block);
+    [[nodiscard]] TransientAllocation allocateOverflow(
+            Frame& frame, VkDeviceSize size, VkDeviceSize alignment);
+
+    Device* m_Device;
+    // High-water mark of all frames
+    VkDeviceSize m_Capacity;
+    std::vector<Frame> m_Frames;
+    uint32_t m_FrameIndex = 0;
+    // Guards the overflow blocks and m_Capacity
+    std::mutex m_Mutex;
+};
+
+} // namespace core::vk
@@ -3,21 +3,47 @@
 #include "application.h"
 #include "config/config.h"
 
+#include <charconv>
 #include <string_view>
 
+// Usage: mysummerjob [config.ini] [--headless] [--frames N]
 int main(int argc, const char** argv)
 {
     logs::Log::init();
     LGINFO("MySummerJob Game ({}.{}.{})", 0, 0, 1);
 
     std::string_view optionalConfigPath;
-    if(argc > 1)
+    bool headless = false;
+    int benchmarkFrames = 0;
+    for(int i = 1; i < argc; ++i)
     {
-        optionalConfigPath = argv[1];
+        const std::string_view arg = argv[i];
+        if(arg == "--headless")
+        {
+            headless = true;
+        }
+        else if(arg == "--frames" && i + 1 < argc)
+        {
+            const std::string_view value = argv[++i];
+            std::from_chars(
+                    value.data(), value.data() + value.size(), benchmarkFrames);
+        }
+        else
+        {
+            optionalConfigPath = arg;
+        }
     }
 
     config::Config::init(optionalConfigPath);
 
+    auto baseConfig = config::Config::getBaseConfig();
+    baseConfig.headless = baseConfig.headless != 0 || headless;
+    if(benchmarkFrames > 0)
+    {
+        baseConfig.benchmarkFrames = benchmarkFrames;
+    }
+    config::Config::setBaseConfig(baseConfig);
+
     auto app = std::make_shared<app::Application>();
     app->run();
 }
@@ -0,0 +1,222 @@
+#include "timer/profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace profiler
+{
+
+namespace
+{
+struct Zone
+{
+    std::atomic<const char*> name = nullptr;
+    std::atomic<int64_t> begin = 0;
+    std::atomic<int64_t> end = 0;
+};
+
+// Ring buffer with the owning thread as the only writer
+struct ThreadBuffer
+{
+    uint32_t id = 0;
+    // Guarded by the registry mutex
+    std::string name;
+    // Zones ever recorded, the next one goes to head % ZONES_PER_THREAD
+    std::atomic<uint64_t> head = 0;
+    std::array<Zone, ZONES_PER_THREAD> zones;
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    // Kept after their threads exit so the zones can still be exported
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& getRegistry()
+{
+    // Never destroyed, workers may still record during static destruction
+    static auto* registry = new Registry;
+    return *registry;
+}
+
+thread_local ThreadBuffer* t_Buffer = nullptr;
+
+ThreadBuffer& getThreadBuffer()
+{
+    if(t_Buffer == nullptr)
+    {
+        auto& registry = getRegistry();
+        std::lock_guard lock{registry.mutex};
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->id = static_cast<uint32_t>(registry.buffers.size());
+        buffer->name = "Thread " + std::to_string(buffer->id);
+        t_Buffer = buffer.get();
+        registry.buffers.push_back(std::move(buffer));
+    }
+    return *t_Buffer;
+}
+
+void writeString(std::ostream& out, std::string_view string)
+{
+    out << '"';
+    for(const char c : string)
+    {
+        if(c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if(static_cast<unsigned char>(c) >= 0x20)
+        {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Microseconds with nanosecond precision, the unit of the trace format
+void writeMicroseconds(std::ostream& out, int64_t nanoseconds)
+{
+    out << nanoseconds / 1000 << '.' << std::setw(3) << std::setfill('0')
+        << nanoseconds % 1000;
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+//
+//
+
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+// ----------------------------------------------------------------------------
+// The release fence orders the previous head store before the writes to the
+// slot, an export that reads any of them also sees the slot as overwritten
+//
+
+void record(const char* name, int64_t beginNs, int64_t endNs)
+{
+    auto& buffer = getThreadBuffer();
+    const uint64_t index = buffer.head.load(std::memory_order_relaxed);
+    auto& zone = buffer.zones[index % ZONES_PER_THREAD];
+
+    std::atomic_thread_fence(std::memory_order_release);
+    zone.name.store(name, std::memory_order_relaxed);
+    zone.begin.store(beginNs, std::memory_order_relaxed);
+    zone.end.store(endNs, std::memory_order_relaxed);
+    buffer.head.store(index + 1, std::memory_order_release);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void setThreadName(const char* name)
+{
+    auto& buffer = getThreadBuffer();
+    std::lock_guard lock{getRegistry().mutex};
+    buffer.name = name;
+}
+
+// ----------------------------------------------------------------------------
+// Zones are copied out first and the head read again, slots the writer may
+// have reached in the meantime are dropped. The slot at the second head can
+// be mid-write, so at most ZONES_PER_THREAD - 1 zones of a thread are written.
+//
+
+bool writeChromeTrace(const std::string& path)
+{
+    struct Copy
+    {
+        const char* name = nullptr;
+        int64_t begin = 0;
+        int64_t end = 0;
+    };
+
+    std::ofstream file(path);
+    file << "{\"traceEvents\":[";
+
+    auto& registry = getRegistry();
+    std::lock_guard lock{registry.mutex};
+
+    bool first = true;
+    std::vector<Copy> copies;
+    copies.reserve(ZONES_PER_THREAD);
+    for(const auto& buffer : registry.buffers)
+    {
+        file << (first ? "\n" : ",\n");
+        first = false;
+        file << R"({"name":"thread_name","ph":"M","pid":1,"tid":)"
+             << buffer->id << R"(,"args":{"name":)";
+        writeString(file, buffer->name);
+        file << "}}";
+
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        const uint64_t begin =
+                head > ZONES_PER_THREAD ? head - ZONES_PER_THREAD : 0;
+        copies.clear();
+        for(uint64_t i = begin; i < head; ++i)
+        {
+            const auto& zone = buffer->zones[i % ZONES_PER_THREAD];
+            copies.push_back(
+                    {zone.name.load(std::memory_order_relaxed),
+                     zone.begin.load(std::memory_order_relaxed),
+                     zone.end.load(std::memory_order_relaxed)});
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t current = buffer->head.load(std::memory_order_relaxed);
+        const uint64_t valid = current + 1 > ZONES_PER_THREAD
+                                       ? current + 1 - ZONES_PER_THREAD
+                                       : 0;
+
+        for(uint64_t i = std::max(begin, valid); i < head; ++i)
+        {
+            const auto& copy = copies[i - begin];
+            const int64_t duration =
+                    std::max(copy.end - copy.begin, int64_t{0});
+            file << ",\n{\"name\":";
+            writeString(file, copy.name);
+            file << R"(,"ph":"X","pid":1,"tid":)" << buffer->id
+                 << R"(,"ts":)";
+            writeMicroseconds(file, copy.begin);
+            file << R"(,"dur":)";
+            writeMicroseconds(file, duration);
+            file << '}';
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return static_cast<bool>(file);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+uint64_t getRecordedCount()
+{
+    auto& registry = getRegistry();
+    std::lock_guard lock{registry.mutex};
+
+    uint64_t count = 0;
+    for(const auto& buffer : registry.buffers)
+    {
+        count += buffer->head.load(std::memory_order_acquire);
+    }
+    return count;
+}
+
+} // namespace profiler
@@ -0,0 +1,207 @@
+#include "utils/framestats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+namespace utils
+{
+
+// ----------------------------------------------------------------------------
+//
+//
+
+const char* getPhaseName(FramePhase phase)
+{
+    switch(phase)
+    {
+    case FramePhase::Events:
+        return "Events";
+    case FramePhase::UiBuild:
+        return "UI build";
+    case FramePhase::SceneUpdate:
+        return "Scene update";
+    case FramePhase::Record:
+        return "Record";
+    case FramePhase::Submit:
+        return "Submit";
+    case FramePhase::PresentWait:
+        return "Present wait";
+    default:
+        return "Unknown";
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+FrameStats::FrameStats(size_t capacity, float hitchFactor) :
+    m_Capacity(capacity), m_HitchFactor(hitchFactor)
+{
+    assert(m_Capacity > 0);
+    m_Scratch.reserve(m_Capacity);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void FrameStats::addPhase(FramePhase phase, float milliseconds)
+{
+    assert(phase != FramePhase::Count);
+    m_Current.phaseMs[static_cast<size_t>(phase)] += milliseconds;
+}
+
+// ----------------------------------------------------------------------------
+// Compared against the window before the frame, so a run of hitches doesn't
+// raise its own threshold right away
+//
+
+void FrameStats::endFrame(uint64_t frame, float totalMs)
+{
+    m_Current.frame = frame;
+    m_Current.totalMs = totalMs;
+
+    if(m_Frames.size() >= MIN_HITCH_FRAMES)
+    {
+        const float medianMs = median(FramePhase::Count);
+        if(totalMs > medianMs * m_HitchFactor)
+        {
+            Hitch hitch;
+            hitch.frame = frame;
+            hitch.totalMs = totalMs;
+            hitch.medianMs = medianMs;
+            std::array<float, FRAME_PHASE_COUNT> excess = {};
+            for(size_t i = 0; i < FRAME_PHASE_COUNT; ++i)
+            {
+                excess[i] = m_Current.phaseMs[i]
+                            - median(static_cast<FramePhase>(i));
+            }
+            const auto top = std::max_element(excess.begin(), excess.end());
+            hitch.phase = static_cast<FramePhase>(top - excess.begin());
+            hitch.phaseExcessMs = *top;
+
+            m_Hitches.push_front(hitch);
+            if(m_Hitches.size() > MAX_HITCHES)
+            {
+                m_Hitches.pop_back();
+            }
+        }
+    }
+
+    m_Frames.push_back(m_Current);
+    if(m_Frames.size() > m_Capacity)
+    {
+        m_Frames.pop_front();
+    }
+    m_Current = {};
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+Summary FrameStats::summarizeTotal() const
+{
+    gather(FramePhase::Count);
+    return summarize(m_Scratch);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+Summary FrameStats::summarizePhase(FramePhase phase) const
+{
+    assert(phase != FramePhase::Count);
+    gather(phase);
+    return summarize(m_Scratch);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+std::vector<uint32_t> FrameStats::getHistogram(
+        size_t binCount, float binMs) const
+{
+    assert(binCount > 0 && binMs > 0.0f);
+    std::vector<uint32_t> bins(binCount, 0);
+    for(const auto& frame : m_Frames)
+    {
+        const float ms = std::max(frame.totalMs, 0.0f);
+        const auto bin = static_cast<size_t>(ms / binMs);
+        bins[std::min(bin, binCount - 1)] += 1;
+    }
+    return bins;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+bool FrameStats::writeCsv(const std::string& path) const
+{
+    static_assert(FRAME_PHASE_COUNT == 6, "Update the CSV header");
+
+    std::ofstream file(path);
+    file << "frame,total_ms,events_ms,ui_build_ms,scene_update_ms,record_ms,"
+            "submit_ms,present_wait_ms,hitch\n";
+
+    // Hitches are newest first, the frames oldest first
+    auto hitch = m_Hitches.rbegin();
+    for(const auto& frame : m_Frames)
+    {
+        while(hitch != m_Hitches.rend() && hitch->frame < frame.frame)
+        {
+            ++hitch;
+        }
+
+        file << frame.frame << ',' << frame.totalMs;
+        for(const float ms : frame.phaseMs)
+        {
+            file << ',' << ms;
+        }
+        const bool isHitch =
+                hitch != m_Hitches.rend() && hitch->frame == frame.frame;
+        file << ',' << (isHitch ? 1 : 0) << '\n';
+    }
+
+    return static_cast<bool>(file);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void FrameStats::gather(FramePhase phase) const
+{
+    m_Scratch.clear();
+    for(const auto& frame : m_Frames)
+    {
+        m_Scratch.push_back(
+                phase == FramePhase::Count
+                        ? frame.totalMs
+                        : frame.phaseMs[static_cast<size_t>(phase)]);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Upper median, enough for a threshold
+//
+
+float FrameStats::median(FramePhase phase) const
+{
+    gather(phase);
+    if(m_Scratch.empty())
+    {
+        return 0.0f;
+    }
+
+    const auto middle = m_Scratch.begin() + m_Scratch.size() / 2;
+    std::nth_element(m_Scratch.begin(), middle, m_Scratch.end());
+    return *middle;
+}
+
+} // namespace utils
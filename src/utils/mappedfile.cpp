@@ -0,0 +1,95 @@
+#include "utils/mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <utility>
+
+namespace utils
+{
+
+// ----------------------------------------------------------------------------
+// The descriptor isn't needed once the file is mapped
+//
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        throw std::runtime_error("Unable to open " + path);
+    }
+
+    struct stat info = {};
+    if(::fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Unable to stat " + path);
+    }
+
+    m_Size = static_cast<size_t>(info.st_size);
+    if(m_Size > 0)
+    {
+        void* data = ::mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("Unable to map " + path);
+        }
+        m_Data = data;
+    }
+    ::close(fd);
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    m_Data(std::exchange(other.m_Data, nullptr)),
+    m_Size(std::exchange(other.m_Size, 0))
+{
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if(this != &other)
+    {
+        unmap();
+        m_Data = std::exchange(other.m_Data, nullptr);
+        m_Size = std::exchange(other.m_Size, 0);
+    }
+    return *this;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+void MappedFile::unmap()
+{
+    if(m_Data)
+    {
+        ::munmap(m_Data, m_Size);
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+}
+
+} // namespace utils
@@ -0,0 +1,56 @@
+#include "utils/statistics.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+namespace utils
+{
+
+// ----------------------------------------------------------------------------
+//
+//
+
+float percentile(std::span<const float> sorted, float p)
+{
+    assert(std::is_sorted(sorted.begin(), sorted.end()));
+    if(sorted.empty())
+    {
+        return 0.0f;
+    }
+
+    const float rank = std::clamp(p, 0.0f, 100.0f) / 100.0f
+                       * static_cast<float>(sorted.size() - 1);
+    const auto lower = static_cast<size_t>(std::floor(rank));
+    const size_t upper = std::min(lower + 1, sorted.size() - 1);
+    const float t = rank - static_cast<float>(lower);
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * t;
+}
+
+// ----------------------------------------------------------------------------
+//
+//
+
+Summary summarize(std::vector<float> samples)
+{
+    Summary summary;
+    if(samples.empty())
+    {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    summary.count = samples.size();
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0f)
+                   / static_cast<float>(samples.size());
+    summary.min = samples.front();
+    summary.p50 = percentile(samples, 50.0f);
+    summary.p90 = percentile(samples, 90.0f);
+    summary.p95 = percentile(samples, 95.0f);
+    summary.p99 = percentile(samples, 99.0f);
+    summary.max = samples.back();
+    return summary;
+}
+
+} // namespace utils
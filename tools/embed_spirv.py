@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Write a C++ source embedding SPIR-V binaries for getEmbeddedShaders().
+
+usage: embed_spirv.py OUTPUT [SPV ...]
+
+Every shader is keyed by its file name, e.g. obj.frag.spv.
+"""
+
+import os
+import re
+import struct
+import sys
+
+SPIRV_MAGIC = 0x07230203
+WORDS_PER_LINE = 6
+
+
+def identifier(name):
+    return 'spv_' + re.sub(r'[^0-9A-Za-z_]', '_', name)
+
+
+def read_words(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) % 4 != 0:
+        sys.exit('{}: size is not a multiple of 4'.format(path))
+    words = struct.unpack('<{}I'.format(len(data) // 4), data)
+    if not words or words[0] != SPIRV_MAGIC:
+        sys.exit('{}: not a SPIR-V binary'.format(path))
+    return words
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    output = sys.argv[1]
+    inputs = sorted(sys.argv[2:], key=os.path.basename)
+
+    lines = [
+        '// Generated by tools/embed_spirv.py, do not edit',
+        '',
+        '#include "core/vulkan/embeddedshaders.h"',
+        '',
+        'namespace core::vk',
+        '{',
+        '',
+        'namespace',
+        '{',
+        '',
+    ]
+
+    entries = []
+    for path in inputs:
+        name = os.path.basename(path)
+        words = read_words(path)
+        array = identifier(name)
+        lines.append('alignas(4) constexpr uint32_t {}[] = {{'.format(array))
+        for i in range(0, len(words), WORDS_PER_LINE):
+            chunk = words[i:i + WORDS_PER_LINE]
+            lines.append('    ' + ', '.join('0x{:08x}'.format(w) for w in chunk) + ',')
+        lines.append('};')
+        lines.append('')
+        entries.append((name, array))
+
+    if entries:
+        lines.append('constexpr EmbeddedShader SHADERS[] = {')
+        for name, array in entries:
+            lines.append('    {{"{}", {}}},'.format(name, array))
+        lines.append('};')
+        lines.append('')
+
+    lines += [
+        '} // namespace',
+        '',
+        'std::span<const EmbeddedShader> getEmbeddedShaders()',
+        '{',
+        '    return {};'.format('SHADERS' if entries else '{}'),
+        '}',
+        '',
+        '} // namespace core::vk',
+    ]
+
+    with open(output, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,260 @@
+#include "catch2/catch.hpp"
+#include "core/scene/components.h"
+#include "core/scene/culling.h"
+
+#include "entt/entity/registry.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+// Axis aligned box from -extent to extent
+core::scene::Frustum makeBox(float extent)
+{
+    core::scene::Frustum frustum;
+    frustum.planes[core::scene::Frustum::Left] = {1.0f, 0.0f, 0.0f, extent};
+    frustum.planes[core::scene::Frustum::Right] = {-1.0f, 0.0f, 0.0f, extent};
+    frustum.planes[core::scene::Frustum::Bottom] = {0.0f, 1.0f, 0.0f, extent};
+    frustum.planes[core::scene::Frustum::Top] = {0.0f, -1.0f, 0.0f, extent};
+    frustum.planes[core::scene::Frustum::Near] = {0.0f, 0.0f, 1.0f, extent};
+    frustum.planes[core::scene::Frustum::Far] = {0.0f, 0.0f, -1.0f, extent};
+    return frustum;
+}
+
+core::scene::SphereSoA makeRandomSpheres(size_t count, float range)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-range, range);
+    std::uniform_real_distribution<float> radius(0.0f, 2.0f);
+
+    core::scene::SphereSoA spheres;
+    spheres.resize(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        spheres.set(
+                i,
+                glm::vec3(position(rng), position(rng), position(rng)),
+                radius(rng));
+    }
+    return spheres;
+}
+
+void createEntities(entt::registry& registry, size_t count, float range)
+{
+    std::mt19937 rng(4321);
+    std::uniform_real_distribution<float> position(-range, range);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        auto entity = registry.create();
+        registry.emplace<core::scene::component::Position>(
+                entity,
+                glm::vec4(position(rng), position(rng), position(rng), 1.0f));
+        registry.emplace<core::scene::component::Transform>(
+                entity, glm::mat4(1.0f));
+        registry.emplace<core::scene::component::Bounds>(
+                entity, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+}
+
+} // namespace
+
+TEST_CASE("Culling[frustum]")
+{
+    // Identity clip space, x and y from -1 to 1 and z from 0 to 1
+    auto frustum = core::scene::Frustum::fromMatrix(glm::mat4(1.0f));
+
+    REQUIRE(frustum.intersectsSphere(glm::vec3(0.0f, 0.0f, 0.5f), 0.1f));
+    REQUIRE(frustum.intersectsSphere(glm::vec3(1.5f, 0.0f, 0.5f), 0.6f));
+    REQUIRE_FALSE(frustum.intersectsSphere(glm::vec3(1.5f, 0.0f, 0.5f), 0.4f));
+    REQUIRE_FALSE(frustum.intersectsSphere(glm::vec3(0.0f, 0.0f, -1.0f), 0.5f));
+    REQUIRE_FALSE(frustum.intersectsSphere(glm::vec3(0.0f, 3.0f, 0.5f), 1.0f));
+}
+
+TEST_CASE("Culling[spheres]")
+{
+    auto frustum = makeBox(10.0f);
+
+    core::scene::SphereSoA spheres;
+    spheres.resize(11);
+    spheres.set(0, glm::vec3(0.0f), 1.0f);
+    spheres.set(1, glm::vec3(20.0f, 0.0f, 0.0f), 1.0f);
+    spheres.set(2, glm::vec3(11.0f, 0.0f, 0.0f), 2.0f);
+    spheres.set(3, glm::vec3(0.0f, -11.0f, 0.0f), 0.5f);
+    spheres.set(4, glm::vec3(0.0f, 0.0f, 10.0f), 0.0f);
+    spheres.set(5, glm::vec3(9.0f, 9.0f, 9.0f), 1.0f);
+    spheres.set(6, glm::vec3(0.0f, 0.0f, -30.0f), 5.0f);
+    spheres.set(7, glm::vec3(-10.5f, 0.0f, 0.0f), 1.0f);
+    spheres.set(8, glm::vec3(0.0f, 100.0f, 0.0f), 200.0f);
+    spheres.set(9, glm::vec3(0.0f, 0.0f, 10.5f), 0.25f);
+    // Tail that doesn't fill a SIMD batch
+    spheres.set(10, glm::vec3(-5.0f, 5.0f, -5.0f), 1.0f);
+
+    const std::vector<uint32_t> expected = {0, 2, 4, 5, 7, 8, 10};
+
+    std::vector<uint32_t> visible(spheres.size());
+    const size_t count = core::scene::cullSpheres(
+            spheres, frustum, 0, spheres.size(), visible.data());
+    visible.resize(count);
+    REQUIRE(expected == visible);
+
+    std::vector<uint32_t> scalar(spheres.size());
+    const size_t scalarCount = core::scene::cullSpheresScalar(
+            spheres, frustum, 0, spheres.size(), scalar.data());
+    scalar.resize(scalarCount);
+    REQUIRE(expected == scalar);
+
+    // Indices are absolute when starting in the middle
+    std::vector<uint32_t> range(spheres.size());
+    const size_t rangeCount = core::scene::cullSpheres(
+            spheres, frustum, 3, 9, range.data());
+    range.resize(rangeCount);
+    REQUIRE(std::vector<uint32_t>{4, 5, 7, 8} == range);
+}
+
+TEST_CASE("Culling[simd matches scalar]")
+{
+    auto frustum = makeBox(10.0f);
+    auto spheres = makeRandomSpheres(10007, 20.0f);
+
+    std::vector<uint32_t> simd(spheres.size());
+    std::vector<uint32_t> scalar(spheres.size());
+
+    for(size_t begin : {size_t(0), size_t(1), size_t(5), size_t(13)})
+    {
+        const size_t simdCount = core::scene::cullSpheres(
+                spheres, frustum, begin, spheres.size(), simd.data());
+        const size_t scalarCount = core::scene::cullSpheresScalar(
+                spheres, frustum, begin, spheres.size(), scalar.data());
+
+        REQUIRE(scalarCount == simdCount);
+        REQUIRE(std::equal(
+                simd.begin(),
+                simd.begin() + simdCount,
+                scalar.begin()));
+    }
+}
+
+TEST_CASE("Culling[system]")
+{
+    entt::registry registry;
+
+    // Enough entities to be split across the work queue
+    createEntities(registry, 40000, 20.0f);
+
+    auto inside = registry.create();
+    registry.emplace<core::scene::component::Position>(
+            inside, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    registry.emplace<core::scene::component::Transform>(
+            inside, glm::mat4(1.0f));
+    registry.emplace<core::scene::component::Bounds>(
+            inside, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    // Mesh space center is moved by the transform, the radius is scaled
+    auto scaled = registry.create();
+    glm::mat4 transform(4.0f);
+    transform[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    registry.emplace<core::scene::component::Position>(
+            scaled, glm::vec4(14.0f, 0.0f, 0.0f, 1.0f));
+    registry.emplace<core::scene::component::Transform>(scaled, transform);
+    registry.emplace<core::scene::component::Bounds>(
+            scaled, glm::vec4(-0.5f, 0.0f, 0.0f, 1.0f));
+
+    auto outside = registry.create();
+    registry.emplace<core::scene::component::Position>(
+            outside, glm::vec4(100.0f, 0.0f, 0.0f, 1.0f));
+    registry.emplace<core::scene::component::Transform>(
+            outside, glm::mat4(1.0f));
+    registry.emplace<core::scene::component::Bounds>(
+            outside, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    // Without bounds it can't be culled
+    auto unbounded = registry.create();
+    registry.emplace<core::scene::component::Position>(
+            unbounded, glm::vec4(100.0f, 0.0f, 0.0f, 1.0f));
+    registry.emplace<core::scene::component::Transform>(
+            unbounded, glm::mat4(1.0f));
+    registry.emplace<core::scene::component::Bounds>(unbounded);
+
+    core::scene::CullingSystem culling;
+    culling.update(registry);
+    culling.cull(makeBox(10.0f));
+
+    REQUIRE(40004 == culling.getTestedCount());
+
+    const auto& visible = culling.getVisible();
+    auto isVisible = [&visible](entt::entity entity) {
+        return std::find(visible.begin(), visible.end(), entity)
+               != visible.end();
+    };
+
+    REQUIRE(isVisible(inside));
+    REQUIRE(isVisible(scaled));
+    REQUIRE_FALSE(isVisible(outside));
+    REQUIRE(isVisible(unbounded));
+
+    // Same answer as testing every entity on its own
+    auto frustum = makeBox(10.0f);
+    size_t expected = 0;
+    auto view = registry.view<
+            core::scene::component::Position,
+            core::scene::component::Bounds>();
+    for(auto entity : view)
+    {
+        const auto& bounds = view.get<core::scene::component::Bounds>(entity);
+        const auto& position =
+                view.get<core::scene::component::Position>(entity);
+        if(bounds.sphere.w < 0.0f
+           || frustum.intersectsSphere(
+                   glm::vec3(position.pos) + glm::vec3(bounds.sphere),
+                   bounds.sphere.w))
+        {
+            expected += 1;
+        }
+    }
+    // The scaled entity is only visible thanks to its transform
+    REQUIRE(expected + 1 == visible.size());
+}
+
+TEST_CASE("Culling[benchmark]", "[.benchmark]")
+{
+    auto frustum = makeBox(10.0f);
+
+    for(size_t count : {size_t(10000), size_t(100000), size_t(1000000)})
+    {
+        auto spheres = makeRandomSpheres(count, 20.0f);
+        std::vector<uint32_t> visible(count);
+
+        BENCHMARK("scalar " + std::to_string(count))
+        {
+            return core::scene::cullSpheresScalar(
+                    spheres, frustum, 0, count, visible.data());
+        };
+
+        BENCHMARK("simd " + std::to_string(count))
+        {
+            return core::scene::cullSpheres(
+                    spheres, frustum, 0, count, visible.data());
+        };
+
+        entt::registry registry;
+        createEntities(registry, count, 20.0f);
+
+        core::scene::CullingSystem culling;
+        culling.update(registry);
+
+        BENCHMARK("system update " + std::to_string(count))
+        {
+            culling.update(registry);
+        };
+
+        BENCHMARK("system cull " + std::to_string(count))
+        {
+            culling.cull(frustum);
+            return culling.getVisible().size();
+        };
+    }
+}
@@ -0,0 +1,137 @@
+#include "catch2/catch.hpp"
+#include "core/scene/drawsort.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::vector<core::scene::DrawPacket> makeRandomPackets(
+        size_t count, uint64_t keyMask)
+{
+    std::mt19937_64 rng(1234);
+
+    std::vector<core::scene::DrawPacket> packets(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        packets[i].key = rng() & keyMask;
+        packets[i].index = static_cast<uint32_t>(i);
+    }
+    return packets;
+}
+
+void requireSortedLikeStableSort(std::vector<core::scene::DrawPacket> packets)
+{
+    auto expected = packets;
+    std::stable_sort(
+            expected.begin(),
+            expected.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.key < rhs.key; });
+
+    std::vector<core::scene::DrawPacket> scratch;
+    core::scene::radixSort(packets, scratch);
+
+    REQUIRE(expected.size() == packets.size());
+    for(size_t i = 0; i < packets.size(); ++i)
+    {
+        REQUIRE(expected[i].key == packets[i].key);
+        REQUIRE(expected[i].index == packets[i].index);
+    }
+}
+
+} // namespace
+
+TEST_CASE("DrawSort[radix sort]")
+{
+    SECTION("empty and single")
+    {
+        requireSortedLikeStableSort({});
+        requireSortedLikeStableSort({{42, 0}});
+    }
+
+    SECTION("small")
+    {
+        requireSortedLikeStableSort(makeRandomPackets(1000, ~uint64_t{0}));
+    }
+
+    SECTION("parallel")
+    {
+        // Several chunks on the work queue
+        requireSortedLikeStableSort(makeRandomPackets(100003, ~uint64_t{0}));
+    }
+
+    SECTION("duplicate keys stay stable")
+    {
+        // Few distinct keys and most digits constant
+        requireSortedLikeStableSort(makeRandomPackets(70000, 0x0f000000000000f0));
+    }
+}
+
+TEST_CASE("DrawSort[keys]")
+{
+    using namespace core::scene::sortkey;
+
+    // State wins over depth
+    REQUIRE(make(Pass::Opaque, 0, 0, 1, 1000.0f)
+            < make(Pass::Opaque, 0, 1, 0, 0.0f));
+    REQUIRE(make(Pass::Opaque, 0, 5, 0, 0.0f)
+            < make(Pass::Opaque, 1, 0, 0, 0.0f));
+    REQUIRE(make(Pass::Opaque, 3, 5, 7, 1e30f)
+            < make(Pass::Transparent, 0, 0, 0, 0.0f));
+
+    // Opaque front to back, transparent back to front
+    REQUIRE(make(Pass::Opaque, 0, 0, 0, 1.0f)
+            < make(Pass::Opaque, 0, 0, 0, 2.0f));
+    REQUIRE(make(Pass::Opaque, 0, 0, 0, 0.0f)
+            < make(Pass::Opaque, 0, 0, 0, 0.5f));
+    REQUIRE(make(Pass::Transparent, 0, 0, 0, 2.0f)
+            < make(Pass::Transparent, 0, 0, 0, 1.0f));
+
+    // Depth doesn't split a batch
+    REQUIRE(stateBits(make(Pass::Opaque, 1, 2, 3, 1.0f))
+            == stateBits(make(Pass::Opaque, 1, 2, 3, 100.0f)));
+    REQUIRE(stateBits(make(Pass::Opaque, 1, 2, 3, 1.0f))
+            != stateBits(make(Pass::Opaque, 1, 2, 4, 1.0f)));
+
+    REQUIRE(0 == quantizeDepth(-1.0f));
+    REQUIRE(quantizeDepth(1.0f) < quantizeDepth(1.5f));
+    REQUIRE(quantizeDepth(1e38f) < (1u << DEPTH_BITS));
+}
+
+TEST_CASE("DrawSort[benchmark]", "[.benchmark]")
+{
+    for(size_t count : {size_t(10000), size_t(100000), size_t(1000000)})
+    {
+        const auto packets = makeRandomPackets(count, ~uint64_t{0});
+        std::vector<core::scene::DrawPacket> scratch;
+
+        // Every run sorts its own unsorted copy
+        BENCHMARK_ADVANCED("std::sort " + std::to_string(count))
+        (Catch::Benchmark::Chronometer meter)
+        {
+            std::vector<std::vector<core::scene::DrawPacket>> runs(
+                    meter.runs(), packets);
+            meter.measure([&runs](int run) {
+                std::sort(
+                        runs[run].begin(),
+                        runs[run].end(),
+                        [](const auto& lhs, const auto& rhs) {
+                            return lhs.key < rhs.key;
+                        });
+            });
+        };
+
+        BENCHMARK_ADVANCED("radix " + std::to_string(count))
+        (Catch::Benchmark::Chronometer meter)
+        {
+            std::vector<std::vector<core::scene::DrawPacket>> runs(
+                    meter.runs(), packets);
+            meter.measure([&runs, &scratch](int run) {
+                core::scene::radixSort(runs[run], scratch);
+            });
+        };
+    }
+}
@@ -0,0 +1,89 @@
+#include "catch2/catch.hpp"
+#include "utils/framestats.h"
+
+#include <fstream>
+#include <string>
+
+TEST_CASE("FrameStats[hitches]")
+{
+    using namespace utils;
+
+    FrameStats stats(100);
+    for(uint64_t frame = 0; frame < FrameStats::MIN_HITCH_FRAMES; ++frame)
+    {
+        stats.addPhase(FramePhase::Record, 4.0f);
+        stats.addPhase(FramePhase::PresentWait, 10.0f);
+        stats.endFrame(frame, 16.0f);
+    }
+    REQUIRE(stats.getHitches().empty());
+
+    SECTION("top phase is the one furthest over its median")
+    {
+        // Present wait is the longest phase, record grew the most
+        stats.addPhase(FramePhase::Record, 20.0f);
+        stats.addPhase(FramePhase::PresentWait, 12.0f);
+        stats.endFrame(1000, 40.0f);
+
+        REQUIRE(stats.getHitches().size() == 1);
+        const auto& hitch = stats.getHitches().front();
+        REQUIRE(hitch.frame == 1000);
+        REQUIRE(hitch.medianMs == Approx(16.0f));
+        REQUIRE(hitch.phase == FramePhase::Record);
+        REQUIRE(hitch.phaseExcessMs == Approx(16.0f));
+    }
+
+    SECTION("slower frames under the threshold are no hitches")
+    {
+        stats.endFrame(1000, 30.0f);
+        REQUIRE(stats.getHitches().empty());
+    }
+
+    SECTION("phases accumulate until the frame ends")
+    {
+        stats.addPhase(FramePhase::Events, 1.0f);
+        stats.addPhase(FramePhase::Events, 2.0f);
+        stats.endFrame(1000, 16.0f);
+        REQUIRE(stats.getFrames().back().phaseMs[0] == Approx(3.0f));
+        REQUIRE(stats.summarizePhase(FramePhase::Events).max == Approx(3.0f));
+    }
+
+    SECTION("window keeps the newest frames")
+    {
+        for(uint64_t frame = 0; frame < 100; ++frame)
+        {
+            stats.endFrame(1000 + frame, 8.0f);
+        }
+        REQUIRE(stats.getFrames().size() == 100);
+        REQUIRE(stats.getFrames().front().frame == 1000);
+        REQUIRE(stats.summarizeTotal().p99 == Approx(8.0f));
+    }
+
+    SECTION("histogram clamps the long frames into the last bin")
+    {
+        stats.endFrame(1000, 2.0f);
+        stats.endFrame(1001, 500.0f);
+        const auto bins = stats.getHistogram(10, 5.0f);
+        REQUIRE(bins[0] == 1);
+        REQUIRE(bins[3] == FrameStats::MIN_HITCH_FRAMES);
+        REQUIRE(bins[9] == 1);
+    }
+
+    SECTION("csv marks the hitches")
+    {
+        stats.endFrame(1000, 100.0f);
+        REQUIRE(stats.writeCsv("framestats_test.csv"));
+
+        std::ifstream file("framestats_test.csv");
+        std::string line;
+        std::string last;
+        size_t lines = 0;
+        while(std::getline(file, line))
+        {
+            last = line;
+            ++lines;
+        }
+        REQUIRE(lines == FrameStats::MIN_HITCH_FRAMES + 2);
+        REQUIRE(last.starts_with("1000,100,"));
+        REQUIRE(last.ends_with(",1"));
+    }
+}
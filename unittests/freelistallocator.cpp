@@ -0,0 +1,96 @@
+#include "catch2/catch.hpp"
+#include "utils/freelistallocator.h"
+
+#include <vector>
+
+TEST_CASE("FreeListAllocator[allocate]")
+{
+    utils::FreeListAllocator allocator(1024);
+
+    auto a = allocator.allocate(100);
+    auto b = allocator.allocate(200);
+    REQUIRE(a.has_value());
+    REQUIRE(b.has_value());
+    REQUIRE(0 == *a);
+    REQUIRE(100 == *b);
+    REQUIRE(300 == allocator.getUsed());
+
+    REQUIRE_FALSE(allocator.allocate(0).has_value());
+    REQUIRE_FALSE(allocator.allocate(1000).has_value());
+
+    auto c = allocator.allocate(724);
+    REQUIRE(c.has_value());
+    REQUIRE(300 == *c);
+    REQUIRE(1024 == allocator.getUsed());
+    REQUIRE(0 == allocator.getFreeRangeCount());
+    REQUIRE_FALSE(allocator.allocate(1).has_value());
+}
+
+TEST_CASE("FreeListAllocator[alignment]")
+{
+    utils::FreeListAllocator allocator(1024);
+
+    auto a = allocator.allocate(3);
+    auto b = allocator.allocate(16, 16);
+    REQUIRE(a.has_value());
+    REQUIRE(b.has_value());
+    REQUIRE(0 == *b % 16);
+    REQUIRE(16 == *b);
+
+    // Padding in front of the aligned range stays usable
+    auto c = allocator.allocate(13);
+    REQUIRE(c.has_value());
+    REQUIRE(3 == *c);
+}
+
+TEST_CASE("FreeListAllocator[coalesce]")
+{
+    utils::FreeListAllocator allocator(300);
+
+    auto a = allocator.allocate(100);
+    auto b = allocator.allocate(100);
+    auto c = allocator.allocate(100);
+    REQUIRE(a.has_value());
+    REQUIRE(b.has_value());
+    REQUIRE(c.has_value());
+
+    allocator.free(*a, 100);
+    allocator.free(*c, 100);
+    REQUIRE(2 == allocator.getFreeRangeCount());
+    REQUIRE(100 == allocator.getLargestFreeRange());
+    REQUIRE_FALSE(allocator.allocate(150).has_value());
+
+    // Releasing the middle range merges all three back together
+    allocator.free(*b, 100);
+    REQUIRE(1 == allocator.getFreeRangeCount());
+    REQUIRE(300 == allocator.getLargestFreeRange());
+    REQUIRE(0 == allocator.getUsed());
+
+    auto d = allocator.allocate(300);
+    REQUIRE(d.has_value());
+    REQUIRE(0 == *d);
+}
+
+TEST_CASE("FreeListAllocator[bestfit]")
+{
+    utils::FreeListAllocator allocator(1000);
+
+    std::vector<uint64_t> offsets;
+    for(int i = 0; i < 10; ++i)
+    {
+        offsets.push_back(*allocator.allocate(100));
+    }
+
+    // Leave holes of 100 and 200 units
+    allocator.free(offsets[1], 100);
+    allocator.free(offsets[5], 100);
+    allocator.free(offsets[6], 100);
+
+    auto small = allocator.allocate(80);
+    REQUIRE(small.has_value());
+    REQUIRE(offsets[1] == *small);
+
+    auto large = allocator.allocate(200);
+    REQUIRE(large.has_value());
+    REQUIRE(offsets[5] == *large);
+}
@@ -0,0 +1,250 @@
+#include "catch2/catch.hpp"
+#include "core/scene/components.h"
+#include "core/scene/instancing.h"
+
+#include "entt/entity/registry.hpp"
+
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// Stand-in for the material buffer of a model, only compared by the batcher
+VkBuffer makeMaterials(uintptr_t id)
+{
+    return reinterpret_cast<VkBuffer>(id);
+}
+
+entt::entity makeRenderable(
+        entt::registry& registry,
+        uint32_t firstIndex,
+        VkBuffer materials,
+        float distance)
+{
+    using namespace core::scene::component;
+
+    auto entity = registry.create();
+    registry.emplace<VertexInfo>(entity, 36u, firstIndex, 0);
+    auto& renderInfo = registry.emplace<RenderInfo>(entity);
+    renderInfo.buffeInfo.buffer = materials;
+    registry.emplace<Position>(entity, glm::vec4(distance, 0.0f, 0.0f, 1.0f));
+    registry.emplace<Transform>(entity, glm::mat4(1.0f));
+    return entity;
+}
+
+// Mesh and material buffer the instance is drawn with
+std::pair<uint32_t, VkBuffer> getState(
+        const entt::registry& registry,
+        const core::scene::InstanceData& instance)
+{
+    using namespace core::scene::component;
+
+    const auto entity = entt::entity{instance.entityId};
+    return {registry.get<VertexInfo>(entity).firstIndex,
+            registry.get<RenderInfo>(entity).buffeInfo.buffer};
+}
+
+struct Written
+{
+    std::vector<core::scene::InstanceData> instances;
+    std::vector<VkDrawIndexedIndirectCommand> commands;
+};
+
+Written write(
+        const core::scene::InstanceBatcher& batcher,
+        const entt::registry& registry,
+        size_t instanceSlots,
+        size_t commandSlots)
+{
+    Written written;
+    written.instances.resize(instanceSlots);
+    written.commands.resize(commandSlots);
+    batcher.write(
+            registry, written.instances.data(), written.commands.data());
+    return written;
+}
+
+} // namespace
+
+TEST_CASE("InstanceBatcher")
+{
+    using namespace core::scene;
+
+    entt::registry registry;
+    const auto materialsA = makeMaterials(1);
+    const auto materialsB = makeMaterials(2);
+
+    // Two instances of mesh 0 with materials A, one with materials B and
+    // two of mesh 100 with materials A
+    const auto far = makeRenderable(registry, 0, materialsA, 20.0f);
+    const auto near = makeRenderable(registry, 0, materialsA, 10.0f);
+    const auto other = makeRenderable(registry, 0, materialsB, 5.0f);
+    makeRenderable(registry, 100, materialsA, 1.0f);
+    makeRenderable(registry, 100, materialsA, 2.0f);
+
+    InstanceBatcher batcher;
+
+    SECTION("instances are grouped by mesh and material")
+    {
+        batcher.build(registry, glm::vec3(0.0f));
+
+        const auto& batches = batcher.getBatches();
+        REQUIRE(batches.size() == 3);
+        REQUIRE(batcher.getInstanceCount() == 5);
+
+        uint32_t instances = 0;
+        for(const auto& batch : batches)
+        {
+            REQUIRE(batch.indexCount == 36);
+            REQUIRE(batch.firstInstance == instances);
+            instances += batch.instanceCount;
+        }
+        REQUIRE(instances == 5);
+
+        // Every instance of a batch has the batch's mesh and materials, no
+        // two batches share both
+        const auto written = write(batcher, registry, 5, 3);
+        std::set<std::pair<uint32_t, VkBuffer>> states;
+        for(size_t i = 0; i < batches.size(); ++i)
+        {
+            const auto& batch = batches[i];
+            const auto state = getState(
+                    registry, written.instances[batch.firstInstance]);
+            REQUIRE(state.first == batch.firstIndex);
+            REQUIRE(states.insert(state).second);
+
+            for(uint32_t j = 0; j < batch.instanceCount; ++j)
+            {
+                const auto& instance =
+                        written.instances[batch.firstInstance + j];
+                REQUIRE(instance.batchIndex == i);
+                REQUIRE(getState(registry, instance) == state);
+            }
+        }
+    }
+
+    SECTION("instances of a batch are front to back")
+    {
+        batcher.build(registry, glm::vec3(0.0f));
+        const auto written = write(batcher, registry, 5, 3);
+
+        for(const auto& batch : batcher.getBatches())
+        {
+            float previous = -1.0f;
+            for(uint32_t j = 0; j < batch.instanceCount; ++j)
+            {
+                const auto& instance =
+                        written.instances[batch.firstInstance + j];
+                const float distance = instance.transform[3].x;
+                REQUIRE(distance > previous);
+                previous = distance;
+            }
+        }
+
+        // The two instances of mesh 0 with materials A, nearest first
+        size_t nearSlot = 0;
+        size_t farSlot = 0;
+        for(size_t i = 0; i < written.instances.size(); ++i)
+        {
+            const auto entity = written.instances[i].entityId;
+            nearSlot = entity == entt::to_integral(near) ? i : nearSlot;
+            farSlot = entity == entt::to_integral(far) ? i : farSlot;
+        }
+        REQUIRE(farSlot == nearSlot + 1);
+        REQUIRE(written.instances[nearSlot].batchIndex
+                == written.instances[farSlot].batchIndex);
+    }
+
+    SECTION("one indirect command per batch")
+    {
+        batcher.build(registry, glm::vec3(0.0f));
+        const auto written = write(batcher, registry, 5, 3);
+
+        const auto& batches = batcher.getBatches();
+        for(size_t i = 0; i < batches.size(); ++i)
+        {
+            const auto& command = written.commands[i];
+            REQUIRE(command.indexCount == batches[i].indexCount);
+            REQUIRE(command.instanceCount == batches[i].instanceCount);
+            REQUIRE(command.firstIndex == batches[i].firstIndex);
+            REQUIRE(command.vertexOffset == batches[i].vertexOffset);
+            REQUIRE(command.firstInstance == batches[i].firstInstance);
+        }
+    }
+
+    SECTION("base offsets shift instances and commands")
+    {
+        batcher.setBase(10, 4);
+        batcher.build(registry, glm::vec3(0.0f));
+        REQUIRE(batcher.getFirstCommand() == 4);
+
+        const auto written = write(batcher, registry, 15, 7);
+
+        const auto& batches = batcher.getBatches();
+        REQUIRE(batches.front().firstInstance == 10);
+        for(size_t i = 0; i < batches.size(); ++i)
+        {
+            const auto& command = written.commands[4 + i];
+            REQUIRE(command.firstInstance == batches[i].firstInstance);
+            REQUIRE(command.instanceCount == batches[i].instanceCount);
+
+            for(uint32_t j = 0; j < batches[i].instanceCount; ++j)
+            {
+                REQUIRE(written.instances[batches[i].firstInstance + j]
+                                .batchIndex
+                        == 4 + i);
+            }
+        }
+
+        std::set<uint32_t> entities;
+        for(size_t i = 10; i < 15; ++i)
+        {
+            entities.insert(written.instances[i].entityId);
+        }
+        REQUIRE(entities.size() == 5);
+    }
+
+    SECTION("only the given entities")
+    {
+        batcher.build(registry, {near, other}, glm::vec3(0.0f));
+
+        REQUIRE(batcher.getInstanceCount() == 2);
+        REQUIRE(batcher.getBatches().size() == 2);
+    }
+
+    SECTION("a batch per instance without instancing")
+    {
+        batcher.setInstancing(false);
+        batcher.build(registry, glm::vec3(0.0f));
+
+        const auto& batches = batcher.getBatches();
+        REQUIRE(batches.size() == 5);
+        for(uint32_t i = 0; i < batches.size(); ++i)
+        {
+            REQUIRE(batches[i].firstInstance == i);
+            REQUIRE(batches[i].instanceCount == 1);
+        }
+    }
+
+    SECTION("forgotten ids make room for new resources")
+    {
+        // More meshes and materials over time than the sort key holds at
+        // once, as when models are loaded and unloaded repeatedly
+        for(uintptr_t round = 0; round < 2; ++round)
+        {
+            registry.clear();
+            for(uint32_t i = 0; i < sortkey::MAX_MATERIALS; ++i)
+            {
+                const uintptr_t id = round * sortkey::MAX_MATERIALS + i + 1;
+                makeRenderable(registry, 36 * i, makeMaterials(id), 1.0f);
+            }
+
+            batcher.build(registry, glm::vec3(0.0f));
+            REQUIRE(batcher.getBatches().size() == sortkey::MAX_MATERIALS);
+            batcher.forgetIds();
+        }
+    }
+}
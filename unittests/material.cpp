@@ -0,0 +1,50 @@
+#include "catch2/catch.hpp"
+#include "core/model/material.h"
+
+#include <vector>
+
+TEST_CASE("Material[shader features]")
+{
+    using namespace core::model;
+
+    MaterialUbo plain;
+    REQUIRE(shaderfeature::SPECIALIZED == getShaderFeatures(plain));
+
+    MaterialUbo textured;
+    textured.diffuseTextureID = 0;
+    textured.normalTextureID = 1;
+    REQUIRE((shaderfeature::SPECIALIZED | shaderfeature::TEXTURED
+             | shaderfeature::NORMAL_MAPPED)
+            == getShaderFeatures(textured));
+
+    MaterialUbo cutout;
+    cutout.flags = shaderfeature::ALPHA_TESTED | shaderfeature::UNLIT;
+    REQUIRE((shaderfeature::SPECIALIZED | shaderfeature::ALPHA_TESTED
+             | shaderfeature::UNLIT)
+            == getShaderFeatures(cutout));
+
+    // What tinyobj reports for an MTL without illum or map_d
+    MaterialUbo translucent;
+    translucent.dissolve = 0.5f;
+    translucent.illum = 0;
+    REQUIRE(shaderfeature::SPECIALIZED == getShaderFeatures(translucent));
+
+    SECTION("shared features are kept")
+    {
+        MaterialUbo other = textured;
+        other.diffuse = glm::vec3(1.0f);
+        other.diffuseTextureID = 3;
+        const std::vector<MaterialUbo> materials = {textured, other};
+        REQUIRE(getShaderFeatures(textured) == getShaderFeatures(materials));
+    }
+
+    SECTION("any difference falls back to the generic variant")
+    {
+        const std::vector<MaterialUbo> materials = {textured, plain};
+        REQUIRE(shaderfeature::GENERIC == getShaderFeatures(materials));
+        REQUIRE(shaderfeature::GENERIC
+                == getShaderFeatures(std::vector<MaterialUbo>{}));
+    }
+
+    REQUIRE(getShaderFeatures(textured) < shaderfeature::VARIANT_COUNT);
+}
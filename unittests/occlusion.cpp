@@ -0,0 +1,148 @@
+#include "catch2/catch.hpp"
+#include "core/scene/components.h"
+#include "core/scene/occlusion.h"
+
+#include "entt/entity/registry.hpp"
+
+#include <memory>
+#include <random>
+
+namespace
+{
+
+// Square from -extent to extent in x and y at the given clip space depth
+core::scene::component::OccluderMesh makeQuad(float extent, float depth)
+{
+    core::scene::component::OccluderMesh mesh;
+    mesh.positions = {
+            glm::vec3(-extent, -extent, depth),
+            glm::vec3(extent, -extent, depth),
+            glm::vec3(extent, extent, depth),
+            glm::vec3(-extent, extent, depth)};
+    mesh.indices = {0, 1, 2, 0, 2, 3};
+    return mesh;
+}
+
+} // namespace
+
+TEST_CASE("Occlusion[rasterize]")
+{
+    // Identity view projection, clip space is world space
+    const glm::mat4 viewProj(1.0f);
+
+    core::scene::OcclusionCuller culler;
+    culler.clear();
+    culler.rasterize(viewProj, makeQuad(0.5f, 0.5f));
+    culler.finalize();
+
+    const uint32_t centerX = core::scene::OcclusionCuller::WIDTH / 2;
+    const uint32_t centerY = core::scene::OcclusionCuller::HEIGHT / 2;
+    REQUIRE(0.5f == Approx(culler.getDepth(centerX, centerY)));
+    REQUIRE(1.0f == culler.getDepth(0, 0));
+    REQUIRE(1.0f
+            == culler.getDepth(
+                    core::scene::OcclusionCuller::WIDTH - 1,
+                    core::scene::OcclusionCuller::HEIGHT - 1));
+
+    // Behind the quad
+    REQUIRE_FALSE(culler.isVisible(
+            viewProj, glm::vec3(-0.2f, -0.2f, 0.7f), glm::vec3(0.2f, 0.2f, 0.8f)));
+    // In front of it
+    REQUIRE(culler.isVisible(
+            viewProj, glm::vec3(-0.2f, -0.2f, 0.2f), glm::vec3(0.2f, 0.2f, 0.3f)));
+    // Partially behind
+    REQUIRE(culler.isVisible(
+            viewProj, glm::vec3(-0.2f, -0.2f, 0.4f), glm::vec3(0.2f, 0.2f, 0.8f)));
+    // Sticking out from the side
+    REQUIRE(culler.isVisible(
+            viewProj, glm::vec3(-0.2f, -0.2f, 0.7f), glm::vec3(0.8f, 0.2f, 0.8f)));
+    // Crossing the near plane
+    REQUIRE(culler.isVisible(
+            viewProj,
+            glm::vec3(-0.2f, -0.2f, -0.1f),
+            glm::vec3(0.2f, 0.2f, 0.8f)));
+
+    // Closer occluders win
+    culler.rasterize(viewProj, makeQuad(0.25f, 0.25f));
+    culler.finalize();
+    REQUIRE(0.25f == Approx(culler.getDepth(centerX, centerY)));
+    REQUIRE(culler.isVisible(
+            viewProj, glm::vec3(-0.2f, -0.2f, 0.2f), glm::vec3(0.2f, 0.2f, 0.3f)));
+    REQUIRE_FALSE(culler.isVisible(
+            viewProj, glm::vec3(-0.1f, -0.1f, 0.3f), glm::vec3(0.1f, 0.1f, 0.4f)));
+}
+
+TEST_CASE("Occlusion[simd matches scalar]")
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-1.5f, 1.5f);
+    std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+
+    core::scene::component::OccluderMesh mesh;
+    for(uint32_t i = 0; i < 300; ++i)
+    {
+        mesh.positions.emplace_back(position(rng), position(rng), depth(rng));
+        mesh.indices.push_back(i);
+    }
+
+    core::scene::OcclusionCuller simd;
+    core::scene::OcclusionCuller scalar;
+    scalar.setUseSimd(false);
+
+    simd.clear();
+    scalar.clear();
+    simd.rasterize(glm::mat4(1.0f), mesh);
+    scalar.rasterize(glm::mat4(1.0f), mesh);
+
+    size_t written = 0;
+    for(uint32_t y = 0; y < core::scene::OcclusionCuller::HEIGHT; ++y)
+    {
+        for(uint32_t x = 0; x < core::scene::OcclusionCuller::WIDTH; ++x)
+        {
+            REQUIRE(scalar.getDepth(x, y) == simd.getDepth(x, y));
+            written += scalar.getDepth(x, y) < 1.0f ? 1 : 0;
+        }
+    }
+    REQUIRE(written > 0);
+}
+
+TEST_CASE("Occlusion[update]")
+{
+    entt::registry registry;
+    const glm::mat4 viewProj(1.0f);
+
+    auto create = [&registry](const glm::vec3& position, float radius) {
+        auto entity = registry.create();
+        registry.emplace<core::scene::component::Position>(
+                entity, glm::vec4(position, 1.0f));
+        registry.emplace<core::scene::component::Transform>(
+                entity, glm::mat4(1.0f));
+        registry.emplace<core::scene::component::Bounds>(
+                entity, glm::vec4(0.0f, 0.0f, 0.0f, radius));
+        return entity;
+    };
+
+    auto wall = create(glm::vec3(0.0f, 0.0f, 0.25f), 0.1f);
+    registry.emplace<core::scene::component::Occluder>(
+            wall,
+            std::make_shared<core::scene::component::OccluderMesh>(
+                    makeQuad(0.5f, 0.0f)));
+
+    auto hidden = create(glm::vec3(0.0f, 0.0f, 0.75f), 0.1f);
+    auto beside = create(glm::vec3(0.8f, 0.0f, 0.75f), 0.1f);
+    auto front = create(glm::vec3(0.0f, 0.0f, 0.1f), 0.05f);
+
+    core::scene::OcclusionCuller culler;
+    culler.update(registry, viewProj, {wall, hidden, beside, front});
+
+    REQUIRE(1 == culler.getOccluderCount());
+    REQUIRE(1 == culler.getCulledCount());
+    REQUIRE(std::vector<entt::entity>{wall, beside, front}
+            == culler.getVisible());
+
+    // Nothing in the candidate list occludes, so nothing is culled
+    culler.update(registry, viewProj, {hidden, beside, front});
+    REQUIRE(0 == culler.getOccluderCount());
+    REQUIRE(0 == culler.getCulledCount());
+    REQUIRE(3 == culler.getVisible().size());
+}
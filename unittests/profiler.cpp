@@ -0,0 +1,69 @@
+#include "catch2/catch.hpp"
+#include "timer/profiler.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace
+{
+std::string readTrace(const std::string& path)
+{
+    REQUIRE(profiler::writeChromeTrace(path));
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+size_t countOf(const std::string& text, const std::string& pattern)
+{
+    size_t count = 0;
+    for(auto i = text.find(pattern); i != std::string::npos;
+        i = text.find(pattern, i + pattern.size()))
+    {
+        ++count;
+    }
+    return count;
+}
+} // namespace
+
+TEST_CASE("Profiler[trace]")
+{
+    // Every thread gets a buffer of its own, fresh threads keep the sections
+    // independent of the zones recorded elsewhere
+    SECTION("zones of a named thread")
+    {
+        std::thread([]() {
+            profiler::setThreadName("Profiler test");
+            profiler::record("test zone", 1'000'000, 1'002'500);
+            profiler::ScopedZone zone("scoped zone");
+        }).join();
+
+        const auto trace = readTrace("profiler_trace.json");
+        REQUIRE(trace.starts_with("{\"traceEvents\":["));
+        REQUIRE(countOf(trace, R"("args":{"name":"Profiler test"})") == 1);
+        REQUIRE(countOf(trace, R"("ts":1000.000,"dur":2.500)") == 1);
+        REQUIRE(countOf(trace, R"("name":"scoped zone")") == 1);
+    }
+
+    SECTION("ring overwrites the oldest zones")
+    {
+        const auto before = profiler::getRecordedCount();
+        std::thread([]() {
+            profiler::record("first zone", 0, 1);
+            for(size_t i = 0; i < profiler::ZONES_PER_THREAD; ++i)
+            {
+                profiler::record("wrapped zone", 0, 1);
+            }
+        }).join();
+        REQUIRE(profiler::getRecordedCount() - before
+                == profiler::ZONES_PER_THREAD + 1);
+
+        const auto trace = readTrace("profiler_trace.json");
+        REQUIRE(countOf(trace, R"("name":"first zone")") == 0);
+        REQUIRE(countOf(trace, R"("name":"wrapped zone")")
+                == profiler::ZONES_PER_THREAD - 1);
+    }
+}
@@ -0,0 +1,247 @@
+#include "catch2/catch.hpp"
+#include "core/vulkan/rendergraph.h"
+
+#include <vector>
+
+using namespace core::vk;
+
+namespace
+{
+const RenderGraph::Record NO_COMMANDS = [](VkCommandBuffer) {};
+} // namespace
+
+TEST_CASE("RenderGraph[culling]")
+{
+    RenderGraph graph;
+    const auto unused = graph.createBuffer("Unused", {256});
+    const auto draws = graph.importBuffer("Draws", std::nullopt);
+
+    const auto debug =
+            graph.addPass("Debug", PassQueue::Graphics, NO_COMMANDS);
+    graph.use(debug, unused, Access::ComputeShaderWrite);
+    const auto cull = graph.addPass("Cull", PassQueue::Graphics, NO_COMMANDS);
+    graph.use(cull, draws, Access::ComputeShaderWrite);
+    const auto scene =
+            graph.addPass("Scene", PassQueue::Graphics, NO_COMMANDS);
+    graph.use(scene, draws, Access::IndirectRead);
+    graph.keep(scene);
+
+    const auto compiled = graph.compile();
+    REQUIRE(compiled.passes.size() == 2);
+    REQUIRE(compiled.passes[0].pass == cull);
+    REQUIRE(compiled.passes[1].pass == scene);
+    REQUIRE(compiled.transients.empty());
+}
+
+TEST_CASE("RenderGraph[barriers]")
+{
+    RenderGraph graph;
+    const auto draws = graph.importBuffer("Draws", std::nullopt);
+
+    const auto cull = graph.addPass("Cull", PassQueue::Graphics, NO_COMMANDS);
+    graph.use(cull, draws, Access::ComputeShaderWrite);
+
+    SECTION("read after write waits once per stage")
+    {
+        const auto first =
+                graph.addPass("First", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(first, draws, Access::IndirectRead);
+        graph.keep(first);
+        const auto second =
+                graph.addPass("Second", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(second, draws, Access::IndirectRead);
+        graph.keep(second);
+
+        const auto compiled = graph.compile();
+        REQUIRE(compiled.passes.size() == 3);
+        REQUIRE(compiled.passes[0].barrier.isEmpty());
+
+        const auto& barrier = compiled.passes[1].barrier;
+        REQUIRE(barrier.srcStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        REQUIRE(barrier.dstStages == VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+        REQUIRE(barrier.srcAccess == VK_ACCESS_SHADER_WRITE_BIT);
+        REQUIRE(barrier.dstAccess == VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        REQUIRE(barrier.images.empty());
+
+        REQUIRE(compiled.passes[2].barrier.isEmpty());
+    }
+
+    SECTION("write after read only waits for execution")
+    {
+        const auto read =
+                graph.addPass("Read", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(read, draws, Access::IndirectRead);
+        graph.keep(read);
+        const auto write =
+                graph.addPass("Write", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(write, draws, Access::TransferWrite);
+        graph.keep(write);
+
+        const auto compiled = graph.compile();
+        const auto& barrier = compiled.passes[2].barrier;
+        REQUIRE(barrier.srcStages == VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+        REQUIRE(barrier.dstStages == VK_PIPELINE_STAGE_TRANSFER_BIT);
+        REQUIRE(barrier.srcAccess == 0);
+        REQUIRE(barrier.dstAccess == 0);
+    }
+}
+
+TEST_CASE("RenderGraph[layouts]")
+{
+    RenderGraph graph;
+    auto* handle = reinterpret_cast<VkImage>(uintptr_t{0x1000});
+    const auto color = graph.importImage(
+            "Color", handle, VK_IMAGE_ASPECT_COLOR_BIT, std::nullopt);
+    graph.setFinalAccess(color, Access::Present);
+
+    const auto draw = graph.addPass("Draw", PassQueue::Graphics, NO_COMMANDS);
+    graph.use(draw, color, Access::ColorAttachment);
+    const auto post = graph.addPass("Post", PassQueue::Graphics, NO_COMMANDS);
+    graph.use(post, color, Access::ComputeShaderWrite);
+
+    const auto compiled = graph.compile();
+    REQUIRE(compiled.passes.size() == 2);
+
+    const auto& first = compiled.passes[0].barrier;
+    REQUIRE(first.srcStages == VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    REQUIRE(first.images.size() == 1);
+    REQUIRE(first.images[0].oldLayout == VK_IMAGE_LAYOUT_UNDEFINED);
+    REQUIRE(first.images[0].newLayout
+            == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+    const auto& second = compiled.passes[1].barrier;
+    REQUIRE(second.srcStages == VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    REQUIRE(second.dstStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    REQUIRE(second.images.size() == 1);
+    REQUIRE(second.images[0].newLayout == VK_IMAGE_LAYOUT_GENERAL);
+    REQUIRE(second.images[0].srcAccess
+            == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+    // Layout transitions are made visible on their own
+    REQUIRE(second.srcAccess == 0);
+
+    const auto& final = compiled.finalBarrier;
+    REQUIRE(final.images.size() == 1);
+    REQUIRE(final.images[0].oldLayout == VK_IMAGE_LAYOUT_GENERAL);
+    REQUIRE(final.images[0].newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    REQUIRE(final.images[0].srcAccess == VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+TEST_CASE("RenderGraph[async compute]")
+{
+    RenderGraph graph;
+    const auto draws = graph.importBuffer("Draws", std::nullopt);
+    const auto cull =
+            graph.addPass("Cull", PassQueue::AsyncCompute, NO_COMMANDS);
+    graph.use(cull, draws, Access::ComputeShaderWrite);
+    const auto scene =
+            graph.addPass("Scene", PassQueue::Graphics, NO_COMMANDS);
+    graph.use(scene, draws, Access::IndirectRead);
+    graph.keep(scene);
+
+    SECTION("graphics waits on the semaphore instead of a barrier")
+    {
+        const auto compiled = graph.compile();
+        REQUIRE(compiled.passes[0].queue == PassQueue::AsyncCompute);
+        REQUIRE(compiled.passes[1].queue == PassQueue::Graphics);
+        REQUIRE(compiled.passes[1].barrier.isEmpty());
+        REQUIRE(compiled.computeWaitStages
+                == VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+    }
+
+    SECTION("compute after graphics moves to the graphics queue")
+    {
+        const auto reuse =
+                graph.addPass("Reuse", PassQueue::AsyncCompute, NO_COMMANDS);
+        graph.use(reuse, draws, Access::ComputeShaderWrite);
+        graph.keep(reuse);
+
+        const auto compiled = graph.compile();
+        REQUIRE(compiled.passes.size() == 3);
+        REQUIRE(compiled.passes[2].queue == PassQueue::Graphics);
+        const auto& barrier = compiled.passes[2].barrier;
+        REQUIRE(barrier.srcStages == VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+        REQUIRE(barrier.dstStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+}
+
+TEST_CASE("RenderGraph[aliasing]")
+{
+    SECTION("ranges alive at different times share memory")
+    {
+        std::vector<TransientRange> ranges(3);
+        ranges[0] = {0, 1, 1000, 256, 0x3, true};
+        ranges[1] = {2, 3, 1000, 256, 0x3, true};
+        ranges[2] = {1, 2, 500, 256, 0x3, true};
+
+        const auto plan = planAliasing(ranges);
+        REQUIRE(plan.blocks.size() == 1);
+        REQUIRE(plan.placements[0].offset == 0);
+        REQUIRE(plan.placements[1].offset == 0);
+        REQUIRE(plan.placements[2].offset == 1024);
+        REQUIRE(plan.blocks[0].size == 1524);
+        REQUIRE(plan.blocks[0].alignment == 256);
+    }
+
+    SECTION("incompatible ranges get blocks of their own")
+    {
+        std::vector<TransientRange> ranges(4);
+        ranges[0] = {0, 0, 100, 16, 0x3, true};
+        ranges[1] = {1, 1, 100, 16, 0x3, false};
+        ranges[2] = {2, 2, 100, 16, 0x1, true};
+        ranges[3] = {3, 3, 100, 16, 0x3, true, true};
+
+        const auto plan = planAliasing(ranges);
+        REQUIRE(plan.blocks.size() == 4);
+    }
+
+    SECTION("first use waits for the previous user of the memory")
+    {
+        RenderGraph graph;
+        const auto first = graph.createImage(
+                "First", {VK_FORMAT_R8G8B8A8_UNORM, {64, 64}});
+        const auto second = graph.createImage(
+                "Second", {VK_FORMAT_R8G8B8A8_UNORM, {64, 64}});
+        const auto output = graph.importBuffer("Output", std::nullopt);
+        graph.setFinalAccess(output, Access::IndirectRead);
+
+        const auto draw =
+                graph.addPass("Draw", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(draw, first, Access::ColorAttachment);
+        const auto shade =
+                graph.addPass("Shade", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(shade, first, Access::GraphicsShaderRead);
+        graph.use(shade, output, Access::ComputeShaderWrite);
+        const auto fill =
+                graph.addPass("Fill", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(fill, second, Access::TransferWrite);
+        const auto resolve =
+                graph.addPass("Resolve", PassQueue::Graphics, NO_COMMANDS);
+        graph.use(resolve, second, Access::ComputeShaderRead);
+        graph.use(resolve, output, Access::ComputeShaderWrite);
+
+        auto compiled = graph.compile();
+        REQUIRE(compiled.passes.size() == 4);
+        REQUIRE(compiled.transients.size() == 2);
+        REQUIRE(compiled.transients[0].first == 0);
+        REQUIRE(compiled.transients[0].last == 1);
+        REQUIRE(compiled.transients[1].first == 2);
+        REQUIRE(compiled.transients[1].last == 3);
+        REQUIRE(compiled.passes[2].barrier.srcStages
+                == VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+        std::vector<TransientRange> ranges(2);
+        ranges[0] = {0, 1, 16384, 256, 0x1, true};
+        ranges[1] = {2, 3, 16384, 256, 0x1, true};
+        const auto plan = planAliasing(ranges);
+        REQUIRE(plan.placements[1].offset == 0);
+
+        RenderGraph::addAliasBarriers(compiled, ranges, plan);
+        const auto& barrier = compiled.passes[2].barrier;
+        REQUIRE(barrier.srcStages
+                == (VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
+                    | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                    | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT));
+        REQUIRE(barrier.dstStages == VK_PIPELINE_STAGE_TRANSFER_BIT);
+        REQUIRE(barrier.dstAccess == VK_ACCESS_TRANSFER_WRITE_BIT);
+    }
+}
@@ -0,0 +1,100 @@
+#include "catch2/catch.hpp"
+#include "core/scene/components.h"
+#include "core/scene/staticdraws.h"
+
+#include "entt/entity/registry.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+entt::entity makeRenderable(entt::registry& registry)
+{
+    using namespace core::scene::component;
+
+    auto entity = registry.create();
+    registry.emplace<VertexInfo>(entity);
+    registry.emplace<RenderInfo>(entity);
+    registry.emplace<Position>(entity, glm::vec4(0.0f));
+    registry.emplace<Transform>(entity, glm::mat4(1.0f));
+    return entity;
+}
+
+bool isStatic(
+        const core::scene::StaticDrawTracker& tracker, entt::entity entity)
+{
+    const auto& statics = tracker.getStatic();
+    return std::find(statics.begin(), statics.end(), entity) != statics.end();
+}
+
+void settle(core::scene::StaticDrawTracker& tracker)
+{
+    for(uint32_t i = 0; i < core::scene::StaticDrawTracker::SETTLE_FRAMES;
+        ++i)
+    {
+        tracker.update();
+    }
+}
+
+} // namespace
+
+TEST_CASE("StaticDraws")
+{
+    using namespace core::scene;
+
+    entt::registry registry;
+    const auto existing = makeRenderable(registry);
+
+    StaticDrawTracker tracker(registry);
+
+    SECTION("renderables from before are static")
+    {
+        REQUIRE(tracker.update());
+        REQUIRE(isStatic(tracker, existing));
+        REQUIRE_FALSE(tracker.update());
+    }
+
+    SECTION("new renderables settle into the static set")
+    {
+        tracker.update();
+        const auto version = tracker.getVersion();
+
+        const auto entity = makeRenderable(registry);
+        tracker.update();
+        REQUIRE(registry.all_of<component::DynamicDraw>(entity));
+        REQUIRE_FALSE(isStatic(tracker, entity));
+
+        settle(tracker);
+        REQUIRE_FALSE(registry.all_of<component::DynamicDraw>(entity));
+        REQUIRE(isStatic(tracker, entity));
+        REQUIRE(tracker.getVersion() > version);
+    }
+
+    SECTION("patched entities leave the static set")
+    {
+        tracker.update();
+
+        registry.patch<component::Position>(
+                existing, [](auto& position) { position.pos.x = 1.0f; });
+        REQUIRE(tracker.update());
+        REQUIRE_FALSE(isStatic(tracker, existing));
+
+        // Changing every frame keeps it dynamic without touching the
+        // static set
+        for(uint32_t i = 0; i < 2 * StaticDrawTracker::SETTLE_FRAMES; ++i)
+        {
+            registry.replace<component::VertexInfo>(existing);
+            REQUIRE_FALSE(tracker.update());
+        }
+        REQUIRE_FALSE(isStatic(tracker, existing));
+    }
+
+    SECTION("destroyed static entities invalidate")
+    {
+        tracker.update();
+        registry.destroy(existing);
+        REQUIRE(tracker.update());
+        REQUIRE(tracker.getStatic().empty());
+    }
+}
@@ -0,0 +1,39 @@
+#include "catch2/catch.hpp"
+#include "utils/statistics.h"
+
+#include <vector>
+
+TEST_CASE("Statistics[percentiles]")
+{
+    using namespace utils;
+
+    const std::vector<float> sorted = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+    REQUIRE(percentile(sorted, 0.0f) == Approx(1.0f));
+    REQUIRE(percentile(sorted, 50.0f) == Approx(3.0f));
+    REQUIRE(percentile(sorted, 100.0f) == Approx(5.0f));
+    // Between the ranks 3 and 4
+    REQUIRE(percentile(sorted, 90.0f) == Approx(4.6f));
+
+    SECTION("single sample")
+    {
+        const std::vector<float> one = {7.0f};
+        REQUIRE(percentile(one, 99.0f) == Approx(7.0f));
+    }
+
+    SECTION("summary sorts the samples")
+    {
+        const auto summary = summarize({5.0f, 1.0f, 4.0f, 2.0f, 3.0f});
+        REQUIRE(summary.count == 5);
+        REQUIRE(summary.mean == Approx(3.0f));
+        REQUIRE(summary.min == Approx(1.0f));
+        REQUIRE(summary.p50 == Approx(3.0f));
+        REQUIRE(summary.max == Approx(5.0f));
+    }
+
+    SECTION("no samples")
+    {
+        const auto summary = summarize({});
+        REQUIRE(summary.count == 0);
+        REQUIRE(summary.p99 == 0.0f);
+    }
+}
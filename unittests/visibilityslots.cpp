@@ -0,0 +1,86 @@
+#include "catch2/catch.hpp"
+#include "core/scene/components.h"
+#include "core/scene/visibilityslots.h"
+
+#include "entt/entity/registry.hpp"
+
+namespace
+{
+
+entt::entity makeRenderable(entt::registry& registry)
+{
+    auto entity = registry.create();
+    registry.emplace<core::scene::component::VertexInfo>(entity);
+    return entity;
+}
+
+uint32_t getSlot(const entt::registry& registry, entt::entity entity)
+{
+    return registry.get<core::scene::component::VisibilitySlot>(entity).index;
+}
+
+} // namespace
+
+TEST_CASE("VisibilitySlots")
+{
+    using namespace core::scene;
+
+    entt::registry registry;
+    const auto existing = makeRenderable(registry);
+
+    VisibilitySlots slots(registry, 4);
+
+    SECTION("renderables from before get a slot")
+    {
+        REQUIRE(getSlot(registry, existing) == 0);
+        REQUIRE(slots.takeAllocated() == std::vector<uint32_t>{0});
+        REQUIRE(slots.takeAllocated().empty());
+    }
+
+    SECTION("new renderables get the next free slot")
+    {
+        const auto entity = makeRenderable(registry);
+        REQUIRE(getSlot(registry, entity) == 1);
+        REQUIRE(slots.getUsed() == 2);
+        REQUIRE(slots.takeAllocated() == std::vector<uint32_t>{0, 1});
+    }
+
+    SECTION("entities without a mesh get no slot")
+    {
+        const auto entity = registry.create();
+        REQUIRE_FALSE(registry.all_of<component::VisibilitySlot>(entity));
+    }
+
+    SECTION("slots of destroyed renderables are reused and cleared again")
+    {
+        const auto first = makeRenderable(registry);
+        makeRenderable(registry);
+        (void)slots.takeAllocated();
+
+        const uint32_t released = getSlot(registry, first);
+        registry.destroy(first);
+        REQUIRE(slots.getUsed() == 2);
+
+        // The registry recycles the entity index, the slot is unrelated
+        const auto recycled = makeRenderable(registry);
+        REQUIRE(entt::to_entity(recycled) == entt::to_entity(first));
+        REQUIRE(getSlot(registry, recycled) == released);
+        REQUIRE(slots.takeAllocated() == std::vector<uint32_t>{released});
+    }
+
+    SECTION("a slot reused before it was taken is cleared once")
+    {
+        const auto first = makeRenderable(registry);
+        registry.destroy(first);
+        makeRenderable(registry);
+        REQUIRE(slots.takeAllocated() == std::vector<uint32_t>{0, 1});
+    }
+
+    SECTION("removing the mesh keeps the slot until the entity is gone")
+    {
+        registry.remove<component::VertexInfo>(existing);
+        REQUIRE(getSlot(registry, existing) == 0);
+        registry.destroy(existing);
+        REQUIRE(slots.getUsed() == 0);
+    }
+}